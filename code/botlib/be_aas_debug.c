@@ -542,32 +542,39 @@ void AAS_DrawCross(vec3_t origin, float size, int color)
 // Returns:					-
 // Changes Globals:		-
 //===========================================================================
-void AAS_PrintTravelType(int traveltype)
+char *AAS_TravelTypeName(int traveltype)
 {
-#ifdef DEBUG
-	char *str;
-	//
 	switch(traveltype & TRAVELTYPE_MASK)
 	{
-		case TRAVEL_INVALID: str = "TRAVEL_INVALID"; break;
-		case TRAVEL_WALK: str = "TRAVEL_WALK"; break;
-		case TRAVEL_CROUCH: str = "TRAVEL_CROUCH"; break;
-		case TRAVEL_BARRIERJUMP: str = "TRAVEL_BARRIERJUMP"; break;
-		case TRAVEL_JUMP: str = "TRAVEL_JUMP"; break;
-		case TRAVEL_LADDER: str = "TRAVEL_LADDER"; break;
-		case TRAVEL_WALKOFFLEDGE: str = "TRAVEL_WALKOFFLEDGE"; break;
-		case TRAVEL_SWIM: str = "TRAVEL_SWIM"; break;
-		case TRAVEL_WATERJUMP: str = "TRAVEL_WATERJUMP"; break;
-		case TRAVEL_TELEPORT: str = "TRAVEL_TELEPORT"; break;
-		case TRAVEL_ELEVATOR: str = "TRAVEL_ELEVATOR"; break;
-		case TRAVEL_ROCKETJUMP: str = "TRAVEL_ROCKETJUMP"; break;
-		case TRAVEL_BFGJUMP: str = "TRAVEL_BFGJUMP"; break;
-		case TRAVEL_GRAPPLEHOOK: str = "TRAVEL_GRAPPLEHOOK"; break;
-		case TRAVEL_JUMPPAD: str = "TRAVEL_JUMPPAD"; break;
-		case TRAVEL_FUNCBOB: str = "TRAVEL_FUNCBOB"; break;
-		default: str = "UNKNOWN TRAVEL TYPE"; break;
+		case TRAVEL_INVALID: return "TRAVEL_INVALID";
+		case TRAVEL_WALK: return "TRAVEL_WALK";
+		case TRAVEL_CROUCH: return "TRAVEL_CROUCH";
+		case TRAVEL_BARRIERJUMP: return "TRAVEL_BARRIERJUMP";
+		case TRAVEL_JUMP: return "TRAVEL_JUMP";
+		case TRAVEL_LADDER: return "TRAVEL_LADDER";
+		case TRAVEL_WALKOFFLEDGE: return "TRAVEL_WALKOFFLEDGE";
+		case TRAVEL_SWIM: return "TRAVEL_SWIM";
+		case TRAVEL_WATERJUMP: return "TRAVEL_WATERJUMP";
+		case TRAVEL_TELEPORT: return "TRAVEL_TELEPORT";
+		case TRAVEL_ELEVATOR: return "TRAVEL_ELEVATOR";
+		case TRAVEL_ROCKETJUMP: return "TRAVEL_ROCKETJUMP";
+		case TRAVEL_BFGJUMP: return "TRAVEL_BFGJUMP";
+		case TRAVEL_GRAPPLEHOOK: return "TRAVEL_GRAPPLEHOOK";
+		case TRAVEL_JUMPPAD: return "TRAVEL_JUMPPAD";
+		case TRAVEL_FUNCBOB: return "TRAVEL_FUNCBOB";
+		default: return "UNKNOWN TRAVEL TYPE";
 	} //end switch
-	botimport.Print(PRT_MESSAGE, "%s", str);
+} //end of the function AAS_TravelTypeName
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+void AAS_PrintTravelType(int traveltype)
+{
+#ifdef DEBUG
+	botimport.Print(PRT_MESSAGE, "%s", AAS_TravelTypeName(traveltype));
 #endif
 } //end of the function AAS_PrintTravelType
 //===========================================================================
@@ -51,6 +51,8 @@ void AAS_ShowArea(int areanum, int groundfacesonly);
 void AAS_ShowAreaPolygons(int areanum, int color, int groundfacesonly);
 //draw a cros
 void AAS_DrawCross(vec3_t origin, float size, int color);
+//name of the travel type
+char *AAS_TravelTypeName(int traveltype);
 //print the travel type
 void AAS_PrintTravelType(int traveltype);
 //draw an arrow
@@ -122,10 +122,14 @@ typedef struct aas_settings_s
 #define CACHETYPE_PORTAL		0
 #define CACHETYPE_AREA			1
 
+//number of routing cache size classes with a memory pool
+#define MAX_ROUTINGCACHECLASSES	40
+
 //routing cache
 typedef struct aas_routingcache_s
 {
 	byte type;									//portal or area cache
+	byte filecache;								//cache is stored in the route cache file
 	float time;									//last time accessed or updated
 	int size;									//size of the routing cache
 	int cluster;								//cluster the cache is for
@@ -136,7 +140,7 @@ typedef struct aas_routingcache_s
 	struct aas_routingcache_s *prev, *next;
 	struct aas_routingcache_s *time_prev, *time_next;
 	unsigned char *reachabilities;				//reachabilities used for routing
-	unsigned short int traveltimes[1];			//travel time for every area (variable sized)
+	unsigned short int *traveltimes;			//travel time for every area
 } aas_routingcache_t;
 
 //fields for the routing algorithm
@@ -152,12 +156,45 @@ typedef struct aas_routingupdate_s
 	struct aas_routingupdate_s *prev;
 } aas_routingupdate_t;
 
+//landmark routing tables over the cluster portal graph for one set of travel flags
+//a portal graph node is a portal together with the cluster it is left into
+typedef struct aas_landmarkrouting_s
+{
+	int travelflags;							//travel flags the tables are built for
+	int size;									//size of the tables in bytes
+	int *clusteroffset;							//start of every cluster in the portal tables
+	unsigned short int *portaltraveltimes;		//travel times from the cluster areas to the cluster portals
+	unsigned char *portalreachabilities;		//reachabilities used to travel towards the cluster portals
+	int numlandmarks;							//number of landmark nodes
+	unsigned short int *landmarkto;				//travel times from every node to the landmarks
+	unsigned short int *landmarkfrom;			//travel times from the landmarks to every node
+	struct aas_landmarkrouting_s *next;
+} aas_landmarkrouting_t;
+
+//search state of a single portal graph search
+typedef struct aas_landmarksearch_s
+{
+	int stamp;									//current search
+	int *nodestamp;								//search the node was last visited in
+	unsigned int *traveltime;					//travel time to the node
+	unsigned int *cost;							//travel time plus estimated travel time to the goal
+	int *reachnum;								//first reachability of the route to the node
+	int *heap;									//open nodes sorted on cost
+	int *heappos;								//position of the node in the heap, -1 when not in the heap
+	int heapsize;
+	struct aas_landmarksearch_s *next;
+} aas_landmarksearch_t;
+
 //reversed reachability link
 typedef struct aas_reversedlink_s
 {
 	int linknum;								//the aas_areareachability_t
 	int areanum;								//reachable from this area
 	struct aas_reversedlink_s *next;			//next link
+	//copies of the reachability fields used by the routing update algorithm
+	int travelflags;							//travel flag for the travel type
+	unsigned short traveltime;					//travel time of the reachability
+	unsigned short reachnum;					//reachability number within areanum
 } aas_reversedlink_t;
 
 //reversed area reachability
@@ -167,6 +204,21 @@ typedef struct aas_reversedreachability_s
 	aas_reversedlink_t *first;
 } aas_reversedreachability_t;
 
+//cluster fields of the area settings used by the routing update algorithm
+typedef struct aas_routingarea_s
+{
+	int cluster;								//cluster the area belongs to, if negative it's a portal
+	int clusterareanum;							//number of the area in the cluster
+} aas_routingarea_t;
+
+//bsp node with a copy of its plane and the numbers narrowed to 16 bits
+typedef struct aas_compactnode_s
+{
+	aas_plane_t plane;							//copy of the plane that splits the node
+	unsigned short planenum;					//number of the plane
+	short children[2];							//child nodes, negative numbers are areas, zero is solid
+} aas_compactnode_t;
+
 //areas a reachability goes through
 typedef struct aas_reachabilityareas_s
 {
@@ -235,6 +287,16 @@ typedef struct aas_s
 	int linkheapsize;							//size of the link heap
 	aas_link_t *freelinks;						//first free link
 	aas_link_t **arealinkedentities;			//entities linked into areas
+	//bsp nodes to start area lookups from for points and boxes in a grid
+	int *nodecache;
+	vec3_t nodecachemins;						//mins of the first grid cell
+	int nodecachesize[3];						//number of grid cells along each axis
+	float nodecachecellsize;					//size of a grid cell
+	//compact copies of the bsp tree, face index and area presence types
+	//used by the samples and traces, NULL when off or when they don't fit
+	aas_compactnode_t *compactnodes;
+	short *compactfaceindex;
+	byte *areapresencetypes;
 	//entities
 	int maxentities;
 	int maxclients;
@@ -248,8 +310,12 @@ typedef struct aas_s
 	aas_routingupdate_t *portalupdate;
 	//number of routing updates during a frame (reset every frame)
 	int frameroutingupdates;
+	//number of portal cache updates during a frame (reset every frame)
+	int frameportalupdates;
 	//reversed reachability links
 	aas_reversedreachability_t *reversedreachability;
+	//cluster fields of the area settings packed for the routing update
+	aas_routingarea_t *routingareas;
 	//travel times within the areas
 	unsigned short ***areatraveltimes;
 	//array of size numclusters with cluster cache
@@ -258,8 +324,19 @@ typedef struct aas_s
 	//cache list sorted on time
 	aas_routingcache_t *oldestcache;		// start of cache list sorted on time
 	aas_routingcache_t *newestcache;		// end of cache list sorted on time
+	//memory pools for the routing caches per size class
+	struct memorypool_s *routingcachepools[MAX_ROUTINGCACHECLASSES];
+	//route cache file the caches in filecaches point into
+	void *routecachefile;
+	int routecachefilesize;
+	qboolean routecachemapped;				// file is mapped instead of read into memory
+	aas_routingcache_t *filecaches;
+	int numfilecaches;
 	//maximum travel time through portal areas
 	int *portalmaxtraveltimes;
+	//landmark routing tables and free searches
+	aas_landmarkrouting_t *landmarkrouting;
+	aas_landmarksearch_t *landmarksearches;
 	//areas the reachabilities go through
 	int *reachabilityareaindex;
 	aas_reachabilityareas_t *reachabilityareas;
@@ -150,10 +150,8 @@ int AAS_UpdateEntity(int entnum, bot_entitystate_t *state)
 			//absolute mins and maxs
 			VectorAdd(ent->i.mins, ent->i.origin, absmins);
 			VectorAdd(ent->i.maxs, ent->i.origin, absmaxs);
-			//unlink the entity
-			AAS_UnlinkFromAreas(ent->areas);
 			//relink the entity to the AAS areas (use the larges bbox)
-			ent->areas = AAS_LinkEntityClientBBox(absmins, absmaxs, entnum, PRESENCE_NORMAL);
+			ent->areas = AAS_RelinkEntityClientBBox(ent->areas, absmins, absmaxs, entnum, PRESENCE_NORMAL);
 			//unlink the entity from the BSP leaves
 			AAS_UnlinkFromBSPLeaves(ent->leaves);
 			//link the entity to the world BSP tree
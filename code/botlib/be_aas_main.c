@@ -122,7 +122,12 @@ void AAS_ContinueInit(float time)
 	if (aasworld.savefile || ((int)LibVarGetValue("forcewrite")))
 	{
 		//optimize the AAS data
-		if ((int)LibVarValue("aasoptimize", "0")) AAS_Optimize();
+		if ((int)LibVarValue("aasoptimize", "0"))
+		{
+			AAS_Optimize();
+			//the optimized data has a new face index
+			AAS_InitCompactTree();
+		} //end if
 		//save the AAS file
 		if (AAS_WriteAASFile(aasworld.filename))
 		{
@@ -156,6 +161,9 @@ int AAS_StartFrame(float time)
 	AAS_ContinueInit(time);
 	//
 	aasworld.frameroutingupdates = 0;
+	aasworld.frameportalupdates = 0;
+	//return memory of evicted routing caches
+	AAS_CompactRoutingCaches();
 	//
 	if (botDeveloper)
 	{
@@ -275,6 +283,10 @@ int AAS_LoadMap(const char *mapname)
 	AAS_InitAASLinkHeap();
 	//initialize the AAS linked entities for the new map
 	AAS_InitAASLinkedEntities();
+	//initialize the bsp node cache for the new map
+	AAS_InitNodeCache();
+	//initialize the compact bsp tree and face index for the new map
+	AAS_InitCompactTree();
 	//initialize reachability for the new map
 	AAS_InitReachability();
 	//initialize the alternative routing
@@ -323,6 +335,10 @@ void AAS_Shutdown(void)
 	AAS_FreeAASLinkHeap();
 	//free aas linked entities
 	AAS_FreeAASLinkedEntities();
+	//free the bsp node cache
+	AAS_FreeNodeCache();
+	//free the compact bsp tree and face index
+	AAS_FreeCompactTree();
 	//free the aas data
 	AAS_DumpAASData();
 	//free the entities
@@ -57,6 +57,13 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 //maximum number of routing updates each frame
 #define MAX_FRAMEROUTINGUPDATES		10
+//maximum number of portal cache updates each frame when there are landmark tables
+#define MAX_FRAMEPORTALUPDATES		4
+
+//smallest routing cache size class, every power of two is split in four classes
+#define ROUTINGCACHE_MINCLASSSIZE	256
+//size of the memory chunks the routing cache pools allocate
+#define ROUTINGCACHE_CHUNKSIZE		(64 * 1024)
 
 
 /*
@@ -83,7 +90,6 @@ int numportalcacheupdates;
 
 int routingcachesize;
 int max_routingcachesize;
-
 //===========================================================================
 //
 // Parameter:			-
@@ -93,9 +99,16 @@ int max_routingcachesize;
 #ifdef ROUTING_DEBUG
 void AAS_RoutingInfo(void)
 {
+	aas_landmarkrouting_t *lr;
+
 	botimport.Print(PRT_MESSAGE, "%d area cache updates\n", numareacacheupdates);
 	botimport.Print(PRT_MESSAGE, "%d portal cache updates\n", numportalcacheupdates);
 	botimport.Print(PRT_MESSAGE, "%d bytes routing cache\n", routingcachesize);
+	for (lr = aasworld.landmarkrouting; lr; lr = lr->next)
+	{
+		botimport.Print(PRT_MESSAGE, "%d landmarks, %d bytes landmark routing for travel flags 0x%x\n",
+							lr->numlandmarks, lr->size, lr->travelflags);
+	} //end for
 } //end of the function AAS_RoutingInfo
 #endif //ROUTING_DEBUG
 //===========================================================================
@@ -110,8 +123,8 @@ static ID_INLINE int AAS_ClusterAreaNum(int cluster, int areanum)
 {
 	int side, areacluster;
 
-	areacluster = aasworld.areasettings[areanum].cluster;
-	if (areacluster > 0) return aasworld.areasettings[areanum].clusterareanum;
+	areacluster = aasworld.routingareas[areanum].cluster;
+	if (areacluster > 0) return aasworld.routingareas[areanum].clusterareanum;
 	else
 	{
 /*#ifdef ROUTING_DEBUG
@@ -191,6 +204,73 @@ int AAS_TravelFlagForType(int traveltype)
 	return AAS_TravelFlagForType_inline(traveltype);
 } //end of the function AAS_TravelFlagForType_inline
 //===========================================================================
+// returns the size class of a routing cache of the given size
+//
+// Parameter:			-
+// Returns:				class number or -1 when the cache is too large for a pool
+// Changes Globals:		-
+//===========================================================================
+static int AAS_RoutingCacheClass(int size, int *blocksize)
+{
+	int n, base;
+
+	base = ROUTINGCACHE_MINCLASSSIZE;
+	for (n = 0; n < MAX_ROUTINGCACHECLASSES; n++)
+	{
+		*blocksize = base + (n & 3) * (base >> 2);
+		if (*blocksize >= size) return n;
+		if ((n & 3) == 3) base <<= 1;
+	} //end for
+	return -1;
+} //end of the function AAS_RoutingCacheClass
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_FreeRoutingCacheMemory(aas_routingcache_t *cache)
+{
+	int cacheclass, blocksize;
+
+	routingcachesize -= cache->size;
+	cacheclass = AAS_RoutingCacheClass(cache->size, &blocksize);
+	if (cacheclass >= 0) FreePoolMemory(aasworld.routingcachepools[cacheclass], cache);
+	else FreeMemory(cache);
+} //end of the function AAS_FreeRoutingCacheMemory
+//===========================================================================
+// returns routing cache pool memory without caches in use to the engine
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void AAS_CompactRoutingCaches(void)
+{
+	int i;
+
+	for (i = 0; i < MAX_ROUTINGCACHECLASSES; i++)
+	{
+		if (aasworld.routingcachepools[i]) CompactMemoryPool(aasworld.routingcachepools[i]);
+	} //end for
+} //end of the function AAS_CompactRoutingCaches
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_FreeRoutingCachePools(void)
+{
+	int i;
+
+	for (i = 0; i < MAX_ROUTINGCACHECLASSES; i++)
+	{
+		if (aasworld.routingcachepools[i]) FreeMemoryPool(aasworld.routingcachepools[i]);
+		aasworld.routingcachepools[i] = NULL;
+	} //end for
+} //end of the function AAS_FreeRoutingCachePools
+//===========================================================================
 //
 // Parameter:			-
 // Returns:				-
@@ -198,6 +278,8 @@ int AAS_TravelFlagForType(int traveltype)
 //===========================================================================
 void AAS_UnlinkCache(aas_routingcache_t *cache)
 {
+	//caches from the route cache file are never freed on their own
+	if (cache->filecache) return;
 	if (cache->time_next) cache->time_next->time_prev = cache->time_prev;
 	else aasworld.newestcache = cache->time_prev;
 	if (cache->time_prev) cache->time_prev->time_next = cache->time_next;
@@ -213,6 +295,7 @@ void AAS_UnlinkCache(aas_routingcache_t *cache)
 //===========================================================================
 void AAS_LinkCache(aas_routingcache_t *cache)
 {
+	if (cache->filecache) return;
 	if (aasworld.newestcache)
 	{
 		aasworld.newestcache->time_next = cache;
@@ -234,9 +317,10 @@ void AAS_LinkCache(aas_routingcache_t *cache)
 //===========================================================================
 void AAS_FreeRoutingCache(aas_routingcache_t *cache)
 {
+	//released together with the route cache file
+	if (cache->filecache) return;
 	AAS_UnlinkCache(cache);
-	routingcachesize -= cache->size;
-	FreeMemory(cache);
+	AAS_FreeRoutingCacheMemory(cache);
 } //end of the function AAS_FreeRoutingCache
 //===========================================================================
 //
@@ -329,6 +413,8 @@ int AAS_EnableRoutingArea(int areanum, int enable)
 	{
 		//remove all routing cache involving this area
 		AAS_RemoveRoutingCacheUsingArea( areanum );
+		//update the portal travel times of the landmark routing
+		AAS_UpdateLandmarkRouting( areanum );
 	} //end if
 	return !flags;
 } //end of the function AAS_EnableRoutingArea
@@ -410,6 +496,26 @@ void AAS_InitAreaContentsTravelFlags(void)
 	}
 } //end of the function AAS_InitAreaContentsTravelFlags
 //===========================================================================
+// copies the cluster fields of the area settings into a compact array
+// so the routing update doesn't pull the whole area settings into the cache
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void AAS_InitRoutingAreas(void)
+{
+	int i;
+
+	if (aasworld.routingareas) FreeMemory(aasworld.routingareas);
+	aasworld.routingareas = (aas_routingarea_t *) GetClearedMemory(aasworld.numareas * sizeof(aas_routingarea_t));
+	for (i = 0; i < aasworld.numareas; i++)
+	{
+		aasworld.routingareas[i].cluster = aasworld.areasettings[i].cluster;
+		aasworld.routingareas[i].clusterareanum = aasworld.areasettings[i].clusterareanum;
+	} //end for
+} //end of the function AAS_InitRoutingAreas
+//===========================================================================
 //
 // Parameter:			-
 // Returns:				-
@@ -418,6 +524,7 @@ void AAS_InitAreaContentsTravelFlags(void)
 void AAS_CreateReversedReachability(void)
 {
 	int i, n;
+	aas_reversedreachability_t *revreach;
 	aas_reversedlink_t *revlink;
 	aas_reachability_t *reach;
 	aas_areasettings_t *settings;
@@ -436,7 +543,7 @@ void AAS_CreateReversedReachability(void)
 	aasworld.reversedreachability = (aas_reversedreachability_t *) ptr;
 	//pointer to the memory for the reversed links
 	ptr += aasworld.numareas * sizeof(aas_reversedreachability_t);
-	//check all reachabilities of all areas
+	//count the reversed links of every area
 	for (i = 1; i < aasworld.numareas; i++)
 	{
 		//settings of the area
@@ -444,20 +551,47 @@ void AAS_CreateReversedReachability(void)
 		//
 		if (settings->numreachableareas >= 128)
 			botimport.Print(PRT_WARNING, "area %d has more than 128 reachabilities\n", i);
-		//create reversed links for the reachabilities
+		//
 		for (n = 0; n < settings->numreachableareas && n < 128; n++)
+		{
+			reach = &aasworld.reachability[settings->firstreachablearea + n];
+			aasworld.reversedreachability[reach->areanum].numlinks++;
+		} //end for
+	} //end for
+	//store the reversed links of an area next to each other
+	for (i = 0; i < aasworld.numareas; i++)
+	{
+		revreach = &aasworld.reversedreachability[i];
+		if (!revreach->numlinks) continue;
+		revreach->first = (aas_reversedlink_t *) ptr;
+		ptr += revreach->numlinks * sizeof(aas_reversedlink_t);
+		revreach->numlinks = 0;
+	} //end for
+	//create reversed links for the reachabilities, the links of an area
+	//are ordered from the last reachability to the first
+	for (i = aasworld.numareas - 1; i > 0; i--)
+	{
+		//settings of the area
+		settings = &aasworld.areasettings[i];
+		//
+		n = settings->numreachableareas;
+		if (n > 128) n = 128;
+		for (n--; n >= 0; n--)
 		{
 			//reachability link
 			reach = &aasworld.reachability[settings->firstreachablearea + n];
 			//
-			revlink = (aas_reversedlink_t *) ptr;
-			ptr += sizeof(aas_reversedlink_t);
+			revreach = &aasworld.reversedreachability[reach->areanum];
+			revlink = &revreach->first[revreach->numlinks];
+			if (revreach->numlinks) revlink[-1].next = revlink;
+			revreach->numlinks++;
 			//
 			revlink->areanum = i;
 			revlink->linknum = settings->firstreachablearea + n;
-			revlink->next = aasworld.reversedreachability[reach->areanum].first;
-			aasworld.reversedreachability[reach->areanum].first = revlink;
-			aasworld.reversedreachability[reach->areanum].numlinks++;
+			revlink->next = NULL;
+			revlink->travelflags = AAS_TravelFlagForType_inline(reach->traveltype);
+			revlink->traveltime = reach->traveltime;
+			revlink->reachnum = n;
 		} //end for
 	} //end for
 #ifdef DEBUG
@@ -736,7 +870,7 @@ int AAS_FreeOldestCache(void)
 aas_routingcache_t *AAS_AllocRoutingCache(int numtraveltimes)
 {
 	aas_routingcache_t *cache;
-	int size;
+	int size, cacheclass, blocksize;
 
 	//
 	size = sizeof(aas_routingcache_t)
@@ -744,8 +878,22 @@ aas_routingcache_t *AAS_AllocRoutingCache(int numtraveltimes)
 						+ numtraveltimes * sizeof(unsigned char);
 	//
 	routingcachesize += size;
-	//
-	cache = (aas_routingcache_t *) GetClearedMemory(size);
+	//caches are allocated from a pool per size class
+	cacheclass = AAS_RoutingCacheClass(size, &blocksize);
+	if (cacheclass >= 0)
+	{
+		if (!aasworld.routingcachepools[cacheclass])
+		{
+			aasworld.routingcachepools[cacheclass] = CreateMemoryPool("routing cache", blocksize,
+												ROUTINGCACHE_CHUNKSIZE / blocksize);
+		} //end if
+		cache = (aas_routingcache_t *) GetClearedPoolMemory(aasworld.routingcachepools[cacheclass]);
+	} //end if
+	else
+	{
+		cache = (aas_routingcache_t *) GetClearedMemory(size);
+	} //end else
+	cache->traveltimes = (unsigned short int *) ((byte *) cache + sizeof(aas_routingcache_t));
 	cache->reachabilities = (unsigned char *) cache + sizeof(aas_routingcache_t)
 								+ numtraveltimes * sizeof(unsigned short int);
 	cache->size = size;
@@ -915,44 +1063,176 @@ void AAS_CreateAllRoutingCache(void)
 //===========================================================================
 
 //the route cache header
-//this header is followed by numportalcache + numareacache aas_routingcache_t
-//structures that store routing cache
+//the header is followed by numportalcache + numareacache records, one for
+//every cache, then the travel times of all the caches and then the
+//reachabilities of all the caches. The records store offsets from the start
+//of the file instead of pointers so the file can be used as it is mapped.
 typedef struct routecacheheader_s
 {
 	int ident;
 	int version;
+	int filesize;
+	int bspchecksum;
 	int numareas;
 	int numclusters;
+	int numportals;
 	int areacrc;
 	int clustercrc;
+	int settingscrc;
 	int numportalcache;
 	int numareacache;
 } routecacheheader_t;
 
+//one routing cache in the route cache file
+typedef struct routecacherecord_s
+{
+	int cluster;
+	int areanum;
+	int travelflags;
+	float starttraveltime;
+	vec3_t origin;
+	int numtraveltimes;
+	int traveltimesofs;							//offset of the travel times in the file
+	int reachabilitiesofs;						//offset of the reachabilities in the file
+} routecacherecord_t;
+
 #define RCID						(('C'<<24)+('R'<<16)+('E'<<8)+'M')
-#define RCVERSION					2
+#define RCVERSION					3
 
 //void AAS_DecompressVis(byte *in, int numareas, byte *decompressed);
 //int AAS_CompressVis(byte *vis, int numareas, byte *dest);
 
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static int AAS_RoutingCacheNumTravelTimes(aas_routingcache_t *cache)
+{
+	if (cache->type == CACHETYPE_PORTAL) return aasworld.numportals;
+	return aasworld.clusters[cache->cluster].numreachabilityareas;
+} //end of the function AAS_RoutingCacheNumTravelTimes
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_RouteCacheHeader(routecacheheader_t *header)
+{
+	header->ident = RCID;
+	header->version = RCVERSION;
+	header->filesize = 0;
+	header->bspchecksum = aasworld.bspchecksum;
+	header->numareas = aasworld.numareas;
+	header->numclusters = aasworld.numclusters;
+	header->numportals = aasworld.numportals;
+	header->areacrc = CRC_ProcessString( (unsigned char *)aasworld.areas, sizeof(aas_area_t) * aasworld.numareas );
+	header->clustercrc = CRC_ProcessString( (unsigned char *)aasworld.clusters, sizeof(aas_cluster_t) * aasworld.numclusters );
+	header->settingscrc = CRC_ProcessString( (unsigned char *)aasworld.areasettings, sizeof(aas_areasettings_t) * aasworld.numareas );
+	header->numportalcache = 0;
+	header->numareacache = 0;
+} //end of the function AAS_RouteCacheHeader
+//===========================================================================
+// moves the caches loaded from a mapped route cache file into memory so
+// the file can be written
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_DetachRouteCacheFile(void)
+{
+	int i, numcaches;
+	byte *data;
+	aas_routingcache_t *cache;
+
+	if (!aasworld.routecachemapped) return;
+	data = (byte *) GetMemory(aasworld.routecachefilesize);
+	Com_Memcpy(data, aasworld.routecachefile, aasworld.routecachefilesize);
+	numcaches = aasworld.numfilecaches;
+	for (i = 0; i < numcaches; i++)
+	{
+		cache = &aasworld.filecaches[i];
+		cache->traveltimes = (unsigned short int *) (data + ((byte *) cache->traveltimes - (byte *) aasworld.routecachefile));
+		cache->reachabilities = data + (cache->reachabilities - (byte *) aasworld.routecachefile);
+	} //end for
+	botimport.FS_UnmapFile(aasworld.routecachefile, aasworld.routecachefilesize);
+	aasworld.routecachefile = data;
+	aasworld.routecachemapped = qfalse;
+} //end of the function AAS_DetachRouteCacheFile
+//===========================================================================
+// the caches from the file have to be removed from the cache lists first
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_FreeRouteCacheFile(void)
+{
+	if (aasworld.routecachefile)
+	{
+		if (aasworld.routecachemapped) botimport.FS_UnmapFile(aasworld.routecachefile, aasworld.routecachefilesize);
+		else FreeMemory(aasworld.routecachefile);
+	} //end if
+	if (aasworld.filecaches) FreeMemory(aasworld.filecaches);
+	aasworld.routecachefile = NULL;
+	aasworld.routecachefilesize = 0;
+	aasworld.routecachemapped = qfalse;
+	aasworld.filecaches = NULL;
+	aasworld.numfilecaches = 0;
+} //end of the function AAS_FreeRouteCacheFile
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_WriteRouteCacheRecords(fileHandle_t fp, aas_routingcache_t *cache, int *traveltimesofs, int *reachabilitiesofs)
+{
+	routecacherecord_t record;
+
+	for (; cache; cache = cache->next)
+	{
+		record.cluster = cache->cluster;
+		record.areanum = cache->areanum;
+		record.travelflags = cache->travelflags;
+		record.starttraveltime = cache->starttraveltime;
+		VectorCopy(cache->origin, record.origin);
+		record.numtraveltimes = AAS_RoutingCacheNumTravelTimes(cache);
+		record.traveltimesofs = *traveltimesofs;
+		record.reachabilitiesofs = *reachabilitiesofs;
+		*traveltimesofs += record.numtraveltimes * sizeof(unsigned short int);
+		*reachabilitiesofs += record.numtraveltimes * sizeof(unsigned char);
+		botimport.FS_Write(&record, sizeof(routecacherecord_t), fp);
+	} //end for
+} //end of the function AAS_WriteRouteCacheRecords
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
 void AAS_WriteRouteCache(void)
 {
-	int i, j, numportalcache, numareacache, totalsize;
+	int i, j, numtraveltimes, traveltimesofs, reachabilitiesofs;
 	aas_routingcache_t *cache;
 	aas_cluster_t *cluster;
 	fileHandle_t fp;
 	char filename[MAX_QPATH];
 	routecacheheader_t routecacheheader;
 
-	numportalcache = 0;
+	AAS_RouteCacheHeader(&routecacheheader);
+	numtraveltimes = 0;
 	for (i = 0; i < aasworld.numareas; i++)
 	{
 		for (cache = aasworld.portalcache[i]; cache; cache = cache->next)
 		{
-			numportalcache++;
+			routecacheheader.numportalcache++;
+			numtraveltimes += AAS_RoutingCacheNumTravelTimes(cache);
 		} //end for
 	} //end for
-	numareacache = 0;
 	for (i = 0; i < aasworld.numclusters; i++)
 	{
 		cluster = &aasworld.clusters[i];
@@ -960,10 +1240,17 @@ void AAS_WriteRouteCache(void)
 		{
 			for (cache = aasworld.clusterareacache[i][j]; cache; cache = cache->next)
 			{
-				numareacache++;
+				routecacheheader.numareacache++;
+				numtraveltimes += AAS_RoutingCacheNumTravelTimes(cache);
 			} //end for
 		} //end for
 	} //end for
+	traveltimesofs = sizeof(routecacheheader_t) +
+			(routecacheheader.numportalcache + routecacheheader.numareacache) * sizeof(routecacherecord_t);
+	reachabilitiesofs = traveltimesofs + numtraveltimes * sizeof(unsigned short int);
+	routecacheheader.filesize = reachabilitiesofs + numtraveltimes * sizeof(unsigned char);
+	//the file might be the one the caches are mapped from
+	AAS_DetachRouteCacheFile();
 	// open the file for writing
 	Com_sprintf(filename, MAX_QPATH, "maps/%s.rcd", aasworld.mapname);
 	botimport.FS_FOpenFile( filename, &fp, FS_WRITE );
@@ -972,26 +1259,27 @@ void AAS_WriteRouteCache(void)
 		AAS_Error("Unable to open file: %s\n", filename);
 		return;
 	} //end if
-	//create the header
-	routecacheheader.ident = RCID;
-	routecacheheader.version = RCVERSION;
-	routecacheheader.numareas = aasworld.numareas;
-	routecacheheader.numclusters = aasworld.numclusters;
-	routecacheheader.areacrc = CRC_ProcessString( (unsigned char *)aasworld.areas, sizeof(aas_area_t) * aasworld.numareas );
-	routecacheheader.clustercrc = CRC_ProcessString( (unsigned char *)aasworld.clusters, sizeof(aas_cluster_t) * aasworld.numclusters );
-	routecacheheader.numportalcache = numportalcache;
-	routecacheheader.numareacache = numareacache;
 	//write the header
 	botimport.FS_Write(&routecacheheader, sizeof(routecacheheader_t), fp);
-	//
-	totalsize = 0;
-	//write all the cache
+	//write the records of all the caches
+	for (i = 0; i < aasworld.numareas; i++)
+	{
+		AAS_WriteRouteCacheRecords(fp, aasworld.portalcache[i], &traveltimesofs, &reachabilitiesofs);
+	} //end for
+	for (i = 0; i < aasworld.numclusters; i++)
+	{
+		cluster = &aasworld.clusters[i];
+		for (j = 0; j < cluster->numareas; j++)
+		{
+			AAS_WriteRouteCacheRecords(fp, aasworld.clusterareacache[i][j], &traveltimesofs, &reachabilitiesofs);
+		} //end for
+	} //end for
+	//write the travel times of all the caches
 	for (i = 0; i < aasworld.numareas; i++)
 	{
 		for (cache = aasworld.portalcache[i]; cache; cache = cache->next)
 		{
-			botimport.FS_Write(cache, cache->size, fp);
-			totalsize += cache->size;
+			botimport.FS_Write(cache->traveltimes, AAS_RoutingCacheNumTravelTimes(cache) * sizeof(unsigned short int), fp);
 		} //end for
 	} //end for
 	for (i = 0; i < aasworld.numclusters; i++)
@@ -1001,51 +1289,75 @@ void AAS_WriteRouteCache(void)
 		{
 			for (cache = aasworld.clusterareacache[i][j]; cache; cache = cache->next)
 			{
-				botimport.FS_Write(cache, cache->size, fp);
-				totalsize += cache->size;
+				botimport.FS_Write(cache->traveltimes, AAS_RoutingCacheNumTravelTimes(cache) * sizeof(unsigned short int), fp);
 			} //end for
 		} //end for
 	} //end for
-	// write the visareas
-	/*
+	//write the reachabilities of all the caches
 	for (i = 0; i < aasworld.numareas; i++)
 	{
-		if (!aasworld.areavisibility[i]) {
-			size = 0;
-			botimport.FS_Write(&size, sizeof(int), fp);
-			continue;
-		}
-		AAS_DecompressVis( aasworld.areavisibility[i], aasworld.numareas, aasworld.decompressedvis );
-		size = AAS_CompressVis( aasworld.decompressedvis, aasworld.numareas, aasworld.decompressedvis );
-		botimport.FS_Write(&size, sizeof(int), fp);
-		botimport.FS_Write(aasworld.decompressedvis, size, fp);
-	}
-	*/
+		for (cache = aasworld.portalcache[i]; cache; cache = cache->next)
+		{
+			botimport.FS_Write(cache->reachabilities, AAS_RoutingCacheNumTravelTimes(cache) * sizeof(unsigned char), fp);
+		} //end for
+	} //end for
+	for (i = 0; i < aasworld.numclusters; i++)
+	{
+		cluster = &aasworld.clusters[i];
+		for (j = 0; j < cluster->numareas; j++)
+		{
+			for (cache = aasworld.clusterareacache[i][j]; cache; cache = cache->next)
+			{
+				botimport.FS_Write(cache->reachabilities, AAS_RoutingCacheNumTravelTimes(cache) * sizeof(unsigned char), fp);
+			} //end for
+		} //end for
+	} //end for
 	//
 	botimport.FS_FCloseFile(fp);
 	botimport.Print(PRT_MESSAGE, "\nroute cache written to %s\n", filename);
-	botimport.Print(PRT_MESSAGE, "written %d bytes of routing cache\n", totalsize);
+	botimport.Print(PRT_MESSAGE, "written %d portal and %d area caches, %d bytes\n",
+					routecacheheader.numportalcache, routecacheheader.numareacache, routecacheheader.filesize);
 } //end of the function AAS_WriteRouteCache
 //===========================================================================
+// checks a cache record before any of its offsets are used
 //
 // Parameter:			-
 // Returns:				-
 // Changes Globals:		-
 //===========================================================================
-aas_routingcache_t *AAS_ReadCache(fileHandle_t fp)
+static qboolean AAS_ValidRouteCacheRecord(routecacherecord_t *record, int type, int filesize)
 {
-	int size;
-	aas_routingcache_t *cache;
+	int areacluster, numtraveltimes;
+	aas_portal_t *portal;
 
-	botimport.FS_Read(&size, sizeof(size), fp);
-	cache = (aas_routingcache_t *) GetMemory(size);
-	cache->size = size;
-	botimport.FS_Read((unsigned char *)cache + sizeof(size), size - sizeof(size), fp);
-	cache->reachabilities = (unsigned char *) cache + sizeof(aas_routingcache_t) - sizeof(unsigned short) +
-		(size - sizeof(aas_routingcache_t) + sizeof(unsigned short)) / 3 * 2;
-	return cache;
-} //end of the function AAS_ReadCache
+	if (record->areanum <= 0 || record->areanum >= aasworld.numareas) return qfalse;
+	if (type == CACHETYPE_PORTAL)
+	{
+		numtraveltimes = aasworld.numportals;
+	} //end if
+	else
+	{
+		if (record->cluster <= 0 || record->cluster >= aasworld.numclusters) return qfalse;
+		areacluster = aasworld.areasettings[record->areanum].cluster;
+		if (areacluster < 0)
+		{
+			portal = &aasworld.portals[-areacluster];
+			if (portal->frontcluster != record->cluster && portal->backcluster != record->cluster) return qfalse;
+		} //end if
+		else if (areacluster != record->cluster) return qfalse;
+		numtraveltimes = aasworld.clusters[record->cluster].numreachabilityareas;
+	} //end else
+	if (record->numtraveltimes != numtraveltimes) return qfalse;
+	if (record->traveltimesofs < (int) sizeof(routecacheheader_t) || (record->traveltimesofs & 1)) return qfalse;
+	if (record->traveltimesofs > filesize - numtraveltimes * (int) sizeof(unsigned short int)) return qfalse;
+	if (record->reachabilitiesofs < (int) sizeof(routecacheheader_t)) return qfalse;
+	if (record->reachabilitiesofs > filesize - numtraveltimes * (int) sizeof(unsigned char)) return qfalse;
+	return qtrue;
+} //end of the function AAS_ValidRouteCacheRecord
 //===========================================================================
+// the route cache file is mapped when possible and otherwise read with a
+// single read. The caches point into the file and are kept out of the
+// least recently used list so they stay for the whole map.
 //
 // Parameter:			-
 // Returns:				-
@@ -1053,87 +1365,114 @@ aas_routingcache_t *AAS_ReadCache(fileHandle_t fp)
 //===========================================================================
 int AAS_ReadRouteCache(void)
 {
-	int i, clusterareanum;//, size;
+	int i, length, numcaches, clusterareanum;
 	fileHandle_t fp;
 	char filename[MAX_QPATH];
-	routecacheheader_t routecacheheader;
-	aas_routingcache_t *cache;
+	byte *data;
+	qboolean mapped, valid;
+	routecacheheader_t routecacheheader, *header;
+	routecacherecord_t *records;
+	aas_routingcache_t *cache, **list;
 
 	Com_sprintf(filename, MAX_QPATH, "maps/%s.rcd", aasworld.mapname);
-	botimport.FS_FOpenFile( filename, &fp, FS_READ );
-	if (!fp)
+	data = botimport.FS_MapFile ? (byte *) botimport.FS_MapFile(filename, &length) : NULL;
+	mapped = data != NULL;
+	if (!mapped)
 	{
-		return qfalse;
+		length = botimport.FS_FOpenFile( filename, &fp, FS_READ );
+		if (!fp)
+		{
+			return qfalse;
+		} //end if
+		if (length < (int) sizeof(routecacheheader_t))
+		{
+			botimport.FS_FCloseFile(fp);
+			AAS_Error("%s is not a route cache dump\n", filename);
+			return qfalse;
+		} //end if
+		data = (byte *) GetMemory(length);
+		botimport.FS_Read(data, length, fp);
+		botimport.FS_FCloseFile(fp);
 	} //end if
-	botimport.FS_Read(&routecacheheader, sizeof(routecacheheader_t), fp );
-	if (routecacheheader.ident != RCID)
+	header = (routecacheheader_t *) data;
+	records = (routecacherecord_t *) (data + sizeof(routecacheheader_t));
+	AAS_RouteCacheHeader(&routecacheheader);
+	valid = qfalse;
+	if (length < (int) sizeof(routecacheheader_t) || header->ident != RCID)
 	{
 		AAS_Error("%s is not a route cache dump\n", filename);
-		return qfalse;
-	} //end if
-	if (routecacheheader.version != RCVERSION)
-	{
-		AAS_Error("route cache dump has wrong version %d, should be %d\n", routecacheheader.version, RCVERSION);
-		return qfalse;
-	} //end if
-	if (routecacheheader.numareas != aasworld.numareas)
-	{
-		//AAS_Error("route cache dump has wrong number of areas\n");
-		return qfalse;
 	} //end if
-	if (routecacheheader.numclusters != aasworld.numclusters)
-	{
-		//AAS_Error("route cache dump has wrong number of clusters\n");
-		return qfalse;
-	} //end if
-	if (routecacheheader.areacrc !=
-		CRC_ProcessString( (unsigned char *)aasworld.areas, sizeof(aas_area_t) * aasworld.numareas ))
-	{
-		//AAS_Error("route cache dump area CRC incorrect\n");
-		return qfalse;
-	} //end if
-	if (routecacheheader.clustercrc !=
-		CRC_ProcessString( (unsigned char *)aasworld.clusters, sizeof(aas_cluster_t) * aasworld.numclusters ))
+	else if (header->version != RCVERSION)
+	{
+		AAS_Error("route cache dump has wrong version %d, should be %d\n", header->version, RCVERSION);
+	} //end else if
+	else if (header->filesize != length ||
+			header->numportalcache < 0 || header->numareacache < 0 ||
+			header->numportalcache + header->numareacache >
+				(length - (int) sizeof(routecacheheader_t)) / (int) sizeof(routecacherecord_t))
+	{
+		AAS_Error("%s is damaged\n", filename);
+	} //end else if
+	//a file from another version of the map is silently replaced
+	else if (header->bspchecksum == routecacheheader.bspchecksum &&
+			header->numareas == routecacheheader.numareas &&
+			header->numclusters == routecacheheader.numclusters &&
+			header->numportals == routecacheheader.numportals &&
+			header->areacrc == routecacheheader.areacrc &&
+			header->clustercrc == routecacheheader.clustercrc &&
+			header->settingscrc == routecacheheader.settingscrc)
+	{
+		numcaches = header->numportalcache + header->numareacache;
+		for (i = 0; i < numcaches; i++)
+		{
+			if (!AAS_ValidRouteCacheRecord(&records[i],
+					i < header->numportalcache ? CACHETYPE_PORTAL : CACHETYPE_AREA, length)) break;
+		} //end for
+		if (i < numcaches) AAS_Error("%s is damaged\n", filename);
+		else valid = qtrue;
+	} //end else if
+	if (!valid)
 	{
-		//AAS_Error("route cache dump cluster CRC incorrect\n");
+		if (mapped) botimport.FS_UnmapFile(data, length);
+		else FreeMemory(data);
 		return qfalse;
 	} //end if
-	//read all the portal cache
-	for (i = 0; i < routecacheheader.numportalcache; i++)
-	{
-		cache = AAS_ReadCache(fp);
-		cache->next = aasworld.portalcache[cache->areanum];
-		cache->prev = NULL;
-		if (aasworld.portalcache[cache->areanum])
-			aasworld.portalcache[cache->areanum]->prev = cache;
-		aasworld.portalcache[cache->areanum] = cache;
-	} //end for
-	//read all the cluster area cache
-	for (i = 0; i < routecacheheader.numareacache; i++)
-	{
-		cache = AAS_ReadCache(fp);
-		clusterareanum = AAS_ClusterAreaNum(cache->cluster, cache->areanum);
-		cache->next = aasworld.clusterareacache[cache->cluster][clusterareanum];
+	//
+	aasworld.routecachefile = data;
+	aasworld.routecachefilesize = length;
+	aasworld.routecachemapped = mapped;
+	aasworld.numfilecaches = header->numportalcache + header->numareacache;
+	aasworld.filecaches = (aas_routingcache_t *) GetClearedMemory(aasworld.numfilecaches * sizeof(aas_routingcache_t));
+	for (i = 0; i < aasworld.numfilecaches; i++)
+	{
+		cache = &aasworld.filecaches[i];
+		cache->type = i < header->numportalcache ? CACHETYPE_PORTAL : CACHETYPE_AREA;
+		cache->filecache = qtrue;
+		cache->cluster = records[i].cluster;
+		cache->areanum = records[i].areanum;
+		cache->travelflags = records[i].travelflags;
+		cache->starttraveltime = records[i].starttraveltime;
+		VectorCopy(records[i].origin, cache->origin);
+		cache->size = records[i].numtraveltimes * (sizeof(unsigned short int) + sizeof(unsigned char));
+		cache->traveltimes = (unsigned short int *) (data + records[i].traveltimesofs);
+		cache->reachabilities = data + records[i].reachabilitiesofs;
+		//add the cache to the portal or cluster area cache list
+		if (cache->type == CACHETYPE_PORTAL)
+		{
+			list = &aasworld.portalcache[cache->areanum];
+		} //end if
+		else
+		{
+			clusterareanum = AAS_ClusterAreaNum(cache->cluster, cache->areanum);
+			list = &aasworld.clusterareacache[cache->cluster][clusterareanum];
+		} //end else
 		cache->prev = NULL;
-		if (aasworld.clusterareacache[cache->cluster][clusterareanum])
-			aasworld.clusterareacache[cache->cluster][clusterareanum]->prev = cache;
-		aasworld.clusterareacache[cache->cluster][clusterareanum] = cache;
+		cache->next = *list;
+		if (*list) (*list)->prev = cache;
+		*list = cache;
 	} //end for
-	// read the visareas
-	/*
-	aasworld.areavisibility = (byte **) GetClearedMemory(aasworld.numareas * sizeof(byte *));
-	aasworld.decompressedvis = (byte *) GetClearedMemory(aasworld.numareas * sizeof(byte));
-	for (i = 0; i < aasworld.numareas; i++)
-	{
-		botimport.FS_Read(&size, sizeof(size), fp );
-		if (size) {
-			aasworld.areavisibility[i] = (byte *) GetMemory(size);
-			botimport.FS_Read(aasworld.areavisibility[i], size, fp );
-		}
-	}
-	*/
-	//
-	botimport.FS_FCloseFile(fp);
+	botimport.Print(PRT_MESSAGE, "loaded %d portal and %d area caches from %s\n",
+					header->numportalcache, header->numareacache, filename);
 	return qtrue;
 } //end of the function AAS_ReadRouteCache
 //===========================================================================
@@ -1221,6 +1560,8 @@ void AAS_InitRouting(void)
 	AAS_InitTravelFlagFromType();
 	//
 	AAS_InitAreaContentsTravelFlags();
+	//copy the area cluster fields used by the routing
+	AAS_InitRoutingAreas();
 	//initialize the routing update fields
 	AAS_InitRoutingUpdate();
 	//create reversed reachability links used by the routing update algorithm
@@ -1245,6 +1586,8 @@ void AAS_InitRouting(void)
 	max_routingcachesize = 1024 * (int) LibVarValue("max_routingcache", "4096");
 	// read any routing cache if available
 	AAS_ReadRouteCache();
+	// build the landmark routing tables
+	AAS_InitLandmarkRouting();
 } //end of the function AAS_InitRouting
 //===========================================================================
 //
@@ -1254,10 +1597,16 @@ void AAS_InitRouting(void)
 //===========================================================================
 void AAS_FreeRoutingCaches(void)
 {
+	// free the landmark routing tables
+	AAS_FreeLandmarkRouting();
 	// free all the existing cluster area cache
 	AAS_FreeAllClusterAreaCache();
 	// free all the existing portal cache
 	AAS_FreeAllPortalCache();
+	// free the caches loaded from the route cache file
+	AAS_FreeRouteCacheFile();
+	// free the routing cache memory pools
+	AAS_FreeRoutingCachePools();
 	// free cached travel times within areas
 	if (aasworld.areatraveltimes) FreeMemory(aasworld.areatraveltimes);
 	aasworld.areatraveltimes = NULL;
@@ -1267,6 +1616,9 @@ void AAS_FreeRoutingCaches(void)
 	// free reversed reachability links
 	if (aasworld.reversedreachability) FreeMemory(aasworld.reversedreachability);
 	aasworld.reversedreachability = NULL;
+	// free the area cluster fields used by the routing
+	if (aasworld.routingareas) FreeMemory(aasworld.routingareas);
+	aasworld.routingareas = NULL;
 	// free routing algorithm memory
 	if (aasworld.areaupdate) FreeMemory(aasworld.areaupdate);
 	aasworld.areaupdate = NULL;
@@ -1291,11 +1643,10 @@ void AAS_FreeRoutingCaches(void)
 //===========================================================================
 void AAS_UpdateAreaRoutingCache(aas_routingcache_t *areacache)
 {
-	int i, nextareanum, cluster, badtravelflags, clusterareanum, linknum;
+	int i, nextareanum, cluster, badtravelflags, clusterareanum;
 	int numreachabilityareas;
 	unsigned short int t, startareatraveltimes[128]; //NOTE: not more than 128 reachabilities per area allowed
 	aas_routingupdate_t *updateliststart, *updatelistend, *curupdate, *nextupdate;
-	aas_reachability_t *reach;
 	aas_reversedreachability_t *revreach;
 	aas_reversedlink_t *revlink;
 
@@ -1338,23 +1689,22 @@ void AAS_UpdateAreaRoutingCache(aas_routingcache_t *areacache)
 		updateliststart = curupdate->next;
 		//
 		curupdate->inlist = qfalse;
+		//all reversed reachabilities lead into the current area so
+		//if not allowed to enter the current area
+		if (aasworld.areasettings[curupdate->areanum].areaflags & AREA_DISABLED) continue;
+		//if the current area has a not allowed travel flag
+		if (AAS_AreaContentsTravelFlags_inline(curupdate->areanum) & badtravelflags) continue;
 		//check all reversed reachability links
 		revreach = &aasworld.reversedreachability[curupdate->areanum];
 		//
-		for (i = 0, revlink = revreach->first; revlink; revlink = revlink->next, i++)
+		for (i = 0, revlink = revreach->first; i < revreach->numlinks; revlink++, i++)
 		{
-			linknum = revlink->linknum;
-			reach = &aasworld.reachability[linknum];
 			//if there is used an undesired travel type
-			if (AAS_TravelFlagForType_inline(reach->traveltype) & badtravelflags) continue;
-			//if not allowed to enter the next area
-			if (aasworld.areasettings[reach->areanum].areaflags & AREA_DISABLED) continue;
-			//if the next area has a not allowed travel flag
-			if (AAS_AreaContentsTravelFlags_inline(reach->areanum) & badtravelflags) continue;
+			if (revlink->travelflags & badtravelflags) continue;
 			//number of the area the reversed reachability leads to
 			nextareanum = revlink->areanum;
 			//get the cluster number of the area
-			cluster = aasworld.areasettings[nextareanum].cluster;
+			cluster = aasworld.routingareas[nextareanum].cluster;
 			//don't leave the cluster
 			if (cluster > 0 && cluster != areacache->cluster) continue;
 			//get the number of the area in the cluster
@@ -1365,19 +1715,18 @@ void AAS_UpdateAreaRoutingCache(aas_routingcache_t *areacache)
 			t = curupdate->tmptraveltime +
 						//AAS_AreaTravelTime(curupdate->areanum, curupdate->start, reach->end) +
 						curupdate->areatraveltimes[i] +
-							reach->traveltime;
+							revlink->traveltime;
 			//
 			if (!areacache->traveltimes[clusterareanum] ||
 					areacache->traveltimes[clusterareanum] > t)
 			{
 				areacache->traveltimes[clusterareanum] = t;
-				areacache->reachabilities[clusterareanum] = linknum - aasworld.areasettings[nextareanum].firstreachablearea;
+				areacache->reachabilities[clusterareanum] = revlink->reachnum;
 				nextupdate = &aasworld.areaupdate[clusterareanum];
 				nextupdate->areanum = nextareanum;
 				nextupdate->tmptraveltime = t;
 				//VectorCopy(reach->start, nextupdate->start);
-				nextupdate->areatraveltimes = aasworld.areatraveltimes[nextareanum][linknum -
-													aasworld.areasettings[nextareanum].firstreachablearea];
+				nextupdate->areatraveltimes = aasworld.areatraveltimes[nextareanum][revlink->reachnum];
 				if (!nextupdate->inlist)
 				{
 					// we add the update to the end of the list
@@ -1395,12 +1744,13 @@ void AAS_UpdateAreaRoutingCache(aas_routingcache_t *areacache)
 	} //end while
 } //end of the function AAS_UpdateAreaRoutingCache
 //===========================================================================
+// the caller holds BLLOCK_ROUTING
 //
 // Parameter:			-
 // Returns:				-
 // Changes Globals:		-
 //===========================================================================
-aas_routingcache_t *AAS_GetAreaRoutingCache(int clusternum, int areanum, int travelflags)
+static aas_routingcache_t *AAS_FindAreaRoutingCache(int clusternum, int areanum, int travelflags)
 {
 	int clusterareanum;
 	aas_routingcache_t *cache, *clustercache;
@@ -1439,28 +1789,842 @@ aas_routingcache_t *AAS_GetAreaRoutingCache(int clusternum, int areanum, int tra
 	cache->type = CACHETYPE_AREA;
 	AAS_LinkCache(cache);
 	return cache;
+} //end of the function AAS_FindAreaRoutingCache
+//===========================================================================
+// a cache is never changed once it has been calculated, so the caller can
+// read its travel times after the lock is released. Caches are only freed
+// outside of bot jobs.
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+aas_routingcache_t *AAS_GetAreaRoutingCache(int clusternum, int areanum, int travelflags)
+{
+	aas_routingcache_t *cache;
+
+	BotLibLock(BLLOCK_ROUTING);
+	cache = AAS_FindAreaRoutingCache(clusternum, areanum, travelflags);
+	BotLibUnlock(BLLOCK_ROUTING);
+	return cache;
 } //end of the function AAS_GetAreaRoutingCache
 //===========================================================================
+// landmark routing:
+// routes between clusters are searched with A* over the cluster portal
+// graph. A node of the graph is a portal together with the cluster the
+// route leaves the portal into. Travel times from every cluster area to
+// the portals of the cluster are precomputed, as are the travel times
+// between every node and a few landmark nodes which give a lower bound
+// for the travel time to the goal (the ALT heuristic). A query only needs
+// the area cache of the goal area, which stays within the goal cluster.
+//
+// the portal tables also replace the area caches of the portals when
+// portal caches are updated. Portal caches are still used when they exist,
+// but only a few are created each frame, other goals are searched.
+//
+// the tables are built outside of bot jobs. The landmark travel times are
+// taken with all areas enabled, disabling areas only makes routes longer
+// so they stay lower bounds, and only the portal travel times of the
+// clusters an area is in change when the area is enabled or disabled.
+// The libvar maxlandmarks sets the number of landmarks, 0 disables them
+//===========================================================================
+#define MAX_LANDMARKS				32
+#define MAX_LANDMARKROUTINGS		4		//travel flag combinations with tables
+#define LANDMARK_INFINITE			0xffff	//node can't be reached
+#define LANDMARK_MAXTIME			0xfffe	//largest stored travel time
+#define LANDMARK_NOESTIMATE			0xffffffffu
+
+int maxlandmarks;
+//===========================================================================
+// returns the graph node of the portal leaving into the given cluster
 //
 // Parameter:			-
 // Returns:				-
 // Changes Globals:		-
 //===========================================================================
-void AAS_UpdatePortalRoutingCache(aas_routingcache_t *portalcache)
+static ID_INLINE int AAS_LandmarkNode(int portalnum, int clusternum)
+{
+	return (portalnum << 1) | (aasworld.portals[portalnum].frontcluster != clusternum);
+} //end of the function AAS_LandmarkNode
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static ID_INLINE int AAS_LandmarkNodeCluster(int node)
 {
-	int i, portalnum, clusterareanum, clusternum;
-	unsigned short int t;
 	aas_portal_t *portal;
-	aas_cluster_t *cluster;
-	aas_routingcache_t *cache;
-	aas_routingupdate_t *updateliststart, *updatelistend, *curupdate, *nextupdate;
 
-#ifdef ROUTING_DEBUG
-	numportalcacheupdates++;
-#endif //ROUTING_DEBUG
-	//clear the routing update fields
-//	Com_Memset(aasworld.portalupdate, 0, (aasworld.numportals+1) * sizeof(aas_routingupdate_t));
-	//
+	portal = &aasworld.portals[node >> 1];
+	return (node & 1) ? portal->backcluster : portal->frontcluster;
+} //end of the function AAS_LandmarkNodeCluster
+//===========================================================================
+// returns the other cluster of the portal
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static ID_INLINE int AAS_PortalOtherCluster(int portalnum, int clusternum)
+{
+	aas_portal_t *portal;
+
+	portal = &aasworld.portals[portalnum];
+	return (portal->frontcluster == clusternum) ? portal->backcluster : portal->frontcluster;
+} //end of the function AAS_PortalOtherCluster
+//===========================================================================
+// index of the travel time from the cluster area towards the n-th portal
+// of the cluster in the portal tables
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static ID_INLINE int AAS_LandmarkPortalIndex(aas_landmarkrouting_t *lr, int clusternum, int n, int clusterareanum)
+{
+	return lr->clusteroffset[clusternum] + n * aasworld.clusters[clusternum].numreachabilityareas + clusterareanum;
+} //end of the function AAS_LandmarkPortalIndex
+//===========================================================================
+// equal costs are ordered on the larger travel time, which is the node
+// closer to the goal
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static ID_INLINE int AAS_LandmarkNodeBefore(aas_landmarksearch_t *search, int node1, int node2)
+{
+	if (search->cost[node1] != search->cost[node2]) return search->cost[node1] < search->cost[node2];
+	return search->traveltime[node1] > search->traveltime[node2];
+} //end of the function AAS_LandmarkNodeBefore
+//===========================================================================
+// adds the node to the heap or moves it up after its cost decreased
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_LandmarkHeapPush(aas_landmarksearch_t *search, int node)
+{
+	int i, parent;
+
+	i = search->heappos[node];
+	if (i < 0) i = search->heapsize++;
+	while (i > 0)
+	{
+		parent = (i - 1) >> 1;
+		if (!AAS_LandmarkNodeBefore(search, node, search->heap[parent])) break;
+		search->heap[i] = search->heap[parent];
+		search->heappos[search->heap[i]] = i;
+		i = parent;
+	} //end while
+	search->heap[i] = node;
+	search->heappos[node] = i;
+} //end of the function AAS_LandmarkHeapPush
+//===========================================================================
+// removes and returns the node with the lowest cost
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static int AAS_LandmarkHeapPop(aas_landmarksearch_t *search)
+{
+	int i, child, node, last;
+
+	node = search->heap[0];
+	search->heappos[node] = -1;
+	last = search->heap[--search->heapsize];
+	if (!search->heapsize) return node;
+	i = 0;
+	while ((child = 2 * i + 1) < search->heapsize)
+	{
+		if (child + 1 < search->heapsize &&
+				AAS_LandmarkNodeBefore(search, search->heap[child + 1], search->heap[child])) child++;
+		if (!AAS_LandmarkNodeBefore(search, search->heap[child], last)) break;
+		search->heap[i] = search->heap[child];
+		search->heappos[search->heap[i]] = i;
+		i = child;
+	} //end while
+	search->heap[i] = last;
+	search->heappos[last] = i;
+	return node;
+} //end of the function AAS_LandmarkHeapPop
+//===========================================================================
+// takes a search from the free list or allocates a new one, there is one
+// search for every thread routing at the same time
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static aas_landmarksearch_t *AAS_GetLandmarkSearch(void)
+{
+	int numnodes;
+	aas_landmarksearch_t *search;
+
+	BotLibLock(BLLOCK_ROUTING);
+	search = aasworld.landmarksearches;
+	if (search) aasworld.landmarksearches = search->next;
+	BotLibUnlock(BLLOCK_ROUTING);
+	if (!search)
+	{
+		numnodes = aasworld.numportals * 2;
+		search = (aas_landmarksearch_t *) GetClearedMemory(sizeof(aas_landmarksearch_t) +
+									numnodes * (4 * sizeof(int) + 2 * sizeof(unsigned int)));
+		search->nodestamp = (int *) (search + 1);
+		search->reachnum = search->nodestamp + numnodes;
+		search->heap = search->reachnum + numnodes;
+		search->heappos = search->heap + numnodes;
+		search->traveltime = (unsigned int *) (search->heappos + numnodes);
+		search->cost = search->traveltime + numnodes;
+	} //end if
+	//start a new search, all nodes are unvisited
+	if (++search->stamp <= 0)
+	{
+		Com_Memset(search->nodestamp, 0, aasworld.numportals * 2 * sizeof(int));
+		search->stamp = 1;
+	} //end if
+	search->heapsize = 0;
+	return search;
+} //end of the function AAS_GetLandmarkSearch
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_ReleaseLandmarkSearch(aas_landmarksearch_t *search)
+{
+	BotLibLock(BLLOCK_ROUTING);
+	search->next = aasworld.landmarksearches;
+	aasworld.landmarksearches = search;
+	BotLibUnlock(BLLOCK_ROUTING);
+} //end of the function AAS_ReleaseLandmarkSearch
+//===========================================================================
+// opens the node or lowers its travel time
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static ID_INLINE void AAS_LandmarkVisitNode(aas_landmarksearch_t *search, int node,
+								unsigned int traveltime, unsigned int estimate, int reachnum)
+{
+	if (search->nodestamp[node] == search->stamp)
+	{
+		//a closed node is opened again when a faster route to it shows up,
+		//saturated landmark travel times can make the estimate inconsistent
+		if (traveltime >= search->traveltime[node]) return;
+		estimate = search->cost[node] - search->traveltime[node];
+	} //end if
+	else
+	{
+		search->nodestamp[node] = search->stamp;
+		search->heappos[node] = -1;
+	} //end else
+	search->traveltime[node] = traveltime;
+	search->cost[node] = traveltime + estimate;
+	search->reachnum[node] = reachnum;
+	AAS_LandmarkHeapPush(search, node);
+} //end of the function AAS_LandmarkVisitNode
+//===========================================================================
+// travel times from or to the landmark node for every node, the travel
+// times of all landmarks are interleaved per node
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_LandmarkTravelTimes(aas_landmarkrouting_t *lr, aas_landmarksearch_t *search,
+								int landmark, qboolean reversed, unsigned short int *traveltimes, int stride)
+{
+	int i, j, n, node, clusternum, portalnum, clusterareanum, numnodes;
+	unsigned int t;
+	aas_cluster_t *cluster;
+
+	numnodes = aasworld.numportals * 2;
+	for (i = 0; i < numnodes; i++) traveltimes[i * stride] = LANDMARK_INFINITE;
+	AAS_LandmarkVisitNode(search, landmark, 0, 0, 0);
+	while (search->heapsize)
+	{
+		node = AAS_LandmarkHeapPop(search);
+		t = search->traveltime[node];
+		traveltimes[node * stride] = t < LANDMARK_MAXTIME ? t : LANDMARK_MAXTIME;
+		portalnum = node >> 1;
+		if (!reversed)
+		{
+			//nodes reached by travelling through the cluster towards its other portals
+			clusternum = AAS_LandmarkNodeCluster(node);
+			cluster = &aasworld.clusters[clusternum];
+			clusterareanum = AAS_ClusterAreaNum(clusternum, aasworld.portals[portalnum].areanum);
+			if (clusterareanum >= cluster->numreachabilityareas) continue;
+			for (i = 0; i < cluster->numportals; i++)
+			{
+				n = aasworld.portalindex[cluster->firstportal + i];
+				if (n == portalnum) continue;
+				t = lr->portaltraveltimes[AAS_LandmarkPortalIndex(lr, clusternum, i, clusterareanum)];
+				if (!t) continue;
+				AAS_LandmarkVisitNode(search, AAS_LandmarkNode(n, AAS_PortalOtherCluster(n, clusternum)),
+										search->traveltime[node] + t + aasworld.portalmaxtraveltimes[n], 0, 0);
+			} //end for
+		} //end if
+		else
+		{
+			//nodes of the other portals in the cluster the portal was entered from
+			clusternum = AAS_PortalOtherCluster(portalnum, AAS_LandmarkNodeCluster(node));
+			cluster = &aasworld.clusters[clusternum];
+			for (j = 0; j < cluster->numportals; j++)
+			{
+				if (aasworld.portalindex[cluster->firstportal + j] == portalnum) break;
+			} //end for
+			if (j >= cluster->numportals) continue;
+			for (i = 0; i < cluster->numportals; i++)
+			{
+				n = aasworld.portalindex[cluster->firstportal + i];
+				if (n == portalnum) continue;
+				clusterareanum = AAS_ClusterAreaNum(clusternum, aasworld.portals[n].areanum);
+				if (clusterareanum >= cluster->numreachabilityareas) continue;
+				t = lr->portaltraveltimes[AAS_LandmarkPortalIndex(lr, clusternum, j, clusterareanum)];
+				if (!t) continue;
+				AAS_LandmarkVisitNode(search, AAS_LandmarkNode(n, clusternum),
+										search->traveltime[node] + t + aasworld.portalmaxtraveltimes[portalnum], 0, 0);
+			} //end for
+		} //end else
+	} //end while
+	//next search
+	if (++search->stamp <= 0)
+	{
+		Com_Memset(search->nodestamp, 0, numnodes * sizeof(int));
+		search->stamp = 1;
+	} //end if
+} //end of the function AAS_LandmarkTravelTimes
+//===========================================================================
+// the landmarks are spread over the portal graph by repeatedly taking
+// the node furthest away from the landmarks already chosen
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_SelectLandmarks(aas_landmarkrouting_t *lr, aas_landmarksearch_t *search)
+{
+	int i, l, node, numnodes, bestnode;
+	unsigned int t, mint, bestt;
+	unsigned short int *from;
+
+	numnodes = aasworld.numportals * 2;
+	//start with the node furthest away from the first portal
+	from = lr->landmarkfrom;
+	AAS_LandmarkTravelTimes(lr, search, AAS_LandmarkNode(1, aasworld.portals[1].frontcluster), qfalse, from, lr->numlandmarks);
+	bestnode = 2;
+	bestt = 0;
+	for (node = 2; node < numnodes; node++)
+	{
+		t = from[node * lr->numlandmarks];
+		if (t != LANDMARK_INFINITE && t > bestt)
+		{
+			bestt = t;
+			bestnode = node;
+		} //end if
+	} //end for
+	for (l = 0; l < lr->numlandmarks; l++)
+	{
+		AAS_LandmarkTravelTimes(lr, search, bestnode, qfalse, lr->landmarkfrom + l, lr->numlandmarks);
+		AAS_LandmarkTravelTimes(lr, search, bestnode, qtrue, lr->landmarkto + l, lr->numlandmarks);
+		//find the node furthest away from all landmarks so far, nodes
+		//no landmark reaches are taken first
+		bestnode = -1;
+		bestt = 0;
+		for (node = 2; node < numnodes; node++)
+		{
+			mint = LANDMARK_INFINITE;
+			for (i = 0; i <= l; i++)
+			{
+				t = lr->landmarkfrom[node * lr->numlandmarks + i];
+				if (t < mint) mint = t;
+			} //end for
+			if (mint > bestt)
+			{
+				bestt = mint;
+				bestnode = node;
+			} //end if
+		} //end for
+		//every node is a landmark, the remaining landmarks are duplicates
+		if (bestnode < 0) bestnode = 2;
+	} //end for
+} //end of the function AAS_SelectLandmarks
+//===========================================================================
+// travel times from every area of the cluster towards every portal of the
+// cluster, the cache must hold the areas of the largest cluster
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_LandmarkClusterTravelTimes(aas_landmarkrouting_t *lr, int clusternum, aas_routingcache_t *cache)
+{
+	int j, n, index;
+	aas_cluster_t *cluster;
+
+	cluster = &aasworld.clusters[clusternum];
+	index = lr->clusteroffset[clusternum];
+	for (n = 0; n < cluster->numportals; n++)
+	{
+		Com_Memset(cache->traveltimes, 0, cluster->numreachabilityareas * sizeof(unsigned short int));
+		cache->cluster = clusternum;
+		cache->areanum = aasworld.portals[aasworld.portalindex[cluster->firstportal + n]].areanum;
+		cache->starttraveltime = 1;
+		cache->travelflags = lr->travelflags;
+		AAS_UpdateAreaRoutingCache(cache);
+		for (j = 0; j < cluster->numreachabilityareas; j++)
+		{
+			lr->portaltraveltimes[index + j] = cache->traveltimes[j];
+			lr->portalreachabilities[index + j] = cache->reachabilities[j];
+		} //end for
+		index += cluster->numreachabilityareas;
+	} //end for
+} //end of the function AAS_LandmarkClusterTravelTimes
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static aas_landmarkrouting_t *AAS_CreateLandmarkRouting(int travelflags)
+{
+	int i, size, numtraveltimes, maxareas, numnodes, index, clusternum;
+	int *disabled, numdisabled;
+	aas_cluster_t *cluster;
+	aas_routingcache_t *cache;
+	aas_landmarkrouting_t *lr;
+	aas_landmarksearch_t *search;
+
+	numnodes = aasworld.numportals * 2;
+	numtraveltimes = 0;
+	maxareas = 0;
+	for (i = 1; i < aasworld.numclusters; i++)
+	{
+		cluster = &aasworld.clusters[i];
+		numtraveltimes += cluster->numportals * cluster->numreachabilityareas;
+		if (cluster->numreachabilityareas > maxareas) maxareas = cluster->numreachabilityareas;
+	} //end for
+	size = sizeof(aas_landmarkrouting_t) + aasworld.numclusters * sizeof(int) +
+				numtraveltimes * (sizeof(unsigned short int) + sizeof(unsigned char)) +
+				2 * maxlandmarks * numnodes * sizeof(unsigned short int);
+	lr = (aas_landmarkrouting_t *) GetClearedMemory(size);
+	lr->travelflags = travelflags;
+	lr->size = size;
+	lr->numlandmarks = maxlandmarks;
+	//the int array goes first so every array is aligned
+	lr->clusteroffset = (int *) (lr + 1);
+	lr->landmarkto = (unsigned short int *) (lr->clusteroffset + aasworld.numclusters);
+	lr->landmarkfrom = lr->landmarkto + maxlandmarks * numnodes;
+	lr->portaltraveltimes = lr->landmarkfrom + maxlandmarks * numnodes;
+	lr->portalreachabilities = (unsigned char *) (lr->portaltraveltimes + numtraveltimes);
+	for (i = 1, index = 0; i < aasworld.numclusters; i++)
+	{
+		lr->clusteroffset[i] = index;
+		index += aasworld.clusters[i].numportals * aasworld.clusters[i].numreachabilityareas;
+	} //end for
+	//the landmarks are selected with all areas enabled
+	disabled = (int *) GetMemory(aasworld.numareas * sizeof(int));
+	for (i = 1, numdisabled = 0; i < aasworld.numareas; i++)
+	{
+		if (aasworld.areasettings[i].areaflags & AREA_DISABLED)
+		{
+			aasworld.areasettings[i].areaflags &= ~AREA_DISABLED;
+			disabled[numdisabled++] = i;
+		} //end if
+	} //end for
+	//travel times from every cluster area towards every portal of the cluster
+	cache = AAS_AllocRoutingCache(maxareas);
+	for (i = 1; i < aasworld.numclusters; i++)
+	{
+		AAS_LandmarkClusterTravelTimes(lr, i, cache);
+	} //end for
+	//
+	if (lr->numlandmarks > 0 && aasworld.numportals > 1)
+	{
+		search = AAS_GetLandmarkSearch();
+		AAS_SelectLandmarks(lr, search);
+		AAS_ReleaseLandmarkSearch(search);
+	} //end if
+	else
+	{
+		lr->numlandmarks = 0;
+	} //end else
+	//the portal travel times use the areas that are disabled
+	for (i = 0; i < numdisabled; i++)
+	{
+		aasworld.areasettings[disabled[i]].areaflags |= AREA_DISABLED;
+	} //end for
+	for (i = 0; i < numdisabled; i++)
+	{
+		clusternum = aasworld.areasettings[disabled[i]].cluster;
+		if (clusternum > 0)
+		{
+			AAS_LandmarkClusterTravelTimes(lr, clusternum, cache);
+		} //end if
+		else
+		{
+			AAS_LandmarkClusterTravelTimes(lr, aasworld.portals[-clusternum].frontcluster, cache);
+			AAS_LandmarkClusterTravelTimes(lr, aasworld.portals[-clusternum].backcluster, cache);
+		} //end else
+	} //end for
+	FreeMemory(disabled);
+	//the cache was never linked
+	AAS_FreeRoutingCacheMemory(cache);
+	return lr;
+} //end of the function AAS_CreateLandmarkRouting
+//===========================================================================
+// returns the landmark tables for the travel flags, or NULL when there
+// are none and they're not created
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static aas_landmarkrouting_t *AAS_LandmarkRouting(int travelflags, qboolean create)
+{
+	int n;
+	aas_landmarkrouting_t *lr;
+
+	for (lr = aasworld.landmarkrouting, n = 0; lr; lr = lr->next, n++)
+	{
+		if (lr->travelflags == travelflags) return lr;
+	} //end for
+	//tables are only built outside of bot jobs so they never change while being read
+	if (!create || maxlandmarks <= 0 || n >= MAX_LANDMARKROUTINGS || botlibglobals.runningjobs)
+	{
+		return NULL;
+	} //end if
+	lr = AAS_CreateLandmarkRouting(travelflags);
+	lr->next = aasworld.landmarkrouting;
+	aasworld.landmarkrouting = lr;
+	return lr;
+} //end of the function AAS_LandmarkRouting
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void AAS_InitLandmarkRouting(void)
+{
+	AAS_FreeLandmarkRouting();
+	maxlandmarks = (int) LibVarValue("maxlandmarks", "16");
+	if (maxlandmarks > MAX_LANDMARKS) maxlandmarks = MAX_LANDMARKS;
+	AAS_LandmarkRouting(TFL_DEFAULT, qtrue);
+} //end of the function AAS_InitLandmarkRouting
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void AAS_FreeLandmarkRouting(void)
+{
+	aas_landmarkrouting_t *lr, *nextlr;
+	aas_landmarksearch_t *search, *nextsearch;
+
+	for (lr = aasworld.landmarkrouting; lr; lr = nextlr)
+	{
+		nextlr = lr->next;
+		FreeMemory(lr);
+	} //end for
+	aasworld.landmarkrouting = NULL;
+	for (search = aasworld.landmarksearches; search; search = nextsearch)
+	{
+		nextsearch = search->next;
+		FreeMemory(search);
+	} //end for
+	aasworld.landmarksearches = NULL;
+} //end of the function AAS_FreeLandmarkRouting
+//===========================================================================
+// updates the portal travel times of the clusters the area is in after
+// the area was enabled or disabled, the landmark travel times are kept
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void AAS_UpdateLandmarkRouting(int areanum)
+{
+	int i, clusternums[2], numclusters, maxareas;
+	aas_landmarkrouting_t *lr;
+	aas_routingcache_t *cache;
+
+	if (!aasworld.landmarkrouting) return;
+	clusternums[0] = aasworld.areasettings[areanum].cluster;
+	numclusters = 1;
+	if (clusternums[0] <= 0)
+	{
+		clusternums[1] = aasworld.portals[-clusternums[0]].backcluster;
+		clusternums[0] = aasworld.portals[-clusternums[0]].frontcluster;
+		numclusters = 2;
+	} //end if
+	maxareas = 0;
+	for (i = 0; i < numclusters; i++)
+	{
+		if (aasworld.clusters[clusternums[i]].numreachabilityareas > maxareas)
+			maxareas = aasworld.clusters[clusternums[i]].numreachabilityareas;
+	} //end for
+	cache = AAS_AllocRoutingCache(maxareas);
+	for (lr = aasworld.landmarkrouting; lr; lr = lr->next)
+	{
+		for (i = 0; i < numclusters; i++)
+		{
+			AAS_LandmarkClusterTravelTimes(lr, clusternums[i], cache);
+		} //end for
+	} //end for
+	AAS_FreeRoutingCacheMemory(cache);
+} //end of the function AAS_UpdateLandmarkRouting
+//===========================================================================
+// lower bound for the travel time from the node to the goal from the
+// travel times between the landmarks and the goal nodes, plus the lowest
+// travel time from a goal node to the goal area
+//
+// Parameter:			-
+// Returns:				LANDMARK_NOESTIMATE when the goal can't be reached
+// Changes Globals:		-
+//===========================================================================
+static unsigned int AAS_LandmarkEstimate(aas_landmarkrouting_t *lr, int node,
+								unsigned int *goalto, unsigned int *goalfrom, unsigned int goaltime)
+{
+	int l;
+	unsigned int to, from, estimate;
+	unsigned short int *nodeto, *nodefrom;
+
+	nodeto = lr->landmarkto + node * lr->numlandmarks;
+	nodefrom = lr->landmarkfrom + node * lr->numlandmarks;
+	estimate = 0;
+	for (l = 0; l < lr->numlandmarks; l++)
+	{
+		to = nodeto[l];
+		from = nodefrom[l];
+		//the landmark is reached from the goal but not from the node or
+		//the node is reached from the landmark but the goal isn't
+		if ((to == LANDMARK_INFINITE && goalto[l] < LANDMARK_INFINITE) ||
+				(from < LANDMARK_INFINITE && goalfrom[l] == LANDMARK_INFINITE))
+		{
+			return LANDMARK_NOESTIMATE;
+		} //end if
+		//saturated travel times are no bound
+		if (to < LANDMARK_MAXTIME && goalto[l] < LANDMARK_MAXTIME && to > goalto[l] + estimate)
+		{
+			estimate = to - goalto[l];
+		} //end if
+		if (from < LANDMARK_MAXTIME && goalfrom[l] < LANDMARK_INFINITE && goalfrom[l] > from + estimate)
+		{
+			estimate = goalfrom[l] - from;
+		} //end if
+	} //end for
+	//every route ends with the travel time from a goal node to the goal area
+	return estimate + goaltime;
+} //end of the function AAS_LandmarkEstimate
+//===========================================================================
+// travel time from the goal node to the goal area, 0 if it isn't a goal node.
+// Like the portal cache, a goal portal is only reached from its front cluster.
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static ID_INLINE unsigned int AAS_LandmarkGoalTravelTime(int node, int goalclusternum,
+								int goalportalnum, aas_routingcache_t *goalcache)
+{
+	int clusterareanum;
+
+	if ((node >> 1) == goalportalnum) return (node & 1);
+	if (AAS_LandmarkNodeCluster(node) != goalclusternum) return 0;
+	clusterareanum = AAS_ClusterAreaNum(goalclusternum, aasworld.portals[node >> 1].areanum);
+	if (clusterareanum >= aasworld.clusters[goalclusternum].numreachabilityareas) return 0;
+	if (!goalcache->traveltimes[clusterareanum]) return 0;
+	return goalcache->traveltimes[clusterareanum] + 1;
+} //end of the function AAS_LandmarkGoalTravelTime
+//===========================================================================
+// route from the area to a goal area in another cluster with A* over the
+// portal graph
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static int AAS_LandmarkRouteToGoalArea(aas_landmarkrouting_t *lr, int areanum, vec3_t origin,
+								int goalareanum, int *traveltime, int *reachnum)
+{
+	int i, l, s, n, node, portalnum, clusternum, clusterareanum, index;
+	int goalclusternum, goalportalnum, startclusters[2], numstartclusters, bestreachnum, rn;
+	unsigned int t, to, from, estimate, besttime, goaltime;
+	unsigned int goalto[MAX_LANDMARKS], goalfrom[MAX_LANDMARKS];
+	aas_cluster_t *cluster;
+	aas_portal_t *portal;
+	aas_routingcache_t *goalcache;
+	aas_landmarksearch_t *search;
+
+	//if the goal area is a portal just assume it's part of the front cluster
+	goalclusternum = aasworld.areasettings[goalareanum].cluster;
+	goalportalnum = 0;
+	if (goalclusternum < 0)
+	{
+		goalportalnum = -goalclusternum;
+		goalclusternum = aasworld.portals[goalportalnum].frontcluster;
+	} //end if
+	goalcache = AAS_GetAreaRoutingCache(goalclusternum, goalareanum, lr->travelflags);
+	//travel times between the landmarks and the nearest goal nodes
+	cluster = &aasworld.clusters[goalclusternum];
+	goaltime = goalportalnum ? 1 : 0;
+	for (i = 0; i < cluster->numportals && goaltime != 1; i++)
+	{
+		node = AAS_LandmarkNode(aasworld.portalindex[cluster->firstportal + i], goalclusternum);
+		t = AAS_LandmarkGoalTravelTime(node, goalclusternum, goalportalnum, goalcache);
+		if (t && (!goaltime || t < goaltime)) goaltime = t;
+	} //end for
+	//the goal can't be reached from outside the cluster
+	if (!goaltime) return qfalse;
+	for (l = 0; l < lr->numlandmarks; l++)
+	{
+		goalto[l] = 0;
+		goalfrom[l] = LANDMARK_INFINITE;
+		for (i = 0; i <= cluster->numportals; i++)
+		{
+			if (i < cluster->numportals)
+			{
+				node = AAS_LandmarkNode(aasworld.portalindex[cluster->firstportal + i], goalclusternum);
+			} //end if
+			else if (goalportalnum)
+			{
+				node = AAS_LandmarkNode(goalportalnum, aasworld.portals[goalportalnum].backcluster);
+			} //end else if
+			else break;
+			to = lr->landmarkto[node * lr->numlandmarks + l];
+			from = lr->landmarkfrom[node * lr->numlandmarks + l];
+			if (to > goalto[l]) goalto[l] = to;
+			if (from < goalfrom[l]) goalfrom[l] = from;
+		} //end for
+	} //end for
+	//
+	search = AAS_GetLandmarkSearch();
+	//leave the start area through the portals of its cluster, or through
+	//both clusters when the area is a portal itself
+	clusternum = aasworld.areasettings[areanum].cluster;
+	if (clusternum > 0)
+	{
+		startclusters[0] = clusternum;
+		numstartclusters = 1;
+	} //end if
+	else
+	{
+		portal = &aasworld.portals[-clusternum];
+		startclusters[0] = portal->frontcluster;
+		startclusters[1] = portal->backcluster;
+		numstartclusters = 2;
+	} //end else
+	for (s = 0; s < numstartclusters; s++)
+	{
+		clusternum = startclusters[s];
+		cluster = &aasworld.clusters[clusternum];
+		clusterareanum = AAS_ClusterAreaNum(clusternum, areanum);
+		if (clusterareanum >= cluster->numreachabilityareas) continue;
+		for (i = 0; i < cluster->numportals; i++)
+		{
+			portalnum = aasworld.portalindex[cluster->firstportal + i];
+			if (aasworld.portals[portalnum].areanum == areanum) continue;
+			index = AAS_LandmarkPortalIndex(lr, clusternum, i, clusterareanum);
+			t = lr->portaltraveltimes[index];
+			if (!t) continue;
+			t += aasworld.portalmaxtraveltimes[portalnum];
+			rn = aasworld.areasettings[areanum].firstreachablearea + lr->portalreachabilities[index];
+			//like the portal cache, routes from a portal start at the portal
+			if (origin && numstartclusters == 1)
+			{
+				t += AAS_AreaTravelTime(areanum, origin, aasworld.reachability[rn].start);
+			} //end if
+			node = AAS_LandmarkNode(portalnum, AAS_PortalOtherCluster(portalnum, clusternum));
+			estimate = AAS_LandmarkEstimate(lr, node, goalto, goalfrom, goaltime);
+			if (estimate == LANDMARK_NOESTIMATE) continue;
+			AAS_LandmarkVisitNode(search, node, t, estimate, rn);
+		} //end for
+	} //end for
+	//
+	besttime = 0;
+	bestreachnum = -1;
+	while (search->heapsize)
+	{
+		node = AAS_LandmarkHeapPop(search);
+		//no route through the remaining nodes can be faster
+		if (bestreachnum >= 0 && search->cost[node] >= besttime) break;
+		//if the goal can be reached from this node
+		t = AAS_LandmarkGoalTravelTime(node, goalclusternum, goalportalnum, goalcache);
+		if (t)
+		{
+			t += search->traveltime[node];
+			if (bestreachnum < 0 || t < besttime)
+			{
+				besttime = t;
+				bestreachnum = search->reachnum[node];
+			} //end if
+		} //end if
+		//travel through the cluster towards its other portals
+		portalnum = node >> 1;
+		clusternum = AAS_LandmarkNodeCluster(node);
+		cluster = &aasworld.clusters[clusternum];
+		clusterareanum = AAS_ClusterAreaNum(clusternum, aasworld.portals[portalnum].areanum);
+		if (clusterareanum >= cluster->numreachabilityareas) continue;
+		for (i = 0; i < cluster->numportals; i++)
+		{
+			n = aasworld.portalindex[cluster->firstportal + i];
+			if (n == portalnum) continue;
+			t = lr->portaltraveltimes[AAS_LandmarkPortalIndex(lr, clusternum, i, clusterareanum)];
+			if (!t) continue;
+			t += search->traveltime[node] + aasworld.portalmaxtraveltimes[n];
+			n = AAS_LandmarkNode(n, AAS_PortalOtherCluster(n, clusternum));
+			if (search->nodestamp[n] == search->stamp)
+			{
+				estimate = 0;
+			} //end if
+			else
+			{
+				estimate = AAS_LandmarkEstimate(lr, n, goalto, goalfrom, goaltime);
+				if (estimate == LANDMARK_NOESTIMATE) continue;
+			} //end else
+			AAS_LandmarkVisitNode(search, n, t, estimate, search->reachnum[node]);
+		} //end for
+	} //end while
+	AAS_ReleaseLandmarkSearch(search);
+	//
+	if (bestreachnum < 0) return qfalse;
+	*traveltime = besttime;
+	*reachnum = bestreachnum;
+	return qtrue;
+} //end of the function AAS_LandmarkRouteToGoalArea
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void AAS_UpdatePortalRoutingCache(aas_routingcache_t *portalcache)
+{
+	int i, n, portalnum, clusterareanum, clusternum;
+	unsigned short int t;
+	aas_portal_t *portal;
+	aas_cluster_t *cluster;
+	aas_routingcache_t *cache;
+	aas_routingupdate_t *updateliststart, *updatelistend, *curupdate, *nextupdate;
+	aas_landmarkrouting_t *lr;
+
+#ifdef ROUTING_DEBUG
+	numportalcacheupdates++;
+#endif //ROUTING_DEBUG
+	aasworld.frameportalupdates++;
+	//travel times towards portals are read from the landmark tables when available
+	lr = AAS_LandmarkRouting(portalcache->travelflags, qfalse);
+	//clear the routing update fields
+//	Com_Memset(aasworld.portalupdate, 0, (aasworld.numportals+1) * sizeof(aas_routingupdate_t));
+	//
 	curupdate = &aasworld.portalupdate[aasworld.numportals];
 	curupdate->cluster = portalcache->cluster;
 	curupdate->areanum = portalcache->areanum;
@@ -1488,9 +2652,22 @@ void AAS_UpdatePortalRoutingCache(aas_routingcache_t *portalcache)
 		curupdate->inlist = qfalse;
 		//
 		cluster = &aasworld.clusters[curupdate->cluster];
-		//
-		cache = AAS_GetAreaRoutingCache(curupdate->cluster,
+		//index of the portal of the current update in the landmark tables
+		n = cluster->numportals;
+		if (lr && aasworld.areasettings[curupdate->areanum].cluster < 0)
+		{
+			for (n = 0; n < cluster->numportals; n++)
+			{
+				portalnum = aasworld.portalindex[cluster->firstportal + n];
+				if (aasworld.portals[portalnum].areanum == curupdate->areanum) break;
+			} //end for
+		} //end if
+		cache = NULL;
+		if (n >= cluster->numportals)
+		{
+			cache = AAS_FindAreaRoutingCache(curupdate->cluster,
 								curupdate->areanum, portalcache->travelflags);
+		} //end if
 		//take all portals of the cluster
 		for (i = 0; i < cluster->numportals; i++)
 		{
@@ -1502,7 +2679,8 @@ void AAS_UpdatePortalRoutingCache(aas_routingcache_t *portalcache)
 			clusterareanum = AAS_ClusterAreaNum(curupdate->cluster, portal->areanum);
 			if (clusterareanum >= cluster->numreachabilityareas) continue;
 			//
-			t = cache->traveltimes[clusterareanum];
+			if (cache) t = cache->traveltimes[clusterareanum];
+			else t = lr->portaltraveltimes[AAS_LandmarkPortalIndex(lr, curupdate->cluster, n, clusterareanum)];
 			if (!t) continue;
 			t += curupdate->tmptraveltime;
 			//
@@ -1539,12 +2717,13 @@ void AAS_UpdatePortalRoutingCache(aas_routingcache_t *portalcache)
 	} //end while
 } //end of the function AAS_UpdatePortalRoutingCache
 //===========================================================================
+// the caller holds BLLOCK_ROUTING
 //
 // Parameter:			-
 // Returns:				-
 // Changes Globals:		-
 //===========================================================================
-aas_routingcache_t *AAS_GetPortalRoutingCache(int clusternum, int areanum, int travelflags)
+static aas_routingcache_t *AAS_FindPortalRoutingCache(int clusternum, int areanum, int travelflags, qboolean create)
 {
 	aas_routingcache_t *cache;
 
@@ -1556,6 +2735,7 @@ aas_routingcache_t *AAS_GetPortalRoutingCache(int clusternum, int areanum, int t
 	//if the portal routing isn't cached
 	if (!cache)
 	{
+		if (!create) return NULL;
 		cache = AAS_AllocRoutingCache(aasworld.numportals);
 		cache->cluster = clusternum;
 		cache->areanum = areanum;
@@ -1579,8 +2759,102 @@ aas_routingcache_t *AAS_GetPortalRoutingCache(int clusternum, int areanum, int t
 	cache->type = CACHETYPE_PORTAL;
 	AAS_LinkCache(cache);
 	return cache;
+} //end of the function AAS_FindPortalRoutingCache
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+aas_routingcache_t *AAS_GetPortalRoutingCache(int clusternum, int areanum, int travelflags)
+{
+	aas_routingcache_t *cache;
+
+	BotLibLock(BLLOCK_ROUTING);
+	cache = AAS_FindPortalRoutingCache(clusternum, areanum, travelflags, qtrue);
+	BotLibUnlock(BLLOCK_ROUTING);
+	return cache;
 } //end of the function AAS_GetPortalRoutingCache
 //===========================================================================
+// builds the area cache of every reachable area in every cluster it is in
+// and the portal cache of every reachable area, like the routing would ask
+// for them with the given travel flags, and prints reachability statistics.
+// Caches are only built while enough memory is left.
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+#define PRECOMPUTE_MINMEMORY		(1024 * 1024)
+
+void AAS_PrecomputeRoutingCache(int travelflags)
+{
+	int i, j, k, flags, numclusters, clusters[2];
+	int reachcount[MAX_TRAVELTYPES], noreach, numareacache, numportalcache, unreachable;
+	aas_routingcache_t *cache;
+	aas_portal_t *portal;
+
+	//reachability statistics
+	Com_Memset(reachcount, 0, sizeof(reachcount));
+	for (i = 1; i < aasworld.reachabilitysize; i++)
+	{
+		reachcount[aasworld.reachability[i].traveltype & TRAVELTYPE_MASK]++;
+	} //end for
+	noreach = 0;
+	for (i = 1; i < aasworld.numareas; i++)
+	{
+		if (!AAS_AreaReachability(i)) noreach++;
+	} //end for
+	botimport.Print(PRT_MESSAGE, "%d areas, %d without reachabilities, %d clusters, %d portals\n",
+					aasworld.numareas - 1, noreach, aasworld.numclusters - 1, aasworld.numportals - 1);
+	for (i = 0; i < MAX_TRAVELTYPES; i++)
+	{
+		if (!reachcount[i]) continue;
+		botimport.Print(PRT_MESSAGE, "%6d %s\n", reachcount[i], AAS_TravelTypeName(i));
+	} //end for
+	//build the caches
+	numareacache = 0;
+	numportalcache = 0;
+	unreachable = 0;
+	for (i = 1; i < aasworld.numareas; i++)
+	{
+		if (!AAS_AreaReachability(i)) continue;
+		if (botimport.AvailableMemory() < PRECOMPUTE_MINMEMORY)
+		{
+			botimport.Print(PRT_WARNING, "out of memory after %d area and %d portal caches\n",
+								numareacache, numportalcache);
+			break;
+		} //end if
+		flags = travelflags;
+		if (AAS_AreaDoNotEnter(i)) flags |= TFL_DONOTENTER;
+		//the clusters the area is in
+		clusters[0] = aasworld.areasettings[i].cluster;
+		numclusters = 1;
+		if (clusters[0] < 0)
+		{
+			portal = &aasworld.portals[-clusters[0]];
+			clusters[0] = portal->frontcluster;
+			clusters[1] = portal->backcluster;
+			if (clusters[1] != clusters[0]) numclusters = 2;
+		} //end if
+		for (j = 0; j < numclusters; j++)
+		{
+			cache = AAS_GetAreaRoutingCache(clusters[j], i, flags);
+			numareacache++;
+			//count the areas in the cluster the area can't be reached from
+			for (k = 0; k < aasworld.clusters[clusters[j]].numreachabilityareas; k++)
+			{
+				if (!cache->traveltimes[k]) unreachable++;
+			} //end for
+		} //end for
+		AAS_GetPortalRoutingCache(clusters[0], i, flags);
+		numportalcache++;
+	} //end for
+	botimport.Print(PRT_MESSAGE, "%d area caches, %d portal caches, %d KB newly built\n",
+					numareacache, numportalcache, routingcachesize >> 10);
+	botimport.Print(PRT_MESSAGE, "%d area pairs within clusters without a route\n", unreachable);
+} //end of the function AAS_PrecomputeRoutingCache
+//===========================================================================
 //
 // Parameter:			-
 // Returns:				-
@@ -1588,12 +2862,13 @@ aas_routingcache_t *AAS_GetPortalRoutingCache(int clusternum, int areanum, int t
 //===========================================================================
 int AAS_AreaRouteToGoalArea(int areanum, vec3_t origin, int goalareanum, int travelflags, int *traveltime, int *reachnum)
 {
-	int clusternum, goalclusternum, portalnum, i, clusterareanum, bestreachnum;
-	unsigned short int t, besttime;
+	int clusternum, goalclusternum, portalnum, i, clusterareanum, bestreachnum, index, portalreach;
+	unsigned short int t, besttime, portaltime;
 	aas_portal_t *portal;
 	aas_cluster_t *cluster;
 	aas_routingcache_t *areacache, *portalcache;
 	aas_reachability_t *reach;
+	aas_landmarkrouting_t *landmarkrouting;
 
 	if (!aasworld.initialized) return qfalse;
 
@@ -1626,7 +2901,8 @@ int AAS_AreaRouteToGoalArea(int areanum, vec3_t origin, int goalareanum, int tra
 	} //end if
 
 	// make sure the routing cache doesn't grow to large
-	while ( routingcachesize > 12 * 1024 * 1024 ) {
+	// bot jobs may still be reading caches, so only free them outside of jobs
+	while ( !botlibglobals.runningjobs && routingcachesize > 12 * 1024 * 1024 ) {
 		if ( !AAS_FreeOldestCache() ) {
 			break;
 		}
@@ -1708,8 +2984,25 @@ int AAS_AreaRouteToGoalArea(int areanum, vec3_t origin, int goalareanum, int tra
 		portal = &aasworld.portals[-goalclusternum];
 		goalclusternum = portal->frontcluster;
 	} //end if
-	//get the portal routing cache
-	portalcache = AAS_GetPortalRoutingCache(goalclusternum, goalareanum, travelflags);
+	landmarkrouting = AAS_LandmarkRouting(travelflags, qtrue);
+	if (landmarkrouting)
+	{
+		//with landmark tables a missing portal cache is only created outside of
+		//bot jobs and for a few goals each frame, other routes are searched
+		BotLibLock(BLLOCK_ROUTING);
+		portalcache = AAS_FindPortalRoutingCache(goalclusternum, goalareanum, travelflags,
+								!botlibglobals.runningjobs && aasworld.frameportalupdates < MAX_FRAMEPORTALUPDATES);
+		BotLibUnlock(BLLOCK_ROUTING);
+		if (!portalcache)
+		{
+			return AAS_LandmarkRouteToGoalArea(landmarkrouting, areanum, origin, goalareanum, traveltime, reachnum);
+		} //end if
+	} //end if
+	else
+	{
+		//get the portal routing cache
+		portalcache = AAS_GetPortalRoutingCache(goalclusternum, goalareanum, travelflags);
+	} //end else
 	//if the area is a cluster portal, read directly from the portal cache
 	if (clusternum < 0)
 	{
@@ -1731,17 +3024,28 @@ int AAS_AreaRouteToGoalArea(int areanum, vec3_t origin, int goalareanum, int tra
 		if (!portalcache->traveltimes[portalnum]) continue;
 		//
 		portal = &aasworld.portals[portalnum];
-		//get the cache of the portal area
-		areacache = AAS_GetAreaRoutingCache(clusternum, portal->areanum, travelflags);
 		//current area inside the current cluster
 		clusterareanum = AAS_ClusterAreaNum(clusternum, areanum);
 		//if the area is NOT a reachability area
 		if (clusterareanum >= cluster->numreachabilityareas) continue;
+		//get the travel time towards the portal area from the landmark tables or the cache of the portal area
+		if (landmarkrouting)
+		{
+			index = AAS_LandmarkPortalIndex(landmarkrouting, clusternum, i, clusterareanum);
+			portaltime = landmarkrouting->portaltraveltimes[index];
+			portalreach = landmarkrouting->portalreachabilities[index];
+		} //end if
+		else
+		{
+			areacache = AAS_GetAreaRoutingCache(clusternum, portal->areanum, travelflags);
+			portaltime = areacache->traveltimes[clusterareanum];
+			portalreach = areacache->reachabilities[clusterareanum];
+		} //end else
 		//if the portal is NOT reachable from this area
-		if (!areacache->traveltimes[clusterareanum]) continue;
+		if (!portaltime) continue;
 		//total travel time is the travel time the portal area is from
 		//the goal area plus the travel time towards the portal area
-		t = portalcache->traveltimes[portalnum] + areacache->traveltimes[clusterareanum];
+		t = portalcache->traveltimes[portalnum] + portaltime;
 		//FIXME: add the exact travel time through the actual portal area
 		//NOTE: for now we just add the largest travel time through the portal area
 		//		because we can't directly calculate the exact travel time
@@ -1751,8 +3055,7 @@ int AAS_AreaRouteToGoalArea(int areanum, vec3_t origin, int goalareanum, int tra
 		//
 		if (origin)
 		{
-			*reachnum = aasworld.areasettings[areanum].firstreachablearea +
-							areacache->reachabilities[clusterareanum];
+			*reachnum = aasworld.areasettings[areanum].firstreachablearea + portalreach;
 			reach = aasworld.reachability + *reachnum;
 			t += AAS_AreaTravelTime(areanum, origin, reach->start);
 		} //end if
@@ -1792,6 +3095,50 @@ int AAS_AreaTravelTimeToGoalArea(int areanum, vec3_t origin, int goalareanum, in
 // Returns:				-
 // Changes Globals:		-
 //===========================================================================
+typedef struct aas_travelbatch_s
+{
+	int *traveltimes;
+	int *areanums;
+	vec3_t *origins;
+	int *goalareanums;
+	int travelflags;
+} aas_travelbatch_t;
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_TravelTimeJob(void *data, int index)
+{
+	aas_travelbatch_t *batch = (aas_travelbatch_t *) data;
+
+	batch->traveltimes[index] = AAS_AreaTravelTimeToGoalArea(batch->areanums[index],
+			batch->origins[index], batch->goalareanums[index], batch->travelflags);
+} //end of the function AAS_TravelTimeJob
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void AAS_AreaTravelTimeToGoalAreaBatch(int *traveltimes, int numqueries, int *areanums, vec3_t *origins, int *goalareanums, int travelflags)
+{
+	aas_travelbatch_t batch;
+
+	batch.traveltimes = traveltimes;
+	batch.areanums = areanums;
+	batch.origins = origins;
+	batch.goalareanums = goalareanums;
+	batch.travelflags = travelflags;
+	BotLibRunJobs(AAS_TravelTimeJob, &batch, numqueries);
+} //end of the function AAS_AreaTravelTimeToGoalAreaBatch
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
 int AAS_AreaReachabilityToGoalArea(int areanum, vec3_t origin, int goalareanum, int travelflags)
 {
 	int traveltime, reachnum = 0;
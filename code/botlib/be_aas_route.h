@@ -34,11 +34,20 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 void AAS_InitRouting(void);
 //free the AAS routing caches
 void AAS_FreeRoutingCaches(void);
+//return unused routing cache memory to the engine
+void AAS_CompactRoutingCaches(void);
 //returns the travel time from start to end in the given area
 unsigned short int AAS_AreaTravelTime(int areanum, vec3_t start, vec3_t end);
 //
 void AAS_CreateAllRoutingCache(void);
+void AAS_PrecomputeRoutingCache(int travelflags);
 void AAS_WriteRouteCache(void);
+//build the landmark routing tables for the default travel flags
+void AAS_InitLandmarkRouting(void);
+//free all landmark routing tables
+void AAS_FreeLandmarkRouting(void);
+//update the landmark routing tables after the area was enabled or disabled
+void AAS_UpdateLandmarkRouting(int areanum);
 //
 void AAS_RoutingInfo(void);
 #endif //AASINTERN
@@ -59,6 +68,8 @@ int AAS_EnableRoutingArea(int areanum, int enable);
 unsigned short int AAS_AreaTravelTime(int areanum, vec3_t start, vec3_t end);
 //returns the travel time from the area to the goal area using the given travel flags
 int AAS_AreaTravelTimeToGoalArea(int areanum, vec3_t origin, int goalareanum, int travelflags);
+//travel times for a batch of queries, resolved as bot jobs
+void AAS_AreaTravelTimeToGoalAreaBatch(int *traveltimes, int numqueries, int *areanums, vec3_t *origins, int *goalareanums, int travelflags);
 //predict a route up to a stop event
 int AAS_PredictRoute(struct aas_predictroute_s *route, int areanum, vec3_t origin,
 							int goalareanum, int travelflags, int maxareas, int maxtime,
@@ -53,6 +53,13 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 #define TRACEPLANE_EPSILON			0.125
 
+#define NODECACHE_MINCELLSIZE		32
+#define NODECACHE_MAXCELLS			(1 << 19)
+//distance to the planes above the cached node
+#define NODECACHE_EPSILON			1
+
+#define MAX_RELINKAREAS				128
+
 typedef struct aas_tracestack_s
 {
 	vec3_t start;		//start point of the piece of line to trace
@@ -146,10 +153,14 @@ aas_link_t *AAS_AllocAASLink(void)
 {
 	aas_link_t *link;
 
+#ifndef BSPC
+	BotLibLock(BLLOCK_LINKHEAP);
+#endif
 	link = aasworld.freelinks;
 	if (!link)
 	{
 #ifndef BSPC
+		BotLibUnlock(BLLOCK_LINKHEAP);
 		if (botDeveloper)
 #endif
 		{
@@ -160,6 +171,9 @@ aas_link_t *AAS_AllocAASLink(void)
 	if (aasworld.freelinks) aasworld.freelinks = aasworld.freelinks->next_ent;
 	if (aasworld.freelinks) aasworld.freelinks->prev_ent = NULL;
 	numaaslinks--;
+#ifndef BSPC
+	BotLibUnlock(BLLOCK_LINKHEAP);
+#endif
 	return link;
 } //end of the function AAS_AllocAASLink
 //===========================================================================
@@ -170,6 +184,9 @@ aas_link_t *AAS_AllocAASLink(void)
 //===========================================================================
 void AAS_DeAllocAASLink(aas_link_t *link)
 {
+#ifndef BSPC
+	BotLibLock(BLLOCK_LINKHEAP);
+#endif
 	if (aasworld.freelinks) aasworld.freelinks->prev_ent = link;
 	link->prev_ent = NULL;
 	link->next_ent = aasworld.freelinks;
@@ -177,6 +194,9 @@ void AAS_DeAllocAASLink(aas_link_t *link)
 	link->next_area = NULL;
 	aasworld.freelinks = link;
 	numaaslinks++;
+#ifndef BSPC
+	BotLibUnlock(BLLOCK_LINKHEAP);
+#endif
 } //end of the function AAS_DeAllocAASLink
 //===========================================================================
 //
@@ -203,6 +223,243 @@ void AAS_FreeAASLinkedEntities(void)
 	aasworld.arealinkedentities = NULL;
 } //end of the function AAS_InitAASLinkedEntities
 //===========================================================================
+// returns the node to start from for points and boxes inside the given
+// bounds, every plane above the node has the bounds completely at one side
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+int AAS_BoundsStartNode(vec3_t mins, vec3_t maxs)
+{
+	int nodenum, i;
+	float dist1, dist2;
+	aas_node_t *node;
+	aas_plane_t *plane;
+
+	nodenum = 1;
+	while(nodenum > 0)
+	{
+		node = &aasworld.nodes[nodenum];
+		plane = &aasworld.planes[node->planenum];
+		//distances of the corners furthest in front of and behind the plane
+		dist1 = dist2 = -plane->dist;
+		for (i = 0; i < 3; i++)
+		{
+			if (plane->normal[i] < 0)
+			{
+				dist1 += plane->normal[i] * mins[i];
+				dist2 += plane->normal[i] * maxs[i];
+			} //end if
+			else
+			{
+				dist1 += plane->normal[i] * maxs[i];
+				dist2 += plane->normal[i] * mins[i];
+			} //end else
+		} //end for
+		if (dist2 > NODECACHE_EPSILON) nodenum = node->children[0];
+		else if (dist1 < -NODECACHE_EPSILON) nodenum = node->children[1];
+		else break;
+	} //end while
+	return nodenum;
+} //end of the function AAS_BoundsStartNode
+//===========================================================================
+// stores the node to start from for every cell of a grid over the map,
+// the cell borders are half a cell away from the map bounds because
+// planes are often at multiples of the cell size from there
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+void AAS_InitNodeCache(void)
+{
+	int i, x, y, z, numcells;
+	float cellsize;
+	vec3_t mins, maxs, cellmins, cellmaxs;
+
+	AAS_FreeNodeCache();
+	if (!aasworld.loaded || aasworld.numareas <= 1 || aasworld.numnodes <= 1) return;
+	//bounds of all the areas
+	ClearBounds(mins, maxs);
+	for (i = 1; i < aasworld.numareas; i++)
+	{
+		AddPointToBounds(aasworld.areas[i].mins, mins, maxs);
+		AddPointToBounds(aasworld.areas[i].maxs, mins, maxs);
+	} //end for
+	//use larger cells for large maps
+	for (cellsize = NODECACHE_MINCELLSIZE; ; cellsize *= 2)
+	{
+		numcells = 1;
+		for (i = 0; i < 3; i++)
+		{
+			aasworld.nodecachesize[i] = (int) ((maxs[i] - mins[i]) / cellsize) + 2;
+			numcells *= aasworld.nodecachesize[i];
+		} //end for
+		if (numcells <= NODECACHE_MAXCELLS) break;
+	} //end for
+	VectorSet(cellmins, cellsize * 0.5, cellsize * 0.5, cellsize * 0.5);
+	VectorSubtract(mins, cellmins, aasworld.nodecachemins);
+	aasworld.nodecachecellsize = cellsize;
+	aasworld.nodecache = (int *) GetHunkMemory(numcells * sizeof(int));
+	//
+	i = 0;
+	for (z = 0; z < aasworld.nodecachesize[2]; z++)
+	{
+		for (y = 0; y < aasworld.nodecachesize[1]; y++)
+		{
+			for (x = 0; x < aasworld.nodecachesize[0]; x++)
+			{
+				VectorSet(cellmins, x, y, z);
+				VectorMA(aasworld.nodecachemins, cellsize, cellmins, cellmins);
+				VectorSet(cellmaxs, x + 1, y + 1, z + 1);
+				VectorMA(aasworld.nodecachemins, cellsize, cellmaxs, cellmaxs);
+				aasworld.nodecache[i++] = AAS_BoundsStartNode(cellmins, cellmaxs);
+			} //end for
+		} //end for
+	} //end for
+} //end of the function AAS_InitNodeCache
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+void AAS_FreeNodeCache(void)
+{
+	if (aasworld.nodecache) FreeMemory(aasworld.nodecache);
+	aasworld.nodecache = NULL;
+} //end of the function AAS_FreeNodeCache
+//===========================================================================
+// copies the bsp tree with the node planes next to the nodes and the face
+// index into arrays with 16-bit numbers, and the area presence types into
+// a byte array, so the samples and traces touch less memory. Each array is
+// only made when its numbers fit, the file structures stay for the rest
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+void AAS_InitCompactTree(void)
+{
+	int i;
+
+	AAS_FreeCompactTree();
+	if (!aasworld.loaded) return;
+	if (!(int)LibVarValue("aascompact", "1")) return;
+	//children are node numbers or negative area numbers
+	if (aasworld.numnodes > 0 && aasworld.numnodes <= 32768 && aasworld.numareas <= 32768 && aasworld.numplanes <= 65536)
+	{
+		aasworld.compactnodes = (aas_compactnode_t *) GetHunkMemory(aasworld.numnodes * sizeof(aas_compactnode_t));
+		for (i = 0; i < aasworld.numnodes; i++)
+		{
+			aasworld.compactnodes[i].plane = aasworld.planes[aasworld.nodes[i].planenum];
+			aasworld.compactnodes[i].planenum = aasworld.nodes[i].planenum;
+			aasworld.compactnodes[i].children[0] = aasworld.nodes[i].children[0];
+			aasworld.compactnodes[i].children[1] = aasworld.nodes[i].children[1];
+		} //end for
+	} //end if
+	//the face index holds negative face numbers for the back side of a face
+	if (aasworld.numfaces <= 32768 && aasworld.faceindexsize > 0)
+	{
+		aasworld.compactfaceindex = (short *) GetHunkMemory(aasworld.faceindexsize * sizeof(short));
+		for (i = 0; i < aasworld.faceindexsize; i++)
+		{
+			aasworld.compactfaceindex[i] = aasworld.faceindex[i];
+		} //end for
+	} //end if
+	for (i = 0; i < aasworld.numareasettings; i++)
+	{
+		if (aasworld.areasettings[i].presencetype & ~0xff) break;
+	} //end for
+	if (aasworld.numareasettings > 0 && i >= aasworld.numareasettings)
+	{
+		aasworld.areapresencetypes = (byte *) GetHunkMemory(aasworld.numareasettings * sizeof(byte));
+		for (i = 0; i < aasworld.numareasettings; i++)
+		{
+			aasworld.areapresencetypes[i] = aasworld.areasettings[i].presencetype;
+		} //end for
+	} //end if
+} //end of the function AAS_InitCompactTree
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+void AAS_FreeCompactTree(void)
+{
+	if (aasworld.compactnodes) FreeMemory(aasworld.compactnodes);
+	aasworld.compactnodes = NULL;
+	if (aasworld.compactfaceindex) FreeMemory(aasworld.compactfaceindex);
+	aasworld.compactfaceindex = NULL;
+	if (aasworld.areapresencetypes) FreeMemory(aasworld.areapresencetypes);
+	aasworld.areapresencetypes = NULL;
+} //end of the function AAS_FreeCompactTree
+//===========================================================================
+// returns the plane of the node and stores the plane number and children
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+static ID_INLINE aas_plane_t *AAS_NodePlane(int nodenum, int *planenum, int *children)
+{
+	aas_compactnode_t *cnode;
+	aas_node_t *node;
+
+	if (aasworld.compactnodes)
+	{
+		cnode = &aasworld.compactnodes[nodenum];
+		*planenum = cnode->planenum;
+		children[0] = cnode->children[0];
+		children[1] = cnode->children[1];
+		return &cnode->plane;
+	} //end if
+	node = &aasworld.nodes[nodenum];
+	*planenum = node->planenum;
+	children[0] = node->children[0];
+	children[1] = node->children[1];
+	return &aasworld.planes[node->planenum];
+} //end of the function AAS_NodePlane
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+static ID_INLINE int AAS_FaceIndex(int index)
+{
+	if (aasworld.compactfaceindex) return aasworld.compactfaceindex[index];
+	return aasworld.faceindex[index];
+} //end of the function AAS_FaceIndex
+//===========================================================================
+// returns the node to start from to find the area(s) of the box,
+// the root node if the box isn't inside a single cell of the node cache
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+int AAS_BoxStartNode(vec3_t absmins, vec3_t absmaxs)
+{
+	int i, cell[3];
+	float f;
+
+	if (!aasworld.nodecache) return 1;
+	for (i = 0; i < 3; i++)
+	{
+		f = (absmins[i] - aasworld.nodecachemins[i]) / aasworld.nodecachecellsize;
+		if (!(f >= 0)) return 1;
+		cell[i] = (int) f;
+		if (cell[i] >= aasworld.nodecachesize[i]) return 1;
+		f = (absmaxs[i] - aasworld.nodecachemins[i]) / aasworld.nodecachecellsize;
+		if (!(f < cell[i] + 1)) return 1;
+	} //end for
+	return aasworld.nodecache[(cell[2] * aasworld.nodecachesize[1] + cell[1]) *
+										aasworld.nodecachesize[0] + cell[0]];
+} //end of the function AAS_BoxStartNode
+//===========================================================================
 // returns the AAS area the point is in
 //
 // Parameter:				-
@@ -211,9 +468,8 @@ void AAS_FreeAASLinkedEntities(void)
 //===========================================================================
 int AAS_PointAreaNum(vec3_t point)
 {
-	int nodenum;
+	int nodenum, planenum, children[2];
 	vec_t	dist;
-	aas_node_t *node;
 	aas_plane_t *plane;
 
 	if (!aasworld.loaded)
@@ -222,8 +478,8 @@ int AAS_PointAreaNum(vec3_t point)
 		return 0;
 	} //end if
 
-	//start with node 1 because node zero is a dummy used for solid leafs
-	nodenum = 1;
+	//start with the cached node, all nodes above it have the point at the same side
+	nodenum = AAS_BoxStartNode(point, point);
 	while (nodenum > 0)
 	{
 //		botimport.Print(PRT_MESSAGE, "[%d]", nodenum);
@@ -234,18 +490,17 @@ int AAS_PointAreaNum(vec3_t point)
 			return 0;
 		} //end if
 #endif //AAS_SAMPLE_DEBUG
-		node = &aasworld.nodes[nodenum];
+		plane = AAS_NodePlane(nodenum, &planenum, children);
 #ifdef AAS_SAMPLE_DEBUG
-		if (node->planenum < 0 || node->planenum >= aasworld.numplanes)
+		if (planenum < 0 || planenum >= aasworld.numplanes)
 		{
-			botimport.Print(PRT_ERROR, "node->planenum = %d >= aasworld.numplanes = %d\n", node->planenum, aasworld.numplanes);
+			botimport.Print(PRT_ERROR, "node->planenum = %d >= aasworld.numplanes = %d\n", planenum, aasworld.numplanes);
 			return 0;
 		} //end if
 #endif //AAS_SAMPLE_DEBUG
-		plane = &aasworld.planes[node->planenum];
 		dist = DotProduct(point, plane->normal) - plane->dist;
-		if (dist > 0) nodenum = node->children[0];
-		else nodenum = node->children[1];
+		if (dist > 0) nodenum = children[0];
+		else nodenum = children[1];
 	} //end while
 	if (!nodenum)
 	{
@@ -448,12 +703,11 @@ qboolean AAS_AreaEntityCollision(int areanum, vec3_t start, vec3_t end,
 aas_trace_t AAS_TraceClientBBox(vec3_t start, vec3_t end, int presencetype,
 																				int passent)
 {
-	int side, nodenum, tmpplanenum;
+	int side, nodenum, tmpplanenum, planenum, children[2], areapresencetype;
 	float front, back, frac;
 	vec3_t cur_start, cur_end, cur_mid, v1, v2;
 	aas_tracestack_t tracestack[127];
 	aas_tracestack_t *tstack_p;
-	aas_node_t *aasnode;
 	aas_plane_t *plane;
 	aas_trace_t trace;
 
@@ -505,7 +759,9 @@ aas_trace_t AAS_TraceClientBBox(vec3_t start, vec3_t end, int presencetype,
 #endif //AAS_SAMPLE_DEBUG
 			//botimport.Print(PRT_MESSAGE, "areanum = %d, must be %d\n", -nodenum, AAS_PointAreaNum(start));
 			//if can't enter the area because it hasn't got the right presence type
-			if (!(aasworld.areasettings[-nodenum].presencetype & presencetype))
+			if (aasworld.areapresencetypes) areapresencetype = aasworld.areapresencetypes[-nodenum];
+			else areapresencetype = aasworld.areasettings[-nodenum].presencetype;
+			if (!(areapresencetype & presencetype))
 			{
 				//if the start point is still the initial start point
 				//NOTE: no need for epsilons because the points will be
@@ -596,14 +852,12 @@ aas_trace_t AAS_TraceClientBBox(vec3_t start, vec3_t end, int presencetype,
 			return trace;
 		} //end if
 #endif //AAS_SAMPLE_DEBUG
-		//the node to test against
-		aasnode = &aasworld.nodes[nodenum];
+		//the node to test against and the current node plane
+		plane = AAS_NodePlane(nodenum, &planenum, children);
 		//start point of current line to test against node
 		VectorCopy(tstack_p->start, cur_start);
 		//end point of the current line to test against node
 		VectorCopy(tstack_p->end, cur_end);
-		//the current node plane
-		plane = &aasworld.planes[aasnode->planenum];
 
 		switch(plane->type)
 		{/*FIXME: wtf doesn't this work? obviously the axial node planes aren't always facing positive!!!
@@ -640,7 +894,7 @@ aas_trace_t AAS_TraceClientBBox(vec3_t start, vec3_t end, int presencetype,
 		{
 			//keep the current start and end point on the stack
 			//and go down the tree with the front child
-			tstack_p->nodenum = aasnode->children[0];
+			tstack_p->nodenum = children[0];
 			tstack_p++;
 			if (tstack_p >= &tracestack[127])
 			{
@@ -654,7 +908,7 @@ aas_trace_t AAS_TraceClientBBox(vec3_t start, vec3_t end, int presencetype,
 		{
 			//keep the current start and end point on the stack
 			//and go down the tree with the back child
-			tstack_p->nodenum = aasnode->children[1];
+			tstack_p->nodenum = children[1];
 			tstack_p++;
 			if (tstack_p >= &tracestack[127])
 			{
@@ -690,8 +944,8 @@ aas_trace_t AAS_TraceClientBBox(vec3_t start, vec3_t end, int presencetype,
 			VectorCopy(cur_mid, tstack_p->start);
 			//not necessary to store because still on stack
 			//VectorCopy(cur_end, tstack_p->end);
-			tstack_p->planenum = aasnode->planenum;
-			tstack_p->nodenum = aasnode->children[!side];
+			tstack_p->planenum = planenum;
+			tstack_p->nodenum = children[!side];
 			tstack_p++;
 			if (tstack_p >= &tracestack[127])
 			{
@@ -704,7 +958,7 @@ aas_trace_t AAS_TraceClientBBox(vec3_t start, vec3_t end, int presencetype,
 			VectorCopy(cur_start, tstack_p->start);
 			VectorCopy(cur_mid, tstack_p->end);
 			tstack_p->planenum = tmpplanenum;
-			tstack_p->nodenum = aasnode->children[side];
+			tstack_p->nodenum = children[side];
 			tstack_p++;
 			if (tstack_p >= &tracestack[127])
 			{
@@ -724,13 +978,12 @@ aas_trace_t AAS_TraceClientBBox(vec3_t start, vec3_t end, int presencetype,
 //===========================================================================
 int AAS_TraceAreas(vec3_t start, vec3_t end, int *areas, vec3_t *points, int maxareas)
 {
-	int side, nodenum, tmpplanenum;
+	int side, nodenum, tmpplanenum, planenum, children[2];
 	int numareas;
 	float front, back, frac;
 	vec3_t cur_start, cur_end, cur_mid;
 	aas_tracestack_t tracestack[127];
 	aas_tracestack_t *tstack_p;
-	aas_node_t *aasnode;
 	aas_plane_t *plane;
 
 	numareas = 0;
@@ -787,14 +1040,12 @@ int AAS_TraceAreas(vec3_t start, vec3_t end, int *areas, vec3_t *points, int max
 			return numareas;
 		} //end if
 #endif //AAS_SAMPLE_DEBUG
-		//the node to test against
-		aasnode = &aasworld.nodes[nodenum];
+		//the node to test against and the current node plane
+		plane = AAS_NodePlane(nodenum, &planenum, children);
 		//start point of current line to test against node
 		VectorCopy(tstack_p->start, cur_start);
 		//end point of the current line to test against node
 		VectorCopy(tstack_p->end, cur_end);
-		//the current node plane
-		plane = &aasworld.planes[aasnode->planenum];
 
 		switch(plane->type)
 		{/*FIXME: wtf doesn't this work? obviously the node planes aren't always facing positive!!!
@@ -831,7 +1082,7 @@ int AAS_TraceAreas(vec3_t start, vec3_t end, int *areas, vec3_t *points, int max
 		{
 			//keep the current start and end point on the stack
 			//and go down the tree with the front child
-			tstack_p->nodenum = aasnode->children[0];
+			tstack_p->nodenum = children[0];
 			tstack_p++;
 			if (tstack_p >= &tracestack[127])
 			{
@@ -845,7 +1096,7 @@ int AAS_TraceAreas(vec3_t start, vec3_t end, int *areas, vec3_t *points, int max
 		{
 			//keep the current start and end point on the stack
 			//and go down the tree with the back child
-			tstack_p->nodenum = aasnode->children[1];
+			tstack_p->nodenum = children[1];
 			tstack_p++;
 			if (tstack_p >= &tracestack[127])
 			{
@@ -876,8 +1127,8 @@ int AAS_TraceAreas(vec3_t start, vec3_t end, int *areas, vec3_t *points, int max
 			VectorCopy(cur_mid, tstack_p->start);
 			//not necessary to store because still on stack
 			//VectorCopy(cur_end, tstack_p->end);
-			tstack_p->planenum = aasnode->planenum;
-			tstack_p->nodenum = aasnode->children[!side];
+			tstack_p->planenum = planenum;
+			tstack_p->nodenum = children[!side];
 			tstack_p++;
 			if (tstack_p >= &tracestack[127])
 			{
@@ -890,7 +1141,7 @@ int AAS_TraceAreas(vec3_t start, vec3_t end, int *areas, vec3_t *points, int max
 			VectorCopy(cur_start, tstack_p->start);
 			VectorCopy(cur_mid, tstack_p->end);
 			tstack_p->planenum = tmpplanenum;
-			tstack_p->nodenum = aasnode->children[side];
+			tstack_p->nodenum = children[side];
 			tstack_p++;
 			if (tstack_p >= &tracestack[127])
 			{
@@ -1027,7 +1278,7 @@ aas_face_t *AAS_AreaGroundFace(int areanum, vec3_t point)
 	area = &aasworld.areas[areanum];
 	for (i = 0; i < area->numfaces; i++)
 	{
-		facenum = aasworld.faceindex[area->firstface + i];
+		facenum = AAS_FaceIndex(area->firstface + i);
 		face = &aasworld.faces[abs(facenum)];
 		//if this is a ground face
 		if (face->faceflags & FACE_GROUND)
@@ -1078,7 +1329,7 @@ aas_face_t *AAS_TraceEndFace(aas_trace_t *trace)
 	//check which face the trace.endpos was in
 	for (i = 0; i < area->numfaces; i++)
 	{
-		facenum = aasworld.faceindex[area->firstface + i];
+		facenum = AAS_FaceIndex(area->firstface + i);
 		face = &aasworld.faces[abs(facenum)];
 		//if the face is in the same plane as the trace end point
 		if ((face->planenum & ~1) == (trace->planenum & ~1))
@@ -1221,10 +1472,9 @@ typedef struct
 
 aas_link_t *AAS_AASLinkEntity(vec3_t absmins, vec3_t absmaxs, int entnum)
 {
-	int side, nodenum;
+	int side, nodenum, planenum, children[2];
 	aas_linkstack_t linkstack[128];
 	aas_linkstack_t *lstack_p;
-	aas_node_t *aasnode;
 	aas_plane_t *plane;
 	aas_link_t *link, *areas;
 
@@ -1238,8 +1488,8 @@ aas_link_t *AAS_AASLinkEntity(vec3_t absmins, vec3_t absmaxs, int entnum)
 	//
 	lstack_p = linkstack;
 	//we start with the whole line on the stack
-	//start with node 1 because node zero is a dummy used for solid leafs
-	lstack_p->nodenum = 1;		//starting at the root of the tree
+	//start with the cached node, all nodes above it have the box at the same side
+	lstack_p->nodenum = AAS_BoxStartNode(absmins, absmaxs);
 	lstack_p++;
 	
 	while (1)
@@ -1282,16 +1532,14 @@ aas_link_t *AAS_AASLinkEntity(vec3_t absmins, vec3_t absmaxs, int entnum)
 		} //end if
 		//if solid leaf
 		if (!nodenum) continue;
-		//the node to test against
-		aasnode = &aasworld.nodes[nodenum];
-		//the current node plane
-		plane = &aasworld.planes[aasnode->planenum];
+		//the node to test against and the current node plane
+		plane = AAS_NodePlane(nodenum, &planenum, children);
 		//get the side(s) the box is situated relative to the plane
 		side = AAS_BoxOnPlaneSide2(absmins, absmaxs, plane);
 		//if on the front side of the node
 		if (side & 1)
 		{
-			lstack_p->nodenum = aasnode->children[0];
+			lstack_p->nodenum = children[0];
 			lstack_p++;
 		} //end if
 		if (lstack_p >= &linkstack[127])
@@ -1302,7 +1550,7 @@ aas_link_t *AAS_AASLinkEntity(vec3_t absmins, vec3_t absmaxs, int entnum)
 		//if on the back side of the node
 		if (side & 2)
 		{
-			lstack_p->nodenum = aasnode->children[1];
+			lstack_p->nodenum = children[1];
 			lstack_p++;
 		} //end if
 		if (lstack_p >= &linkstack[127])
@@ -1331,26 +1579,180 @@ aas_link_t *AAS_LinkEntityClientBBox(vec3_t absmins, vec3_t absmaxs, int entnum,
 	return AAS_AASLinkEntity(newabsmins, newabsmaxs, entnum);
 } //end of the function AAS_LinkEntityClientBBox
 //===========================================================================
+// relinks an entity linked into the given areas, only the links to areas
+// the entity left or entered change. The returned area list has the same
+// order as one from AAS_LinkEntityClientBBox
 //
 // Parameter:				-
 // Returns:					-
 // Changes Globals:		-
 //===========================================================================
+aas_link_t *AAS_RelinkEntityClientBBox(aas_link_t *areas, vec3_t absmins, vec3_t absmaxs, int entnum, int presencetype)
+{
+	int areanums[MAX_RELINKAREAS], num, i;
+	vec3_t mins, maxs;
+	vec3_t newabsmins, newabsmaxs;
+	aas_link_t *link, *nextlink, *newareas;
+
+	AAS_PresenceTypeBoundingBox(presencetype, mins, maxs);
+	VectorSubtract(absmins, maxs, newabsmins);
+	VectorSubtract(absmaxs, mins, newabsmaxs);
+	//get the areas in the order they would be linked in
+	num = AAS_BBoxAreas(newabsmins, newabsmaxs, areanums, MAX_RELINKAREAS);
+	if (num >= MAX_RELINKAREAS)
+	{
+		AAS_UnlinkFromAreas(areas);
+		return AAS_AASLinkEntity(newabsmins, newabsmaxs, entnum);
+	} //end if
+	//if the entity stays in the same areas
+	for (i = 0, link = areas; i < num && link; i++, link = link->next_area)
+	{
+		if (link->areanum != areanums[i]) break;
+	} //end for
+	if (i >= num && !link) return areas;
+	//remove the links to the areas the entity left
+	for (link = areas; link; link = nextlink)
+	{
+		nextlink = link->next_area;
+		for (i = 0; i < num; i++)
+		{
+			if (areanums[i] == link->areanum) break;
+		} //end for
+		if (i < num) continue;
+		if (link->prev_area) link->prev_area->next_area = link->next_area;
+		else areas = link->next_area;
+		if (link->next_area) link->next_area->prev_area = link->prev_area;
+		link->next_area = NULL;
+		AAS_UnlinkFromAreas(link);
+	} //end for
+	//build the new area list, areas are put at the start of the list
+	//in the same order AAS_AASLinkEntity finds them
+	newareas = NULL;
+	for (i = num - 1; i >= 0; i--)
+	{
+		for (link = areas; link; link = link->next_area)
+		{
+			if (link->areanum == areanums[i]) break;
+		} //end for
+		if (link)
+		{
+			//take the link from the old area list
+			if (link->prev_area) link->prev_area->next_area = link->next_area;
+			else areas = link->next_area;
+			if (link->next_area) link->next_area->prev_area = link->prev_area;
+		} //end if
+		else
+		{
+			link = AAS_AllocAASLink();
+			if (!link) break;
+			link->entnum = entnum;
+			link->areanum = areanums[i];
+			//put the link into the double linked entity list of the area
+			link->prev_ent = NULL;
+			link->next_ent = aasworld.arealinkedentities[areanums[i]];
+			if (aasworld.arealinkedentities[areanums[i]])
+					aasworld.arealinkedentities[areanums[i]]->prev_ent = link;
+			aasworld.arealinkedentities[areanums[i]] = link;
+		} //end else
+		//put the link into the double linked area list of the entity
+		link->prev_area = NULL;
+		link->next_area = newareas;
+		if (newareas) newareas->prev_area = link;
+		newareas = link;
+	} //end for
+	//remove links left when the link heap ran out
+	AAS_UnlinkFromAreas(areas);
+	return newareas;
+} //end of the function AAS_RelinkEntityClientBBox
+//===========================================================================
+// walks the tree like AAS_AASLinkEntity but never links into the area
+// lists, so bot jobs on worker threads can call it concurrently. Like the
+// temporary links it replaces, the areas found last come first, and when
+// there are more than maxareas the ones found first are left out.
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+#define MAX_BBOX_FOUND			128
+
 int AAS_BBoxAreas(vec3_t absmins, vec3_t absmaxs, int *areas, int maxareas)
 {
-	aas_link_t *linkedareas, *link;
-	int num;
+	int side, nodenum, planenum, children[2], num, i;
+	int foundbuf[MAX_BBOX_FOUND], *found, *newfound, maxfound, numfound;
+	aas_linkstack_t linkstack[128];
+	aas_linkstack_t *lstack_p;
+	aas_plane_t *plane;
+
+	if (!aasworld.loaded)
+	{
+		botimport.Print(PRT_ERROR, "AAS_BBoxAreas: aas not loaded\n");
+		return 0;
+	} //end if
+
+	found = foundbuf;
+	maxfound = MAX_BBOX_FOUND;
+	numfound = 0;
+	lstack_p = linkstack;
+	//start with the cached node, all nodes above it have the box at the same side
+	lstack_p->nodenum = AAS_BoxStartNode(absmins, absmaxs);
+	lstack_p++;
 
-	linkedareas = AAS_AASLinkEntity(absmins, absmaxs, -1);
-	num = 0;
-	for (link = linkedareas; link; link = link->next_area)
+	while (lstack_p > linkstack)
 	{
-		areas[num] = link->areanum;
-		num++;
-		if (num >= maxareas)
+		lstack_p--;
+		nodenum = lstack_p->nodenum;
+		//if it is an area
+		if (nodenum < 0)
+		{
+			//several node children can point to the same area
+			for (i = 0; i < numfound; i++)
+			{
+				if (found[i] == -nodenum) break;
+			} //end for
+			if (i < numfound) continue;
+			//no area is found twice, so a list for all of them can't overflow
+			if (numfound >= maxfound)
+			{
+				newfound = (int *) GetMemory(aasworld.numareas * sizeof(int));
+				Com_Memcpy(newfound, found, numfound * sizeof(int));
+				found = newfound;
+				maxfound = aasworld.numareas;
+			} //end if
+			found[numfound++] = -nodenum;
+			continue;
+		} //end if
+		//if solid leaf
+		if (!nodenum) continue;
+		plane = AAS_NodePlane(nodenum, &planenum, children);
+		side = AAS_BoxOnPlaneSide2(absmins, absmaxs, plane);
+		if (side & 1)
+		{
+			lstack_p->nodenum = children[0];
+			lstack_p++;
+		} //end if
+		if (lstack_p >= &linkstack[127])
+		{
+			botimport.Print(PRT_ERROR, "AAS_BBoxAreas: stack overflow\n");
+			break;
+		} //end if
+		if (side & 2)
+		{
+			lstack_p->nodenum = children[1];
+			lstack_p++;
+		} //end if
+		if (lstack_p >= &linkstack[127])
+		{
+			botimport.Print(PRT_ERROR, "AAS_BBoxAreas: stack overflow\n");
 			break;
+		} //end if
+	} //end while
+	num = numfound < maxareas ? numfound : maxareas;
+	for (i = 0; i < num; i++)
+	{
+		areas[i] = found[numfound - 1 - i];
 	} //end for
-	AAS_UnlinkFromAreas(linkedareas);
+	if (found != foundbuf) FreeMemory(found);
 	return num;
 } //end of the function AAS_BBoxAreas
 //===========================================================================
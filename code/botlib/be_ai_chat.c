@@ -69,6 +69,8 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #define RCKFL_GENDERLESS			256		//bot must be genderless
 //time to ignore a chat message after using it
 #define CHATMESSAGE_RECENTTIME	20
+//number of matched messages remembered
+#define MAX_MATCHCACHE			16
 
 //the actuall chat messages
 typedef struct bot_chatmessage_s
@@ -111,6 +113,7 @@ typedef struct bot_synonym_s
 {
 	char *string;
 	float weight;
+	int stringnum;								//number of the string in the synonym matcher
 	struct bot_synonym_s *next;
 } bot_synonym_t;
 //list with synonyms
@@ -126,6 +129,7 @@ typedef struct bot_synonymlist_s
 typedef struct bot_matchstring_s
 {
 	char *string;
+	int stringnum;								//number of the string in the match matcher, -1 if none
 	struct bot_matchstring_s *next;
 } bot_matchstring_t;
 
@@ -147,6 +151,34 @@ typedef struct bot_matchtemplate_s
 	struct bot_matchtemplate_s *next;
 } bot_matchtemplate_t;
 
+//node of a string matcher
+typedef struct bot_matchernode_s
+{
+	int c;										//case folded character leading to this node
+	int firstchild;								//first child node, 0 if none
+	int sibling;								//next node with the same parent, 0 if none
+	int fail;									//node of the longest proper suffix in the trie
+	int stringnum;								//string ending at this node, -1 if none
+	int dictionary;								//next node on the fail chain a string ends at, 0 if none
+} bot_matchernode_t;
+//Aho-Corasick automaton finding a set of strings in a message in one pass
+typedef struct bot_stringmatcher_s
+{
+	int numnodes;
+	int maxnodes;
+	bot_matchernode_t *nodes;
+	int rootchild[256];							//children of the root node
+	int numstrings;
+	byte *found;								//strings found in the last message
+} bot_stringmatcher_t;
+//match result shared by the bots seeing the same message
+typedef struct bot_matchcache_s
+{
+	unsigned long int context;
+	int found;
+	bot_match_t match;
+} bot_matchcache_t;
+
 //reply chat key
 typedef struct bot_replychatkey_s
 {
@@ -203,8 +235,15 @@ bot_consolemessage_t *consolemessageheap = NULL;
 bot_consolemessage_t *freeconsolemessages = NULL;
 //list with match strings
 bot_matchtemplate_t *matchtemplates = NULL;
+//matcher with the strings of the match templates
+bot_stringmatcher_t *matchtemplatematcher = NULL;
+//results of the last matched messages
+bot_matchcache_t matchcache[MAX_MATCHCACHE];
+int nummatchcache, matchcachenext;
 //list with synonyms
 bot_synonymlist_t *synonyms = NULL;
+//matcher with the synonyms that are replaced
+bot_stringmatcher_t *synonymmatcher = NULL;
 //list with random strings
 bot_randomlist_t *randomstrings = NULL;
 //reply chats
@@ -547,9 +586,12 @@ char *StringContainsWord(char *str1, char *str2, int casesensitive)
 // Returns:					-
 // Changes Globals:		-
 //===========================================================================
-void StringReplaceWords(char *string, char *synonym, char *replacement)
+int StringReplaceWords(char *string, char *synonym, char *replacement)
 {
 	char *str, *str2;
+	int numreplaced;
+
+	numreplaced = 0;
 
 	//find the synonym in the string
 	str = StringContainsWord(string, synonym, qfalse);
@@ -569,12 +611,172 @@ void StringReplaceWords(char *string, char *synonym, char *replacement)
 			memmove(str + strlen(replacement), str+strlen(synonym), strlen(str+strlen(synonym))+1);
 			//append the synonum replacement
 			Com_Memcpy(str, replacement, strlen(replacement));
+			numreplaced++;
 		} //end if
 		//find the next synonym in the string
 		str = StringContainsWord(str+strlen(replacement), synonym, qfalse);
 	} //end if
+	return numreplaced;
 } //end of the function StringReplaceWords
 //===========================================================================
+// allocates a string matcher for at most maxstrings strings with
+// at most maxchars characters in total
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+bot_stringmatcher_t *BotAllocStringMatcher(int maxchars, int maxstrings)
+{
+	bot_stringmatcher_t *matcher;
+
+	matcher = (bot_stringmatcher_t *) GetClearedMemory(sizeof(bot_stringmatcher_t) +
+						(maxchars + 1) * sizeof(bot_matchernode_t) + maxstrings);
+	matcher->maxnodes = maxchars + 1;
+	matcher->nodes = (bot_matchernode_t *) (matcher + 1);
+	matcher->found = (byte *) (matcher->nodes + matcher->maxnodes);
+	//the root node
+	matcher->numnodes = 1;
+	matcher->nodes[0].stringnum = -1;
+	return matcher;
+} //end of the function BotAllocStringMatcher
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+static int BotMatcherChild(bot_stringmatcher_t *matcher, int node, int c)
+{
+	int child;
+
+	for (child = matcher->nodes[node].firstchild; child; child = matcher->nodes[child].sibling)
+	{
+		if (matcher->nodes[child].c == c) return child;
+	} //end for
+	return 0;
+} //end of the function BotMatcherChild
+//===========================================================================
+// adds a string to the matcher, strings only differing in case share a number
+//
+// Parameter:				-
+// Returns:					number of the string or -1 when the matcher is full
+// Changes Globals:		-
+//===========================================================================
+int BotAddMatcherString(bot_stringmatcher_t *matcher, char *string)
+{
+	bot_matchernode_t *nodes;
+	int node, child, c;
+
+	nodes = matcher->nodes;
+	node = 0;
+	for (; *string; string++)
+	{
+		c = toupper((unsigned char) *string);
+		child = BotMatcherChild(matcher, node, c);
+		if (!child)
+		{
+			if (matcher->numnodes >= matcher->maxnodes) return -1;
+			child = matcher->numnodes++;
+			nodes[child].c = c;
+			nodes[child].firstchild = 0;
+			nodes[child].sibling = nodes[node].firstchild;
+			nodes[child].stringnum = -1;
+			nodes[node].firstchild = child;
+		} //end if
+		node = child;
+	} //end for
+	if (!node) return -1;
+	if (nodes[node].stringnum < 0) nodes[node].stringnum = matcher->numstrings++;
+	return nodes[node].stringnum;
+} //end of the function BotAddMatcherString
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+static int BotMatcherNextNode(bot_stringmatcher_t *matcher, int node, int c)
+{
+	int child;
+
+	while(node)
+	{
+		child = BotMatcherChild(matcher, node, c);
+		if (child) return child;
+		node = matcher->nodes[node].fail;
+	} //end while
+	return matcher->rootchild[c];
+} //end of the function BotMatcherNextNode
+//===========================================================================
+// sets up the fail and dictionary links after all strings are added
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+void BotFinishStringMatcher(bot_stringmatcher_t *matcher)
+{
+	bot_matchernode_t *nodes;
+	int *queue, head, tail, node, child, fail;
+
+	nodes = matcher->nodes;
+	queue = (int *) GetMemory(matcher->numnodes * sizeof(int));
+	head = tail = 0;
+	//the nodes one character deep fail to the root
+	for (child = nodes[0].firstchild; child; child = nodes[child].sibling)
+	{
+		nodes[child].fail = 0;
+		nodes[child].dictionary = 0;
+		matcher->rootchild[nodes[child].c] = child;
+		queue[tail++] = child;
+	} //end for
+	//breadth first so the fail node of a parent is always done
+	while(head < tail)
+	{
+		node = queue[head++];
+		for (child = nodes[node].firstchild; child; child = nodes[child].sibling)
+		{
+			fail = BotMatcherNextNode(matcher, nodes[node].fail, nodes[child].c);
+			nodes[child].fail = fail;
+			if (nodes[fail].stringnum >= 0) nodes[child].dictionary = fail;
+			else nodes[child].dictionary = nodes[fail].dictionary;
+			queue[tail++] = child;
+		} //end for
+	} //end while
+	FreeMemory(queue);
+} //end of the function BotFinishStringMatcher
+//===========================================================================
+// marks the matcher strings the message contains, case insensitive
+// like StringContains
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+void BotFindMatcherStrings(bot_stringmatcher_t *matcher, char *str)
+{
+	bot_matchernode_t *nodes;
+	int node, out;
+
+	nodes = matcher->nodes;
+	Com_Memset(matcher->found, 0, matcher->numstrings);
+	node = 0;
+	for (; *str; str++)
+	{
+		node = BotMatcherNextNode(matcher, node, toupper((unsigned char) *str));
+		//mark the strings ending here, a string marked before
+		//had all the strings on its dictionary chain marked with it
+		if (nodes[node].stringnum >= 0) out = node;
+		else out = nodes[node].dictionary;
+		for (; out; out = nodes[out].dictionary)
+		{
+			if (matcher->found[nodes[out].stringnum]) break;
+			matcher->found[nodes[out].stringnum] = 1;
+		} //end for
+	} //end for
+} //end of the function BotFindMatcherStrings
+//===========================================================================
 //
 // Parameter:				-
 // Returns:					-
@@ -768,6 +970,42 @@ bot_synonymlist_t *BotLoadSynonyms(char *filename)
 	return synlist;
 } //end of the function BotLoadSynonyms
 //===========================================================================
+// builds the matcher with the synonyms BotReplaceSynonyms searches for
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+bot_stringmatcher_t *BotCompileSynonyms(bot_synonymlist_t *synlist)
+{
+	bot_stringmatcher_t *matcher;
+	bot_synonymlist_t *syn;
+	bot_synonym_t *synonym;
+	int numchars, numstrings;
+
+	numchars = 0;
+	numstrings = 0;
+	for (syn = synlist; syn; syn = syn->next)
+	{
+		for (synonym = syn->firstsynonym->next; synonym; synonym = synonym->next)
+		{
+			numchars += strlen(synonym->string);
+			numstrings++;
+		} //end for
+	} //end for
+	if (!numstrings) return NULL;
+	matcher = BotAllocStringMatcher(numchars, numstrings);
+	for (syn = synlist; syn; syn = syn->next)
+	{
+		for (synonym = syn->firstsynonym->next; synonym; synonym = synonym->next)
+		{
+			synonym->stringnum = BotAddMatcherString(matcher, synonym->string);
+		} //end for
+	} //end for
+	BotFinishStringMatcher(matcher);
+	return matcher;
+} //end of the function BotCompileSynonyms
+//===========================================================================
 // replace all the synonyms in the string
 //
 // Parameter:				-
@@ -779,12 +1017,20 @@ void BotReplaceSynonyms(char *string, unsigned long int context)
 	bot_synonymlist_t *syn;
 	bot_synonym_t *synonym;
 
+	//find all synonyms in the string in one pass
+	if (synonymmatcher) BotFindMatcherStrings(synonymmatcher, string);
 	for (syn = synonyms; syn; syn = syn->next)
 	{
 		if (!(syn->context & context)) continue;
 		for (synonym = syn->firstsynonym->next; synonym; synonym = synonym->next)
 		{
-			StringReplaceWords(string, synonym->string, syn->firstsynonym->string);
+			if (synonymmatcher && synonym->stringnum >= 0 &&
+					!synonymmatcher->found[synonym->stringnum]) continue;
+			if (StringReplaceWords(string, synonym->string, syn->firstsynonym->string))
+			{
+				//the replacement may have put other synonyms in the string
+				if (synonymmatcher) BotFindMatcherStrings(synonymmatcher, string);
+			} //end if
 		} //end for
 	} //end for
 } //end of the function BotReplaceSynonyms
@@ -1226,6 +1472,7 @@ bot_matchpiece_t *BotLoadMatchPieces(source_t *source, char *endtoken)
 				matchstring = (bot_matchstring_t *) GetClearedHunkMemory(sizeof(bot_matchstring_t) + strlen(token.string) + 1);
 				matchstring->string = (char *) matchstring + sizeof(bot_matchstring_t);
 				strcpy(matchstring->string, token.string);
+				matchstring->stringnum = -1;
 				if (!strlen(token.string)) emptystring = qtrue;
 				matchstring->next = NULL;
 				if (lastmatchstring) lastmatchstring->next = matchstring;
@@ -1369,6 +1616,77 @@ bot_matchtemplate_t *BotLoadMatchTemplates(char *matchfile)
 	return matches;
 } //end of the function BotLoadMatchTemplates
 //===========================================================================
+// builds the matcher with the strings of all match templates
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+bot_stringmatcher_t *BotCompileMatchTemplates(bot_matchtemplate_t *matches)
+{
+	bot_stringmatcher_t *matcher;
+	bot_matchtemplate_t *mt;
+	bot_matchpiece_t *mp;
+	bot_matchstring_t *ms;
+	int numchars, numstrings;
+
+	numchars = 0;
+	numstrings = 0;
+	for (mt = matches; mt; mt = mt->next)
+	{
+		for (mp = mt->first; mp; mp = mp->next)
+		{
+			if (mp->type != MT_STRING) continue;
+			for (ms = mp->firststring; ms; ms = ms->next)
+			{
+				numchars += strlen(ms->string);
+				numstrings++;
+			} //end for
+		} //end for
+	} //end for
+	if (!numstrings) return NULL;
+	matcher = BotAllocStringMatcher(numchars, numstrings);
+	for (mt = matches; mt; mt = mt->next)
+	{
+		for (mp = mt->first; mp; mp = mp->next)
+		{
+			if (mp->type != MT_STRING) continue;
+			for (ms = mp->firststring; ms; ms = ms->next)
+			{
+				//an empty string always matches
+				if (!strlen(ms->string)) continue;
+				ms->stringnum = BotAddMatcherString(matcher, ms->string);
+			} //end for
+		} //end for
+	} //end for
+	BotFinishStringMatcher(matcher);
+	return matcher;
+} //end of the function BotCompileMatchTemplates
+//===========================================================================
+// returns false when a string piece of the template can't match because
+// none of its strings is in the message
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+static int BotMatchStringsFound(bot_stringmatcher_t *matcher, bot_matchpiece_t *pieces)
+{
+	bot_matchpiece_t *mp;
+	bot_matchstring_t *ms;
+
+	for (mp = pieces; mp; mp = mp->next)
+	{
+		if (mp->type != MT_STRING) continue;
+		for (ms = mp->firststring; ms; ms = ms->next)
+		{
+			if (ms->stringnum < 0 || matcher->found[ms->stringnum]) break;
+		} //end for
+		if (!ms) return qfalse;
+	} //end for
+	return qtrue;
+} //end of the function BotMatchStringsFound
+//===========================================================================
 //
 // Parameter:				-
 // Returns:					-
@@ -1453,8 +1771,9 @@ int StringsMatch(bot_matchpiece_t *pieces, bot_match_t *match)
 //===========================================================================
 int BotFindMatch(char *str, bot_match_t *match, unsigned long int context)
 {
-	int i;
+	int i, j, found;
 	bot_matchtemplate_t *ms;
+	bot_matchcache_t *mc;
 
 	Q_strncpyz(match->string, str, MAX_MESSAGE_SIZE);
 	//remove any trailing enters
@@ -1463,10 +1782,28 @@ int BotFindMatch(char *str, bot_match_t *match, unsigned long int context)
 	{
 		match->string[strlen(match->string)-1] = '\0';
 	} //end while
+	//every bot seeing a message matches it with the same context
+	for (i = 0; i < nummatchcache; i++)
+	{
+		mc = &matchcache[i];
+		if (mc->context != context) continue;
+		if (strcmp(mc->match.string, match->string)) continue;
+		if (mc->found)
+		{
+			Com_Memcpy(match, &mc->match, sizeof(bot_match_t));
+			return qtrue;
+		} //end if
+		for (j = 0; j < MAX_MATCHVARIABLES; j++) match->variables[j].offset = -1;
+		return qfalse;
+	} //end for
+	//find the strings of all match templates in the message in one pass
+	if (matchtemplatematcher) BotFindMatcherStrings(matchtemplatematcher, match->string);
 	//compare the string with all the match strings
+	found = qfalse;
 	for (ms = matchtemplates; ms; ms = ms->next)
 	{
 		if (!(ms->context & context)) continue;
+		if (matchtemplatematcher && !BotMatchStringsFound(matchtemplatematcher, ms->first)) continue;
 		//reset the match variable offsets
 		for (i = 0; i < MAX_MATCHVARIABLES; i++) match->variables[i].offset = -1;
 		//
@@ -1474,10 +1811,22 @@ int BotFindMatch(char *str, bot_match_t *match, unsigned long int context)
 		{
 			match->type = ms->type;
 			match->subtype = ms->subtype;
-			return qtrue;
+			found = qtrue;
+			break;
 		} //end if
 	} //end for
-	return qfalse;
+	if (!found)
+	{
+		for (i = 0; i < MAX_MATCHVARIABLES; i++) match->variables[i].offset = -1;
+	} //end if
+	//remember the result for the other bots
+	mc = &matchcache[matchcachenext];
+	matchcachenext = (matchcachenext + 1) % MAX_MATCHCACHE;
+	if (nummatchcache < MAX_MATCHCACHE) nummatchcache++;
+	mc->context = context;
+	mc->found = found;
+	Com_Memcpy(&mc->match, match, sizeof(bot_match_t));
+	return found;
 } //end of the function BotFindMatch
 //===========================================================================
 //
@@ -2976,10 +3325,14 @@ int BotSetupChatAI(void)
 
 	file = LibVarString("synfile", "syn.c");
 	synonyms = BotLoadSynonyms(file);
+	synonymmatcher = BotCompileSynonyms(synonyms);
 	file = LibVarString("rndfile", "rnd.c");
 	randomstrings = BotLoadRandomStrings(file);
 	file = LibVarString("matchfile", "match.c");
 	matchtemplates = BotLoadMatchTemplates(file);
+	matchtemplatematcher = BotCompileMatchTemplates(matchtemplates);
+	nummatchcache = 0;
+	matchcachenext = 0;
 	//
 	if (!LibVarValue("nochat", "0"))
 	{
@@ -3026,10 +3379,15 @@ void BotShutdownChatAI(void)
 	consolemessageheap = NULL;
 	if (matchtemplates) BotFreeMatchTemplates(matchtemplates);
 	matchtemplates = NULL;
+	if (matchtemplatematcher) FreeMemory(matchtemplatematcher);
+	matchtemplatematcher = NULL;
+	nummatchcache = 0;
 	if (randomstrings) FreeMemory(randomstrings);
 	randomstrings = NULL;
 	if (synonyms) FreeMemory(synonyms);
 	synonyms = NULL;
+	if (synonymmatcher) FreeMemory(synonymmatcher);
+	synonymmatcher = NULL;
 	if (replychats) BotFreeReplyChat(replychats);
 	replychats = NULL;
 } //end of the function BotShutdownChatAI
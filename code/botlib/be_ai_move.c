@@ -3462,6 +3462,63 @@ void BotMoveToGoal(bot_moveresult_t *result, int movestate, bot_goal_t *goal, in
 // Returns:					-
 // Changes Globals:		-
 //===========================================================================
+typedef struct bot_movebatch_s
+{
+	bot_moveresult_t *results;
+	int *movestates;
+	bot_goal_t *goals;
+	int *travelflags;
+} bot_movebatch_t;
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+static void BotMoveToGoalJob(void *data, int index)
+{
+	bot_movebatch_t *batch = (bot_movebatch_t *) data;
+
+	BotMoveToGoal(&batch->results[index], batch->movestates[index],
+					&batch->goals[index], batch->travelflags[index]);
+} //end of the function BotMoveToGoalJob
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+void BotMoveToGoalBatch(bot_moveresult_t *results, int nummoves, int *movestates, bot_goal_t *goals, int *travelflags)
+{
+	bot_movebatch_t batch;
+	int i, j;
+
+	//two jobs on the same move state would race on it
+	for (i = 1; i < nummoves; i++)
+	{
+		for (j = 0; j < i; j++)
+		{
+			if (movestates[i] != movestates[j]) continue;
+			botimport.Print(PRT_ERROR, "BotMoveToGoalBatch: move state %d used twice\n", movestates[i]);
+			for (i = 0; i < nummoves; i++)
+			{
+				BotMoveToGoal(&results[i], movestates[i], &goals[i], travelflags[i]);
+			} //end for
+			return;
+		} //end for
+	} //end for
+	batch.results = results;
+	batch.movestates = movestates;
+	batch.goals = goals;
+	batch.travelflags = travelflags;
+	BotLibRunJobs(BotMoveToGoalJob, &batch, nummoves);
+} //end of the function BotMoveToGoalBatch
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
 void BotResetAvoidReach(int movestate)
 {
 	bot_movestate_t *ms;
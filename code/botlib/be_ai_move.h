@@ -113,6 +113,8 @@ typedef struct bot_avoidspot_s
 void BotResetMoveState(int movestate);
 //moves the bot to the given goal
 void BotMoveToGoal(bot_moveresult_t *result, int movestate, bot_goal_t *goal, int travelflags);
+//moves a batch of bots to their goals as bot jobs, a move state may appear only once
+void BotMoveToGoalBatch(bot_moveresult_t *results, int nummoves, int *movestates, bot_goal_t *goals, int *travelflags);
 //moves the bot in the specified direction using the specified type of movement
 int BotMoveInDirection(int movestate, vec3_t dir, float speed, int type);
 //reset avoid reachability
@@ -433,6 +433,70 @@ int BotChooseBestFightWeapon(int weaponstate, int *inventory)
 	return bestweapon;
 } //end of the function BotChooseBestFightWeapon
 //===========================================================================
+// chooses the best fight weapon for a number of bots, the weights of the
+// bots that share a weapon weight configuration are evaluated together
+//
+// Parameter:				weapons			: stores the best weapon of every bot
+//								inventories		: inventorysize values for every bot
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+void BotChooseBestFightWeaponBatch(int *weapons, int numstates, int *weaponstates, int *inventories, int inventorysize)
+{
+	int i, j, n, w, index, *members, **groupinventories;
+	float *weights, *bestweights;
+	weaponconfig_t *wc;
+	bot_weaponstate_t *ws, *ws2;
+	qboolean *done;
+
+	if (numstates <= 0) return;
+	members = (int *) GetMemory(numstates * (sizeof(int) + sizeof(int *) + 2 * sizeof(float) + sizeof(qboolean)));
+	groupinventories = (int **) (members + numstates);
+	weights = (float *) (groupinventories + numstates);
+	bestweights = weights + numstates;
+	done = (qboolean *) (bestweights + numstates);
+	Com_Memset(done, 0, numstates * sizeof(qboolean));
+	wc = weaponconfig;
+	for (i = 0; i < numstates; i++)
+	{
+		if (done[i]) continue;
+		weapons[i] = 0;
+		ws = BotWeaponStateFromHandle(weaponstates[i]);
+		//if the bot has no weapon weight configuration
+		if (!ws || !wc || !ws->weaponweightconfig) continue;
+		//the bots with the same weight configuration
+		for (j = i, n = 0; j < numstates; j++)
+		{
+			if (done[j]) continue;
+			ws2 = (j == i) ? ws : BotWeaponStateFromHandle(weaponstates[j]);
+			if (!ws2 || ws2->weaponweightconfig != ws->weaponweightconfig) continue;
+			done[j] = qtrue;
+			members[n] = j;
+			groupinventories[n] = inventories + j * inventorysize;
+			bestweights[n] = 0;
+			weapons[j] = 0;
+			n++;
+		} //end for
+		//the weight indexes only depend on the weight configuration
+		for (w = 0; w < wc->numweapons; w++)
+		{
+			if (!wc->weaponinfo[w].valid) continue;
+			index = ws->weaponweightindex[w];
+			if (index < 0) continue;
+			FuzzyWeights(groupinventories, n, ws->weaponweightconfig, index, weights);
+			for (j = 0; j < n; j++)
+			{
+				if (weights[j] > bestweights[j])
+				{
+					bestweights[j] = weights[j];
+					weapons[members[j]] = w;
+				} //end if
+			} //end for
+		} //end for
+	} //end for
+	FreeMemory(members);
+} //end of the function BotChooseBestFightWeaponBatch
+//===========================================================================
 //
 // Parameter:				-
 // Returns:					-
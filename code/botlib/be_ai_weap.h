@@ -92,6 +92,9 @@ int BotSetupWeaponAI(void);
 void BotShutdownWeaponAI(void);
 //returns the best weapon to fight with
 int BotChooseBestFightWeapon(int weaponstate, int *inventory);
+//returns the best weapon to fight with for a number of bots, every bot has
+//inventorysize inventory values
+void BotChooseBestFightWeaponBatch(int *weapons, int numstates, int *weaponstates, int *inventories, int inventorysize);
 //returns the information of the current weapon
 void BotGetWeaponInfo(int weaponstate, int weapon, weaponinfo_t *weaponinfo);
 //loads the weapon weights
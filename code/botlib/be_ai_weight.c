@@ -45,7 +45,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "be_ai_weight.h"
 
 #define MAX_INVENTORYVALUE			999999
-#define EVALUATERECURSIVELY
+#define MAX_FUZZYDEPTH				32		//nested switches of the seperator arrays
 
 #define MAX_WEIGHT_FILES			128
 weightconfig_t	*weightFileList[MAX_WEIGHT_FILES];
@@ -135,9 +135,11 @@ void FreeWeightConfig2(weightconfig_t *config)
 
 	for (i = 0; i < config->numweights; i++)
 	{
-		FreeFuzzySeperators_r(config->weights[i].firstseperator);
+		if (!config->seperators) FreeFuzzySeperators_r(config->weights[i].firstseperator);
 		if (config->weights[i].name) FreeMemory(config->weights[i].name);
 	} //end for
+	if (config->seperators) FreeMemory(config->seperators);
+	if (config->fuzzynodes) FreeMemory(config->fuzzynodes);
 	FreeMemory(config);
 } //end of the function FreeWeightConfig2
 //===========================================================================
@@ -282,6 +284,135 @@ fuzzyseperator_t *ReadFuzzySeperators_r(source_t *source)
 // Returns:					-
 // Changes Globals:		-
 //===========================================================================
+int NumFuzzySeperators_r(fuzzyseperator_t *fs)
+{
+	int num;
+
+	for (num = 0; fs; fs = fs->next)
+	{
+		num++;
+		if (fs->child) num += NumFuzzySeperators_r(fs->child);
+	} //end for
+	return num;
+} //end of the function NumFuzzySeperators_r
+//===========================================================================
+// returns the number of nested switches
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+int FuzzySeperatorDepth_r(fuzzyseperator_t *fs)
+{
+	int depth, maxdepth;
+
+	for (maxdepth = 0; fs; fs = fs->next)
+	{
+		if (!fs->child) continue;
+		depth = FuzzySeperatorDepth_r(fs->child);
+		if (depth > maxdepth) maxdepth = depth;
+	} //end for
+	return maxdepth + 1;
+} //end of the function FuzzySeperatorDepth_r
+//===========================================================================
+// copies the seperators to the block, the cases of a switch are stored
+// next to each other followed by the switches of the cases
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+fuzzyseperator_t *CopyFuzzySeperators_r(fuzzyseperator_t *fs, fuzzyseperator_t **block)
+{
+	fuzzyseperator_t *first, *in, *out;
+
+	first = *block;
+	for (in = fs, out = first; in; in = in->next, out++)
+	{
+		*out = *in;
+		if (in->next) out->next = out + 1;
+	} //end for
+	*block = out;
+	for (in = fs, out = first; in; in = in->next, out++)
+	{
+		if (in->child) out->child = CopyFuzzySeperators_r(in->child, block);
+	} //end for
+	return first;
+} //end of the function CopyFuzzySeperators_r
+//===========================================================================
+// copies the weights of the seperators to the weight arrays, needed after
+// the weights of the seperators changed
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+void UpdateFuzzyWeights(weightconfig_t *config)
+{
+	int i;
+	fuzzyseperator_t *fs;
+
+	if (!config->fuzzynodes) return;
+	for (i = 0; i < config->numseperators; i++)
+	{
+		fs = &config->seperators[i];
+		config->fuzzynodes[i].weight = fs->weight;
+		config->fuzzynodes[i].minweight = fs->minweight;
+		config->fuzzynodes[i].maxweight = fs->maxweight;
+	} //end for
+} //end of the function UpdateFuzzyWeights
+//===========================================================================
+// stores the seperators of all the weights in one block of memory and
+// builds the seperator arrays
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+void FlattenWeightConfig(weightconfig_t *config)
+{
+	int i, numseperators, depth, maxdepth;
+	fuzzyseperator_t *block, *fs;
+
+	numseperators = 0;
+	for (i = 0; i < config->numweights; i++)
+	{
+		numseperators += NumFuzzySeperators_r(config->weights[i].firstseperator);
+	} //end for
+	if (!numseperators) return;
+	block = (fuzzyseperator_t *) GetClearedMemory(numseperators * sizeof(fuzzyseperator_t));
+	config->seperators = block;
+	maxdepth = 0;
+	for (i = 0; i < config->numweights; i++)
+	{
+		fs = config->weights[i].firstseperator;
+		if (!fs) continue;
+		depth = FuzzySeperatorDepth_r(fs);
+		if (depth > maxdepth) maxdepth = depth;
+		config->weights[i].firstseperator = CopyFuzzySeperators_r(fs, &block);
+		FreeFuzzySeperators_r(fs);
+	} //end for
+	//the iterative evaluation keeps a stack of interpolations, one per switch
+	if (maxdepth > MAX_FUZZYDEPTH) return;
+	config->numseperators = numseperators;
+	config->fuzzynodes = (fuzzynode_t *) GetClearedMemory(numseperators * sizeof(fuzzynode_t));
+	for (i = 0; i < numseperators; i++)
+	{
+		fs = &config->seperators[i];
+		config->fuzzynodes[i].index = fs->index;
+		config->fuzzynodes[i].value = fs->value;
+		config->fuzzynodes[i].child = fs->child ? fs->child - config->seperators : -1;
+		config->fuzzynodes[i].nextvalue = fs->next ? fs->next->value : INT_MAX;
+		config->fuzzynodes[i].last = !fs->next;
+	} //end for
+	UpdateFuzzyWeights(config);
+} //end of the function FlattenWeightConfig
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
 weightconfig_t *ReadWeightConfig(char *filename)
 {
 	int newindent, avail = 0, n;
@@ -425,6 +556,8 @@ weightconfig_t *ReadWeightConfig(char *filename)
 	} //end while
 	//free the source at the end of a pass
 	FreeSource(source);
+	//store the seperators in one block for fast evaluation
+	FlattenWeightConfig(config);
 	//if the file was located in a pak file
 	botimport.Print(PRT_MESSAGE, "loaded %s\n", filename);
 #ifdef DEBUG
@@ -574,6 +707,8 @@ int FindFuzzyWeight(weightconfig_t *wc, char *name)
 	return -1;
 } //end of the function FindFuzzyWeight
 //===========================================================================
+// only recurses to get the weights of two cases for interpolation,
+// walking the cases and going into a switch of a case is done in a loop
 //
 // Parameter:				-
 // Returns:					-
@@ -582,33 +717,41 @@ int FindFuzzyWeight(weightconfig_t *wc, char *name)
 float FuzzyWeight_r(int *inventory, fuzzyseperator_t *fs)
 {
 	float scale, w1, w2;
+	int value;
 
-	if (inventory[fs->index] < fs->value)
-	{
-		if (fs->child) return FuzzyWeight_r(inventory, fs->child);
-		else return fs->weight;
-	} //end if
-	else if (fs->next)
+	while(1)
 	{
-		if (inventory[fs->index] < fs->next->value)
+		//all the cases of a switch test the same inventory value
+		value = inventory[fs->index];
+		while(value >= fs->value && fs->next && value >= fs->next->value)
 		{
-			//first weight
-			if (fs->child) w1 = FuzzyWeight_r(inventory, fs->child);
-			else w1 = fs->weight;
-			//second weight
-			if (fs->next->child) w2 = FuzzyWeight_r(inventory, fs->next->child);
-			else w2 = fs->next->weight;
-			//the scale factor
-			if(fs->next->value == MAX_INVENTORYVALUE) // is fs->next the default case?
-        		return w2;      // can't interpolate, return default weight
-			else
-				scale = (float) (inventory[fs->index] - fs->value) / (fs->next->value - fs->value);
-			//scale between the two weights
-			return (1 - scale) * w1 + scale * w2;
+			fs = fs->next;
+		} //end while
+		if (value < fs->value)
+		{
+			if (!fs->child) return fs->weight;
+			fs = fs->child;
+			continue;
 		} //end if
-		return FuzzyWeight_r(inventory, fs->next);
-	} //end else if
-	return fs->weight;
+		if (!fs->next) return fs->weight;
+		//if fs->next is the default case there's no interpolation, return the default weight
+		if (fs->next->value == MAX_INVENTORYVALUE)
+		{
+			if (!fs->next->child) return fs->next->weight;
+			fs = fs->next->child;
+			continue;
+		} //end if
+		//first weight
+		if (fs->child) w1 = FuzzyWeight_r(inventory, fs->child);
+		else w1 = fs->weight;
+		//second weight
+		if (fs->next->child) w2 = FuzzyWeight_r(inventory, fs->next->child);
+		else w2 = fs->next->weight;
+		//the scale factor
+		scale = (float) (value - fs->value) / (fs->next->value - fs->value);
+		//scale between the two weights
+		return (1 - scale) * w1 + scale * w2;
+	} //end while
 } //end of the function FuzzyWeight_r
 //===========================================================================
 //
@@ -619,64 +762,183 @@ float FuzzyWeight_r(int *inventory, fuzzyseperator_t *fs)
 float FuzzyWeightUndecided_r(int *inventory, fuzzyseperator_t *fs)
 {
 	float scale, w1, w2;
+	int value;
 
-	if (inventory[fs->index] < fs->value)
-	{
-		if (fs->child) return FuzzyWeightUndecided_r(inventory, fs->child);
-		else return fs->minweight + random() * (fs->maxweight - fs->minweight);
-	} //end if
-	else if (fs->next)
+	while(1)
 	{
-		if (inventory[fs->index] < fs->next->value)
+		//all the cases of a switch test the same inventory value
+		value = inventory[fs->index];
+		while(value >= fs->value && fs->next && value >= fs->next->value)
 		{
-			//first weight
-			if (fs->child) w1 = FuzzyWeightUndecided_r(inventory, fs->child);
-			else w1 = fs->minweight + random() * (fs->maxweight - fs->minweight);
-			//second weight
-			if (fs->next->child) w2 = FuzzyWeight_r(inventory, fs->next->child);
-			else w2 = fs->next->minweight + random() * (fs->next->maxweight - fs->next->minweight);
-			//the scale factor
-			if(fs->next->value == MAX_INVENTORYVALUE) // is fs->next the default case?
-        		return w2;      // can't interpolate, return default weight
-			else
-				scale = (float) (inventory[fs->index] - fs->value) / (fs->next->value - fs->value);
-			//scale between the two weights
-			return (1 - scale) * w1 + scale * w2;
+			fs = fs->next;
+		} //end while
+		if (value < fs->value)
+		{
+			if (!fs->child) return fs->minweight + random() * (fs->maxweight - fs->minweight);
+			fs = fs->child;
+			continue;
 		} //end if
-		return FuzzyWeightUndecided_r(inventory, fs->next);
-	} //end else if
-	return fs->weight;
+		if (!fs->next) return fs->weight;
+		//first weight
+		if (fs->child) w1 = FuzzyWeightUndecided_r(inventory, fs->child);
+		else w1 = fs->minweight + random() * (fs->maxweight - fs->minweight);
+		//second weight
+		if (fs->next->child) w2 = FuzzyWeight_r(inventory, fs->next->child);
+		else w2 = fs->next->minweight + random() * (fs->next->maxweight - fs->next->minweight);
+		//the scale factor
+		if (fs->next->value == MAX_INVENTORYVALUE) // is fs->next the default case?
+			return w2;      // can't interpolate, return default weight
+		else
+			scale = (float) (value - fs->value) / (fs->next->value - fs->value);
+		//scale between the two weights
+		return (1 - scale) * w1 + scale * w2;
+	} //end while
 } //end of the function FuzzyWeightUndecided_r
 //===========================================================================
+// evaluates the weight starting at the seperator with the seperator arrays,
+// in the same order and with the same random numbers as the recursive
+// functions above. Interpolations wait on a stack for their second weight,
+// which like in FuzzyWeightUndecided_r is never undecided when it's a switch
 //
 // Parameter:				-
 // Returns:					-
 // Changes Globals:		-
 //===========================================================================
-float FuzzyWeight(int *inventory, weightconfig_t *wc, int weightnum)
+typedef struct fuzzyinterpolation_s
 {
-#ifdef EVALUATERECURSIVELY
-	return FuzzyWeight_r(inventory, wc->weights[weightnum].firstseperator);
-#else
-	fuzzyseperator_t *s;
+	int second;			//second case of the interpolation, -1 once the first weight is known
+	int undecided;		//evaluated undecided
+	int defaultcase;	//the second case is the default case, no interpolation
+	float scale;
+	float first;
+} fuzzyinterpolation_t;
 
-	s = wc->weights[weightnum].firstseperator;
-	if (!s) return 0;
+float FuzzyWeightIterative(int *inventory, weightconfig_t *wc, int i, int undecided)
+{
+	fuzzyinterpolation_t stack[MAX_FUZZYDEPTH], *fi;
+	fuzzynode_t *nodes, *fn;
+	int sp, value, defaultcase;
+	float w, w2, scale;
+
+	nodes = wc->fuzzynodes;
+	sp = 0;
 	while(1)
 	{
-		if (inventory[s->index] < s->value)
+		//all the cases of a switch test the same inventory value
+		fn = &nodes[i];
+		value = inventory[fn->index];
+		while(value >= fn->nextvalue && value >= fn->value && !fn->last)
+		{
+			fn++;
+		} //end while
+		if (value < fn->value)
 		{
-			if (s->child) s = s->child;
-			else return s->weight;
+			if (fn->child >= 0)
+			{
+				i = fn->child;
+				continue;
+			} //end if
+			if (undecided) w = fn->minweight + random() * (fn->maxweight - fn->minweight);
+			else w = fn->weight;
 		} //end if
+		else if (fn->last)
+		{
+			w = fn->weight;
+		} //end else if
+		else if (!undecided && fn[1].value == MAX_INVENTORYVALUE)
+		{
+			//no interpolation with the default case, return the default weight
+			if (fn[1].child >= 0)
+			{
+				i = fn[1].child;
+				continue;
+			} //end if
+			w = fn[1].weight;
+		} //end else if
 		else
 		{
-			if (s->next) s = s->next;
-			else return s->weight;
+			defaultcase = fn[1].value == MAX_INVENTORYVALUE;
+			if (defaultcase) scale = 0;
+			else scale = (float) (value - fn->value) / (fn[1].value - fn->value);
+			//first weight
+			if (fn->child < 0)
+			{
+				if (undecided) w = fn->minweight + random() * (fn->maxweight - fn->minweight);
+				else w = fn->weight;
+				fn++;
+				//second weight
+				if (fn->child < 0)
+				{
+					if (undecided) w2 = fn->minweight + random() * (fn->maxweight - fn->minweight);
+					else w2 = fn->weight;
+					//scale between the two weights
+					if (defaultcase) w = w2;
+					else w = (1 - scale) * w + scale * w2;
+				} //end if
+				else
+				{
+					//wait for the weight of the switch in the second case
+					fi = &stack[sp++];
+					fi->second = -1;
+					fi->undecided = undecided;
+					fi->defaultcase = defaultcase;
+					fi->scale = scale;
+					fi->first = w;
+					i = fn->child;
+					undecided = qfalse;
+					continue;
+				} //end else
+			} //end if
+			else
+			{
+				//wait for the weight of the switch in the first case
+				fi = &stack[sp++];
+				fi->second = fn - nodes + 1;
+				fi->undecided = undecided;
+				fi->defaultcase = defaultcase;
+				fi->scale = scale;
+				i = fn->child;
+				continue;
+			} //end else
 		} //end else
-	} //end if
-	return 0;
-#endif
+		//finish the interpolations waiting for this weight
+		while(sp > 0)
+		{
+			fi = &stack[sp-1];
+			if (fi->second >= 0)
+			{
+				fi->first = w;
+				//second weight
+				fn = &nodes[fi->second];
+				fi->second = -1;
+				if (fn->child >= 0) break;
+				if (fi->undecided) w = fn->minweight + random() * (fn->maxweight - fn->minweight);
+				else w = fn->weight;
+			} //end if
+			//scale between the two weights
+			if (!fi->defaultcase) w = (1 - fi->scale) * fi->first + fi->scale * w;
+			sp--;
+		} //end while
+		if (!sp) return w;
+		//evaluate the switch of the second case
+		i = fn->child;
+		undecided = qfalse;
+	} //end while
+} //end of the function FuzzyWeightIterative
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+float FuzzyWeight(int *inventory, weightconfig_t *wc, int weightnum)
+{
+	fuzzyseperator_t *fs;
+
+	fs = wc->weights[weightnum].firstseperator;
+	if (!fs) return 0;
+	if (wc->fuzzynodes) return FuzzyWeightIterative(inventory, wc, fs - wc->seperators, qfalse);
+	return FuzzyWeight_r(inventory, fs);
 } //end of the function FuzzyWeight
 //===========================================================================
 //
@@ -686,30 +948,36 @@ float FuzzyWeight(int *inventory, weightconfig_t *wc, int weightnum)
 //===========================================================================
 float FuzzyWeightUndecided(int *inventory, weightconfig_t *wc, int weightnum)
 {
-#ifdef EVALUATERECURSIVELY
-	return FuzzyWeightUndecided_r(inventory, wc->weights[weightnum].firstseperator);
-#else
-	fuzzyseperator_t *s;
+	fuzzyseperator_t *fs;
 
-	s = wc->weights[weightnum].firstseperator;
-	if (!s) return 0;
-	while(1)
-	{
-		if (inventory[s->index] < s->value)
-		{
-			if (s->child) s = s->child;
-			else return s->minweight + random() * (s->maxweight - s->minweight);
-		} //end if
-		else
-		{
-			if (s->next) s = s->next;
-			else return s->minweight + random() * (s->maxweight - s->minweight);
-		} //end else
-	} //end if
-	return 0;
-#endif
+	fs = wc->weights[weightnum].firstseperator;
+	if (!fs) return 0;
+	if (wc->fuzzynodes) return FuzzyWeightIterative(inventory, wc, fs - wc->seperators, qtrue);
+	return FuzzyWeightUndecided_r(inventory, fs);
 } //end of the function FuzzyWeightUndecided
 //===========================================================================
+// evaluates the fuzzy weight for a number of inventories
+//
+// Parameter:				inventories		: inventories to evaluate the weight for
+//								numinventories	: number of inventories
+//								weights			: stores the weight for every inventory
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+void FuzzyWeights(int **inventories, int numinventories, weightconfig_t *wc, int weightnum, float *weights)
+{
+	fuzzyseperator_t *fs;
+	int i;
+
+	fs = wc->weights[weightnum].firstseperator;
+	for (i = 0; i < numinventories; i++)
+	{
+		if (!fs) weights[i] = 0;
+		else if (wc->fuzzynodes) weights[i] = FuzzyWeightIterative(inventories[i], wc, fs - wc->seperators, qfalse);
+		else weights[i] = FuzzyWeight_r(inventories[i], fs);
+	} //end for
+} //end of the function FuzzyWeights
+//===========================================================================
 //
 // Parameter:				-
 // Returns:					-
@@ -746,6 +1014,7 @@ void EvolveWeightConfig(weightconfig_t *config)
 	{
 		EvolveFuzzySeperator_r(config->weights[i].firstseperator);
 	} //end for
+	UpdateFuzzyWeights(config);
 } //end of the function EvolveWeightConfig
 //===========================================================================
 //
@@ -789,6 +1058,7 @@ void ScaleWeight(weightconfig_t *config, char *name, float scale)
 			break;
 		} //end if
 	} //end for
+	UpdateFuzzyWeights(config);
 } //end of the function ScaleWeight
 //===========================================================================
 //
@@ -831,6 +1101,7 @@ void ScaleFuzzyBalanceRange(weightconfig_t *config, float scale)
 	{
 		ScaleFuzzySeperatorBalanceRange_r(config->weights[i].firstseperator, scale);
 	} //end for
+	UpdateFuzzyWeights(config);
 } //end of the function ScaleFuzzyBalanceRange
 //===========================================================================
 //
@@ -902,6 +1173,7 @@ void InterbreedWeightConfigs(weightconfig_t *config1, weightconfig_t *config2,
 									config2->weights[i].firstseperator,
 									configout->weights[i].firstseperator);
 	} //end for
+	UpdateFuzzyWeights(configout);
 } //end of the function InterbreedWeightConfigs
 //===========================================================================
 //
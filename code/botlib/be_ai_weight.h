@@ -45,6 +45,20 @@ typedef struct fuzzyseperator_s
 	struct fuzzyseperator_s *next;
 } fuzzyseperator_t;
 
+//seperator without links, the child is an index into the same array and
+//the next case of a switch is the next node
+typedef struct fuzzynode_s
+{
+	int index;					//inventory index tested by the case
+	int value;					//inventory value up to which the case applies
+	int nextvalue;				//value of the next case, INT_MAX for the last case
+	int child;					//first case of the switch in the case, -1 if none
+	int last;					//last case of the switch
+	float weight;
+	float minweight;
+	float maxweight;
+} fuzzynode_t;
+
 //fuzzy weight
 typedef struct weight_s
 {
@@ -58,6 +72,10 @@ typedef struct weightconfig_s
 	int numweights;
 	weight_t weights[MAX_WEIGHTS];
 	char		filename[MAX_QPATH];
+	fuzzyseperator_t *seperators;		//all seperators of the weights in one block
+	//the seperators of the block as an array of nodes, evaluated iteratively
+	int numseperators;
+	struct fuzzynode_s *fuzzynodes;
 } weightconfig_t;
 
 //reads a weight configuration
@@ -71,6 +89,8 @@ int FindFuzzyWeight(weightconfig_t *wc, char *name);
 //returns the fuzzy weight for the given inventory and weight
 float FuzzyWeight(int *inventory, weightconfig_t *wc, int weightnum);
 float FuzzyWeightUndecided(int *inventory, weightconfig_t *wc, int weightnum);
+//returns the fuzzy weight for a number of inventories
+void FuzzyWeights(int **inventories, int numinventories, weightconfig_t *wc, int weightnum, float *weights);
 //scales the weight with the given name
 void ScaleWeight(weightconfig_t *config, char *name, float scale);
 //scale the balance range
@@ -39,9 +39,20 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "be_ea.h"
 
 #define MAX_USERMOVE				400
+#define MAX_DEFERREDCOMMANDS		4
+#define MAX_DEFERREDCOMMAND			128
 
 bot_input_t *botinputs;
 
+//client commands issued by bot jobs, executed once the jobs are done
+typedef struct ea_deferred_s
+{
+	int numcommands;
+	char commands[MAX_DEFERREDCOMMANDS][MAX_DEFERREDCOMMAND];
+} ea_deferred_t;
+
+static ea_deferred_t ea_deferred[MAX_CLIENTS];
+
 //===========================================================================
 //
 // Parameter:				-
@@ -134,10 +145,45 @@ void EA_Gesture(int client)
 //===========================================================================
 void EA_Command(int client, char *command)
 {
+	ea_deferred_t *deferred;
+
+	//the command runs game code, which bot jobs on worker threads can't
+	if (botlibglobals.runningjobs && client >= 0 && client < MAX_CLIENTS)
+	{
+		deferred = &ea_deferred[client];
+		if (deferred->numcommands >= MAX_DEFERREDCOMMANDS)
+		{
+			botimport.Print(PRT_WARNING, "EA_Command: too many commands for client %d\n", client);
+			return;
+		} //end if
+		Q_strncpyz(deferred->commands[deferred->numcommands++], command, MAX_DEFERREDCOMMAND);
+		return;
+	} //end if
 	botimport.BotClientCommand(client, command);
 } //end of the function EA_Command
 //===========================================================================
 //
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+void EA_ExecuteDeferredCommands(void)
+{
+	int client, i;
+	ea_deferred_t *deferred;
+
+	for (client = 0; client < MAX_CLIENTS; client++)
+	{
+		deferred = &ea_deferred[client];
+		for (i = 0; i < deferred->numcommands; i++)
+		{
+			botimport.BotClientCommand(client, deferred->commands[i]);
+		} //end for
+		deferred->numcommands = 0;
+	} //end for
+} //end of the function EA_ExecuteDeferredCommands
+//===========================================================================
+//
 // Parameter:			-
 // Returns:				-
 // Changes Globals:		-
@@ -34,6 +34,8 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 void EA_Say(int client, char *str);
 void EA_SayTeam(int client, char *str);
 void EA_Command(int client, char *command );
+//execute the commands bot jobs issued
+void EA_ExecuteDeferredCommands(void);
 
 void EA_Action(int client, int action);
 void EA_Crouch(int client);
@@ -61,6 +61,8 @@ botlib_import_t botimport;
 int botDeveloper;
 //qtrue if the library is setup
 int botlibsetup = qfalse;
+//mutexes behind BotLibLock, NULL when the import has none
+static void *botliblocks[BLLOCK_MAX];
 
 //===========================================================================
 //
@@ -112,6 +114,65 @@ qboolean ValidEntityNumber(int num, char *str)
 	return qtrue;
 } //end of the function BotValidateClientNumber
 //===========================================================================
+// the locks are only contended while the server runs bot jobs on
+// worker threads, otherwise they cost an uncontended mutex each
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+static void BotLibInitLocks(void)
+{
+	int i;
+
+	if (!botimport.MutexCreate) return;
+	for (i = 0; i < BLLOCK_MAX; i++)
+	{
+		if (!botliblocks[i]) botliblocks[i] = botimport.MutexCreate();
+	} //end for
+} //end of the function BotLibInitLocks
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+void BotLibLock(botliblock_t lock)
+{
+	if (botliblocks[lock]) botimport.MutexLock(botliblocks[lock]);
+} //end of the function BotLibLock
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+void BotLibUnlock(botliblock_t lock)
+{
+	if (botliblocks[lock]) botimport.MutexUnlock(botliblocks[lock]);
+} //end of the function BotLibUnlock
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+void BotLibRunJobs(void (*job)(void *data, int index), void *data, int numjobs)
+{
+	int i;
+
+	//without locks or worker threads the jobs run right here
+	if (!botimport.RunJobs || !botliblocks[0] || numjobs < 2)
+	{
+		for (i = 0; i < numjobs; i++) job(data, i);
+		return;
+	} //end if
+	botlibglobals.runningjobs = qtrue;
+	botimport.RunJobs(job, data, numjobs);
+	botlibglobals.runningjobs = qfalse;
+	EA_ExecuteDeferredCommands();
+} //end of the function BotLibRunJobs
+//===========================================================================
 //
 // Parameter:				-
 // Returns:					-
@@ -197,6 +258,8 @@ int Export_BotLibShutdown(void)
 	LibVarDeAllocAll();
 	//remove all global defines from the pre compiler
 	PC_RemoveAllGlobalDefines();
+	//free the pre compiler token cache
+	PC_FreeTokenCache();
 
 	//dump all allocated memory
 //	DumpMemory();
@@ -281,6 +344,49 @@ int Export_BotLibLoadMap(const char *mapname)
 	return BLERR_NOERROR;
 } //end of the function Export_BotLibLoadMap
 //===========================================================================
+// sets up only the AAS, loads the map, builds all the routing caches for
+// the default travel flags, writes them to the route cache file and shuts
+// the AAS down again. Used without a game, so the library can't be setup.
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+int Export_BotLibPrecomputeRouting(const char *mapname)
+{
+	int errnum, frame;
+
+	if (botlibglobals.botlibsetup)
+	{
+		botimport.Print(PRT_ERROR, "BotLibPrecomputeRouting: bot library is in use\n");
+		return BLERR_LIBRARYALREADYSETUP;
+	} //end if
+	botDeveloper = LibVarGetValue("bot_developer");
+	memset( &botlibglobals, 0, sizeof(botlibglobals) );
+	botlibglobals.maxclients = (int) LibVarValue("maxclients", "128");
+	botlibglobals.maxentities = (int) LibVarValue("maxentities", "1024");
+	//
+	errnum = AAS_Setup();
+	if (errnum == BLERR_NOERROR)
+	{
+		errnum = AAS_LoadMap(mapname);
+	} //end if
+	if (errnum == BLERR_NOERROR)
+	{
+		//finish the initialization, this calculates the reachabilities
+		//when the AAS file doesn't have them
+		for (frame = 0; !AAS_Initialized(); frame++)
+		{
+			AAS_StartFrame(frame * 0.1f);
+		} //end for
+		AAS_PrecomputeRoutingCache(TFL_DEFAULT);
+		AAS_WriteRouteCache();
+	} //end if
+	AAS_Shutdown();
+	LibVarDeAllocAll();
+	return errnum;
+} //end of the function Export_BotLibPrecomputeRouting
+//===========================================================================
 //
 // Parameter:				-
 // Returns:					-
@@ -692,6 +798,7 @@ static void Init_AAS_Export( aas_export_t *aas ) {
 	// be_aas_route.c
 	//--------------------------------------------
 	aas->AAS_AreaTravelTimeToGoalArea = AAS_AreaTravelTimeToGoalArea;
+	aas->AAS_AreaTravelTimeToGoalAreaBatch = AAS_AreaTravelTimeToGoalAreaBatch;
 	aas->AAS_EnableRoutingArea = AAS_EnableRoutingArea;
 	aas->AAS_PredictRoute = AAS_PredictRoute;
 	//--------------------------------------------
@@ -818,6 +925,7 @@ static void Init_AI_Export( ai_export_t *ai ) {
 	//-----------------------------------
 	ai->BotResetMoveState = BotResetMoveState;
 	ai->BotMoveToGoal = BotMoveToGoal;
+	ai->BotMoveToGoalBatch = BotMoveToGoalBatch;
 	ai->BotMoveInDirection = BotMoveInDirection;
 	ai->BotResetAvoidReach = BotResetAvoidReach;
 	ai->BotResetLastAvoidReach = BotResetLastAvoidReach;
@@ -832,6 +940,7 @@ static void Init_AI_Export( ai_export_t *ai ) {
 	// be_ai_weap.h
 	//-----------------------------------
 	ai->BotChooseBestFightWeapon = BotChooseBestFightWeapon;
+	ai->BotChooseBestFightWeaponBatch = BotChooseBestFightWeaponBatch;
 	ai->BotGetWeaponInfo = BotGetWeaponInfo;
 	ai->BotLoadWeaponWeights = BotLoadWeaponWeights;
 	ai->BotAllocWeaponState = BotAllocWeaponState;
@@ -855,6 +964,7 @@ botlib_export_t *GetBotLibAPI(int apiVersion, botlib_import_t *import) {
 	assert(botimport.Print);
 
 	Com_Memset( &be_botlib_export, 0, sizeof( be_botlib_export ) );
+	BotLibInitLocks();
 
 	if ( apiVersion != BOTLIB_API_VERSION ) {
 		botimport.Print( PRT_ERROR, "Mismatched BOTLIB_API_VERSION: expected %i, got %i\n", BOTLIB_API_VERSION, apiVersion );
@@ -878,6 +988,7 @@ botlib_export_t *GetBotLibAPI(int apiVersion, botlib_import_t *import) {
 
 	be_botlib_export.BotLibStartFrame = Export_BotLibStartFrame;
 	be_botlib_export.BotLibLoadMap = Export_BotLibLoadMap;
+	be_botlib_export.BotLibPrecomputeRouting = Export_BotLibPrecomputeRouting;
 	be_botlib_export.BotLibUpdateEntity = Export_BotLibUpdateEntity;
 	be_botlib_export.Test = BotExportTest;
 
@@ -39,6 +39,7 @@ typedef struct botlib_globals_s
 	int maxentities;						//maximum number of entities
 	int maxclients;							//maximum number of clients
 	float time;								//the global time
+	int runningjobs;						//true while bot jobs may run on worker threads
 #ifdef DEBUG
 	qboolean debug;							//true if debug is on
 	int goalareanum;
@@ -52,6 +53,22 @@ extern botlib_globals_t botlibglobals;
 extern botlib_import_t botimport;
 extern int botDeveloper;					//true if developer is on
 
+//locks around botlib state that bot jobs on worker threads share
+typedef enum
+{
+	BLLOCK_MEMORY,							//zone and hunk allocation
+	BLLOCK_ROUTING,							//routing cache lookup, update and eviction
+	BLLOCK_LINKHEAP,						//aas link heap
+	BLLOCK_MAX
+} botliblock_t;
+
+void BotLibLock(botliblock_t lock);
+void BotLibUnlock(botliblock_t lock);
+//calls job for every index below numjobs, on worker threads when the
+//server provides them. Jobs may only touch botlib state behind the locks
+//above and per bot state of their own.
+void BotLibRunJobs(void (*job)(void *data, int index), void *data, int numjobs);
+
 //
 int Sys_MilliSeconds(void);
 
@@ -77,6 +77,7 @@ struct weaponinfo_s;
 #define BLERR_CANNOTLOADITEMCONFIG		10	//cannot load item config
 #define BLERR_CANNOTLOADWEAPONWEIGHTS	11	//cannot load weapon weights
 #define BLERR_CANNOTLOADWEAPONCONFIG	12	//cannot load weapon config
+#define BLERR_LIBRARYALREADYSETUP		13	//library is setup and in use
 
 //action flags
 #define ACTION_ATTACK			0x00000001
@@ -196,6 +197,9 @@ typedef struct botlib_import_s
 	int			(*FS_Write)( const void *buffer, int len, fileHandle_t f );
 	void		(*FS_FCloseFile)( fileHandle_t f );
 	int			(*FS_Seek)( fileHandle_t f, long offset, int origin );
+	//map a file read only, NULL if it has to be read with FS_Read
+	void		*(*FS_MapFile)( const char *qpath, int *length );
+	void		(*FS_UnmapFile)( void *buffer, int length );
 	//debug visualisation stuff
 	int			(*DebugLineCreate)(void);
 	void		(*DebugLineDelete)(int line);
@@ -203,6 +207,13 @@ typedef struct botlib_import_s
 	//
 	int			(*DebugPolygonCreate)(int color, int numPoints, vec3_t *points);
 	void		(*DebugPolygonDelete)(int id);
+	//mutexes guarding botlib state shared by bot jobs on worker threads
+	void		*(*MutexCreate)(void);
+	void		(*MutexLock)(void *mutex);
+	void		(*MutexUnlock)(void *mutex);
+	void		(*MutexFree)(void *mutex);
+	//run job for every index below numJobs, possibly on worker threads
+	void		(*RunJobs)(void (*job)(void *data, int index), void *data, int numJobs);
 } botlib_import_t;
 
 typedef struct aas_export_s
@@ -242,6 +253,7 @@ typedef struct aas_export_s
 	// be_aas_route.c
 	//--------------------------------------------
 	int			(*AAS_AreaTravelTimeToGoalArea)(int areanum, vec3_t origin, int goalareanum, int travelflags);
+	void		(*AAS_AreaTravelTimeToGoalAreaBatch)(int *traveltimes, int numqueries, int *areanums, vec3_t *origins, int *goalareanums, int travelflags);
 	int			(*AAS_EnableRoutingArea)(int areanum, int enable);
 	int			(*AAS_PredictRoute)(struct aas_predictroute_s *route, int areanum, vec3_t origin,
 							int goalareanum, int travelflags, int maxareas, int maxtime,
@@ -370,6 +382,7 @@ typedef struct ai_export_s
 	//-----------------------------------
 	void	(*BotResetMoveState)(int movestate);
 	void	(*BotMoveToGoal)(struct bot_moveresult_s *result, int movestate, struct bot_goal_s *goal, int travelflags);
+	void	(*BotMoveToGoalBatch)(struct bot_moveresult_s *results, int nummoves, int *movestates, struct bot_goal_s *goals, int *travelflags);
 	int		(*BotMoveInDirection)(int movestate, vec3_t dir, float speed, int type);
 	void	(*BotResetAvoidReach)(int movestate);
 	void	(*BotResetLastAvoidReach)(int movestate);
@@ -384,6 +397,7 @@ typedef struct ai_export_s
 	// be_ai_weap.h
 	//-----------------------------------
 	int		(*BotChooseBestFightWeapon)(int weaponstate, int *inventory);
+	void	(*BotChooseBestFightWeaponBatch)(int *weapons, int numstates, int *weaponstates, int *inventories, int inventorysize);
 	void	(*BotGetWeaponInfo)(int weaponstate, int weapon, struct weaponinfo_s *weaponinfo);
 	int		(*BotLoadWeaponWeights)(int weaponstate, char *filename);
 	int		(*BotAllocWeaponState)(void);
@@ -424,6 +438,9 @@ typedef struct botlib_export_s
 	int (*BotLibStartFrame)(float time);
 	//load a new map in the bot library
 	int (*BotLibLoadMap)(const char *mapname);
+	//load a map without a game and write the routing caches for all areas,
+	//only while the library isn't setup, returns BLERR_
+	int (*BotLibPrecomputeRouting)(const char *mapname);
 	//entity updates
 	int (*BotLibUpdateEntity)(int ent, bot_entitystate_t *state);
 	//just for testing
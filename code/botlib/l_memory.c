@@ -102,6 +102,7 @@ void *GetMemory(unsigned long size)
 	void *ptr;
 	memoryblock_t *block;
 	assert(botimport.GetMemory);
+	BotLibLock(BLLOCK_MEMORY);
 	ptr = botimport.GetMemory(size + sizeof(memoryblock_t));
 	block = (memoryblock_t *) ptr;
 	block->id = MEM_ID;
@@ -116,6 +117,7 @@ void *GetMemory(unsigned long size)
 	allocatedmemory += block->size;
 	totalmemorysize += block->size + sizeof(memoryblock_t);
 	numblocks++;
+	BotLibUnlock(BLLOCK_MEMORY);
 	return block->ptr;
 } //end of the function GetMemoryDebug
 //===========================================================================
@@ -154,6 +156,7 @@ void *GetHunkMemory(unsigned long size)
 	void *ptr;
 	memoryblock_t *block;
 
+	BotLibLock(BLLOCK_MEMORY);
 	ptr = botimport.HunkAlloc(size + sizeof(memoryblock_t));
 	block = (memoryblock_t *) ptr;
 	block->id = HUNK_ID;
@@ -168,6 +171,7 @@ void *GetHunkMemory(unsigned long size)
 	allocatedmemory += block->size;
 	totalmemorysize += block->size + sizeof(memoryblock_t);
 	numblocks++;
+	BotLibUnlock(BLLOCK_MEMORY);
 	return block->ptr;
 } //end of the function GetHunkMemoryDebug
 //===========================================================================
@@ -235,6 +239,7 @@ void FreeMemory(void *ptr)
 
 	block = BlockFromPointer(ptr, "FreeMemory");
 	if (!block) return;
+	BotLibLock(BLLOCK_MEMORY);
 	UnlinkMemoryBlock(block);
 	allocatedmemory -= block->size;
 	totalmemorysize -= block->size + sizeof(memoryblock_t);
@@ -244,6 +249,7 @@ void FreeMemory(void *ptr)
 	{
 		botimport.FreeMemory(block);
 	} //end if
+	BotLibUnlock(BLLOCK_MEMORY);
 } //end of the function FreeMemory
 //===========================================================================
 //
@@ -280,6 +286,7 @@ void PrintUsedMemorySize(void)
 	botimport.Print(PRT_MESSAGE, "total allocated memory: %d KB\n", allocatedmemory >> 10);
 	botimport.Print(PRT_MESSAGE, "total botlib memory: %d KB\n", totalmemorysize >> 10);
 	botimport.Print(PRT_MESSAGE, "total memory blocks: %d\n", numblocks);
+	PrintMemoryPoolUsage();
 } //end of the function PrintUsedMemorySize
 //===========================================================================
 //
@@ -346,7 +353,9 @@ void *GetMemory(unsigned long size)
 	void *ptr;
 	unsigned long int *memid;
 
+	BotLibLock(BLLOCK_MEMORY);
 	ptr = botimport.GetMemory(size + sizeof(unsigned long int));
+	BotLibUnlock(BLLOCK_MEMORY);
 	if (!ptr) return NULL;
 	memid = (unsigned long int *) ptr;
 	*memid = MEM_ID;
@@ -388,7 +397,9 @@ void *GetHunkMemory(unsigned long size)
 	void *ptr;
 	unsigned long int *memid;
 
+	BotLibLock(BLLOCK_MEMORY);
 	ptr = botimport.HunkAlloc(size + sizeof(unsigned long int));
+	BotLibUnlock(BLLOCK_MEMORY);
 	if (!ptr) return NULL;
 	memid = (unsigned long int *) ptr;
 	*memid = HUNK_ID;
@@ -429,7 +440,9 @@ void FreeMemory(void *ptr)
 
 	if (*memid == MEM_ID)
 	{
+		BotLibLock(BLLOCK_MEMORY);
 		botimport.FreeMemory(memid);
+		BotLibUnlock(BLLOCK_MEMORY);
 	} //end if
 } //end of the function FreeMemory
 //===========================================================================
@@ -450,6 +463,7 @@ int AvailableMemory(void)
 //===========================================================================
 void PrintUsedMemorySize(void)
 {
+	PrintMemoryPoolUsage();
 } //end of the function PrintUsedMemorySize
 //===========================================================================
 //
@@ -462,3 +476,314 @@ void PrintMemoryLabels(void)
 } //end of the function PrintMemoryLabels
 
 #endif
+
+//===========================================================================
+// fixed size memory pools
+//
+// blocks are carved from chunks allocated through botimport.GetMemory
+// and kept on a free list, so allocating and freeing a block is O(1)
+// and does not add a memory header to every block
+//===========================================================================
+
+#define POOL_ALIGN			8
+#define POOL_CHUNKHEADER	((sizeof(memorypoolchunk_t) + POOL_ALIGN - 1) & ~(POOL_ALIGN - 1))
+
+typedef struct memorypoolblock_s
+{
+	struct memorypoolblock_s *next;
+} memorypoolblock_t;
+
+typedef struct memorypoolchunk_s
+{
+	struct memorypoolchunk_s *next;
+} memorypoolchunk_t;
+
+typedef struct memorypool_s
+{
+	char name[32];
+	int blocksize;							//size of the blocks handed out
+	int blocksperchunk;						//number of blocks in a chunk
+	memorypoolchunk_t *chunks;				//chunks the blocks are carved from
+	int numchunks;
+	memorypoolblock_t *freeblocks;			//blocks not in use
+	int numfree;							//number of blocks on the free list
+	int compactfree;						//number of free blocks after the last compaction
+	int numused;							//number of blocks in use
+	int peakused;							//peak number of blocks in use
+	int numallocs;							//number of blocks handed out
+	struct memorypool_s *prev, *next;
+} memorypool_t;
+
+memorypool_t *memorypools;
+
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+memorypool_t *CreateMemoryPool(char *name, int blocksize, int blocksperchunk)
+{
+	memorypool_t *pool;
+
+	pool = (memorypool_t *) GetClearedMemory(sizeof(memorypool_t));
+	if (!pool) return NULL;
+	Q_strncpyz(pool->name, name, sizeof(pool->name));
+	if (blocksize < sizeof(memorypoolblock_t)) blocksize = sizeof(memorypoolblock_t);
+	pool->blocksize = (blocksize + POOL_ALIGN - 1) & ~(POOL_ALIGN - 1);
+	pool->blocksperchunk = blocksperchunk > 0 ? blocksperchunk : 1;
+	//link the pool for the usage statistics
+	BotLibLock(BLLOCK_MEMORY);
+	pool->prev = NULL;
+	pool->next = memorypools;
+	if (memorypools) memorypools->prev = pool;
+	memorypools = pool;
+	BotLibUnlock(BLLOCK_MEMORY);
+	return pool;
+} //end of the function CreateMemoryPool
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void FreeMemoryPool(memorypool_t *pool)
+{
+	memorypoolchunk_t *chunk, *nextchunk;
+
+	BotLibLock(BLLOCK_MEMORY);
+	if (pool->prev) pool->prev->next = pool->next;
+	else memorypools = pool->next;
+	if (pool->next) pool->next->prev = pool->prev;
+	//
+	for (chunk = pool->chunks; chunk; chunk = nextchunk)
+	{
+		nextchunk = chunk->next;
+		botimport.FreeMemory(chunk);
+	} //end for
+	BotLibUnlock(BLLOCK_MEMORY);
+	FreeMemory(pool);
+} //end of the function FreeMemoryPool
+//===========================================================================
+// the caller holds BLLOCK_MEMORY
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static qboolean AllocMemoryPoolChunk(memorypool_t *pool)
+{
+	memorypoolchunk_t *chunk;
+	memorypoolblock_t *block;
+	int i;
+
+	chunk = (memorypoolchunk_t *) botimport.GetMemory(POOL_CHUNKHEADER +
+										pool->blocksperchunk * pool->blocksize);
+	if (!chunk) return qfalse;
+	chunk->next = pool->chunks;
+	pool->chunks = chunk;
+	pool->numchunks++;
+	//put the blocks on the free list in address order
+	for (i = pool->blocksperchunk - 1; i >= 0; i--)
+	{
+		block = (memorypoolblock_t *) ((byte *) chunk + POOL_CHUNKHEADER + i * pool->blocksize);
+		block->next = pool->freeblocks;
+		pool->freeblocks = block;
+	} //end for
+	pool->numfree += pool->blocksperchunk;
+	return qtrue;
+} //end of the function AllocMemoryPoolChunk
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void *GetPoolMemory(memorypool_t *pool)
+{
+	memorypoolblock_t *block;
+
+	BotLibLock(BLLOCK_MEMORY);
+	if (!pool->freeblocks && !AllocMemoryPoolChunk(pool))
+	{
+		BotLibUnlock(BLLOCK_MEMORY);
+		return NULL;
+	} //end if
+	block = pool->freeblocks;
+	pool->freeblocks = block->next;
+	pool->numfree--;
+	if (pool->compactfree > pool->numfree) pool->compactfree = pool->numfree;
+	pool->numused++;
+	if (pool->numused > pool->peakused) pool->peakused = pool->numused;
+	pool->numallocs++;
+	BotLibUnlock(BLLOCK_MEMORY);
+	return block;
+} //end of the function GetPoolMemory
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void *GetClearedPoolMemory(memorypool_t *pool)
+{
+	void *ptr;
+
+	ptr = GetPoolMemory(pool);
+	if (ptr) Com_Memset(ptr, 0, pool->blocksize);
+	return ptr;
+} //end of the function GetClearedPoolMemory
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void FreePoolMemory(memorypool_t *pool, void *ptr)
+{
+	memorypoolblock_t *block;
+
+	block = (memorypoolblock_t *) ptr;
+	BotLibLock(BLLOCK_MEMORY);
+	block->next = pool->freeblocks;
+	pool->freeblocks = block;
+	pool->numfree++;
+	pool->numused--;
+	BotLibUnlock(BLLOCK_MEMORY);
+} //end of the function FreePoolMemory
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static int MemoryPoolChunkCompare(const void *a, const void *b)
+{
+	memorypoolchunk_t *chunk1, *chunk2;
+
+	chunk1 = *(memorypoolchunk_t **) a;
+	chunk2 = *(memorypoolchunk_t **) b;
+	if (chunk1 < chunk2) return -1;
+	if (chunk1 > chunk2) return 1;
+	return 0;
+} //end of the function MemoryPoolChunkCompare
+//===========================================================================
+// returns the index of the chunk the block is carved from
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static int MemoryPoolBlockChunk(memorypoolchunk_t **chunks, int numchunks, void *ptr)
+{
+	int low, high, mid;
+
+	low = 0;
+	high = numchunks - 1;
+	while (low < high)
+	{
+		mid = (low + high + 1) >> 1;
+		if ((byte *) chunks[mid] > (byte *) ptr) high = mid - 1;
+		else low = mid;
+	} //end while
+	return low;
+} //end of the function MemoryPoolBlockChunk
+//===========================================================================
+// frees the chunks of which all blocks are on the free list
+// the free list is only compacted once at least two chunks worth of
+// blocks were freed since the last compaction, so a pool cycling
+// through a few blocks does not free and allocate a chunk every time
+//
+// Parameter:			-
+// Returns:				number of bytes returned to the engine
+// Changes Globals:		-
+//===========================================================================
+int CompactMemoryPool(memorypool_t *pool)
+{
+	memorypoolchunk_t **chunks, *chunk, **lastchunk;
+	memorypoolblock_t *block, **lastblock;
+	int *numfree, i, n, numchunks, numreleased, released;
+
+	BotLibLock(BLLOCK_MEMORY);
+	if (pool->numfree - pool->compactfree < 2 * pool->blocksperchunk)
+	{
+		BotLibUnlock(BLLOCK_MEMORY);
+		return 0;
+	} //end if
+	//the sorted chunk array keeps its size while chunks are freed
+	numchunks = pool->numchunks;
+	chunks = (memorypoolchunk_t **) botimport.GetMemory(numchunks *
+									(sizeof(memorypoolchunk_t *) + sizeof(int)));
+	if (!chunks)
+	{
+		BotLibUnlock(BLLOCK_MEMORY);
+		return 0;
+	} //end if
+	numfree = (int *) (chunks + numchunks);
+	for (n = 0, chunk = pool->chunks; chunk; chunk = chunk->next)
+	{
+		chunks[n++] = chunk;
+	} //end for
+	qsort(chunks, numchunks, sizeof(memorypoolchunk_t *), MemoryPoolChunkCompare);
+	//count the free blocks in every chunk
+	Com_Memset(numfree, 0, numchunks * sizeof(int));
+	for (block = pool->freeblocks; block; block = block->next)
+	{
+		numfree[MemoryPoolBlockChunk(chunks, numchunks, block)]++;
+	} //end for
+	//remove the blocks of the empty chunks from the free list
+	lastblock = &pool->freeblocks;
+	for (block = pool->freeblocks; block; block = block->next)
+	{
+		if (numfree[MemoryPoolBlockChunk(chunks, numchunks, block)] >= pool->blocksperchunk)
+		{
+			pool->numfree--;
+			continue;
+		} //end if
+		*lastblock = block;
+		lastblock = &block->next;
+	} //end for
+	*lastblock = NULL;
+	//free the empty chunks
+	numreleased = 0;
+	lastchunk = &pool->chunks;
+	for (chunk = pool->chunks; chunk; chunk = *lastchunk)
+	{
+		i = MemoryPoolBlockChunk(chunks, numchunks, chunk);
+		if (numfree[i] >= pool->blocksperchunk)
+		{
+			*lastchunk = chunk->next;
+			botimport.FreeMemory(chunk);
+			numreleased++;
+			continue;
+		} //end if
+		lastchunk = &chunk->next;
+	} //end for
+	pool->numchunks -= numreleased;
+	released = numreleased * (POOL_CHUNKHEADER + pool->blocksperchunk * pool->blocksize);
+	botimport.FreeMemory(chunks);
+	pool->compactfree = pool->numfree;
+	BotLibUnlock(BLLOCK_MEMORY);
+	return released;
+} //end of the function CompactMemoryPool
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void PrintMemoryPoolUsage(void)
+{
+	memorypool_t *pool;
+	int size;
+
+	BotLibLock(BLLOCK_MEMORY);
+	for (pool = memorypools; pool; pool = pool->next)
+	{
+		size = pool->numchunks * (POOL_CHUNKHEADER + pool->blocksperchunk * pool->blocksize);
+		botimport.Print(PRT_MESSAGE, "%-24s %6d bytes: %6d used, %6d peak, %6d free, %8d allocs, %6d KB\n",
+							pool->name, pool->blocksize, pool->numused, pool->peakused,
+							pool->numfree, pool->numallocs, size >> 10);
+	} //end for
+	BotLibUnlock(BLLOCK_MEMORY);
+} //end of the function PrintMemoryPoolUsage
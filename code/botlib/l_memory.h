@@ -74,3 +74,20 @@ void PrintMemoryLabels(void);
 int MemoryByteSize(void *ptr);
 //free all allocated memory
 void DumpMemory(void);
+
+//pool with fixed size memory blocks
+struct memorypool_s;
+//create a pool with blocks of the given size allocated in chunks of blocksperchunk blocks
+struct memorypool_s *CreateMemoryPool(char *name, int blocksize, int blocksperchunk);
+//free the pool and all of its blocks
+void FreeMemoryPool(struct memorypool_s *pool);
+//allocate a block from the pool
+void *GetPoolMemory(struct memorypool_s *pool);
+//allocate a block from the pool and clear it
+void *GetClearedPoolMemory(struct memorypool_s *pool);
+//return a block to the pool
+void FreePoolMemory(struct memorypool_s *pool, void *ptr);
+//free the pool chunks without blocks in use, returns the number of bytes freed
+int CompactMemoryPool(struct memorypool_s *pool);
+//prints the usage of all memory pools
+void PrintMemoryPoolUsage(void);
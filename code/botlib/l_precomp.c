@@ -98,6 +98,11 @@ typedef enum {qfalse, qtrue}	qboolean;
 
 #define DEFINEHASHING			1
 
+#ifdef BOTLIB
+//keep the preprocessed tokens of loaded source files
+#define TOKENCACHE
+#endif //BOTLIB
+
 //directive name with parse function
 typedef struct directive_s
 {
@@ -118,6 +123,91 @@ token_t *freetokens;					//free tokens from the heap
 
 //list with global defines added to every source loaded
 define_t *globaldefines;
+//changed every time the global defines change
+int globaldefinesversion;
+//number of source errors and warnings printed
+int numsourcemessages;
+
+#ifdef TOKENCACHE
+
+#define MAX_CACHEDINCLUDES		32
+#define MAX_TOKENCACHESIZE		(4 * 1024 * 1024)
+
+//preprocessed token
+typedef struct pc_cachedtoken_s
+{
+	int type;
+	int subtype;
+	unsigned long int intvalue;
+	float floatvalue;
+	int line;
+	int linescrossed;
+	int string;								//offset of the token string
+} pc_cachedtoken_t;
+
+//file included by a cached source file
+typedef struct pc_cachedinclude_s
+{
+	char filename[MAX_QPATH];
+	int length;
+	unsigned int checksum;
+} pc_cachedinclude_t;
+
+//preprocessed tokens of a source file
+typedef struct pc_tokencache_s
+{
+	char filename[MAX_QPATH];				//file the source was loaded from
+	char basefolder[MAX_QPATH];				//base folder the file was loaded from
+	int length;								//length of the file
+	unsigned int checksum;					//checksum of the file contents
+	int globaldefines;						//version of the global defines
+	int numincludes;
+	pc_cachedinclude_t *includes;			//files included by the source file
+	int numtokens;
+	pc_cachedtoken_t *tokens;				//preprocessed tokens
+	char *strings;							//token strings
+	int size;								//size of the cache in bytes
+	int refs;								//sources reading the tokens
+	int cached;							//true when linked in the token cache
+	struct pc_tokencache_s *next;
+} pc_tokencache_t;
+
+extern char basefolder[MAX_QPATH];
+
+//token caches of the loaded source files
+pc_tokencache_t *tokencache;
+int tokencachesize;
+//source of which the included files are recorded
+source_t *recordsource;
+int numrecordincludes;
+pc_cachedinclude_t recordincludes[MAX_CACHEDINCLUDES];
+
+static pc_tokencache_t *PC_FindTokenCache(const char *filename);
+static void PC_RecordTokenCache(source_t *source);
+
+#endif //TOKENCACHE
+
+//============================================================================
+// file name and line to report, a source read from the token
+// cache has no script so the line of the last read token is used
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//============================================================================
+static void PC_SourcePosition(source_t *source, char **filename, int *line)
+{
+	if (source->scriptstack)
+	{
+		*filename = source->scriptstack->filename;
+		*line = source->scriptstack->line;
+	} //end if
+	else
+	{
+		*filename = source->filename;
+		*line = source->token.line;
+	} //end else
+} //end of the function PC_SourcePosition
 
 //============================================================================
 //
@@ -127,20 +217,23 @@ define_t *globaldefines;
 //============================================================================
 void QDECL SourceError(source_t *source, char *str, ...)
 {
-	char text[1024];
+	char text[1024], *filename;
+	int line;
 	va_list ap;
 
 	va_start(ap, str);
 	Q_vsnprintf(text, sizeof(text), str, ap);
 	va_end(ap);
+	numsourcemessages++;
+	PC_SourcePosition(source, &filename, &line);
 #ifdef BOTLIB
-	botimport.Print(PRT_ERROR, "file %s, line %d: %s\n", source->scriptstack->filename, source->scriptstack->line, text);
+	botimport.Print(PRT_ERROR, "file %s, line %d: %s\n", filename, line, text);
 #endif	//BOTLIB
 #ifdef MEQCC
-	printf("error: file %s, line %d: %s\n", source->scriptstack->filename, source->scriptstack->line, text);
+	printf("error: file %s, line %d: %s\n", filename, line, text);
 #endif //MEQCC
 #ifdef BSPC
-	Log_Print("error: file %s, line %d: %s\n", source->scriptstack->filename, source->scriptstack->line, text);
+	Log_Print("error: file %s, line %d: %s\n", filename, line, text);
 #endif //BSPC
 } //end of the function SourceError
 //===========================================================================
@@ -151,20 +244,23 @@ void QDECL SourceError(source_t *source, char *str, ...)
 //===========================================================================
 void QDECL SourceWarning(source_t *source, char *str, ...)
 {
-	char text[1024];
+	char text[1024], *filename;
+	int line;
 	va_list ap;
 
 	va_start(ap, str);
 	Q_vsnprintf(text, sizeof(text), str, ap);
 	va_end(ap);
+	numsourcemessages++;
+	PC_SourcePosition(source, &filename, &line);
 #ifdef BOTLIB
-	botimport.Print(PRT_WARNING, "file %s, line %d: %s\n", source->scriptstack->filename, source->scriptstack->line, text);
+	botimport.Print(PRT_WARNING, "file %s, line %d: %s\n", filename, line, text);
 #endif //BOTLIB
 #ifdef MEQCC
-	printf("warning: file %s, line %d: %s\n", source->scriptstack->filename, source->scriptstack->line, text);
+	printf("warning: file %s, line %d: %s\n", filename, line, text);
 #endif //MEQCC
 #ifdef BSPC
-	Log_Print("warning: file %s, line %d: %s\n", source->scriptstack->filename, source->scriptstack->line, text);
+	Log_Print("warning: file %s, line %d: %s\n", filename, line, text);
 #endif //BSPC
 } //end of the function ScriptWarning
 //============================================================================
@@ -231,6 +327,19 @@ void PC_PushScript(source_t *source, script_t *script)
 	//push the script on the script stack
 	script->next = source->scriptstack;
 	source->scriptstack = script;
+#ifdef TOKENCACHE
+	//remember the files included by a source being cached
+	if (source == recordsource)
+	{
+		if (numrecordincludes < MAX_CACHEDINCLUDES)
+		{
+			Q_strncpyz(recordincludes[numrecordincludes].filename, script->filename, MAX_QPATH);
+			recordincludes[numrecordincludes].length = script->length;
+			recordincludes[numrecordincludes].checksum = ScriptChecksum(script->buffer, script->length);
+		} //end if
+		numrecordincludes++;
+	} //end if
+#endif //TOKENCACHE
 } //end of the function PC_PushScript
 //============================================================================
 //
@@ -295,6 +404,32 @@ void PC_FreeToken(token_t *token)
 //	freetokens = token;
 	numtokens--;
 } //end of the function PC_FreeToken
+#ifdef TOKENCACHE
+//============================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//============================================================================
+static int PC_ReadCachedToken(source_t *source, token_t *token)
+{
+	pc_cachedtoken_t *ct;
+
+	if (source->cachetoken >= source->tokencache->numtokens) return qfalse;
+	ct = &source->tokencache->tokens[source->cachetoken++];
+	strcpy(token->string, source->tokencache->strings + ct->string);
+	token->type = ct->type;
+	token->subtype = ct->subtype;
+	token->intvalue = ct->intvalue;
+	token->floatvalue = ct->floatvalue;
+	token->line = ct->line;
+	token->linescrossed = ct->linescrossed;
+	token->whitespace_p = NULL;
+	token->endwhitespace_p = NULL;
+	token->next = NULL;
+	return qtrue;
+} //end of the function PC_ReadCachedToken
+#endif //TOKENCACHE
 //============================================================================
 //
 // Parameter:				-
@@ -310,6 +445,10 @@ int PC_ReadSourceToken(source_t *source, token_t *token)
 	//if there's no token already available
 	while(!source->tokens)
 	{
+#ifdef TOKENCACHE
+		//if the source is read from the token cache
+		if (source->tokencache) return PC_ReadCachedToken(source, token);
+#endif //TOKENCACHE
 		//if there's a token to read from the script
 		if (PS_ReadToken(source->scriptstack, token)) return qtrue;
 		//if at the end of the script
@@ -1397,6 +1536,7 @@ int PC_AddGlobalDefine(char *string)
 	if (!define) return qfalse;
 	define->next = globaldefines;
 	globaldefines = define;
+	globaldefinesversion++;
 	return qtrue;
 } //end of the function PC_AddGlobalDefine
 //============================================================================
@@ -1414,6 +1554,7 @@ int PC_RemoveGlobalDefine(char *name)
 	if (define)
 	{
 		PC_FreeDefine(define);
+		globaldefinesversion++;
 		return qtrue;
 	} //end if
 	return qfalse;
@@ -1434,6 +1575,7 @@ void PC_RemoveAllGlobalDefines(void)
 		globaldefines = globaldefines->next;
 		PC_FreeDefine(define);
 	} //end for
+	globaldefinesversion++;
 } //end of the function PC_RemoveAllGlobalDefines
 //============================================================================
 //
@@ -2990,9 +3132,29 @@ source_t *LoadSourceFile(const char *filename)
 {
 	source_t *source;
 	script_t *script;
+#ifdef TOKENCACHE
+	pc_tokencache_t *tc;
+#endif //TOKENCACHE
 
 	PC_InitTokenHeap();
 
+#ifdef TOKENCACHE
+	//read the tokens from the token cache if the file did not change
+	tc = PC_FindTokenCache(filename);
+	if (tc)
+	{
+		source = (source_t *) GetClearedMemory(sizeof(source_t));
+		Q_strncpyz(source->filename, filename, sizeof(source->filename));
+#if DEFINEHASHING
+		source->definehash = GetClearedMemory(DEFINEHASHSIZE * sizeof(define_t *));
+#endif //DEFINEHASHING
+		source->tokencache = tc;
+		source->cachetoken = 0;
+		tc->refs++;
+		return source;
+	} //end if
+#endif //TOKENCACHE
+
 	script = LoadScriptFile(filename);
 	if (!script) return NULL;
 
@@ -3012,6 +3174,9 @@ source_t *LoadSourceFile(const char *filename)
 	source->definehash = GetClearedMemory(DEFINEHASHSIZE * sizeof(define_t *));
 #endif //DEFINEHASHING
 	PC_AddGlobalDefinesToSource(source);
+#ifdef TOKENCACHE
+	PC_RecordTokenCache(source);
+#endif //TOKENCACHE
 	return source;
 } //end of the function LoadSourceFile
 //============================================================================
@@ -3053,7 +3218,7 @@ source_t *LoadSourceMemory(char *ptr, int length, char *name)
 // Returns:					-
 // Changes Globals:		-
 //============================================================================
-void FreeSource(source_t *source)
+static void PC_ClearSource(source_t *source)
 {
 	script_t *script;
 	token_t *token;
@@ -3061,7 +3226,6 @@ void FreeSource(source_t *source)
 	indent_t *indent;
 	int i;
 
-	//PC_PrintDefineHashTable(source->definehash);
 	//free all the scripts
 	while(source->scriptstack)
 	{
@@ -3102,6 +3266,210 @@ void FreeSource(source_t *source)
 		source->indentstack = source->indentstack->next;
 		FreeMemory(indent);
 	} //end for
+	source->skip = 0;
+} //end of the function PC_ClearSource
+#ifdef TOKENCACHE
+//============================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//============================================================================
+static void PC_ReleaseTokenCache(pc_tokencache_t *tc)
+{
+	tc->refs--;
+	if (!tc->cached && tc->refs <= 0) FreeMemory(tc);
+} //end of the function PC_ReleaseTokenCache
+//============================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//============================================================================
+static void PC_UnlinkTokenCache(pc_tokencache_t **prev)
+{
+	pc_tokencache_t *tc;
+
+	tc = *prev;
+	*prev = tc->next;
+	tokencachesize -= tc->size;
+	//the memory is freed when the last source reading the tokens is freed
+	tc->cached = qfalse;
+	if (tc->refs <= 0) FreeMemory(tc);
+} //end of the function PC_UnlinkTokenCache
+//============================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//============================================================================
+void PC_FreeTokenCache(void)
+{
+	while(tokencache)
+	{
+		PC_UnlinkTokenCache(&tokencache);
+	} //end while
+} //end of the function PC_FreeTokenCache
+//============================================================================
+// returns the token cache of the source file if the file, the files it
+// includes and the global defines did not change since it was cached
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//============================================================================
+static pc_tokencache_t *PC_FindTokenCache(const char *filename)
+{
+	pc_tokencache_t *tc, **prev;
+	int length, i;
+	unsigned int checksum;
+
+	if (!tokencache) return NULL;
+	if (!ScriptFileChecksum(filename, &length, &checksum)) return NULL;
+	for (prev = &tokencache; *prev; prev = &(*prev)->next)
+	{
+		tc = *prev;
+		if (strcmp(tc->filename, filename)) continue;
+		if (strcmp(tc->basefolder, basefolder)) continue;
+		//the file changed
+		if (tc->length != length || tc->checksum != checksum) break;
+		//the global defines changed
+		if (tc->globaldefines != globaldefinesversion) break;
+		//check the included files
+		for (i = 0; i < tc->numincludes; i++)
+		{
+			if (!ScriptFileChecksum(tc->includes[i].filename, &length, &checksum)) break;
+			if (tc->includes[i].length != length) break;
+			if (tc->includes[i].checksum != checksum) break;
+		} //end for
+		if (i < tc->numincludes) break;
+		return tc;
+	} //end for
+	//remove the outdated token cache
+	if (*prev) PC_UnlinkTokenCache(prev);
+	return NULL;
+} //end of the function PC_FindTokenCache
+//============================================================================
+// reads all tokens from the source and stores them in a token cache,
+// from then on the source reads the tokens from the token cache
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//============================================================================
+static void PC_RecordTokenCache(source_t *source)
+{
+	token_t token;
+	pc_cachedtoken_t *tokens, *newtokens;
+	pc_tokencache_t *tc;
+	char *strings, *newstrings;
+	int numtokens, maxtokens, stringsize, maxstringsize;
+	int nummessages, clean, size, length;
+	unsigned int checksum;
+
+	length = source->scriptstack->length;
+	checksum = ScriptChecksum(source->scriptstack->buffer, length);
+	nummessages = numsourcemessages;
+	recordsource = source;
+	numrecordincludes = 0;
+	//read all the tokens from the source
+	tokens = NULL;
+	numtokens = maxtokens = 0;
+	strings = NULL;
+	stringsize = maxstringsize = 0;
+	while(PC_ReadToken(source, &token))
+	{
+		if (numtokens >= maxtokens)
+		{
+			maxtokens = maxtokens ? maxtokens * 2 : 1024;
+			newtokens = (pc_cachedtoken_t *) GetMemory(maxtokens * sizeof(pc_cachedtoken_t));
+			if (tokens)
+			{
+				Com_Memcpy(newtokens, tokens, numtokens * sizeof(pc_cachedtoken_t));
+				FreeMemory(tokens);
+			} //end if
+			tokens = newtokens;
+		} //end if
+		size = strlen(token.string) + 1;
+		if (stringsize + size > maxstringsize)
+		{
+			maxstringsize = maxstringsize ? maxstringsize * 2 : 8192;
+			if (maxstringsize < stringsize + size) maxstringsize = stringsize + size;
+			newstrings = (char *) GetMemory(maxstringsize);
+			if (strings)
+			{
+				Com_Memcpy(newstrings, strings, stringsize);
+				FreeMemory(strings);
+			} //end if
+			strings = newstrings;
+		} //end if
+		tokens[numtokens].type = token.type;
+		tokens[numtokens].subtype = token.subtype;
+		tokens[numtokens].intvalue = token.intvalue;
+		tokens[numtokens].floatvalue = token.floatvalue;
+		tokens[numtokens].line = token.line;
+		tokens[numtokens].linescrossed = token.linescrossed;
+		tokens[numtokens].string = stringsize;
+		Com_Memcpy(strings + stringsize, token.string, size);
+		stringsize += size;
+		numtokens++;
+	} //end while
+	recordsource = NULL;
+	//only cache sources read until the end without errors or warnings
+	clean = numsourcemessages == nummessages &&
+			numrecordincludes <= MAX_CACHEDINCLUDES &&
+			!source->tokens && !source->skip && !source->indentstack &&
+			source->scriptstack && !source->scriptstack->next &&
+			EndOfScript(source->scriptstack);
+	if (numrecordincludes > MAX_CACHEDINCLUDES) numrecordincludes = MAX_CACHEDINCLUDES;
+	//store the tokens in one block of memory
+	size = sizeof(pc_tokencache_t) + numtokens * sizeof(pc_cachedtoken_t) +
+			numrecordincludes * sizeof(pc_cachedinclude_t) + stringsize;
+	tc = (pc_tokencache_t *) GetClearedMemory(size);
+	tc->tokens = (pc_cachedtoken_t *) (tc + 1);
+	tc->includes = (pc_cachedinclude_t *) (tc->tokens + numtokens);
+	tc->strings = (char *) (tc->includes + numrecordincludes);
+	Q_strncpyz(tc->filename, source->filename, sizeof(tc->filename));
+	Q_strncpyz(tc->basefolder, basefolder, sizeof(tc->basefolder));
+	tc->length = length;
+	tc->checksum = checksum;
+	tc->globaldefines = globaldefinesversion;
+	tc->numincludes = numrecordincludes;
+	if (numrecordincludes) Com_Memcpy(tc->includes, recordincludes, numrecordincludes * sizeof(pc_cachedinclude_t));
+	tc->numtokens = numtokens;
+	if (numtokens) Com_Memcpy(tc->tokens, tokens, numtokens * sizeof(pc_cachedtoken_t));
+	if (stringsize) Com_Memcpy(tc->strings, strings, stringsize);
+	tc->size = size;
+	if (tokens) FreeMemory(tokens);
+	if (strings) FreeMemory(strings);
+	//the source reads the tokens from the token cache from now on
+	PC_ClearSource(source);
+	source->tokencache = tc;
+	source->cachetoken = 0;
+	tc->refs = 1;
+	//keep the tokens for the next time the file is loaded
+	if (clean && tokencachesize + size <= MAX_TOKENCACHESIZE)
+	{
+		tc->cached = qtrue;
+		tc->next = tokencache;
+		tokencache = tc;
+		tokencachesize += size;
+	} //end if
+} //end of the function PC_RecordTokenCache
+#endif //TOKENCACHE
+//============================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//============================================================================
+void FreeSource(source_t *source)
+{
+	//PC_PrintDefineHashTable(source->definehash);
+	PC_ClearSource(source);
+#ifdef TOKENCACHE
+	if (source->tokencache) PC_ReleaseTokenCache(source->tokencache);
+#endif //TOKENCACHE
 #if DEFINEHASHING
 	//
 	if (source->definehash) FreeMemory(source->definehash);
@@ -3198,6 +3566,8 @@ int PC_SourceFileAndLine(int handle, char *filename, int *line)
 	strcpy(filename, sourceFiles[handle]->filename);
 	if (sourceFiles[handle]->scriptstack)
 		*line = sourceFiles[handle]->scriptstack->line;
+	else if (sourceFiles[handle]->tokencache)
+		*line = sourceFiles[handle]->token.line;
 	else
 		*line = 0;
 	return qtrue;
@@ -3227,7 +3597,7 @@ void PC_CheckOpenSourceHandles(void)
 		if (sourceFiles[i])
 		{
 #ifdef BOTLIB
-			botimport.Print(PRT_ERROR, "file %s still open in precompiler\n", sourceFiles[i]->scriptstack->filename);
+			botimport.Print(PRT_ERROR, "file %s still open in precompiler\n", sourceFiles[i]->filename);
 #endif	//BOTLIB
 		} //end if
 	} //end for
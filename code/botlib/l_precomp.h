@@ -100,6 +100,8 @@ typedef struct source_s
 	indent_t *indentstack;					//stack with indents
 	int skip;								// > 0 if skipping conditional code
 	token_t token;							//last read token
+	struct pc_tokencache_s *tokencache;		//preprocessed tokens the source is read from
+	int cachetoken;							//next token to read from the token cache
 } source_t;
 
 
@@ -133,6 +135,8 @@ int PC_AddGlobalDefine(char *string);
 int PC_RemoveGlobalDefine(char *name);
 //remove all globals defines
 void PC_RemoveAllGlobalDefines(void);
+//free the preprocessed tokens kept of loaded source files
+void PC_FreeTokenCache(void);
 //add builtin defines
 void PC_AddBuiltinDefines(source_t *source);
 //set the source include path
@@ -1419,6 +1419,74 @@ script_t *LoadScriptMemory(char *ptr, int length, char *name)
 	return script;
 } //end of the function LoadScriptMemory
 //============================================================================
+// FNV-1a hash of the given memory
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//============================================================================
+unsigned int ScriptChecksum(const char *buffer, int length)
+{
+	unsigned int hash;
+	int i;
+
+	hash = 2166136261u;
+	for (i = 0; i < length; i++)
+	{
+		hash = (hash ^ (unsigned char) buffer[i]) * 16777619u;
+	} //end for
+	return hash;
+} //end of the function ScriptChecksum
+//============================================================================
+// returns the length and checksum of the contents of a script file
+// without setting up the script for reading
+//
+// Parameter:			-
+// Returns:				qfalse if the file can't be read
+// Changes Globals:		-
+//============================================================================
+int ScriptFileChecksum(const char *filename, int *length, unsigned int *checksum)
+{
+#ifdef BOTLIB
+	fileHandle_t fp;
+	char pathname[MAX_QPATH];
+#else
+	FILE *fp;
+#endif
+	char *buffer;
+
+#ifdef BOTLIB
+	if (strlen(basefolder))
+		Com_sprintf(pathname, sizeof(pathname), "%s/%s", basefolder, filename);
+	else
+		Com_sprintf(pathname, sizeof(pathname), "%s", filename);
+	*length = botimport.FS_FOpenFile( pathname, &fp, FS_READ );
+	if (!fp) return qfalse;
+#else
+	fp = fopen(filename, "rb");
+	if (!fp) return qfalse;
+
+	*length = FileLength(fp);
+#endif
+
+	buffer = (char *) GetMemory(*length + 1);
+#ifdef BOTLIB
+	botimport.FS_Read(buffer, *length, fp);
+	botimport.FS_FCloseFile(fp);
+#else
+	if (fread(buffer, *length, 1, fp) != 1)
+	{
+		FreeMemory(buffer);
+		fclose(fp);
+		return qfalse;
+	} //end if
+	fclose(fp);
+#endif
+	*checksum = ScriptChecksum(buffer, *length);
+	FreeMemory(buffer);
+	return qtrue;
+} //end of the function ScriptFileChecksum
+//============================================================================
 //
 // Parameter:				-
 // Returns:					-
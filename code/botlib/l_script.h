@@ -235,6 +235,10 @@ char *PunctuationFromNum(script_t *script, int num);
 script_t *LoadScriptFile(const char *filename);
 //load a script from the given memory with the given length
 script_t *LoadScriptMemory(char *ptr, int length, char *name);
+//returns a checksum of the given script contents
+unsigned int ScriptChecksum(const char *buffer, int length);
+//returns the length and checksum of the contents of the given script file
+int ScriptFileChecksum(const char *filename, int *length, unsigned int *checksum);
 //free a script
 void FreeScript(script_t *script);
 //set the base folder to load files from
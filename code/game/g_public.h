@@ -47,6 +47,8 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #define SVF_CAPSULE				0x00000400	// use capsule for collision detection instead of bbox
 #define SVF_NOTSINGLECLIENT		0x00000800	// send entity to everyone but one client
 											// (entityShared_t->singleClient)
+#define SVF_PHS					0x00001000	// cull with the potentially hearable set instead
+											// of the pvs, for sound events
 
 
 
@@ -230,6 +232,11 @@ typedef enum {
 	// 1.32
 	G_FS_SEEK,
 
+	G_TRACE_BATCH,	// ( trace_t *results, int numTraces, const vec3_t *starts, const vec3_t *ends, const vec3_t mins, const vec3_t maxs, int passEntityNum, int contentmask, int capsule );
+
+	G_TRACE_FOR_CLIENT,	// ( trace_t *results, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int clientNum );
+	// traces against the other entities where clientNum saw them, for lag compensated shots
+
 	BOTLIB_SETUP = 200,				// ( void );
 	BOTLIB_SHUTDOWN,				// ( void );
 	BOTLIB_LIBVAR_SET,
@@ -389,6 +396,12 @@ typedef enum {
 	BOTLIB_PC_READ_TOKEN,
 	BOTLIB_PC_SOURCE_FILE_AND_LINE,
 
+	BOTLIB_AI_MOVE_TO_GOAL_BATCH,		// ( bot_moveresult_t *results, int numMoves, int *movestates, bot_goal_t *goals, int *travelflags );
+	BOTLIB_AAS_AREA_TRAVEL_TIME_BATCH,	// ( int *traveltimes, int numQueries, int *areanums, vec3_t *origins, int *goalareanums, int travelflags );
+	// each bot's query may be resolved on a worker thread, see bot_threads
+	BOTLIB_AI_CHOOSE_BEST_FIGHT_WEAPON_BATCH,	// ( int *weapons, int numStates, int *weaponstates, int *inventories, int inventorySize );
+	// bots that share a weapon weight file are evaluated together
+
 #ifdef USE_AUTH
 	G_NET_STRINGTOADR = 600,
 	G_NET_SENDPACKET,
@@ -22,6 +22,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 // cmodel.c -- model loading
 
 #include "cm_local.h"
+#include "cm_patch.h"
 
 #ifdef BSPC
 
@@ -52,6 +53,7 @@ void SetPlaneSignbits (cplane_t *out) {
 
 
 clipMap_t	cm;
+int			cm_loadCount;		// bumped on every map change, invalidates trace contexts
 int			c_pointcontents;
 int			c_traces, c_brush_traces, c_patch_traces;
 
@@ -62,6 +64,9 @@ byte		*cmod_base;
 cvar_t		*cm_noAreas;
 cvar_t		*cm_noCurves;
 cvar_t		*cm_playerCurveClip;
+cvar_t		*cm_leafBvh;
+cvar_t		*cm_patchCache;
+cvar_t		*cm_loadThreads;
 #endif
 
 cmodel_t	box_model;
@@ -196,7 +201,7 @@ void CMod_LoadNodes( lump_t *l ) {
 
 	for (i=0 ; i<count ; i++, out++, in++)
 	{
-		out->plane = cm.planes + LittleLong( in->planeNum );
+		out->plane = cm.planes[ LittleLong( in->planeNum ) ];
 		for (j=0 ; j<2 ; j++)
 		{
 			child = LittleLong (in->children[j]);
@@ -224,6 +229,42 @@ void CM_BoundBrush( cbrush_t *b ) {
 }
 
 
+// floats in a packed brush plane block: x, y and z normals, dists,
+// then one signbits byte per side rounded up to a whole float
+#define	BRUSH_PLANE_FLOATS( numsides )	( 4 * (numsides) + ( (numsides) + 3 ) / 4 )
+
+/*
+=================
+CM_PackBrushPlanes
+
+Copies the side planes of a brush into its planes block as runs of
+x normals, y normals, z normals, dists and signbits, so the trace
+loops don't have to go through every side's plane pointer
+=================
+*/
+void CM_PackBrushPlanes( cbrush_t *b ) {
+	int			i, n;
+	float		*nx, *ny, *nz, *dist;
+	byte		*signbits;
+	cplane_t	*plane;
+
+	n = b->numsides;
+	nx = b->planes;
+	ny = nx + n;
+	nz = ny + n;
+	dist = nz + n;
+	signbits = (byte *)( dist + n );
+
+	for ( i = 0 ; i < n ; i++ ) {
+		plane = b->sides[i].plane;
+		nx[i] = plane->normal[0];
+		ny[i] = plane->normal[1];
+		nz[i] = plane->normal[2];
+		dist[i] = plane->dist;
+		signbits[i] = plane->signbits;
+	}
+}
+
 /*
 =================
 CMod_LoadBrushes
@@ -234,6 +275,8 @@ void CMod_LoadBrushes( lump_t *l ) {
 	dbrush_t	*in;
 	cbrush_t	*out;
 	int			i, count;
+	int			firstSide, numPlaneFloats;
+	float		*planes;
 
 	in = (void *)(cmod_base + l->fileofs);
 	if (l->filelen % sizeof(*in)) {
@@ -245,10 +288,16 @@ void CMod_LoadBrushes( lump_t *l ) {
 	cm.numBrushes = count;
 
 	out = cm.brushes;
+	numPlaneFloats = 0;
 
 	for ( i=0 ; i<count ; i++, out++, in++ ) {
-		out->sides = cm.brushsides + LittleLong(in->firstSide);
+		firstSide = LittleLong(in->firstSide);
 		out->numsides = LittleLong(in->numSides);
+		if ( firstSide < 0 || out->numsides < 0 || firstSide + out->numsides > cm.numBrushSides ) {
+			Com_Error( ERR_DROP, "CMod_LoadBrushes: bad side range" );
+		}
+		out->sides = cm.brushsides + firstSide;
+		numPlaneFloats += BRUSH_PLANE_FLOATS( out->numsides );
 
 		out->shaderNum = LittleLong( in->shaderNum );
 		if ( out->shaderNum < 0 || out->shaderNum >= cm.numShaders ) {
@@ -259,6 +308,13 @@ void CMod_LoadBrushes( lump_t *l ) {
 		CM_BoundBrush( out );
 	}
 
+	// all the packed planes go in one block in brush order
+	planes = Hunk_Alloc( numPlaneFloats * sizeof( float ), h_high );
+	for ( i=0, out=cm.brushes ; i<count ; i++, out++ ) {
+		out->planes = planes;
+		CM_PackBrushPlanes( out );
+		planes += BRUSH_PLANE_FLOATS( out->numsides );
+	}
 }
 
 /*
@@ -446,42 +502,575 @@ void CMod_LoadEntityString( lump_t *l ) {
 	Com_Memcpy (cm.entityString, cmod_base + l->fileofs, l->filelen);
 }
 
+/*
+=================
+CMod_CalcHearability
+
+The potentially hearable set of a cluster is everything that can be
+seen from any cluster it can see, so a sound around a corner still
+reaches a client that can't see where it was made.
+=================
+*/
+static void CMod_CalcHearability( void ) {
+	int				i, j, k, c, w;
+	int				rowWords;
+	const byte		*pvs;
+	const unsigned	*src;
+	unsigned		*dst, bits;
+	int				visible, hearable;
+
+	rowWords = cm.clusterBytes >> 2;
+	cm.hearability = Hunk_Alloc( cm.numClusters * cm.clusterBytes, h_high );
+
+	visible = hearable = 0;
+	for ( i = 0 ; i < cm.numClusters ; i++ ) {
+		pvs = cm.visibility + i * cm.clusterBytes;
+		dst = (unsigned *)( cm.hearability + i * cm.clusterBytes );
+
+		for ( j = 0 ; j < cm.clusterBytes ; j++ ) {
+			if ( !pvs[j] ) {
+				continue;
+			}
+			for ( k = 0 ; k < 8 ; k++ ) {
+				c = ( j << 3 ) + k;
+				if ( !( pvs[j] & ( 1 << k ) ) || c >= cm.numClusters ) {
+					continue;
+				}
+				visible++;
+				src = (const unsigned *)( cm.visibility + c * cm.clusterBytes );
+				for ( w = 0 ; w < rowWords ; w++ ) {
+					dst[w] |= src[w];
+				}
+			}
+		}
+
+		for ( w = 0 ; w < rowWords ; w++ ) {
+			for ( bits = dst[w] ; bits ; bits &= bits - 1 ) {
+				hearable++;
+			}
+		}
+	}
+
+	if ( cm.numClusters ) {
+		Com_DPrintf( "%i clusters: %i visible, %i hearable on average\n",
+			cm.numClusters, visible / cm.numClusters, hearable / cm.numClusters );
+	}
+}
+
 /*
 =================
 CMod_LoadVisibility
+
+Rows are padded out to whole words so that the server can test
+entity cluster bits against them a word at a time.
 =================
 */
 #define	VIS_HEADER	8
 void CMod_LoadVisibility( lump_t *l ) {
 	int		len;
 	byte	*buf;
+	int		i, rowBytes;
 
     len = l->filelen;
 	if ( !len ) {
 		cm.clusterBytes = ( cm.numClusters + 31 ) & ~31;
 		cm.visibility = Hunk_Alloc( cm.clusterBytes, h_high );
 		Com_Memset( cm.visibility, 255, cm.clusterBytes );
+		cm.hearability = cm.visibility;
 		return;
 	}
+	if ( len < VIS_HEADER ) {
+		Com_Error( ERR_DROP, "CMod_LoadVisibility: funny lump size" );
+	}
 	buf = cmod_base + l->fileofs;
 
 	cm.vised = qtrue;
-	cm.visibility = Hunk_Alloc( len, h_high );
 	cm.numClusters = LittleLong( ((int *)buf)[0] );
-	cm.clusterBytes = LittleLong( ((int *)buf)[1] );
-	Com_Memcpy (cm.visibility, buf + VIS_HEADER, len - VIS_HEADER );
+	rowBytes = LittleLong( ((int *)buf)[1] );
+	if ( cm.numClusters <= 0 || rowBytes < ( cm.numClusters + 7 ) >> 3
+		|| rowBytes > ( len - VIS_HEADER ) / cm.numClusters ) {
+		Com_Error( ERR_DROP, "CMod_LoadVisibility: funny lump size" );
+	}
+
+	cm.clusterBytes = ( rowBytes + 3 ) & ~3;
+	cm.visibility = Hunk_Alloc( cm.numClusters * cm.clusterBytes, h_high );
+	for ( i = 0 ; i < cm.numClusters ; i++ ) {
+		Com_Memcpy( cm.visibility + i * cm.clusterBytes, buf + VIS_HEADER + i * rowBytes, rowBytes );
+	}
+
+	CMod_CalcHearability();
 }
 
 //==================================================================
 
 
+#ifndef BSPC
+/*
+===============================================================================
+
+PATCH COLLISION CACHE
+
+Generating the facets of curved surfaces is a good part of loading a
+map with many curves.  With cm_patchCache set the result is written to
+patchcache/ under a name that includes the bsp checksum, and read back
+the next time the same map is loaded.  It is only read back from
+fs_homepath where it was written, so a pk3 can't ship one.  The cache
+holds the structures as they are in memory, so one written by a build
+with a different layout or byte order is ignored and replaced.
+
+===============================================================================
+*/
+
+#define	MAX_PATCH_VERTS		1024
+
+#define	PATCH_CACHE_IDENT	(('L'<<24)+('O'<<16)+('C'<<8)+'P')		// "PCOL"
+#define	PATCH_CACHE_VERSION	1
+
+typedef struct {
+	int			ident;
+	int			version;
+	int			checksum;		// of the whole bsp
+	int			numSurfaces;
+	int			numPatches;
+	int			planeSize;		// sizeof( patchPlane_t )
+	int			facetSize;		// sizeof( facet_t )
+} patchCacheHeader_t;
+
+// one for every patch, in surface order, followed by its planes and facets
+typedef struct {
+	int			surfaceNum;
+	vec3_t		bounds[2];
+	int			numPlanes;
+	int			numFacets;
+} patchCacheEntry_t;
+
+/*
+=================
+CM_PatchCacheName
+=================
+*/
+static void CM_PatchCacheName( const char *mapName, int checksum, char *out, int outSize ) {
+	char	base[MAX_QPATH];
+
+	COM_StripExtension( COM_SkipPath( mapName ), base, sizeof( base ) );
+	Com_sprintf( out, outSize, "patchcache/%s_%08x.pcol", base, checksum );
+}
+
+/*
+=================
+CM_CheckPatchCacheEntry
+
+Returns the size of the entry at p, or 0 if it doesn't hold together.
+A bad plane number would send the trace code outside the planes, and
+bad signbits outside the offsets of the trace.
+=================
+*/
+static int CM_CheckPatchCacheEntry( const byte *p, const byte *end ) {
+	const patchCacheEntry_t	*entry;
+	const patchPlane_t	*plane;
+	const facet_t	*facet;
+	int				i, j, size;
+
+	if ( end - p < sizeof( *entry ) ) {
+		return 0;
+	}
+	entry = (const patchCacheEntry_t *)p;
+
+	if ( entry->surfaceNum < 0 || entry->surfaceNum >= cm.numSurfaces || !cm.surfaces[entry->surfaceNum] ) {
+		return 0;
+	}
+	if ( entry->numPlanes < 0 || entry->numPlanes > MAX_PATCH_PLANES
+		|| entry->numFacets < 0 || entry->numFacets > MAX_FACETS ) {
+		return 0;
+	}
+
+	size = sizeof( *entry ) + entry->numPlanes * sizeof( patchPlane_t ) + entry->numFacets * sizeof( facet_t );
+	if ( end - p < size ) {
+		return 0;
+	}
+
+	plane = (const patchPlane_t *)( p + sizeof( *entry ) );
+	for ( i = 0 ; i < entry->numPlanes ; i++, plane++ ) {
+		if ( plane->signbits < 0 || plane->signbits > 7 ) {
+			return 0;
+		}
+	}
+
+	facet = (const facet_t *)( p + sizeof( *entry ) + entry->numPlanes * sizeof( patchPlane_t ) );
+	for ( i = 0 ; i < entry->numFacets ; i++, facet++ ) {
+		if ( facet->surfacePlane < 0 || facet->surfacePlane >= entry->numPlanes
+			|| facet->numBorders < 0 || facet->numBorders > ARRAY_LEN( facet->borderPlanes ) ) {
+			return 0;
+		}
+		for ( j = 0 ; j < facet->numBorders ; j++ ) {
+			if ( facet->borderPlanes[j] < 0 || facet->borderPlanes[j] >= entry->numPlanes ) {
+				return 0;
+			}
+		}
+	}
+
+	return size;
+}
+
+/*
+=================
+CM_ReadPatchCache
+
+Sets up the collision of every patch surface from the cache.  Nothing
+is touched unless the whole cache checks out.
+=================
+*/
+static qboolean CM_ReadPatchCache( const char *mapName, int checksum, int numPatches ) {
+	char				name[MAX_QPATH];
+	union {
+		byte			*b;
+		void			*v;
+	} buf;
+	int					len, size, i;
+	const byte			*p, *end;
+	patchCacheHeader_t	header;
+	const patchCacheEntry_t	*entry;
+	patchCollide_t		*pc;
+	int					lastSurface;
+
+	CM_PatchCacheName( mapName, checksum, name, sizeof( name ) );
+	len = FS_ReadHomeFile( name, &buf.v );
+	if ( !buf.b ) {
+		return qfalse;
+	}
+
+	if ( len < sizeof( header ) ) {
+		FS_FreeFile( buf.v );
+		return qfalse;
+	}
+	Com_Memcpy( &header, buf.b, sizeof( header ) );
+	if ( header.ident != PATCH_CACHE_IDENT || header.version != PATCH_CACHE_VERSION
+		|| header.checksum != checksum || header.numSurfaces != cm.numSurfaces
+		|| header.numPatches != numPatches
+		|| header.planeSize != sizeof( patchPlane_t ) || header.facetSize != sizeof( facet_t ) ) {
+		Com_DPrintf( "%s is out of date\n", name );
+		FS_FreeFile( buf.v );
+		return qfalse;
+	}
+
+	// check everything before allocating anything
+	p = buf.b + sizeof( header );
+	end = buf.b + len;
+	lastSurface = -1;
+	for ( i = 0 ; i < numPatches ; i++ ) {
+		size = CM_CheckPatchCacheEntry( p, end );
+		if ( !size || ((const patchCacheEntry_t *)p)->surfaceNum <= lastSurface ) {
+			Com_Printf( S_COLOR_YELLOW "WARNING: %s is damaged, regenerating patch collision\n", name );
+			FS_FreeFile( buf.v );
+			return qfalse;
+		}
+		lastSurface = ((const patchCacheEntry_t *)p)->surfaceNum;
+		p += size;
+	}
+
+	p = buf.b + sizeof( header );
+	for ( i = 0 ; i < numPatches ; i++ ) {
+		entry = (const patchCacheEntry_t *)p;
+		p += sizeof( *entry );
+
+		pc = Hunk_Alloc( sizeof( *pc ), h_high );
+		VectorCopy( entry->bounds[0], pc->bounds[0] );
+		VectorCopy( entry->bounds[1], pc->bounds[1] );
+		pc->numPlanes = entry->numPlanes;
+		pc->numFacets = entry->numFacets;
+		pc->planes = Hunk_Alloc( pc->numPlanes * sizeof( *pc->planes ), h_high );
+		Com_Memcpy( pc->planes, p, pc->numPlanes * sizeof( *pc->planes ) );
+		p += pc->numPlanes * sizeof( *pc->planes );
+		pc->facets = Hunk_Alloc( pc->numFacets * sizeof( *pc->facets ), h_high );
+		Com_Memcpy( pc->facets, p, pc->numFacets * sizeof( *pc->facets ) );
+		p += pc->numFacets * sizeof( *pc->facets );
+
+		cm.surfaces[entry->surfaceNum]->pc = pc;
+	}
+
+	Com_DPrintf( "loaded collision for %i patches from %s\n", numPatches, name );
+	FS_FreeFile( buf.v );
+	return qtrue;
+}
+
+/*
+=================
+CM_WritePatchCache
+=================
+*/
+static void CM_WritePatchCache( const char *mapName, int checksum, int numPatches ) {
+	char				name[MAX_QPATH];
+	byte				*buf, *p;
+	int					i, size;
+	patchCacheHeader_t	*header;
+	patchCacheEntry_t	*entry;
+	const patchCollide_t	*pc;
+
+	size = sizeof( *header );
+	for ( i = 0 ; i < cm.numSurfaces ; i++ ) {
+		if ( cm.surfaces[i] ) {
+			pc = cm.surfaces[i]->pc;
+			size += sizeof( *entry ) + pc->numPlanes * sizeof( *pc->planes ) + pc->numFacets * sizeof( *pc->facets );
+		}
+	}
+
+	buf = Z_Malloc( size );
+
+	header = (patchCacheHeader_t *)buf;
+	header->ident = PATCH_CACHE_IDENT;
+	header->version = PATCH_CACHE_VERSION;
+	header->checksum = checksum;
+	header->numSurfaces = cm.numSurfaces;
+	header->numPatches = numPatches;
+	header->planeSize = sizeof( patchPlane_t );
+	header->facetSize = sizeof( facet_t );
+
+	p = buf + sizeof( *header );
+	for ( i = 0 ; i < cm.numSurfaces ; i++ ) {
+		if ( !cm.surfaces[i] ) {
+			continue;
+		}
+		pc = cm.surfaces[i]->pc;
+
+		entry = (patchCacheEntry_t *)p;
+		entry->surfaceNum = i;
+		VectorCopy( pc->bounds[0], entry->bounds[0] );
+		VectorCopy( pc->bounds[1], entry->bounds[1] );
+		entry->numPlanes = pc->numPlanes;
+		entry->numFacets = pc->numFacets;
+		p += sizeof( *entry );
+
+		Com_Memcpy( p, pc->planes, pc->numPlanes * sizeof( *pc->planes ) );
+		p += pc->numPlanes * sizeof( *pc->planes );
+		Com_Memcpy( p, pc->facets, pc->numFacets * sizeof( *pc->facets ) );
+		p += pc->numFacets * sizeof( *pc->facets );
+	}
+
+	CM_PatchCacheName( mapName, checksum, name, sizeof( name ) );
+	FS_WriteFile( name, buf, size );
+	Com_DPrintf( "wrote collision for %i patches to %s\n", numPatches, name );
+
+	Z_Free( buf );
+}
+
+/*
+=================
+CM_PatchCacheExists
+=================
+*/
+static qboolean CM_PatchCacheExists( const char *mapName, int checksum ) {
+	char	name[MAX_QPATH];
+
+	CM_PatchCacheName( mapName, checksum, name, sizeof( name ) );
+	return FS_ReadHomeFile( name, NULL ) > 0;
+}
+
+/*
+===============================================================================
+
+PATCH JOBS
+
+Patch collision depends on nothing but the surface and draw vert lumps,
+so it is started on worker threads as soon as the bsp has been read,
+and it runs while the main thread parses the rest of the lumps.  The
+jobs get their own copy of the control points, so an error on the
+main thread can't free the file out from under them.
+
+===============================================================================
+*/
+
+#define	MAX_LOAD_THREADS	16
+
+typedef struct {
+	int			surfaceNum;
+	int			width, height;
+	vec3_t		*points;
+	qboolean	generated;		// qfalse if the main thread has to do it
+	patchCollide_t	pc;			// planes and facets are malloc'd
+} patchJob_t;
+
+typedef struct {
+	int			first;
+	int			step;
+} patchWorker_t;
+
+static patchJob_t		*cm_patchJobs;
+static int				cm_numPatchJobs;
+static vec3_t			*cm_patchJobPoints;
+static patchWorker_t	cm_patchWorkers[MAX_LOAD_THREADS];
+static void				*cm_patchThreads[MAX_LOAD_THREADS];
+static int				cm_numPatchThreads;
+
+/*
+=================
+CM_PatchWorker
+=================
+*/
+static void CM_PatchWorker( void *data ) {
+	patchWorker_t	*worker = data;
+	patchJob_t		*job;
+	int				i;
+
+	for ( i = worker->first ; i < cm_numPatchJobs ; i += worker->step ) {
+		job = &cm_patchJobs[i];
+		job->generated = CM_GeneratePatchCollideThreaded( job->width, job->height, job->points, &job->pc );
+	}
+}
+
+/*
+=================
+CM_LoadThreads
+
+How many workers to use besides the main thread.
+=================
+*/
+static int CM_LoadThreads( void ) {
+	int		threads;
+
+	threads = cm_loadThreads->integer;
+	if ( threads < 0 ) {
+		return 0;
+	}
+	if ( !threads ) {
+		threads = Sys_NumProcessors() - 1;
+	}
+	if ( threads > MAX_LOAD_THREADS ) {
+		threads = MAX_LOAD_THREADS;
+	}
+	return threads;
+}
+
+/*
+=================
+CM_StartPatchJobs
+
+Anything that doesn't look right is left for CMod_LoadPatches to
+find and report.
+=================
+*/
+static void CM_StartPatchJobs( lump_t *surfs, lump_t *verts ) {
+	dsurface_t	*in;
+	drawVert_t	*dv, *dv_p;
+	int			count, numVerts;
+	int			i, j, c, firstVert;
+	int			numJobs, numPoints, threads;
+	patchJob_t	*job;
+	vec3_t		*points;
+
+	threads = CM_LoadThreads();
+	if ( !threads ) {
+		return;
+	}
+
+	if ( surfs->filelen % sizeof( *in ) || verts->filelen % sizeof( *dv ) ) {
+		return;
+	}
+	in = (void *)( cmod_base + surfs->fileofs );
+	count = surfs->filelen / sizeof( *in );
+	dv = (void *)( cmod_base + verts->fileofs );
+	numVerts = verts->filelen / sizeof( *dv );
+
+	numJobs = numPoints = 0;
+	for ( i = 0 ; i < count ; i++ ) {
+		if ( LittleLong( in[i].surfaceType ) != MST_PATCH ) {
+			continue;
+		}
+		c = LittleLong( in[i].patchWidth ) * LittleLong( in[i].patchHeight );
+		firstVert = LittleLong( in[i].firstVert );
+		if ( c <= 0 || c > MAX_PATCH_VERTS || firstVert < 0 || firstVert > numVerts - c ) {
+			return;
+		}
+		numJobs++;
+		numPoints += c;
+	}
+	if ( !numJobs ) {
+		return;
+	}
+
+	cm_patchJobs = Z_Malloc( numJobs * sizeof( *cm_patchJobs ) );
+	cm_patchJobPoints = Z_Malloc( numPoints * sizeof( *cm_patchJobPoints ) );
+	cm_numPatchJobs = numJobs;
+
+	job = cm_patchJobs;
+	points = cm_patchJobPoints;
+	for ( i = 0 ; i < count ; i++ ) {
+		if ( LittleLong( in[i].surfaceType ) != MST_PATCH ) {
+			continue;
+		}
+		job->surfaceNum = i;
+		job->width = LittleLong( in[i].patchWidth );
+		job->height = LittleLong( in[i].patchHeight );
+		job->points = points;
+
+		c = job->width * job->height;
+		dv_p = dv + LittleLong( in[i].firstVert );
+		for ( j = 0 ; j < c ; j++, dv_p++, points++ ) {
+			(*points)[0] = LittleFloat( dv_p->xyz[0] );
+			(*points)[1] = LittleFloat( dv_p->xyz[1] );
+			(*points)[2] = LittleFloat( dv_p->xyz[2] );
+		}
+		job++;
+	}
+
+	// a worker that fails to start just leaves its jobs to the main thread
+	for ( i = 0 ; i < threads ; i++ ) {
+		cm_patchWorkers[i].first = i;
+		cm_patchWorkers[i].step = threads;
+		cm_patchThreads[cm_numPatchThreads] = Sys_CreateThread( CM_PatchWorker, &cm_patchWorkers[i] );
+		if ( cm_patchThreads[cm_numPatchThreads] ) {
+			cm_numPatchThreads++;
+		}
+	}
+}
+
+/*
+=================
+CM_FinishPatchJobs
+=================
+*/
+static void CM_FinishPatchJobs( void ) {
+	int		i;
+
+	for ( i = 0 ; i < cm_numPatchThreads ; i++ ) {
+		Sys_JoinThread( cm_patchThreads[i] );
+	}
+	cm_numPatchThreads = 0;
+}
+
+/*
+=================
+CM_FreePatchJobs
+
+Also called when a load is cut short by an error, so the workers
+are waited for first.
+=================
+*/
+static void CM_FreePatchJobs( void ) {
+	int		i;
+
+	CM_FinishPatchJobs();
+
+	for ( i = 0 ; i < cm_numPatchJobs ; i++ ) {
+		if ( cm_patchJobs[i].generated ) {
+			CM_FreeThreadedPatchCollide( &cm_patchJobs[i].pc );
+		}
+	}
+	if ( cm_patchJobs ) {
+		Z_Free( cm_patchJobs );
+		Z_Free( cm_patchJobPoints );
+	}
+	cm_patchJobs = NULL;
+	cm_patchJobPoints = NULL;
+	cm_numPatchJobs = 0;
+}
+#endif //BSPC
+
 /*
 =================
 CMod_LoadPatches
 =================
 */
-#define	MAX_PATCH_VERTS		1024
-void CMod_LoadPatches( lump_t *surfs, lump_t *verts ) {
+void CMod_LoadPatches( lump_t *surfs, lump_t *verts, const char *mapName, int checksum ) {
 	drawVert_t	*dv, *dv_p;
 	dsurface_t	*in;
 	int			count;
@@ -491,6 +1080,10 @@ void CMod_LoadPatches( lump_t *surfs, lump_t *verts ) {
 	vec3_t		points[MAX_PATCH_VERTS];
 	int			width, height;
 	int			shaderNum;
+	int			numPatches;
+#ifndef BSPC
+	patchJob_t	*job;
+#endif
 
 	in = (void *)(cmod_base + surfs->fileofs);
 	if (surfs->filelen % sizeof(*in))
@@ -504,14 +1097,51 @@ void CMod_LoadPatches( lump_t *surfs, lump_t *verts ) {
 
 	// scan through all the surfaces, but only load patches,
 	// not planar faces
-	for ( i = 0 ; i < count ; i++, in++ ) {
-		if ( LittleLong( in->surfaceType ) != MST_PATCH ) {
+	numPatches = 0;
+	for ( i = 0 ; i < count ; i++ ) {
+		if ( LittleLong( in[i].surfaceType ) != MST_PATCH ) {
 			continue;		// ignore other surfaces
 		}
 		// FIXME: check for non-colliding patches
 
 		cm.surfaces[ i ] = patch = Hunk_Alloc( sizeof( *patch ), h_high );
 
+		shaderNum = LittleLong( in[i].shaderNum );
+		patch->contents = cm.shaders[shaderNum].contentFlags;
+		patch->surfaceFlags = cm.shaders[shaderNum].surfaceFlags;
+		numPatches++;
+	}
+
+#ifndef BSPC
+	if ( cm_patchCache->integer && numPatches && CM_ReadPatchCache( mapName, checksum, numPatches ) ) {
+		CM_FreePatchJobs();
+		return;
+	}
+
+	// collect what the workers have done, in surface order so
+	// the hunk looks the same as when loading without them
+	CM_FinishPatchJobs();
+	job = cm_patchJobs;
+#endif
+
+	for ( i = 0 ; i < count ; i++, in++ ) {
+		patch = cm.surfaces[ i ];
+		if ( !patch ) {
+			continue;
+		}
+
+#ifndef BSPC
+		if ( job && job < cm_patchJobs + cm_numPatchJobs && job->surfaceNum == i ) {
+			if ( job->generated ) {
+				patch->pc = CM_HunkPatchCollide( &job->pc );
+				job->generated = qfalse;
+				job++;
+				continue;
+			}
+			job++;
+		}
+#endif
+
 		// load the full drawverts onto the stack
 		width = LittleLong( in->patchWidth );
 		height = LittleLong( in->patchHeight );
@@ -527,13 +1157,206 @@ void CMod_LoadPatches( lump_t *surfs, lump_t *verts ) {
 			points[j][2] = LittleFloat( dv_p->xyz[2] );
 		}
 
-		shaderNum = LittleLong( in->shaderNum );
-		patch->contents = cm.shaders[shaderNum].contentFlags;
-		patch->surfaceFlags = cm.shaders[shaderNum].surfaceFlags;
-
 		// create the internal facet structure
 		patch->pc = CM_GeneratePatchCollide( width, height, points );
 	}
+
+#ifndef BSPC
+	CM_FreePatchJobs();
+
+	if ( cm_patchCache->integer && numPatches ) {
+		CM_WritePatchCache( mapName, checksum, numPatches );
+	}
+#endif
+}
+
+/*
+===============================================================================
+
+LEAF BOUNDING VOLUME HIERARCHIES
+
+===============================================================================
+*/
+
+#define	LEAF_BVH_DEFAULT	32		// items a leaf needs before it gets a hierarchy
+
+typedef struct {
+	int			item;
+	vec3_t		bounds[2];
+	float		center;			// along the axis being split
+} bvhBuildItem_t;
+
+/*
+=================
+CM_CompareBvhItems
+=================
+*/
+static int CM_CompareBvhItems( const void *a, const void *b ) {
+	float	ca, cb;
+
+	ca = ( (const bvhBuildItem_t *)a )->center;
+	cb = ( (const bvhBuildItem_t *)b )->center;
+	if ( ca < cb ) {
+		return -1;
+	}
+	if ( ca > cb ) {
+		return 1;
+	}
+	return ( (const bvhBuildItem_t *)a )->item - ( (const bvhBuildItem_t *)b )->item;
+}
+
+/*
+=================
+CM_BuildLeafBvhNode
+
+Splits the items at the median of their centers along the longest axis
+of the centers, until few enough are left for a node to hold them
+=================
+*/
+static void CM_BuildLeafBvhNode( bvhBuildItem_t *items, int numItems ) {
+	cLeafBvhNode_t	*node;
+	vec3_t		centerMins, centerMaxs, center;
+	int			i, axis;
+
+	node = &cm.leafBvhNodes[ cm.numLeafBvhNodes++ ];
+
+	ClearBounds( node->bounds[0], node->bounds[1] );
+	ClearBounds( centerMins, centerMaxs );
+	for ( i = 0 ; i < numItems ; i++ ) {
+		AddPointToBounds( items[i].bounds[0], node->bounds[0], node->bounds[1] );
+		AddPointToBounds( items[i].bounds[1], node->bounds[0], node->bounds[1] );
+		VectorAdd( items[i].bounds[0], items[i].bounds[1], center );
+		AddPointToBounds( center, centerMins, centerMaxs );
+	}
+
+	if ( numItems <= LEAF_BVH_NODE_ITEMS ) {
+		node->firstItem = cm.numLeafBvhItems;
+		node->numItems = numItems;
+		for ( i = 0 ; i < numItems ; i++ ) {
+			cm.leafBvhItems[ cm.numLeafBvhItems++ ] = items[i].item;
+		}
+		node->skip = cm.numLeafBvhNodes;
+		return;
+	}
+
+	axis = 0;
+	for ( i = 1 ; i < 3 ; i++ ) {
+		if ( centerMaxs[i] - centerMins[i] > centerMaxs[axis] - centerMins[axis] ) {
+			axis = i;
+		}
+	}
+	for ( i = 0 ; i < numItems ; i++ ) {
+		items[i].center = items[i].bounds[0][axis] + items[i].bounds[1][axis];
+	}
+	qsort( items, numItems, sizeof( *items ), CM_CompareBvhItems );
+
+	node->firstItem = 0;
+	node->numItems = 0;
+	CM_BuildLeafBvhNode( items, numItems / 2 );
+	CM_BuildLeafBvhNode( items + numItems / 2, numItems - numItems / 2 );
+	node->skip = cm.numLeafBvhNodes;
+}
+
+/*
+=================
+CM_LeafBvhItemCount
+=================
+*/
+static int CM_LeafBvhItemCount( cLeaf_t *leaf ) {
+	int		k, count;
+
+	count = leaf->numLeafBrushes;
+	for ( k = 0 ; k < leaf->numLeafSurfaces ; k++ ) {
+		if ( cm.surfaces[ cm.leafsurfaces[ leaf->firstLeafSurface + k ] ] ) {
+			count++;
+		}
+	}
+	return count;
+}
+
+/*
+=================
+CM_BuildLeafBvhs
+
+Leafs with a lot of detail brushes and curves get a hierarchy over them,
+so a trace through the leaf only tests the ones near it.  Small leafs
+keep the plain loops, which are faster for a handful of brushes.
+=================
+*/
+static void CM_BuildLeafBvhs( void ) {
+	int				i, k, count, threshold;
+	int				totalItems, maxItems;
+	cLeaf_t			*leaf;
+	cPatch_t		*patch;
+	bvhBuildItem_t	*items;
+
+#ifdef BSPC
+	threshold = LEAF_BVH_DEFAULT;
+#else
+	threshold = cm_leafBvh->integer;
+#endif
+	if ( threshold <= 0 ) {
+		return;
+	}
+	if ( threshold < LEAF_BVH_NODE_ITEMS * 2 ) {
+		threshold = LEAF_BVH_NODE_ITEMS * 2;
+	}
+
+	totalItems = 0;
+	maxItems = 0;
+	for ( i = 0, leaf = cm.leafs ; i < cm.numLeafs ; i++, leaf++ ) {
+		count = CM_LeafBvhItemCount( leaf );
+		if ( count >= threshold ) {
+			totalItems += count;
+			if ( count > maxItems ) {
+				maxItems = count;
+			}
+			if ( leaf->numLeafBrushes + leaf->numLeafSurfaces > cm.maxLeafBvhItems ) {
+				cm.maxLeafBvhItems = leaf->numLeafBrushes + leaf->numLeafSurfaces;
+			}
+		}
+	}
+	if ( !totalItems ) {
+		return;
+	}
+
+	// a binary tree over n items has fewer than 2n nodes
+	cm.leafBvhNodes = Hunk_Alloc( 2 * totalItems * sizeof( *cm.leafBvhNodes ), h_high );
+	cm.leafBvhItems = Hunk_Alloc( totalItems * sizeof( *cm.leafBvhItems ), h_high );
+	items = Z_Malloc( maxItems * sizeof( *items ) );
+
+	for ( i = 0, leaf = cm.leafs ; i < cm.numLeafs ; i++, leaf++ ) {
+		count = CM_LeafBvhItemCount( leaf );
+		if ( count < threshold ) {
+			continue;
+		}
+
+		count = 0;
+		for ( k = 0 ; k < leaf->numLeafBrushes ; k++ ) {
+			items[count].item = k;
+			VectorCopy( cm.brushes[ cm.leafbrushes[ leaf->firstLeafBrush + k ] ].bounds[0], items[count].bounds[0] );
+			VectorCopy( cm.brushes[ cm.leafbrushes[ leaf->firstLeafBrush + k ] ].bounds[1], items[count].bounds[1] );
+			count++;
+		}
+		for ( k = 0 ; k < leaf->numLeafSurfaces ; k++ ) {
+			patch = cm.surfaces[ cm.leafsurfaces[ leaf->firstLeafSurface + k ] ];
+			if ( !patch ) {
+				continue;
+			}
+			items[count].item = leaf->numLeafBrushes + k;
+			VectorCopy( patch->pc->bounds[0], items[count].bounds[0] );
+			VectorCopy( patch->pc->bounds[1], items[count].bounds[1] );
+			count++;
+		}
+
+		leaf->firstBvhNode = cm.numLeafBvhNodes;
+		CM_BuildLeafBvhNode( items, count );
+		leaf->numBvhNodes = cm.numLeafBvhNodes - leaf->firstBvhNode;
+	}
+
+	Z_Free( items );
+
+	Com_DPrintf( "%i leaf bvh nodes over %i items\n", cm.numLeafBvhNodes, cm.numLeafBvhItems );
 }
 
 //==================================================================
@@ -559,6 +1382,17 @@ unsigned CM_Checksum(dheader_t *header) {
 	return LittleLong(Com_BlockChecksum(checksums, 11 * 4));
 }
 
+/*
+==================
+CM_ResetSerialContext
+==================
+*/
+static void CM_ResetSerialContext( void ) {
+	cm_loadCount++;
+	cm.serialContext.loadCount = cm_loadCount;
+	cm.serialContext.serial = qtrue;
+}
+
 /*
 ==================
 CM_LoadMap
@@ -575,6 +1409,10 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 	dheader_t		header;
 	int				length;
 	static unsigned	last_checksum;
+#ifndef BSPC
+	int				startTime, readTime, lumpTime, patchTime;
+	int				patchThreads;
+#endif
 
 	if ( !name || !name[0] ) {
 		Com_Error( ERR_DROP, "CM_LoadMap: NULL name" );
@@ -584,6 +1422,9 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 	cm_noAreas = Cvar_Get ("cm_noAreas", "0", CVAR_CHEAT);
 	cm_noCurves = Cvar_Get ("cm_noCurves", "0", CVAR_CHEAT);
 	cm_playerCurveClip = Cvar_Get ("cm_playerCurveClip", "1", CVAR_ARCHIVE|CVAR_CHEAT );
+	cm_leafBvh = Cvar_Get ("cm_leafBvh", "32", CVAR_ARCHIVE );
+	cm_patchCache = Cvar_Get ("cm_patchCache", "1", CVAR_ARCHIVE );
+	cm_loadThreads = Cvar_Get ("cm_loadThreads", "0", CVAR_ARCHIVE );
 #endif
 	Com_DPrintf( "CM_LoadMap( %s, %i )\n", name, clientload );
 
@@ -593,8 +1434,12 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 	}
 
 	// free old stuff
+#ifndef BSPC
+	CM_FreePatchJobs();
+#endif
 	Com_Memset( &cm, 0, sizeof( cm ) );
 	CM_ClearLevelPatches();
+	CM_ResetSerialContext();
 
 	if ( !name[0] ) {
 		cm.numLeafs = 1;
@@ -609,6 +1454,7 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 	// load the file
 	//
 #ifndef BSPC
+	startTime = Sys_Milliseconds();
 	length = FS_ReadFile( name, &buf.v );
 #else
 	length = LoadQuakeFile((quakefile_t *) name, &buf.v);
@@ -633,6 +1479,16 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 
 	cmod_base = (byte *)buf.i;
 
+#ifndef BSPC
+	readTime = Sys_Milliseconds();
+
+	// get the patches going while the other lumps are parsed
+	if ( !cm_patchCache->integer || !CM_PatchCacheExists( name, last_checksum ) ) {
+		CM_StartPatchJobs( &header.lumps[LUMP_SURFACES], &header.lumps[LUMP_DRAWVERTS] );
+	}
+	patchThreads = cm_numPatchThreads;
+#endif
+
 	// load into heap
 	CMod_LoadShaders( &header.lumps[LUMP_SHADERS] );
 	CMod_LoadLeafs (&header.lumps[LUMP_LEAFS]);
@@ -645,7 +1501,21 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 	CMod_LoadNodes (&header.lumps[LUMP_NODES]);
 	CMod_LoadEntityString (&header.lumps[LUMP_ENTITIES]);
 	CMod_LoadVisibility( &header.lumps[LUMP_VISIBILITY] );
-	CMod_LoadPatches( &header.lumps[LUMP_SURFACES], &header.lumps[LUMP_DRAWVERTS] );
+#ifndef BSPC
+	lumpTime = Sys_Milliseconds();
+#endif
+	CMod_LoadPatches( &header.lumps[LUMP_SURFACES], &header.lumps[LUMP_DRAWVERTS], name, last_checksum );
+#ifndef BSPC
+	patchTime = Sys_Milliseconds();
+#endif
+	CM_BuildLeafBvhs();
+
+	cm.serialContext.brushMarks = Hunk_Alloc( ( BOX_BRUSHES + cm.numBrushes ) * sizeof( int ), h_high );
+	cm.serialContext.patchMarks = Hunk_Alloc( cm.numSurfaces * sizeof( int ), h_high );
+	cm.serialContext.brushBatchBits = Hunk_Alloc( ( BOX_BRUSHES + cm.numBrushes ) * sizeof( unsigned ), h_high );
+	cm.serialContext.patchBatchBits = Hunk_Alloc( cm.numSurfaces * sizeof( unsigned ), h_high );
+	cm.serialContext.leafBvhList = Hunk_Alloc( cm.maxLeafBvhItems * sizeof( int ), h_high );
+	cm.serialContext.leafBvhMasks = Hunk_Alloc( cm.maxLeafBvhItems * sizeof( unsigned ), h_high );
 
 	// we are NOT freeing the file, because it is cached for the ref
 	FS_FreeFile (buf.v);
@@ -654,6 +1524,14 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 
 	CM_FloodAreaConnections ();
 
+#ifndef BSPC
+	// the patch time is only what the workers weren't done with
+	// by the time the other lumps were
+	Com_Printf( "CM_LoadMap: %i msec (read %i, lumps %i, patches %i with %i threads, rest %i)\n",
+		Sys_Milliseconds() - startTime, readTime - startTime, lumpTime - readTime,
+		patchTime - lumpTime, patchThreads, Sys_Milliseconds() - patchTime );
+#endif
+
 	// allow this to be cached if it is loaded by the server
 	if ( !clientload ) {
 		Q_strncpyz( cm.name, name, sizeof( cm.name ) );
@@ -666,8 +1544,60 @@ CM_ClearMap
 ==================
 */
 void CM_ClearMap( void ) {
+#ifndef BSPC
+	CM_FreePatchJobs();
+#endif
 	Com_Memset( &cm, 0, sizeof( cm ) );
 	CM_ClearLevelPatches();
+	CM_ResetSerialContext();
+}
+
+/*
+==================
+CM_AllocTraceContext
+
+Gives a worker thread its own visit marks so it can trace against the
+map while other threads do the same.  Has to be called from the main
+thread, and the context has to be replaced after the next map change.
+==================
+*/
+cmTraceContext_t *CM_AllocTraceContext( void ) {
+	cmTraceContext_t	*ctx;
+	int					numBrushMarks;
+
+	numBrushMarks = BOX_BRUSHES + cm.numBrushes;
+	ctx = Z_Malloc( sizeof( *ctx ) + ( numBrushMarks + cm.numSurfaces ) * ( sizeof( int ) + sizeof( unsigned ) )
+		+ cm.maxLeafBvhItems * ( sizeof( int ) + sizeof( unsigned ) ) );
+	ctx->brushMarks = (int *)( ctx + 1 );
+	ctx->patchMarks = ctx->brushMarks + numBrushMarks;
+	ctx->brushBatchBits = (unsigned *)( ctx->patchMarks + cm.numSurfaces );
+	ctx->patchBatchBits = ctx->brushBatchBits + numBrushMarks;
+	ctx->leafBvhList = (int *)( ctx->patchBatchBits + cm.numSurfaces );
+	ctx->leafBvhMasks = (unsigned *)( ctx->leafBvhList + cm.maxLeafBvhItems );
+	ctx->loadCount = cm_loadCount;
+	ctx->serial = qfalse;
+
+	return ctx;
+}
+
+/*
+==================
+CM_FreeTraceContext
+==================
+*/
+void CM_FreeTraceContext( cmTraceContext_t *ctx ) {
+	Z_Free( ctx );
+}
+
+/*
+==================
+CM_TraceContextCurrent
+
+Lets a long lived owner know when its context has to be replaced
+==================
+*/
+qboolean CM_TraceContextCurrent( const cmTraceContext_t *ctx ) {
+	return ctx->loadCount == cm_loadCount;
 }
 
 /*
@@ -756,6 +1686,7 @@ void CM_InitBoxHull (void)
 	box_brush = &cm.brushes[cm.numBrushes];
 	box_brush->numsides = 6;
 	box_brush->sides = cm.brushsides + cm.numBrushSides;
+	box_brush->planes = Hunk_Alloc( BRUSH_PLANE_FLOATS( BOX_SIDES ) * sizeof( float ), h_high );
 	box_brush->contents = CONTENTS_BODY;
 
 	box_model.leaf.numLeafBrushes = 1;
@@ -787,6 +1718,8 @@ void CM_InitBoxHull (void)
 
 		SetPlaneSignbits( p );
 	}	
+
+	CM_PackBrushPlanes( box_brush );
 }
 
 /*
@@ -823,6 +1756,8 @@ clipHandle_t CM_TempBoxModel( const vec3_t mins, const vec3_t maxs, int capsule
 	VectorCopy( mins, box_brush->bounds[0] );
 	VectorCopy( maxs, box_brush->bounds[1] );
 
+	CM_PackBrushPlanes( box_brush );
+
 	return BOX_MODEL_HANDLE;
 }
 
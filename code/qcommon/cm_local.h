@@ -30,7 +30,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 
 typedef struct {
-	cplane_t	*plane;
+	cplane_t	plane;				// copied in so a descent doesn't hop to cm.planes
 	int			children[2];		// negative numbers are leafs
 } cNode_t;
 
@@ -43,8 +43,25 @@ typedef struct {
 
 	int			firstLeafSurface;
 	int			numLeafSurfaces;
+
+	int			firstBvhNode;		// crowded leafs only, see CM_BuildLeafBvhs
+	int			numBvhNodes;
 } cLeaf_t;
 
+// bounding volume hierarchy over the brushes and patches of a crowded leaf.
+// Nodes are stored depth first, so the first child of an inner node is the
+// next node, and a culled or finished subtree continues at skip.  Items are
+// positions in the leaf, brushes first and then surfaces, which keeps the
+// order the plain leaf loops would test them in.
+#define	LEAF_BVH_NODE_ITEMS		4
+
+typedef struct {
+	vec3_t		bounds[2];
+	int			firstItem;		// into cm.leafBvhItems
+	int			numItems;		// 0 for inner nodes
+	int			skip;			// next node once this subtree is done
+} cLeafBvhNode_t;
+
 typedef struct cmodel_s {
 	vec3_t		mins, maxs;
 	cLeaf_t		leaf;			// submodels don't reference the main tree
@@ -62,12 +79,11 @@ typedef struct {
 	vec3_t		bounds[2];
 	int			numsides;
 	cbrushside_t	*sides;
-	int			checkcount;		// to avoid repeated testings
+	float		*planes;		// side planes packed for the trace loops, see CM_PackBrushPlanes
 } cbrush_t;
 
 
 typedef struct {
-	int			checkcount;				// to avoid repeated testings
 	int			surfaceFlags;
 	int			contents;
 	struct patchCollide_s	*pc;
@@ -79,6 +95,20 @@ typedef struct {
 	int			floodvalid;
 } cArea_t;
 
+// everything a trace writes besides its traceWork_t, so traces with
+// different contexts can run against the same clipMap_t at once
+struct cmTraceContext_s {
+	int			checkcount;		// incremented on each trace
+	int			*brushMarks;	// [numBrushes + box brush] checkcount of the last visit
+	int			*patchMarks;	// [numSurfaces]
+	unsigned	*brushBatchBits;	// [numBrushes + box brush] traces of a CM_TraceBatch that visited each brush
+	unsigned	*patchBatchBits;	// [numSurfaces]
+	int			*leafBvhList;	// [maxLeafBvhItems] candidates of a crowded leaf
+	unsigned	*leafBvhMasks;	// [maxLeafBvhItems] traces of a CM_TraceBatch near each candidate
+	int			loadCount;		// cm_loadCount the marks were sized for
+	qboolean	serial;			// main thread context, keeps statistics and debug surfaces
+};
+
 typedef struct {
 	char		name[MAX_QPATH];
 
@@ -111,7 +141,8 @@ typedef struct {
 
 	int			numClusters;
 	int			clusterBytes;
-	byte		*visibility;
+	byte		*visibility;	// rows of clusterBytes, a multiple of 4
+	byte		*hearability;	// same layout, built from visibility at load
 	qboolean	vised;			// if false, visibility is just a single cluster of ffs
 
 	int			numEntityChars;
@@ -124,8 +155,14 @@ typedef struct {
 	int			numSurfaces;
 	cPatch_t	**surfaces;			// non-patches will be NULL
 
+	int			numLeafBvhNodes;
+	cLeafBvhNode_t	*leafBvhNodes;
+	int			numLeafBvhItems;
+	int			*leafBvhItems;
+	int			maxLeafBvhItems;	// positions in the most crowded leaf with a hierarchy
+
 	int			floodvalid;
-	int			checkcount;					// incremented on each trace
+	cmTraceContext_t	serialContext;		// used by the plain trace functions
 } clipMap_t;
 
 
@@ -134,11 +171,19 @@ typedef struct {
 #define	SURFACE_CLIP_EPSILON	(0.125)
 
 extern	clipMap_t	cm;
+extern	int			cm_loadCount;
 extern	int			c_pointcontents;
 extern	int			c_traces, c_brush_traces, c_patch_traces;
 extern	cvar_t		*cm_noAreas;
 extern	cvar_t		*cm_noCurves;
 extern	cvar_t		*cm_playerCurveClip;
+extern	cvar_t		*cm_leafBvh;
+extern	cvar_t		*cm_patchCache;
+extern	cvar_t		*cm_loadThreads;
+
+// cm_load.c
+
+void CM_PackBrushPlanes( cbrush_t *b );
 
 // cm_test.c
 
@@ -164,6 +209,9 @@ typedef struct {
 	qboolean	isPoint;	// optimized case
 	trace_t		trace;		// returned from trace call
 	sphere_t	sphere;		// sphere for oriendted capsule collision
+	cmTraceContext_t	*ctx;	// visit marks for this trace
+	int			checkcount;	// marks this trace leaves in ctx
+	unsigned	batchBit;	// this trace's bit in the ctx batch bits
 } traceWork_t;
 
 typedef struct leafList_s {
@@ -173,6 +221,7 @@ typedef struct leafList_s {
 	int		*list;
 	vec3_t	bounds[2];
 	int		lastLeaf;		// for overflows where each leaf can't be stored individually
+	cmTraceContext_t	*ctx;	// visit marks for CM_StoreBrushes
 	void	(*storeLeafs)( struct leafList_s *ll, int nodenum );
 } leafList_t;
 
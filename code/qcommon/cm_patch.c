@@ -22,6 +22,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 #include "cm_local.h"
 #include "cm_patch.h"
+#include <setjmp.h>
 
 /*
 
@@ -414,11 +415,47 @@ PATCH COLLIDE GENERATION
 ================================================================================
 */
 
-static	int				numPlanes;
-static	patchPlane_t	planes[MAX_PATCH_PLANES];
+// the scratch space is per thread so that patches can be generated
+// on the map load workers, see CM_GeneratePatchCollideThreaded
+static	QTHREADLOCAL int			numPlanes;
+static	QTHREADLOCAL patchPlane_t	planes[MAX_PATCH_PLANES];
 
-static	int				numFacets;
-static	facet_t			facets[MAX_FACETS];
+static	QTHREADLOCAL int			numFacets;
+static	QTHREADLOCAL facet_t		facets[MAX_FACETS];
+
+// set while generating on a worker, where an error only fails the patch
+static	QTHREADLOCAL jmp_buf		*patchAbort;
+
+/*
+==================
+CM_PatchError
+==================
+*/
+static void CM_PatchError( int code, const char *message ) {
+	if ( patchAbort ) {
+		longjmp( *patchAbort, 1 );
+	}
+	Com_Error( code, "%s", message );
+}
+
+/*
+==================
+CM_PatchWarning
+
+Workers can't print, so the patch is failed instead and the main
+thread prints the warning when it generates the patch again.
+==================
+*/
+static void CM_PatchWarning( qboolean developer, const char *message ) {
+	if ( patchAbort ) {
+		longjmp( *patchAbort, 1 );
+	}
+	if ( developer ) {
+		Com_DPrintf( "%s", message );
+	} else {
+		Com_Printf( "%s", message );
+	}
+}
 
 #define	NORMAL_EPSILON	0.0001
 #define	DIST_EPSILON	0.02
@@ -497,7 +534,7 @@ int CM_FindPlane2(float plane[4], int *flipped) {
 
 	// add a new plane
 	if ( numPlanes == MAX_PATCH_PLANES ) {
-		Com_Error( ERR_DROP, "MAX_PATCH_PLANES" );
+		CM_PatchError( ERR_DROP, "MAX_PATCH_PLANES" );
 	}
 
 	Vector4Copy( plane, planes[numPlanes].plane );
@@ -551,7 +588,7 @@ static int CM_FindPlane( float *p1, float *p2, float *p3 ) {
 
 	// add a new plane
 	if ( numPlanes == MAX_PATCH_PLANES ) {
-		Com_Error( ERR_DROP, "MAX_PATCH_PLANES" );
+		CM_PatchError( ERR_DROP, "MAX_PATCH_PLANES" );
 	}
 
 	Vector4Copy( plane, planes[numPlanes].plane );
@@ -607,7 +644,7 @@ static int	CM_GridPlane( int gridPlanes[MAX_GRID_SIZE][MAX_GRID_SIZE][2], int i,
 	}
 
 	// should never happen
-	Com_Printf( "WARNING: CM_GridPlane unresolvable\n" );
+	CM_PatchWarning( qfalse, "WARNING: CM_GridPlane unresolvable\n" );
 	return -1;
 }
 
@@ -684,7 +721,7 @@ static int CM_EdgePlaneNum( cGrid_t *grid, int gridPlanes[MAX_GRID_SIZE][MAX_GRI
 
 	}
 
-	Com_Error( ERR_DROP, "CM_EdgePlaneNum: bad k" );
+	CM_PatchError( ERR_DROP, "CM_EdgePlaneNum: bad k" );
 	return -1;
 }
 
@@ -720,7 +757,7 @@ static void CM_SetBorderInward( facet_t *facet, cGrid_t *grid, int gridPlanes[MA
 		numPoints = 3;
 		break;
 	default:
-		Com_Error( ERR_FATAL, "CM_SetBorderInward: bad parameter" );
+		CM_PatchError( ERR_FATAL, "CM_SetBorderInward: bad parameter" );
 		numPoints = 0;
 		break;
 	}
@@ -751,7 +788,7 @@ static void CM_SetBorderInward( facet_t *facet, cGrid_t *grid, int gridPlanes[MA
 			facet->borderPlanes[k] = -1;
 		} else {
 			// bisecting side border
-			Com_DPrintf( "WARNING: CM_SetBorderInward: mixed plane sides\n" );
+			CM_PatchWarning( qtrue, "WARNING: CM_SetBorderInward: mixed plane sides\n" );
 			facet->borderInward[k] = qfalse;
 			if ( !debugBlock ) {
 				debugBlock = qtrue;
@@ -876,7 +913,7 @@ void CM_AddFacetBevels( facet_t *facet ) {
 
 			if ( i == facet->numBorders ) {
 				if ( facet->numBorders >= 4 + 6 + 16 ) {
-					Com_Printf( "ERROR: too many bevels\n" );
+					CM_PatchWarning( qfalse, "ERROR: too many bevels\n" );
 					continue;
 				}
 				facet->borderPlanes[facet->numBorders] = CM_FindPlane2(plane, &flipped);
@@ -941,14 +978,14 @@ void CM_AddFacetBevels( facet_t *facet ) {
 
 				if ( i == facet->numBorders ) {
 					if ( facet->numBorders >= 4 + 6 + 16 ) {
-						Com_Printf( "ERROR: too many bevels\n" );
+						CM_PatchWarning( qfalse, "ERROR: too many bevels\n" );
 						continue;
 					}
 					facet->borderPlanes[facet->numBorders] = CM_FindPlane2(plane, &flipped);
 
 					for ( k = 0 ; k < facet->numBorders ; k++ ) {
 						if (facet->borderPlanes[facet->numBorders] ==
-							facet->borderPlanes[k]) Com_Printf("WARNING: bevel plane already used\n");
+							facet->borderPlanes[k]) CM_PatchWarning( qfalse, "WARNING: bevel plane already used\n" );
 					}
 
 					facet->borderNoAdjust[facet->numBorders] = 0;
@@ -963,7 +1000,7 @@ void CM_AddFacetBevels( facet_t *facet ) {
 					} //end if
 					ChopWindingInPlace( &w2, newplane, newplane[3], 0.1f );
 					if (!w2) {
-						Com_DPrintf("WARNING: CM_AddFacetBevels... invalid bevel\n");
+						CM_PatchWarning( qtrue, "WARNING: CM_AddFacetBevels... invalid bevel\n" );
 						continue;
 					}
 					else {
@@ -982,7 +1019,7 @@ void CM_AddFacetBevels( facet_t *facet ) {
 #ifndef BSPC
 	//add opposite plane
 	if ( facet->numBorders >= 4 + 6 + 16 ) {
-		Com_Printf( "ERROR: too many bevels\n" );
+		CM_PatchWarning( qfalse, "ERROR: too many bevels\n" );
 		return;
 	}
 	facet->borderPlanes[facet->numBorders] = facet->surfacePlane;
@@ -1080,7 +1117,7 @@ static void CM_PatchCollideFromGrid( cGrid_t *grid, patchCollide_t *pf ) {
 			}
 
 			if ( numFacets == MAX_FACETS ) {
-				Com_Error( ERR_DROP, "MAX_FACETS" );
+				CM_PatchError( ERR_DROP, "MAX_FACETS" );
 			}
 			facet = &facets[numFacets];
 			Com_Memset( facet, 0, sizeof( *facet ) );
@@ -1126,7 +1163,7 @@ static void CM_PatchCollideFromGrid( cGrid_t *grid, patchCollide_t *pf ) {
 				}
 
 				if ( numFacets == MAX_FACETS ) {
-					Com_Error( ERR_DROP, "MAX_FACETS" );
+					CM_PatchError( ERR_DROP, "MAX_FACETS" );
 				}
 				facet = &facets[numFacets];
 				Com_Memset( facet, 0, sizeof( *facet ) );
@@ -1153,44 +1190,26 @@ static void CM_PatchCollideFromGrid( cGrid_t *grid, patchCollide_t *pf ) {
 		}
 	}
 
-	// copy the results out
+	// the results are left in the scratch space for the caller to copy
 	pf->numPlanes = numPlanes;
+	pf->planes = planes;
 	pf->numFacets = numFacets;
-	pf->facets = Hunk_Alloc( numFacets * sizeof( *pf->facets ), h_high );
-	Com_Memcpy( pf->facets, facets, numFacets * sizeof( *pf->facets ) );
-	pf->planes = Hunk_Alloc( numPlanes * sizeof( *pf->planes ), h_high );
-	Com_Memcpy( pf->planes, planes, numPlanes * sizeof( *pf->planes ) );
+	pf->facets = facets;
 }
 
 
 /*
 ===================
-CM_GeneratePatchCollide
+CM_BuildPatchCollide
 
-Creates an internal structure that will be used to perform
-collision detection with a patch mesh.
-
-Points is packed as concatenated rows.
+Fills in pf with planes and facets pointing at the scratch space of
+the calling thread.
 ===================
 */
-struct patchCollide_s	*CM_GeneratePatchCollide( int width, int height, vec3_t *points ) {
-	patchCollide_t	*pf;
+static void CM_BuildPatchCollide( int width, int height, vec3_t *points, patchCollide_t *pf ) {
 	cGrid_t			grid;
 	int				i, j;
 
-	if ( width <= 2 || height <= 2 || !points ) {
-		Com_Error( ERR_DROP, "CM_GeneratePatchFacets: bad parameters: (%i, %i, %p)",
-			width, height, (void *)points );
-	}
-
-	if ( !(width & 1) || !(height & 1) ) {
-		Com_Error( ERR_DROP, "CM_GeneratePatchFacets: even sizes are invalid for quadratic meshes" );
-	}
-
-	if ( width > MAX_GRID_SIZE || height > MAX_GRID_SIZE ) {
-		Com_Error( ERR_DROP, "CM_GeneratePatchFacets: source is > MAX_GRID_SIZE" );
-	}
-
 	// build a grid
 	grid.width = width;
 	grid.height = height;
@@ -1216,7 +1235,6 @@ struct patchCollide_s	*CM_GeneratePatchCollide( int width, int height, vec3_t *p
 	// we now have a grid of points exactly on the curve
 	// the approximate surface defined by these points will be
 	// collided against
-	pf = Hunk_Alloc( sizeof( *pf ), h_high );
 	ClearBounds( pf->bounds[0], pf->bounds[1] );
 	for ( i = 0 ; i < grid.width ; i++ ) {
 		for ( j = 0 ; j < grid.height ; j++ ) {
@@ -1224,7 +1242,9 @@ struct patchCollide_s	*CM_GeneratePatchCollide( int width, int height, vec3_t *p
 		}
 	}
 
-	c_totalPatchBlocks += ( grid.width - 1 ) * ( grid.height - 1 );
+	if ( !patchAbort ) {
+		c_totalPatchBlocks += ( grid.width - 1 ) * ( grid.height - 1 );
+	}
 
 	// generate a bsp tree for the surface
 	CM_PatchCollideFromGrid( &grid, pf );
@@ -1237,10 +1257,129 @@ struct patchCollide_s	*CM_GeneratePatchCollide( int width, int height, vec3_t *p
 	pf->bounds[1][0] += 1;
 	pf->bounds[1][1] += 1;
 	pf->bounds[1][2] += 1;
+}
+
+/*
+===================
+CM_GeneratePatchCollide
+
+Creates an internal structure that will be used to perform
+collision detection with a patch mesh.
+
+Points is packed as concatenated rows.
+===================
+*/
+struct patchCollide_s	*CM_GeneratePatchCollide( int width, int height, vec3_t *points ) {
+	patchCollide_t	*pf;
+
+	if ( width <= 2 || height <= 2 || !points ) {
+		Com_Error( ERR_DROP, "CM_GeneratePatchFacets: bad parameters: (%i, %i, %p)",
+			width, height, (void *)points );
+	}
+
+	if ( !(width & 1) || !(height & 1) ) {
+		Com_Error( ERR_DROP, "CM_GeneratePatchFacets: even sizes are invalid for quadratic meshes" );
+	}
+
+	if ( width > MAX_GRID_SIZE || height > MAX_GRID_SIZE ) {
+		Com_Error( ERR_DROP, "CM_GeneratePatchFacets: source is > MAX_GRID_SIZE" );
+	}
+
+	pf = Hunk_Alloc( sizeof( *pf ), h_high );
+	CM_BuildPatchCollide( width, height, points, pf );
+
+	// copy the results out
+	pf->facets = Hunk_Alloc( numFacets * sizeof( *pf->facets ), h_high );
+	Com_Memcpy( pf->facets, facets, numFacets * sizeof( *pf->facets ) );
+	pf->planes = Hunk_Alloc( numPlanes * sizeof( *pf->planes ), h_high );
+	Com_Memcpy( pf->planes, planes, numPlanes * sizeof( *pf->planes ) );
 
 	return pf;
 }
 
+#ifndef BSPC
+/*
+===================
+CM_GeneratePatchCollideThreaded
+
+CM_GeneratePatchCollide for a worker thread, which can't touch the hunk
+or raise errors.  The planes and facets are malloc'd, and if anything
+is wrong with the patch qfalse is returned so the main thread can run
+CM_GeneratePatchCollide on it and report the error itself.
+===================
+*/
+qboolean CM_GeneratePatchCollideThreaded( int width, int height, vec3_t *points, patchCollide_t *pc ) {
+	jmp_buf		abort;
+
+	Com_Memset( pc, 0, sizeof( *pc ) );
+
+	if ( width <= 2 || height <= 2 || !points || !(width & 1) || !(height & 1)
+		|| width > MAX_GRID_SIZE || height > MAX_GRID_SIZE ) {
+		return qfalse;
+	}
+
+	if ( setjmp( abort ) ) {
+		patchAbort = NULL;
+		SetWindingAbort( NULL );
+		Com_Memset( pc, 0, sizeof( *pc ) );
+		return qfalse;
+	}
+	patchAbort = &abort;
+	SetWindingAbort( &abort );
+	CM_BuildPatchCollide( width, height, points, pc );
+	patchAbort = NULL;
+	SetWindingAbort( NULL );
+
+	// malloc( 0 ) may come back NULL
+	pc->facets = malloc( ( numFacets + 1 ) * sizeof( *pc->facets ) );
+	pc->planes = malloc( ( numPlanes + 1 ) * sizeof( *pc->planes ) );
+	if ( !pc->facets || !pc->planes ) {
+		CM_FreeThreadedPatchCollide( pc );
+		return qfalse;
+	}
+	Com_Memcpy( pc->facets, facets, numFacets * sizeof( *pc->facets ) );
+	Com_Memcpy( pc->planes, planes, numPlanes * sizeof( *pc->planes ) );
+
+	return qtrue;
+}
+
+/*
+===================
+CM_FreeThreadedPatchCollide
+===================
+*/
+void CM_FreeThreadedPatchCollide( patchCollide_t *pc ) {
+	free( pc->facets );
+	free( pc->planes );
+	pc->facets = NULL;
+	pc->planes = NULL;
+	pc->numFacets = pc->numPlanes = 0;
+}
+
+/*
+===================
+CM_HunkPatchCollide
+
+Moves a patch made by CM_GeneratePatchCollideThreaded onto the hunk.
+===================
+*/
+struct patchCollide_s *CM_HunkPatchCollide( patchCollide_t *pc ) {
+	patchCollide_t	*pf;
+
+	pf = Hunk_Alloc( sizeof( *pf ), h_high );
+	*pf = *pc;
+
+	pf->facets = Hunk_Alloc( pc->numFacets * sizeof( *pf->facets ), h_high );
+	Com_Memcpy( pf->facets, pc->facets, pc->numFacets * sizeof( *pf->facets ) );
+	pf->planes = Hunk_Alloc( pc->numPlanes * sizeof( *pf->planes ), h_high );
+	Com_Memcpy( pf->planes, pc->planes, pc->numPlanes * sizeof( *pf->planes ) );
+
+	CM_FreeThreadedPatchCollide( pc );
+
+	return pf;
+}
+#endif //BSPC
+
 /*
 ================================================================================
 
@@ -1325,12 +1464,14 @@ void CM_TracePointThroughPatchCollide( traceWork_t *tw, const struct patchCollid
 		if ( j == facet->numBorders ) {
 			// we hit this facet
 #ifndef BSPC
-			if (!cv) {
-				cv = Cvar_Get( "r_debugSurfaceUpdate", "1", 0 );
-			}
-			if (cv->integer) {
-				debugPatchCollide = pc;
-				debugFacet = facet;
+			if ( tw->ctx->serial ) {
+				if (!cv) {
+					cv = Cvar_Get( "r_debugSurfaceUpdate", "1", 0 );
+				}
+				if (cv->integer) {
+					debugPatchCollide = pc;
+					debugFacet = facet;
+				}
 			}
 #endif //BSPC
 			planes = &pc->planes[facet->surfacePlane];
@@ -1512,12 +1653,14 @@ void CM_TraceThroughPatchCollide( traceWork_t *tw, const struct patchCollide_s *
 					enterFrac = 0;
 				}
 #ifndef BSPC
-				if (!cv) {
-					cv = Cvar_Get( "r_debugSurfaceUpdate", "1", 0 );
-				}
-				if (cv && cv->integer) {
-					debugPatchCollide = pc;
-					debugFacet = facet;
+				if ( tw->ctx->serial ) {
+					if (!cv) {
+						cv = Cvar_Get( "r_debugSurfaceUpdate", "1", 0 );
+					}
+					if (cv && cv->integer) {
+						debugPatchCollide = pc;
+						debugFacet = facet;
+					}
 				}
 #endif //BSPC
 
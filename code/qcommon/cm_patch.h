@@ -101,3 +101,8 @@ typedef struct {
 
 
 struct patchCollide_s	*CM_GeneratePatchCollide( int width, int height, vec3_t *points );
+#ifndef BSPC
+qboolean CM_GeneratePatchCollideThreaded( int width, int height, vec3_t *points, patchCollide_t *pc );
+void CM_FreeThreadedPatchCollide( patchCollide_t *pc );
+struct patchCollide_s *CM_HunkPatchCollide( patchCollide_t *pc );
+#endif
@@ -26,12 +26,60 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "cm_local.h"
 
 
-// counters are only bumped when running single threaded,
-// because they are an awful coherence problem
-int	c_active_windings;
-int	c_peak_windings;
-int	c_winding_allocs;
-int	c_winding_points;
+// counters are per thread, because they are an awful coherence problem
+QTHREADLOCAL int	c_active_windings;
+QTHREADLOCAL int	c_peak_windings;
+QTHREADLOCAL int	c_winding_allocs;
+QTHREADLOCAL int	c_winding_points;
+
+// set while patches are generated on a worker thread, which can't touch
+// the zone or raise errors, see CM_GeneratePatchCollideThreaded
+static QTHREADLOCAL jmp_buf	*windingAbort;
+
+// windings malloc'd while windingAbort is set, freed when the work is aborted
+#define	MAX_WORKER_WINDINGS		64
+static QTHREADLOCAL winding_t	*workerWindings[MAX_WORKER_WINDINGS];
+static QTHREADLOCAL int			numWorkerWindings;
+
+/*
+=============
+SetWindingAbort
+
+Windings come from malloc while abort is set, and errors jump back to it.
+Clearing it frees the windings that are still allocated, which are the
+ones an aborted job left behind.
+=============
+*/
+void SetWindingAbort( jmp_buf *abort ) {
+	if ( !abort ) {
+		while ( numWorkerWindings > 0 ) {
+			free( workerWindings[--numWorkerWindings] );
+			c_active_windings--;
+		}
+	}
+	windingAbort = abort;
+}
+
+static void QDECL WindingError( int code, const char *fmt, ... ) __attribute__ ((noreturn, format (printf, 2, 3)));
+
+/*
+=============
+WindingError
+=============
+*/
+static void QDECL WindingError( int code, const char *fmt, ... ) {
+	va_list		argptr;
+	char		text[1024];
+
+	if ( windingAbort ) {
+		longjmp( *windingAbort, 1 );
+	}
+
+	va_start( argptr, fmt );
+	Q_vsnprintf( text, sizeof( text ), fmt, argptr );
+	va_end( argptr );
+	Com_Error( code, "%s", text );
+}
 
 void pw(winding_t *w)
 {
@@ -58,19 +106,44 @@ winding_t	*AllocWinding (int points)
 		c_peak_windings = c_active_windings;
 
 	s = sizeof(vec_t)*3*points + sizeof(int);
-	w = Z_Malloc (s);
+	if (windingAbort)
+	{
+		if (numWorkerWindings >= MAX_WORKER_WINDINGS)
+			WindingError (ERR_DROP, "AllocWinding: MAX_WORKER_WINDINGS");
+		w = malloc (s);
+		if (!w)
+			WindingError (ERR_DROP, "AllocWinding: out of memory");
+		workerWindings[numWorkerWindings++] = w;
+	}
+	else
+		w = Z_Malloc (s);
 	Com_Memset (w, 0, s); 
 	return w;
 }
 
 void FreeWinding (winding_t *w)
 {
+	int		i;
+
 	if (*(unsigned *)w == 0xdeaddead)
-		Com_Error (ERR_FATAL, "FreeWinding: freed a freed winding");
+		WindingError (ERR_FATAL, "FreeWinding: freed a freed winding");
 	*(unsigned *)w = 0xdeaddead;
 
 	c_active_windings--;
-	Z_Free (w);
+	if (windingAbort)
+	{
+		for (i=numWorkerWindings-1 ; i>=0 ; i--)
+		{
+			if (workerWindings[i] == w)
+			{
+				workerWindings[i] = workerWindings[--numWorkerWindings];
+				break;
+			}
+		}
+		free (w);
+	}
+	else
+		Z_Free (w);
 }
 
 /*
@@ -220,7 +293,7 @@ winding_t *BaseWindingForPlane (vec3_t normal, vec_t dist)
 		}
 	}
 	if (x==-1)
-		Com_Error (ERR_DROP, "BaseWindingForPlane: no axis found");
+		WindingError (ERR_DROP, "BaseWindingForPlane: no axis found");
 		
 	VectorCopy (vec3_origin, vup);	
 	switch (x)
@@ -407,9 +480,9 @@ void	ClipWindingEpsilon (winding_t *in, vec3_t normal, vec_t dist,
 	}
 	
 	if (f->numpoints > maxpts || b->numpoints > maxpts)
-		Com_Error (ERR_DROP, "ClipWinding: points exceeded estimate");
+		WindingError (ERR_DROP, "ClipWinding: points exceeded estimate");
 	if (f->numpoints > MAX_POINTS_ON_WINDING || b->numpoints > MAX_POINTS_ON_WINDING)
-		Com_Error (ERR_DROP, "ClipWinding: MAX_POINTS_ON_WINDING");
+		WindingError (ERR_DROP, "ClipWinding: MAX_POINTS_ON_WINDING");
 }
 
 
@@ -506,9 +579,9 @@ void ChopWindingInPlace (winding_t **inout, vec3_t normal, vec_t dist, vec_t eps
 	}
 	
 	if (f->numpoints > maxpts)
-		Com_Error (ERR_DROP, "ClipWinding: points exceeded estimate");
+		WindingError (ERR_DROP, "ClipWinding: points exceeded estimate");
 	if (f->numpoints > MAX_POINTS_ON_WINDING)
-		Com_Error (ERR_DROP, "ClipWinding: MAX_POINTS_ON_WINDING");
+		WindingError (ERR_DROP, "ClipWinding: MAX_POINTS_ON_WINDING");
 
 	FreeWinding (in);
 	*inout = f;
@@ -551,11 +624,11 @@ void CheckWinding (winding_t *w)
 	vec_t	facedist;
 
 	if (w->numpoints < 3)
-		Com_Error (ERR_DROP, "CheckWinding: %i points",w->numpoints);
+		WindingError (ERR_DROP, "CheckWinding: %i points",w->numpoints);
 	
 	area = WindingArea(w);
 	if (area < 1)
-		Com_Error (ERR_DROP, "CheckWinding: %f area", area);
+		WindingError (ERR_DROP, "CheckWinding: %f area", area);
 
 	WindingPlane (w, facenormal, &facedist);
 	
@@ -565,21 +638,21 @@ void CheckWinding (winding_t *w)
 
 		for (j=0 ; j<3 ; j++)
 			if (p1[j] > MAX_MAP_BOUNDS || p1[j] < -MAX_MAP_BOUNDS)
-				Com_Error (ERR_DROP, "CheckFace: BUGUS_RANGE: %f",p1[j]);
+				WindingError (ERR_DROP, "CheckFace: BUGUS_RANGE: %f",p1[j]);
 
 		j = i+1 == w->numpoints ? 0 : i+1;
 		
 	// check the point is on the face plane
 		d = DotProduct (p1, facenormal) - facedist;
 		if (d < -ON_EPSILON || d > ON_EPSILON)
-			Com_Error (ERR_DROP, "CheckWinding: point off plane");
+			WindingError (ERR_DROP, "CheckWinding: point off plane");
 	
 	// check the edge isn't degenerate
 		p2 = w->p[j];
 		VectorSubtract (p2, p1, dir);
 		
 		if (VectorLength (dir) < ON_EPSILON)
-			Com_Error (ERR_DROP, "CheckWinding: degenerate edge");
+			WindingError (ERR_DROP, "CheckWinding: degenerate edge");
 			
 		CrossProduct (facenormal, dir, edgenormal);
 		VectorNormalize2 (edgenormal, edgenormal);
@@ -593,7 +666,7 @@ void CheckWinding (winding_t *w)
 				continue;
 			d = DotProduct (w->p[j], edgenormal);
 			if (d > edgedist)
-				Com_Error (ERR_DROP, "CheckWinding: non-convex");
+				WindingError (ERR_DROP, "CheckWinding: non-convex");
 		}
 	}
 }
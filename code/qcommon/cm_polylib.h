@@ -22,6 +22,8 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 // this is only used for visualization tools in cm_ debug functions
 
+#include <setjmp.h>
+
 typedef struct
 {
 	int		numpoints;
@@ -66,3 +68,7 @@ void	ChopWindingInPlace (winding_t **w, vec3_t normal, vec_t dist, vec_t epsilon
 // frees the original if clipped
 
 void pw(winding_t *w);
+
+// windings built on a worker thread are malloc'd and errors jump to abort,
+// clearing it frees the windings an aborted job left
+void	SetWindingAbort( jmp_buf *abort );
@@ -45,8 +45,30 @@ void		CM_TransformedBoxTrace( trace_t *results, const vec3_t start, const vec3_t
 						  vec3_t mins, vec3_t maxs,
 						  clipHandle_t model, int brushmask,
 						  const vec3_t origin, const vec3_t angles, int capsule );
+void		CM_TraceBatch( trace_t *results, int numTraces, const vec3_t *starts, const vec3_t *ends,
+						  vec3_t mins, vec3_t maxs, clipHandle_t model, int brushmask, int capsule );
+
+// traces through different contexts may run concurrently, one context per
+// thread; contexts are allocated on the main thread and are only valid for
+// the map loaded at the time. CM_TempBoxModel is shared, so other threads
+// have to serialize it together with the trace against the box.
+typedef struct cmTraceContext_s cmTraceContext_t;
+
+cmTraceContext_t *CM_AllocTraceContext( void );
+void		CM_FreeTraceContext( cmTraceContext_t *ctx );
+qboolean	CM_TraceContextCurrent( const cmTraceContext_t *ctx );	// qfalse once the map it was made for is gone
+void		CM_SetThreadTraceContext( cmTraceContext_t *ctx );	// NULL for the main thread context
+void		CM_BoxTraceContext( cmTraceContext_t *ctx, trace_t *results, const vec3_t start, const vec3_t end,
+						  vec3_t mins, vec3_t maxs,
+						  clipHandle_t model, int brushmask, int capsule );
+void		CM_TransformedBoxTraceContext( cmTraceContext_t *ctx, trace_t *results, const vec3_t start, const vec3_t end,
+						  vec3_t mins, vec3_t maxs,
+						  clipHandle_t model, int brushmask,
+						  const vec3_t origin, const vec3_t angles, int capsule );
 
 byte		*CM_ClusterPVS (int cluster);
+byte		*CM_ClusterPHS (int cluster);
+// rows are padded to a multiple of 4 bytes, so they can be read as words
 
 int			CM_PointLeafnum( const vec3_t p );
 
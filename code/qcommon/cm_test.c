@@ -36,7 +36,7 @@ int CM_PointLeafnum_r( const vec3_t p, int num ) {
 	while (num >= 0)
 	{
 		node = cm.nodes + num;
-		plane = node->plane;
+		plane = &node->plane;
 		
 		if (plane->type < 3)
 			d = p[plane->type] - plane->dist;
@@ -100,11 +100,11 @@ void CM_StoreBrushes( leafList_t *ll, int nodenum ) {
 
 	for ( k = 0 ; k < leaf->numLeafBrushes ; k++ ) {
 		brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
-		b = &cm.brushes[brushnum];
-		if ( b->checkcount == cm.checkcount ) {
+		if ( ll->ctx->brushMarks[brushnum] == ll->ctx->checkcount ) {
 			continue;	// already checked this brush in another leaf
 		}
-		b->checkcount = cm.checkcount;
+		ll->ctx->brushMarks[brushnum] = ll->ctx->checkcount;
+		b = &cm.brushes[brushnum];
 		for ( i = 0 ; i < 3 ; i++ ) {
 			if ( b->bounds[0][i] >= ll->bounds[1][i] || b->bounds[1][i] <= ll->bounds[0][i] ) {
 				break;
@@ -149,7 +149,7 @@ void CM_BoxLeafnums_r( leafList_t *ll, int nodenum ) {
 		}
 	
 		node = &cm.nodes[nodenum];
-		plane = node->plane;
+		plane = &node->plane;
 		s = BoxOnPlaneSide( ll->bounds[0], ll->bounds[1], plane );
 		if (s == 1) {
 			nodenum = node->children[0];
@@ -172,8 +172,6 @@ CM_BoxLeafnums
 int	CM_BoxLeafnums( const vec3_t mins, const vec3_t maxs, int *list, int listsize, int *lastLeaf) {
 	leafList_t	ll;
 
-	cm.checkcount++;
-
 	VectorCopy( mins, ll.bounds[0] );
 	VectorCopy( maxs, ll.bounds[1] );
 	ll.count = 0;
@@ -182,6 +180,7 @@ int	CM_BoxLeafnums( const vec3_t mins, const vec3_t maxs, int *list, int listsiz
 	ll.storeLeafs = CM_StoreLeafs;
 	ll.lastLeaf = 0;
 	ll.overflowed = qfalse;
+	ll.ctx = NULL;
 
 	CM_BoxLeafnums_r( &ll, 0 );
 
@@ -197,7 +196,7 @@ CM_BoxBrushes
 int CM_BoxBrushes( const vec3_t mins, const vec3_t maxs, cbrush_t **list, int listsize ) {
 	leafList_t	ll;
 
-	cm.checkcount++;
+	cm.serialContext.checkcount++;
 
 	VectorCopy( mins, ll.bounds[0] );
 	VectorCopy( maxs, ll.bounds[1] );
@@ -207,6 +206,7 @@ int CM_BoxBrushes( const vec3_t mins, const vec3_t maxs, cbrush_t **list, int li
 	ll.storeLeafs = CM_StoreBrushes;
 	ll.lastLeaf = 0;
 	ll.overflowed = qfalse;
+	ll.ctx = &cm.serialContext;
 	
 	CM_BoxLeafnums_r( &ll, 0 );
 
@@ -231,6 +231,7 @@ int CM_PointContents( const vec3_t p, clipHandle_t model ) {
 	cbrush_t	*b;
 	int			contents;
 	float		d;
+	const float	*nx, *ny, *nz, *dist;
 	cmodel_t	*clipm;
 
 	if (!cm.numNodes) {	// map not loaded
@@ -255,11 +256,15 @@ int CM_PointContents( const vec3_t p, clipHandle_t model ) {
 		}
 
 		// see if the point is in the brush
+		nx = b->planes;
+		ny = nx + b->numsides;
+		nz = ny + b->numsides;
+		dist = nz + b->numsides;
 		for ( i = 0 ; i < b->numsides ; i++ ) {
-			d = DotProduct( p, b->sides[i].plane->normal );
+			d = p[0] * nx[i] + p[1] * ny[i] + p[2] * nz[i];
 // FIXME test for Cash
-//			if ( d >= b->sides[i].plane->dist ) {
-			if ( d > b->sides[i].plane->dist ) {
+//			if ( d >= dist[i] ) {
+			if ( d > dist[i] ) {
 				break;
 			}
 		}
@@ -321,6 +326,14 @@ byte	*CM_ClusterPVS (int cluster) {
 	return cm.visibility + cluster * cm.clusterBytes;
 }
 
+byte	*CM_ClusterPHS (int cluster) {
+	if (cluster < 0 || cluster >= cm.numClusters || !cm.vised ) {
+		return cm.hearability;
+	}
+
+	return cm.hearability + cluster * cm.clusterBytes;
+}
+
 
 
 /*
@@ -20,6 +20,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 ===========================================================================
 */
 #include "cm_local.h"
+#include "cm_patch.h"
 
 // always use bbox vs. bbox collision and never capsule vs. bbox or vice versa
 //#define ALWAYS_BBOX_VS_BBOX
@@ -160,10 +161,11 @@ CM_TestBoxInBrush
 */
 void CM_TestBoxInBrush( traceWork_t *tw, cbrush_t *brush ) {
 	int			i;
-	cplane_t	*plane;
+	const float	*nx, *ny, *nz, *pdist;
+	const byte	*signbits;
+	float		*offset;
 	float		dist;
 	float		d1;
-	cbrushside_t	*side;
 	float		t;
 	vec3_t		startp;
 
@@ -182,17 +184,20 @@ void CM_TestBoxInBrush( traceWork_t *tw, cbrush_t *brush ) {
 		return;
 	}
 
+	nx = brush->planes;
+	ny = nx + brush->numsides;
+	nz = ny + brush->numsides;
+	pdist = nz + brush->numsides;
+	signbits = (const byte *)( pdist + brush->numsides );
+
    if ( tw->sphere.use ) {
 		// the first six planes are the axial planes, so we only
 		// need to test the remainder
 		for ( i = 6 ; i < brush->numsides ; i++ ) {
-			side = brush->sides + i;
-			plane = side->plane;
-
 			// adjust the plane distance appropriately for radius
-			dist = plane->dist + tw->sphere.radius;
+			dist = pdist[i] + tw->sphere.radius;
 			// find the closest point on the capsule to the plane
-			t = DotProduct( plane->normal, tw->sphere.offset );
+			t = nx[i] * tw->sphere.offset[0] + ny[i] * tw->sphere.offset[1] + nz[i] * tw->sphere.offset[2];
 			if ( t > 0 )
 			{
 				VectorSubtract( tw->start, tw->sphere.offset, startp );
@@ -201,7 +206,7 @@ void CM_TestBoxInBrush( traceWork_t *tw, cbrush_t *brush ) {
 			{
 				VectorAdd( tw->start, tw->sphere.offset, startp );
 			}
-			d1 = DotProduct( startp, plane->normal ) - dist;
+			d1 = startp[0] * nx[i] + startp[1] * ny[i] + startp[2] * nz[i] - dist;
 			// if completely in front of face, no intersection
 			if ( d1 > 0 ) {
 				return;
@@ -211,13 +216,11 @@ void CM_TestBoxInBrush( traceWork_t *tw, cbrush_t *brush ) {
 		// the first six planes are the axial planes, so we only
 		// need to test the remainder
 		for ( i = 6 ; i < brush->numsides ; i++ ) {
-			side = brush->sides + i;
-			plane = side->plane;
-
 			// adjust the plane distance appropriately for mins/maxs
-			dist = plane->dist - DotProduct( tw->offsets[ plane->signbits ], plane->normal );
+			offset = tw->offsets[ signbits[i] ];
+			dist = pdist[i] - ( offset[0] * nx[i] + offset[1] * ny[i] + offset[2] * nz[i] );
 
-			d1 = DotProduct( tw->start, plane->normal ) - dist;
+			d1 = tw->start[0] * nx[i] + tw->start[1] * ny[i] + tw->start[2] * nz[i] - dist;
 
 			// if completely in front of face, no intersection
 			if ( d1 > 0 ) {
@@ -234,6 +237,198 @@ void CM_TestBoxInBrush( traceWork_t *tw, cbrush_t *brush ) {
 
 
 
+/*
+================
+CM_SweepNearBounds
+
+Returns qfalse if the part of the move that hasn't been clipped off yet
+stays further than the trace extents from the bounds
+================
+*/
+static qboolean CM_SweepNearBounds( traceWork_t *tw, const vec3_t mins, const vec3_t maxs ) {
+	int		i;
+	float	lo, hi, d, t0, t1, t;
+	float	enter, leave;
+
+	enter = 0;
+	leave = tw->trace.fraction;
+
+	for ( i = 0 ; i < 3 ; i++ ) {
+		// the extra unit covers the clip epsilon and rounding
+		lo = mins[i] - tw->extents[i] - 1;
+		hi = maxs[i] + tw->extents[i] + 1;
+		d = tw->end[i] - tw->start[i];
+
+		if ( d == 0 ) {
+			if ( tw->start[i] < lo || tw->start[i] > hi ) {
+				return qfalse;
+			}
+			continue;
+		}
+
+		t0 = ( lo - tw->start[i] ) / d;
+		t1 = ( hi - tw->start[i] ) / d;
+		if ( t0 > t1 ) {
+			t = t0;
+			t0 = t1;
+			t1 = t;
+		}
+		if ( t0 > enter ) {
+			enter = t0;
+		}
+		if ( t1 < leave ) {
+			leave = t1;
+		}
+		if ( enter > leave ) {
+			return qfalse;
+		}
+	}
+
+	return qtrue;
+}
+
+/*
+================
+CM_CompareLeafBvhItems
+================
+*/
+static int CM_CompareLeafBvhItems( const void *a, const void *b ) {
+	return *(const int *)a - *(const int *)b;
+}
+
+/*
+================
+CM_SortLeafBvhCandidates
+
+Puts the candidates back in leaf order
+================
+*/
+static void CM_SortLeafBvhCandidates( int *list, int count ) {
+	int			i, j, item;
+
+	// the lists are usually short, so an insertion sort is all it takes
+	if ( count > 32 ) {
+		qsort( list, count, sizeof( *list ), CM_CompareLeafBvhItems );
+		return;
+	}
+	for ( i = 1 ; i < count ; i++ ) {
+		item = list[i];
+		for ( j = i ; j > 0 && list[j-1] > item ; j-- ) {
+			list[j] = list[j-1];
+		}
+		list[j] = item;
+	}
+}
+
+/*
+================
+CM_LeafBvhCandidates
+
+Walks the hierarchy of a crowded leaf and lists the positions of the
+brushes and patches inside the bounds, and near the sweep of the trace
+if one is given.  The list is in leaf order so they are tested in the
+same order as by the plain loops.
+================
+*/
+static int CM_LeafBvhCandidates( cLeaf_t *leaf, const vec3_t mins, const vec3_t maxs, traceWork_t *sweep, int *list ) {
+	cLeafBvhNode_t	*node;
+	int			i, count;
+	int			num, end;
+
+	count = 0;
+	num = leaf->firstBvhNode;
+	end = num + leaf->numBvhNodes;
+
+	while ( num < end ) {
+		node = &cm.leafBvhNodes[num];
+
+		if ( !CM_BoundsIntersect( mins, maxs, node->bounds[0], node->bounds[1] )
+			|| ( sweep && !CM_SweepNearBounds( sweep, node->bounds[0], node->bounds[1] ) ) ) {
+			num = node->skip;
+			continue;
+		}
+
+		if ( !node->numItems ) {
+			num++;		// descend into the first child
+			continue;
+		}
+
+		for ( i = 0 ; i < node->numItems ; i++ ) {
+			list[count++] = cm.leafBvhItems[ node->firstItem + i ];
+		}
+		num = node->skip;
+	}
+
+	CM_SortLeafBvhCandidates( list, count );
+
+	return count;
+}
+
+/*
+================
+CM_TestInLeafBvh
+
+CM_TestInLeaf for leafs with a hierarchy
+================
+*/
+static void CM_TestInLeafBvh( traceWork_t *tw, cLeaf_t *leaf ) {
+	int			i, k, count;
+	int			brushnum;
+	int			surfnum;
+	int			*list;
+	cbrush_t	*b;
+	cPatch_t	*patch;
+
+	list = tw->ctx->leafBvhList;
+	count = CM_LeafBvhCandidates( leaf, tw->bounds[0], tw->bounds[1], NULL, list );
+
+	for ( i = 0 ; i < count ; i++ ) {
+		k = list[i];
+
+		if ( k < leaf->numLeafBrushes ) {
+			brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
+			if ( tw->ctx->brushMarks[brushnum] == tw->ctx->checkcount ) {
+				continue;	// already checked this brush in another leaf
+			}
+			tw->ctx->brushMarks[brushnum] = tw->ctx->checkcount;
+			b = &cm.brushes[brushnum];
+
+			if ( !(b->contents & tw->contents)) {
+				continue;
+			}
+
+			CM_TestBoxInBrush( tw, b );
+			if ( tw->trace.allsolid ) {
+				return;
+			}
+			continue;
+		}
+
+#ifndef BSPC
+		if ( cm_noCurves->integer ) {
+			return;		// only patches are left
+		}
+#endif
+		surfnum = cm.leafsurfaces[ leaf->firstLeafSurface + k - leaf->numLeafBrushes ];
+		patch = cm.surfaces[ surfnum ];
+		if ( tw->ctx->patchMarks[surfnum] == tw->ctx->checkcount ) {
+			continue;	// already checked this patch in another leaf
+		}
+		tw->ctx->patchMarks[surfnum] = tw->ctx->checkcount;
+
+		if ( !(patch->contents & tw->contents)) {
+			continue;
+		}
+
+		if ( CM_PositionTestInPatchCollide( tw, patch->pc ) ) {
+			tw->trace.startsolid = tw->trace.allsolid = qtrue;
+			tw->trace.fraction = 0;
+			tw->trace.contents = patch->contents;
+			return;
+		}
+	}
+}
+
 /*
 ================
 CM_TestInLeaf
@@ -242,17 +437,23 @@ CM_TestInLeaf
 void CM_TestInLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	int			k;
 	int			brushnum;
+	int			surfnum;
 	cbrush_t	*b;
 	cPatch_t	*patch;
 
+	if ( leaf->numBvhNodes ) {
+		CM_TestInLeafBvh( tw, leaf );
+		return;
+	}
+
 	// test box position against all brushes in the leaf
 	for (k=0 ; k<leaf->numLeafBrushes ; k++) {
 		brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
-		b = &cm.brushes[brushnum];
-		if (b->checkcount == cm.checkcount) {
+		if ( tw->ctx->brushMarks[brushnum] == tw->ctx->checkcount ) {
 			continue;	// already checked this brush in another leaf
 		}
-		b->checkcount = cm.checkcount;
+		tw->ctx->brushMarks[brushnum] = tw->ctx->checkcount;
+		b = &cm.brushes[brushnum];
 
 		if ( !(b->contents & tw->contents)) {
 			continue;
@@ -271,14 +472,15 @@ void CM_TestInLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	if ( !cm_noCurves->integer ) {
 #endif //BSPC
 		for ( k = 0 ; k < leaf->numLeafSurfaces ; k++ ) {
-			patch = cm.surfaces[ cm.leafsurfaces[ leaf->firstLeafSurface + k ] ];
+			surfnum = cm.leafsurfaces[ leaf->firstLeafSurface + k ];
+			patch = cm.surfaces[ surfnum ];
 			if ( !patch ) {
 				continue;
 			}
-			if ( patch->checkcount == cm.checkcount ) {
+			if ( tw->ctx->patchMarks[surfnum] == tw->ctx->checkcount ) {
 				continue;	// already checked this brush in another leaf
 			}
-			patch->checkcount = cm.checkcount;
+			tw->ctx->patchMarks[surfnum] = tw->ctx->checkcount;
 
 			if ( !(patch->contents & tw->contents)) {
 				continue;
@@ -427,13 +629,11 @@ void CM_PositionTest( traceWork_t *tw ) {
 	ll.storeLeafs = CM_StoreLeafs;
 	ll.lastLeaf = 0;
 	ll.overflowed = qfalse;
-
-	cm.checkcount++;
+	ll.ctx = tw->ctx;
 
 	CM_BoxLeafnums_r( &ll, 0 );
 
-
-	cm.checkcount++;
+	tw->ctx->checkcount++;
 
 	// test the contents of the leafs
 	for (i=0 ; i < ll.count ; i++) {
@@ -462,7 +662,9 @@ CM_TraceThroughPatch
 void CM_TraceThroughPatch( traceWork_t *tw, cPatch_t *patch ) {
 	float		oldFrac;
 
-	c_patch_traces++;
+	if ( tw->ctx->serial ) {
+		c_patch_traces++;
+	}
 
 	oldFrac = tw->trace.fraction;
 
@@ -481,31 +683,40 @@ CM_TraceThroughBrush
 */
 void CM_TraceThroughBrush( traceWork_t *tw, cbrush_t *brush ) {
 	int			i;
-	cplane_t	*plane, *clipplane;
+	const float	*nx, *ny, *nz, *pdist;
+	const byte	*signbits;
+	float		*offset;
 	float		dist;
 	float		enterFrac, leaveFrac;
 	float		d1, d2;
 	qboolean	getout, startout;
 	float		f;
-	cbrushside_t	*side, *leadside;
+	int			leadside;
 	float		t;
 	vec3_t		startp;
 	vec3_t		endp;
 
 	enterFrac = -1.0;
 	leaveFrac = 1.0;
-	clipplane = NULL;
 
 	if ( !brush->numsides ) {
 		return;
 	}
 
-	c_brush_traces++;
+	if ( tw->ctx->serial ) {
+		c_brush_traces++;
+	}
 
 	getout = qfalse;
 	startout = qfalse;
 
-	leadside = NULL;
+	leadside = -1;
+
+	nx = brush->planes;
+	ny = nx + brush->numsides;
+	nz = ny + brush->numsides;
+	pdist = nz + brush->numsides;
+	signbits = (const byte *)( pdist + brush->numsides );
 
 	if ( tw->sphere.use ) {
 		//
@@ -514,14 +725,11 @@ void CM_TraceThroughBrush( traceWork_t *tw, cbrush_t *brush ) {
 		// and the earliest time the trace crosses a plane towards the exterior
 		//
 		for (i = 0; i < brush->numsides; i++) {
-			side = brush->sides + i;
-			plane = side->plane;
-
 			// adjust the plane distance appropriately for radius
-			dist = plane->dist + tw->sphere.radius;
+			dist = pdist[i] + tw->sphere.radius;
 
 			// find the closest point on the capsule to the plane
-			t = DotProduct( plane->normal, tw->sphere.offset );
+			t = nx[i] * tw->sphere.offset[0] + ny[i] * tw->sphere.offset[1] + nz[i] * tw->sphere.offset[2];
 			if ( t > 0 )
 			{
 				VectorSubtract( tw->start, tw->sphere.offset, startp );
@@ -533,8 +741,8 @@ void CM_TraceThroughBrush( traceWork_t *tw, cbrush_t *brush ) {
 				VectorAdd( tw->end, tw->sphere.offset, endp );
 			}
 
-			d1 = DotProduct( startp, plane->normal ) - dist;
-			d2 = DotProduct( endp, plane->normal ) - dist;
+			d1 = startp[0] * nx[i] + startp[1] * ny[i] + startp[2] * nz[i] - dist;
+			d2 = endp[0] * nx[i] + endp[1] * ny[i] + endp[2] * nz[i] - dist;
 
 			if (d2 > 0) {
 				getout = qtrue;	// endpoint is not in solid
@@ -561,8 +769,7 @@ void CM_TraceThroughBrush( traceWork_t *tw, cbrush_t *brush ) {
 				}
 				if (f > enterFrac) {
 					enterFrac = f;
-					clipplane = plane;
-					leadside = side;
+					leadside = i;
 				}
 			} else {	// leave
 				f = (d1+SURFACE_CLIP_EPSILON) / (d1-d2);
@@ -581,14 +788,12 @@ void CM_TraceThroughBrush( traceWork_t *tw, cbrush_t *brush ) {
 		// and the earliest time the trace crosses a plane towards the exterior
 		//
 		for (i = 0; i < brush->numsides; i++) {
-			side = brush->sides + i;
-			plane = side->plane;
-
 			// adjust the plane distance appropriately for mins/maxs
-			dist = plane->dist - DotProduct( tw->offsets[ plane->signbits ], plane->normal );
+			offset = tw->offsets[ signbits[i] ];
+			dist = pdist[i] - ( offset[0] * nx[i] + offset[1] * ny[i] + offset[2] * nz[i] );
 
-			d1 = DotProduct( tw->start, plane->normal ) - dist;
-			d2 = DotProduct( tw->end, plane->normal ) - dist;
+			d1 = tw->start[0] * nx[i] + tw->start[1] * ny[i] + tw->start[2] * nz[i] - dist;
+			d2 = tw->end[0] * nx[i] + tw->end[1] * ny[i] + tw->end[2] * nz[i] - dist;
 
 			if (d2 > 0) {
 				getout = qtrue;	// endpoint is not in solid
@@ -615,8 +820,7 @@ void CM_TraceThroughBrush( traceWork_t *tw, cbrush_t *brush ) {
 				}
 				if (f > enterFrac) {
 					enterFrac = f;
-					clipplane = plane;
-					leadside = side;
+					leadside = i;
 				}
 			} else {	// leave
 				f = (d1+SURFACE_CLIP_EPSILON) / (d1-d2);
@@ -650,17 +854,83 @@ void CM_TraceThroughBrush( traceWork_t *tw, cbrush_t *brush ) {
 				enterFrac = 0;
 			}
 			tw->trace.fraction = enterFrac;
-			if (clipplane != NULL) {
-				tw->trace.plane = *clipplane;
-			}
-			if (leadside != NULL) {
-				tw->trace.surfaceFlags = leadside->surfaceFlags;
+			if (leadside != -1) {
+				tw->trace.plane = *brush->sides[leadside].plane;
+				tw->trace.surfaceFlags = brush->sides[leadside].surfaceFlags;
 			}
 			tw->trace.contents = brush->contents;
 		}
 	}
 }
 
+/*
+================
+CM_TraceThroughLeafBvh
+
+CM_TraceThroughLeaf for leafs with a hierarchy
+================
+*/
+static void CM_TraceThroughLeafBvh( traceWork_t *tw, cLeaf_t *leaf ) {
+	int			i, k, count;
+	int			brushnum;
+	int			surfnum;
+	int			*list;
+	cbrush_t	*b;
+	cPatch_t	*patch;
+
+	list = tw->ctx->leafBvhList;
+	count = CM_LeafBvhCandidates( leaf, tw->bounds[0], tw->bounds[1], tw, list );
+
+	for ( i = 0 ; i < count ; i++ ) {
+		k = list[i];
+
+		if ( k < leaf->numLeafBrushes ) {
+			brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
+			if ( tw->ctx->brushMarks[brushnum] == tw->ctx->checkcount ) {
+				continue;	// already checked this brush in another leaf
+			}
+			tw->ctx->brushMarks[brushnum] = tw->ctx->checkcount;
+			b = &cm.brushes[brushnum];
+
+			if ( !(b->contents & tw->contents) ) {
+				continue;
+			}
+
+			if ( !CM_BoundsIntersect( tw->bounds[0], tw->bounds[1],
+						b->bounds[0], b->bounds[1] ) ) {
+				continue;
+			}
+
+			CM_TraceThroughBrush( tw, b );
+			if ( !tw->trace.fraction ) {
+				return;
+			}
+			continue;
+		}
+
+#ifndef BSPC
+		if ( cm_noCurves->integer ) {
+			return;		// only patches are left
+		}
+#endif
+		surfnum = cm.leafsurfaces[ leaf->firstLeafSurface + k - leaf->numLeafBrushes ];
+		patch = cm.surfaces[ surfnum ];
+		if ( tw->ctx->patchMarks[surfnum] == tw->ctx->checkcount ) {
+			continue;	// already checked this patch in another leaf
+		}
+		tw->ctx->patchMarks[surfnum] = tw->ctx->checkcount;
+
+		if ( !(patch->contents & tw->contents) ) {
+			continue;
+		}
+
+		CM_TraceThroughPatch( tw, patch );
+		if ( !tw->trace.fraction ) {
+			return;
+		}
+	}
+}
+
 /*
 ================
 CM_TraceThroughLeaf
@@ -669,18 +939,24 @@ CM_TraceThroughLeaf
 void CM_TraceThroughLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	int			k;
 	int			brushnum;
+	int			surfnum;
 	cbrush_t	*b;
 	cPatch_t	*patch;
 
+	if ( leaf->numBvhNodes ) {
+		CM_TraceThroughLeafBvh( tw, leaf );
+		return;
+	}
+
 	// trace line against all brushes in the leaf
 	for ( k = 0 ; k < leaf->numLeafBrushes ; k++ ) {
 		brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
 
-		b = &cm.brushes[brushnum];
-		if ( b->checkcount == cm.checkcount ) {
+		if ( tw->ctx->brushMarks[brushnum] == tw->ctx->checkcount ) {
 			continue;	// already checked this brush in another leaf
 		}
-		b->checkcount = cm.checkcount;
+		tw->ctx->brushMarks[brushnum] = tw->ctx->checkcount;
+		b = &cm.brushes[brushnum];
 
 		if ( !(b->contents & tw->contents) ) {
 			continue;
@@ -704,14 +980,15 @@ void CM_TraceThroughLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	if ( !cm_noCurves->integer ) {
 #endif
 		for ( k = 0 ; k < leaf->numLeafSurfaces ; k++ ) {
-			patch = cm.surfaces[ cm.leafsurfaces[ leaf->firstLeafSurface + k ] ];
+			surfnum = cm.leafsurfaces[ leaf->firstLeafSurface + k ];
+			patch = cm.surfaces[ surfnum ];
 			if ( !patch ) {
 				continue;
 			}
-			if ( patch->checkcount == cm.checkcount ) {
+			if ( tw->ctx->patchMarks[surfnum] == tw->ctx->checkcount ) {
 				continue;	// already checked this patch in another leaf
 			}
-			patch->checkcount = cm.checkcount;
+			tw->ctx->patchMarks[surfnum] = tw->ctx->checkcount;
 
 			if ( !(patch->contents & tw->contents) ) {
 				continue;
@@ -1057,7 +1334,7 @@ void CM_TraceThroughTree( traceWork_t *tw, int num, float p1f, float p2f, vec3_t
 	// and the offset for the size of the box
 	//
 	node = cm.nodes + num;
-	plane = node->plane;
+	plane = &node->plane;
 
 	// adjust the plane distance appropriately for mins/maxs
 	if ( plane->type < 3 ) {
@@ -1137,176 +1414,763 @@ void CM_TraceThroughTree( traceWork_t *tw, int num, float p1f, float p2f, vec3_t
 }
 
 
-//======================================================================
+/*
+===============================================================================
 
+BATCHED TRACING
 
-/*
-==================
-CM_Trace
-==================
-*/
-void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, vec3_t mins, vec3_t maxs,
-						  clipHandle_t model, const vec3_t origin, int brushmask, int capsule, sphere_t *sphere ) {
-	int			i;
-	traceWork_t	tw;
-	vec3_t		offset;
-	cmodel_t	*cmod;
+Rays that share a box size, model and content mask go through the tree
+together.  Every ray keeps its own segment and visits leafs and brushes
+in the same order it would on its own, so the results match CM_Trace,
+but the node tests and brush planes are loaded once for the whole batch.
 
-	cmod = CM_ClipHandleToModel( model );
+===============================================================================
+*/
 
-	cm.checkcount++;		// for multi-check avoidance
+#define	MAX_TRACE_BATCH		32
 
-	c_traces++;				// for statistics, may be zeroed
+typedef struct {
+	traceWork_t	*tw;
+	float		p1f, p2f;
+	vec3_t		p1, p2;
+} traceSegment_t;
 
-	// fill in a default trace
-	Com_Memset( &tw, 0, sizeof(tw) );
-	tw.trace.fraction = 1;	// assume it goes the entire distance until shown otherwise
-	VectorCopy(origin, tw.modelOrigin);
+/*
+================
+CM_TraceBatchThroughBrush
 
-	if (!cm.numNodes) {
-		*results = tw.trace;
+Same tests as CM_TraceThroughBrush for several box traces of the same size
+================
+*/
+static void CM_TraceBatchThroughBrush( traceWork_t **tws, int numTraces, cbrush_t *brush ) {
+	int			i, j, numActive;
+	int			active[MAX_TRACE_BATCH];
+	const float	*nx, *ny, *nz, *pdist;
+	const byte	*signbits;
+	float		*offset;
+	float		dist;
+	float		enterFrac[MAX_TRACE_BATCH], leaveFrac[MAX_TRACE_BATCH];
+	float		d1, d2;
+	qboolean	getout[MAX_TRACE_BATCH], startout[MAX_TRACE_BATCH];
+	float		f;
+	int			leadside[MAX_TRACE_BATCH];
+	traceWork_t	*tw;
 
-		return;	// map not loaded, shouldn't happen
+	if ( !brush->numsides ) {
+		return;
 	}
 
-	// allow NULL to be passed in for 0,0,0
-	if ( !mins ) {
-		mins = vec3_origin;
-	}
-	if ( !maxs ) {
-		maxs = vec3_origin;
+	if ( tws[0]->sphere.use ) {
+		for ( j = 0 ; j < numTraces ; j++ ) {
+			CM_TraceThroughBrush( tws[j], brush );
+		}
+		return;
 	}
 
-	// set basic parms
-	tw.contents = brushmask;
-
-	// adjust so that mins and maxs are always symetric, which
-	// avoids some complications with plane expanding of rotated
-	// bmodels
-	for ( i = 0 ; i < 3 ; i++ ) {
-		offset[i] = ( mins[i] + maxs[i] ) * 0.5;
-		tw.size[0][i] = mins[i] - offset[i];
-		tw.size[1][i] = maxs[i] - offset[i];
-		tw.start[i] = start[i] + offset[i];
-		tw.end[i] = end[i] + offset[i];
+	if ( tws[0]->ctx->serial ) {
+		c_brush_traces += numTraces;
 	}
 
-	// if a sphere is already specified
-	if ( sphere ) {
-		tw.sphere = *sphere;
-	}
-	else {
-		tw.sphere.use = capsule;
-		tw.sphere.radius = ( tw.size[1][0] > tw.size[1][2] ) ? tw.size[1][2]: tw.size[1][0];
-		tw.sphere.halfheight = tw.size[1][2];
-		VectorSet( tw.sphere.offset, 0, 0, tw.size[1][2] - tw.sphere.radius );
+	for ( j = 0 ; j < numTraces ; j++ ) {
+		active[j] = j;
+		enterFrac[j] = -1.0;
+		leaveFrac[j] = 1.0;
+		getout[j] = qfalse;
+		startout[j] = qfalse;
+		leadside[j] = -1;
 	}
+	numActive = numTraces;
 
-	tw.maxOffset = tw.size[1][0] + tw.size[1][1] + tw.size[1][2];
-
-	// tw.offsets[signbits] = vector to appropriate corner from origin
-	tw.offsets[0][0] = tw.size[0][0];
-	tw.offsets[0][1] = tw.size[0][1];
-	tw.offsets[0][2] = tw.size[0][2];
+	nx = brush->planes;
+	ny = nx + brush->numsides;
+	nz = ny + brush->numsides;
+	pdist = nz + brush->numsides;
+	signbits = (const byte *)( pdist + brush->numsides );
 
-	tw.offsets[1][0] = tw.size[1][0];
-	tw.offsets[1][1] = tw.size[0][1];
-	tw.offsets[1][2] = tw.size[0][2];
+	for ( i = 0 ; i < brush->numsides ; i++ ) {
+		// all traces in the batch have the same offsets
+		offset = tws[0]->offsets[ signbits[i] ];
+		dist = pdist[i] - ( offset[0] * nx[i] + offset[1] * ny[i] + offset[2] * nz[i] );
 
-	tw.offsets[2][0] = tw.size[0][0];
-	tw.offsets[2][1] = tw.size[1][1];
-	tw.offsets[2][2] = tw.size[0][2];
+		for ( j = 0 ; j < numActive ; ) {
+			tw = tws[ active[j] ];
 
-	tw.offsets[3][0] = tw.size[1][0];
-	tw.offsets[3][1] = tw.size[1][1];
-	tw.offsets[3][2] = tw.size[0][2];
+			d1 = tw->start[0] * nx[i] + tw->start[1] * ny[i] + tw->start[2] * nz[i] - dist;
+			d2 = tw->end[0] * nx[i] + tw->end[1] * ny[i] + tw->end[2] * nz[i] - dist;
 
-	tw.offsets[4][0] = tw.size[0][0];
-	tw.offsets[4][1] = tw.size[0][1];
-	tw.offsets[4][2] = tw.size[1][2];
-
-	tw.offsets[5][0] = tw.size[1][0];
-	tw.offsets[5][1] = tw.size[0][1];
-	tw.offsets[5][2] = tw.size[1][2];
-
-	tw.offsets[6][0] = tw.size[0][0];
-	tw.offsets[6][1] = tw.size[1][1];
-	tw.offsets[6][2] = tw.size[1][2];
+			if (d2 > 0) {
+				getout[ active[j] ] = qtrue;	// endpoint is not in solid
+			}
+			if (d1 > 0) {
+				startout[ active[j] ] = qtrue;
+			}
 
-	tw.offsets[7][0] = tw.size[1][0];
-	tw.offsets[7][1] = tw.size[1][1];
-	tw.offsets[7][2] = tw.size[1][2];
+			// if completely in front of face, no intersection with the entire brush
+			if (d1 > 0 && ( d2 >= SURFACE_CLIP_EPSILON || d2 >= d1 )  ) {
+				active[j] = active[--numActive];
+				continue;
+			}
 
-	//
-	// calculate bounds
-	//
-	if ( tw.sphere.use ) {
-		for ( i = 0 ; i < 3 ; i++ ) {
-			if ( tw.start[i] < tw.end[i] ) {
-				tw.bounds[0][i] = tw.start[i] - fabs(tw.sphere.offset[i]) - tw.sphere.radius;
-				tw.bounds[1][i] = tw.end[i] + fabs(tw.sphere.offset[i]) + tw.sphere.radius;
-			} else {
-				tw.bounds[0][i] = tw.end[i] - fabs(tw.sphere.offset[i]) - tw.sphere.radius;
-				tw.bounds[1][i] = tw.start[i] + fabs(tw.sphere.offset[i]) + tw.sphere.radius;
+			// crosses face
+			if ( d1 > 0 || d2 > 0 ) {
+				if (d1 > d2) {	// enter
+					f = (d1-SURFACE_CLIP_EPSILON) / (d1-d2);
+					if ( f < 0 ) {
+						f = 0;
+					}
+					if (f > enterFrac[ active[j] ]) {
+						enterFrac[ active[j] ] = f;
+						leadside[ active[j] ] = i;
+					}
+				} else {	// leave
+					f = (d1+SURFACE_CLIP_EPSILON) / (d1-d2);
+					if ( f > 1 ) {
+						f = 1;
+					}
+					if (f < leaveFrac[ active[j] ]) {
+						leaveFrac[ active[j] ] = f;
+					}
+				}
 			}
+			j++;
 		}
-	}
-	else {
-		for ( i = 0 ; i < 3 ; i++ ) {
-			if ( tw.start[i] < tw.end[i] ) {
-				tw.bounds[0][i] = tw.start[i] + tw.size[0][i];
-				tw.bounds[1][i] = tw.end[i] + tw.size[1][i];
-			} else {
-				tw.bounds[0][i] = tw.end[i] + tw.size[0][i];
-				tw.bounds[1][i] = tw.start[i] + tw.size[1][i];
-			}
+
+		if ( !numActive ) {
+			return;
 		}
 	}
 
 	//
-	// check for position test special case
+	// all planes have been checked, and these traces were not
+	// completely outside the brush
 	//
-	if (start[0] == end[0] && start[1] == end[1] && start[2] == end[2]) {
-		if ( model ) {
-#ifdef ALWAYS_BBOX_VS_BBOX // FIXME - compile time flag?
-			if ( model == BOX_MODEL_HANDLE || model == CAPSULE_MODEL_HANDLE) {
-				tw.sphere.use = qfalse;
-				CM_TestInLeaf( &tw, &cmod->leaf );
-			}
-			else
-#elif defined(ALWAYS_CAPSULE_VS_CAPSULE)
-			if ( model == BOX_MODEL_HANDLE || model == CAPSULE_MODEL_HANDLE) {
-				CM_TestCapsuleInCapsule( &tw, model );
+	for ( i = 0 ; i < numActive ; i++ ) {
+		j = active[i];
+		tw = tws[j];
+
+		if (!startout[j]) {	// original point was inside brush
+			tw->trace.startsolid = qtrue;
+			if (!getout[j]) {
+				tw->trace.allsolid = qtrue;
+				tw->trace.fraction = 0;
+				tw->trace.contents = brush->contents;
 			}
-			else
-#endif
-			if ( model == CAPSULE_MODEL_HANDLE ) {
-				if ( tw.sphere.use ) {
-					CM_TestCapsuleInCapsule( &tw, model );
+			continue;
+		}
+
+		if (enterFrac[j] < leaveFrac[j]) {
+			if (enterFrac[j] > -1 && enterFrac[j] < tw->trace.fraction) {
+				if (enterFrac[j] < 0) {
+					enterFrac[j] = 0;
 				}
-				else {
-					CM_TestBoundingBoxInCapsule( &tw, model );
+				tw->trace.fraction = enterFrac[j];
+				if (leadside[j] != -1) {
+					tw->trace.plane = *brush->sides[ leadside[j] ].plane;
+					tw->trace.surfaceFlags = brush->sides[ leadside[j] ].surfaceFlags;
 				}
+				tw->trace.contents = brush->contents;
 			}
-			else {
-				CM_TestInLeaf( &tw, &cmod->leaf );
-			}
-		} else {
-			CM_PositionTest( &tw );
 		}
+	}
+}
+
+/*
+================
+CM_LeafBvhBatchCandidates
+
+CM_LeafBvhCandidates for a batch.  Every node keeps the mask of the traces
+that can touch it, so a subtree is dropped as soon as none of them can,
+and each candidate gets the mask of its node in masks[position].
+================
+*/
+#define	MAX_LEAF_BVH_DEPTH		64
+
+static int CM_LeafBvhBatchCandidates( traceWork_t **tws, int numTraces, unsigned mask,
+									cLeaf_t *leaf, int *list, unsigned *masks ) {
+	cLeafBvhNode_t	*node;
+	traceWork_t	*tw;
+	int			stack[MAX_LEAF_BVH_DEPTH];
+	unsigned	stackMasks[MAX_LEAF_BVH_DEPTH];
+	int			i, j, count, item;
+	int			num, depth;
+	unsigned	parent;
+
+	count = 0;
+	depth = 0;
+	num = leaf->firstBvhNode;
+
+	for ( ;; ) {
+		node = &cm.leafBvhNodes[num];
+
+		parent = mask;
+		mask = 0;
+		for ( j = 0 ; j < numTraces ; j++ ) {
+			if ( !( parent & ( 1u << j ) ) ) {
+				continue;
+			}
+			tw = tws[j];
+			if ( CM_BoundsIntersect( tw->bounds[0], tw->bounds[1], node->bounds[0], node->bounds[1] )
+				&& CM_SweepNearBounds( tw, node->bounds[0], node->bounds[1] ) ) {
+				mask |= 1u << j;
+			}
+		}
+
+		if ( mask && !node->numItems ) {
+			// the second child starts where the first one is done
+			if ( depth == MAX_LEAF_BVH_DEPTH ) {
+				Com_Error( ERR_DROP, "CM_LeafBvhBatchCandidates: hierarchy too deep" );
+			}
+			stack[depth] = cm.leafBvhNodes[num + 1].skip;
+			stackMasks[depth] = mask;
+			depth++;
+			num++;
+			continue;
+		}
+
+		for ( i = 0 ; mask && i < node->numItems ; i++ ) {
+			item = cm.leafBvhItems[ node->firstItem + i ];
+			list[count++] = item;
+			masks[item] = mask;
+		}
+
+		if ( !depth ) {
+			break;
+		}
+		depth--;
+		num = stack[depth];
+		mask = stackMasks[depth];
+	}
+
+	CM_SortLeafBvhCandidates( list, count );
+
+	return count;
+}
+
+/*
+================
+CM_TraceBatchThroughLeafBrush
+
+Traces the traces of the batch in mask through one brush of a leaf.
+Leafs with a hierarchy also skip the traces whose sweep passes by the
+brush, like the nodes of the hierarchy do for single traces.
+================
+*/
+static void CM_TraceBatchThroughLeafBrush( traceWork_t **tws, int numTraces, unsigned mask, int brushnum, qboolean sweep ) {
+	int			j, count;
+	cbrush_t	*b;
+	traceWork_t	*tw;
+	traceWork_t	*list[MAX_TRACE_BATCH];
+	cmTraceContext_t	*ctx;
+	unsigned	*bits;
+
+	ctx = tws[0]->ctx;
+	b = &cm.brushes[brushnum];
+
+	if ( ctx->brushMarks[brushnum] != tws[0]->checkcount ) {
+		ctx->brushMarks[brushnum] = tws[0]->checkcount;
+		ctx->brushBatchBits[brushnum] = 0;
+	}
+	bits = &ctx->brushBatchBits[brushnum];
+
+	count = 0;
+	for ( j = 0 ; j < numTraces ; j++ ) {
+		tw = tws[j];
+		if ( !( mask & ( 1u << j ) ) ) {
+			continue;
+		}
+		if ( !tw->trace.fraction ) {
+			continue;	// done with this leaf
+		}
+		if ( *bits & tw->batchBit ) {
+			continue;	// already checked this brush in another leaf
+		}
+		*bits |= tw->batchBit;
+
+		if ( !(b->contents & tw->contents) ) {
+			continue;
+		}
+
+		if ( !CM_BoundsIntersect( tw->bounds[0], tw->bounds[1],
+					b->bounds[0], b->bounds[1] ) ) {
+			continue;
+		}
+		if ( sweep && !CM_SweepNearBounds( tw, b->bounds[0], b->bounds[1] ) ) {
+			continue;
+		}
+		list[count++] = tw;
+	}
+
+	if ( count ) {
+		CM_TraceBatchThroughBrush( list, count, b );
+	}
+}
+
+/*
+================
+CM_TraceBatchThroughLeafPatch
+
+Same as CM_TraceBatchThroughLeafBrush for a patch
+================
+*/
+static void CM_TraceBatchThroughLeafPatch( traceWork_t **tws, int numTraces, unsigned mask, int surfnum, qboolean sweep ) {
+	int			j;
+	cPatch_t	*patch;
+	traceWork_t	*tw;
+	cmTraceContext_t	*ctx;
+	unsigned	*bits;
+
+	ctx = tws[0]->ctx;
+	patch = cm.surfaces[ surfnum ];
+
+	if ( ctx->patchMarks[surfnum] != tws[0]->checkcount ) {
+		ctx->patchMarks[surfnum] = tws[0]->checkcount;
+		ctx->patchBatchBits[surfnum] = 0;
+	}
+	bits = &ctx->patchBatchBits[surfnum];
+
+	for ( j = 0 ; j < numTraces ; j++ ) {
+		tw = tws[j];
+		if ( !( mask & ( 1u << j ) ) ) {
+			continue;
+		}
+		if ( !tw->trace.fraction ) {
+			continue;
+		}
+		if ( *bits & tw->batchBit ) {
+			continue;	// already checked this patch in another leaf
+		}
+		*bits |= tw->batchBit;
+
+		if ( !(patch->contents & tw->contents) ) {
+			continue;
+		}
+		if ( sweep && !CM_SweepNearBounds( tw, patch->pc->bounds[0], patch->pc->bounds[1] ) ) {
+			continue;
+		}
+
+		CM_TraceThroughPatch( tw, patch );
+	}
+}
+
+/*
+================
+CM_TraceBatchThroughLeaf
+
+The whole batch shares one checkcount, and every trace has its own bit
+for the brushes and patches it visited.  Brushes and patches outside the
+bounds of all the traces are skipped without touching their marks, no
+trace would clip against them.
+================
+*/
+static void CM_TraceBatchThroughLeaf( traceWork_t **tws, int numTraces, cLeaf_t *leaf ) {
+	int			j, k;
+	int			i, count;
+	int			brushnum;
+	int			surfnum;
+	int			*list;
+	unsigned	*masks;
+	unsigned	all;
+	cbrush_t	*b;
+	vec3_t		bounds[2];
+
+	all = numTraces == 32 ? ~0u : ( 1u << numTraces ) - 1;
+
+	if ( leaf->numBvhNodes ) {
+		list = tws[0]->ctx->leafBvhList;
+		masks = tws[0]->ctx->leafBvhMasks;
+		count = CM_LeafBvhBatchCandidates( tws, numTraces, all, leaf, list, masks );
+
+		for ( i = 0 ; i < count ; i++ ) {
+			k = list[i];
+			if ( k < leaf->numLeafBrushes ) {
+				CM_TraceBatchThroughLeafBrush( tws, numTraces, masks[k], cm.leafbrushes[leaf->firstLeafBrush+k], qtrue );
+				continue;
+			}
+#ifndef BSPC
+			if ( cm_noCurves->integer ) {
+				return;		// only patches are left
+			}
+#endif
+			CM_TraceBatchThroughLeafPatch( tws, numTraces, masks[k], cm.leafsurfaces[ leaf->firstLeafSurface + k - leaf->numLeafBrushes ], qtrue );
+		}
+		return;
+	}
+
+	ClearBounds( bounds[0], bounds[1] );
+	for ( j = 0 ; j < numTraces ; j++ ) {
+		AddPointToBounds( tws[j]->bounds[0], bounds[0], bounds[1] );
+		AddPointToBounds( tws[j]->bounds[1], bounds[0], bounds[1] );
+	}
+
+	// trace lines against all brushes in the leaf
+	for ( k = 0 ; k < leaf->numLeafBrushes ; k++ ) {
+		brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
+		b = &cm.brushes[brushnum];
+
+		if ( !CM_BoundsIntersect( bounds[0], bounds[1], b->bounds[0], b->bounds[1] ) ) {
+			continue;
+		}
+		CM_TraceBatchThroughLeafBrush( tws, numTraces, all, brushnum, qfalse );
+	}
+
+	// trace lines against all patches in the leaf
+#ifdef BSPC
+	if (1) {
+#else
+	if ( !cm_noCurves->integer ) {
+#endif
+		for ( k = 0 ; k < leaf->numLeafSurfaces ; k++ ) {
+			surfnum = cm.leafsurfaces[ leaf->firstLeafSurface + k ];
+			if ( !cm.surfaces[ surfnum ] ) {
+				continue;
+			}
+			CM_TraceBatchThroughLeafPatch( tws, numTraces, all, surfnum, qfalse );
+		}
+	}
+}
+
+/*
+==================
+CM_TraceBatchThroughTree
+
+Every segment takes the same path as in CM_TraceThroughTree.  Segments
+that cross a node are split, and the near halves are visited before the
+far halves so each trace still sees the leafs front to back.
+==================
+*/
+static void CM_TraceBatchThroughTree( traceSegment_t **segs, int numSegs, int num ) {
+	cNode_t		*node;
+	cplane_t	*plane;
+	float		t1, t2, offset;
+	float		frac, frac2;
+	float		idist;
+	traceSegment_t	*seg, *near, *far;
+	traceSegment_t	*lists[3][MAX_TRACE_BATCH];
+	traceSegment_t	split[MAX_TRACE_BATCH*2];
+	traceWork_t	*tws[MAX_TRACE_BATCH];
+	int			counts[3];
+	int			i, numSplit, numTraces;
+
+	// if < 0, we are in a leaf node
+	if ( num < 0 ) {
+		for ( i = 0, numTraces = 0 ; i < numSegs ; i++ ) {
+			if ( segs[i]->tw->trace.fraction > segs[i]->p1f ) {
+				tws[numTraces++] = segs[i]->tw;
+			}
+		}
+		if ( numTraces ) {
+			CM_TraceBatchThroughLeaf( tws, numTraces, &cm.leafs[-1-num] );
+		}
+		return;
+	}
+
+	node = cm.nodes + num;
+	plane = &node->plane;
+
+	// the traces share their size, so they share the offset too
+	if ( plane->type < 3 ) {
+		offset = segs[0]->tw->extents[plane->type];
+	} else if ( segs[0]->tw->isPoint ) {
+		offset = 0;
 	} else {
-		//
-		// check for point special case
-		//
-		if ( tw.size[0][0] == 0 && tw.size[0][1] == 0 && tw.size[0][2] == 0 ) {
-			tw.isPoint = qtrue;
-			VectorClear( tw.extents );
+		// this is silly
+		offset = 2048;
+	}
+
+	//
+	// lists[0] goes to child 0 first, then lists[1] to child 1, then
+	// lists[2] to child 0 again for the far halves of segments that
+	// crossed the node from the child 1 side
+	//
+	counts[0] = counts[1] = counts[2] = 0;
+	numSplit = 0;
+
+	for ( i = 0 ; i < numSegs ; i++ ) {
+		seg = segs[i];
+
+		if ( seg->tw->trace.fraction <= seg->p1f ) {
+			continue;		// already hit something nearer
+		}
+
+		if ( plane->type < 3 ) {
+			t1 = seg->p1[plane->type] - plane->dist;
+			t2 = seg->p2[plane->type] - plane->dist;
+		} else {
+			t1 = DotProduct (plane->normal, seg->p1) - plane->dist;
+			t2 = DotProduct (plane->normal, seg->p2) - plane->dist;
+		}
+
+		// see which sides we need to consider
+		if ( t1 >= offset + 1 && t2 >= offset + 1 ) {
+			lists[0][counts[0]++] = seg;
+			continue;
+		}
+		if ( t1 < -offset - 1 && t2 < -offset - 1 ) {
+			lists[1][counts[1]++] = seg;
+			continue;
+		}
+
+		near = &split[numSplit++];
+		far = &split[numSplit++];
+
+		// put the crosspoint SURFACE_CLIP_EPSILON pixels on the near side
+		if ( t1 < t2 ) {
+			idist = 1.0/(t1-t2);
+			frac2 = (t1 + offset + SURFACE_CLIP_EPSILON)*idist;
+			frac = (t1 - offset + SURFACE_CLIP_EPSILON)*idist;
+			lists[1][counts[1]++] = near;
+			lists[2][counts[2]++] = far;
+		} else {
+			if (t1 > t2) {
+				idist = 1.0/(t1-t2);
+				frac2 = (t1 - offset - SURFACE_CLIP_EPSILON)*idist;
+				frac = (t1 + offset + SURFACE_CLIP_EPSILON)*idist;
+			} else {
+				frac = 1;
+				frac2 = 0;
+			}
+			lists[0][counts[0]++] = near;
+			lists[1][counts[1]++] = far;
+		}
+
+		// move up to the node
+		if ( frac < 0 ) {
+			frac = 0;
+		}
+		if ( frac > 1 ) {
+			frac = 1;
+		}
+
+		near->tw = seg->tw;
+		near->p1f = seg->p1f;
+		near->p2f = seg->p1f + (seg->p2f - seg->p1f)*frac;
+		VectorCopy( seg->p1, near->p1 );
+		near->p2[0] = seg->p1[0] + frac*(seg->p2[0] - seg->p1[0]);
+		near->p2[1] = seg->p1[1] + frac*(seg->p2[1] - seg->p1[1]);
+		near->p2[2] = seg->p1[2] + frac*(seg->p2[2] - seg->p1[2]);
+
+		// go past the node
+		if ( frac2 < 0 ) {
+			frac2 = 0;
+		}
+		if ( frac2 > 1 ) {
+			frac2 = 1;
+		}
+
+		far->tw = seg->tw;
+		far->p1f = seg->p1f + (seg->p2f - seg->p1f)*frac2;
+		far->p2f = seg->p2f;
+		far->p1[0] = seg->p1[0] + frac2*(seg->p2[0] - seg->p1[0]);
+		far->p1[1] = seg->p1[1] + frac2*(seg->p2[1] - seg->p1[1]);
+		far->p1[2] = seg->p1[2] + frac2*(seg->p2[2] - seg->p1[2]);
+		VectorCopy( seg->p2, far->p2 );
+	}
+
+	if ( counts[0] ) {
+		CM_TraceBatchThroughTree( lists[0], counts[0], node->children[0] );
+	}
+	if ( counts[1] ) {
+		CM_TraceBatchThroughTree( lists[1], counts[1], node->children[1] );
+	}
+	if ( counts[2] ) {
+		CM_TraceBatchThroughTree( lists[2], counts[2], node->children[0] );
+	}
+}
+
+//======================================================================
+
+
+/*
+==================
+CM_InitTraceWork
+
+Returns qfalse if there is no map to trace through
+==================
+*/
+static qboolean CM_InitTraceWork( cmTraceContext_t *ctx, traceWork_t *tw, const vec3_t start, const vec3_t end,
+						  vec3_t mins, vec3_t maxs, const vec3_t origin, int brushmask, int capsule, sphere_t *sphere ) {
+	int			i;
+	vec3_t		offset;
+
+	if ( ctx->loadCount != cm_loadCount ) {
+		Com_Error( ERR_DROP, "CM_Trace: trace context is from a previous map" );
+	}
+
+	ctx->checkcount++;		// for multi-check avoidance
+
+	if ( ctx->serial ) {
+		c_traces++;			// for statistics, may be zeroed
+	}
+
+	// fill in a default trace
+	Com_Memset( tw, 0, sizeof(*tw) );
+	tw->trace.fraction = 1;	// assume it goes the entire distance until shown otherwise
+	VectorCopy(origin, tw->modelOrigin);
+	tw->ctx = ctx;
+	tw->checkcount = ctx->checkcount;
+
+	if (!cm.numNodes) {
+		return qfalse;	// map not loaded, shouldn't happen
+	}
+
+	// allow NULL to be passed in for 0,0,0
+	if ( !mins ) {
+		mins = vec3_origin;
+	}
+	if ( !maxs ) {
+		maxs = vec3_origin;
+	}
+
+	// set basic parms
+	tw->contents = brushmask;
+
+	// adjust so that mins and maxs are always symetric, which
+	// avoids some complications with plane expanding of rotated
+	// bmodels
+	for ( i = 0 ; i < 3 ; i++ ) {
+		offset[i] = ( mins[i] + maxs[i] ) * 0.5;
+		tw->size[0][i] = mins[i] - offset[i];
+		tw->size[1][i] = maxs[i] - offset[i];
+		tw->start[i] = start[i] + offset[i];
+		tw->end[i] = end[i] + offset[i];
+	}
+
+	// if a sphere is already specified
+	if ( sphere ) {
+		tw->sphere = *sphere;
+	}
+	else {
+		tw->sphere.use = capsule;
+		tw->sphere.radius = ( tw->size[1][0] > tw->size[1][2] ) ? tw->size[1][2]: tw->size[1][0];
+		tw->sphere.halfheight = tw->size[1][2];
+		VectorSet( tw->sphere.offset, 0, 0, tw->size[1][2] - tw->sphere.radius );
+	}
+
+	tw->maxOffset = tw->size[1][0] + tw->size[1][1] + tw->size[1][2];
+
+	// tw->offsets[signbits] = vector to appropriate corner from origin
+	tw->offsets[0][0] = tw->size[0][0];
+	tw->offsets[0][1] = tw->size[0][1];
+	tw->offsets[0][2] = tw->size[0][2];
+
+	tw->offsets[1][0] = tw->size[1][0];
+	tw->offsets[1][1] = tw->size[0][1];
+	tw->offsets[1][2] = tw->size[0][2];
+
+	tw->offsets[2][0] = tw->size[0][0];
+	tw->offsets[2][1] = tw->size[1][1];
+	tw->offsets[2][2] = tw->size[0][2];
+
+	tw->offsets[3][0] = tw->size[1][0];
+	tw->offsets[3][1] = tw->size[1][1];
+	tw->offsets[3][2] = tw->size[0][2];
+
+	tw->offsets[4][0] = tw->size[0][0];
+	tw->offsets[4][1] = tw->size[0][1];
+	tw->offsets[4][2] = tw->size[1][2];
+
+	tw->offsets[5][0] = tw->size[1][0];
+	tw->offsets[5][1] = tw->size[0][1];
+	tw->offsets[5][2] = tw->size[1][2];
+
+	tw->offsets[6][0] = tw->size[0][0];
+	tw->offsets[6][1] = tw->size[1][1];
+	tw->offsets[6][2] = tw->size[1][2];
+
+	tw->offsets[7][0] = tw->size[1][0];
+	tw->offsets[7][1] = tw->size[1][1];
+	tw->offsets[7][2] = tw->size[1][2];
+
+	//
+	// calculate bounds
+	//
+	if ( tw->sphere.use ) {
+		for ( i = 0 ; i < 3 ; i++ ) {
+			if ( tw->start[i] < tw->end[i] ) {
+				tw->bounds[0][i] = tw->start[i] - fabs(tw->sphere.offset[i]) - tw->sphere.radius;
+				tw->bounds[1][i] = tw->end[i] + fabs(tw->sphere.offset[i]) + tw->sphere.radius;
+			} else {
+				tw->bounds[0][i] = tw->end[i] - fabs(tw->sphere.offset[i]) - tw->sphere.radius;
+				tw->bounds[1][i] = tw->start[i] + fabs(tw->sphere.offset[i]) + tw->sphere.radius;
+			}
+		}
+	}
+	else {
+		for ( i = 0 ; i < 3 ; i++ ) {
+			if ( tw->start[i] < tw->end[i] ) {
+				tw->bounds[0][i] = tw->start[i] + tw->size[0][i];
+				tw->bounds[1][i] = tw->end[i] + tw->size[1][i];
+			} else {
+				tw->bounds[0][i] = tw->end[i] + tw->size[0][i];
+				tw->bounds[1][i] = tw->start[i] + tw->size[1][i];
+			}
+		}
+	}
+
+	return qtrue;
+}
+
+/*
+==================
+CM_SetSweepExtents
+==================
+*/
+static void CM_SetSweepExtents( traceWork_t *tw ) {
+	//
+	// check for point special case
+	//
+	if ( tw->size[0][0] == 0 && tw->size[0][1] == 0 && tw->size[0][2] == 0 ) {
+		tw->isPoint = qtrue;
+		VectorClear( tw->extents );
+	} else {
+		tw->isPoint = qfalse;
+		tw->extents[0] = tw->size[1][0];
+		tw->extents[1] = tw->size[1][1];
+		tw->extents[2] = tw->size[1][2];
+	}
+}
+
+/*
+==================
+CM_TraceWork
+
+Runs a prepared trace through the given model
+==================
+*/
+static void CM_TraceWork( traceWork_t *tw, const vec3_t start, const vec3_t end, clipHandle_t model, cmodel_t *cmod ) {
+	//
+	// check for position test special case
+	//
+	if (start[0] == end[0] && start[1] == end[1] && start[2] == end[2]) {
+		if ( model ) {
+#ifdef ALWAYS_BBOX_VS_BBOX // FIXME - compile time flag?
+			if ( model == BOX_MODEL_HANDLE || model == CAPSULE_MODEL_HANDLE) {
+				tw->sphere.use = qfalse;
+				CM_TestInLeaf( tw, &cmod->leaf );
+			}
+			else
+#elif defined(ALWAYS_CAPSULE_VS_CAPSULE)
+			if ( model == BOX_MODEL_HANDLE || model == CAPSULE_MODEL_HANDLE) {
+				CM_TestCapsuleInCapsule( tw, model );
+			}
+			else
+#endif
+			if ( model == CAPSULE_MODEL_HANDLE ) {
+				if ( tw->sphere.use ) {
+					CM_TestCapsuleInCapsule( tw, model );
+				}
+				else {
+					CM_TestBoundingBoxInCapsule( tw, model );
+				}
+			}
+			else {
+				CM_TestInLeaf( tw, &cmod->leaf );
+			}
 		} else {
-			tw.isPoint = qfalse;
-			tw.extents[0] = tw.size[1][0];
-			tw.extents[1] = tw.size[1][1];
-			tw.extents[2] = tw.size[1][2];
+			CM_PositionTest( tw );
 		}
+	} else {
+		CM_SetSweepExtents( tw );
 
 		//
 		// general sweeping through world
@@ -1314,48 +2178,174 @@ void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, vec3_t mi
 		if ( model ) {
 #ifdef ALWAYS_BBOX_VS_BBOX
 			if ( model == BOX_MODEL_HANDLE || model == CAPSULE_MODEL_HANDLE) {
-				tw.sphere.use = qfalse;
-				CM_TraceThroughLeaf( &tw, &cmod->leaf );
+				tw->sphere.use = qfalse;
+				CM_TraceThroughLeaf( tw, &cmod->leaf );
 			}
 			else
 #elif defined(ALWAYS_CAPSULE_VS_CAPSULE)
 			if ( model == BOX_MODEL_HANDLE || model == CAPSULE_MODEL_HANDLE) {
-				CM_TraceCapsuleThroughCapsule( &tw, model );
+				CM_TraceCapsuleThroughCapsule( tw, model );
 			}
 			else
 #endif
 			if ( model == CAPSULE_MODEL_HANDLE ) {
-				if ( tw.sphere.use ) {
-					CM_TraceCapsuleThroughCapsule( &tw, model );
+				if ( tw->sphere.use ) {
+					CM_TraceCapsuleThroughCapsule( tw, model );
 				}
 				else {
-					CM_TraceBoundingBoxThroughCapsule( &tw, model );
+					CM_TraceBoundingBoxThroughCapsule( tw, model );
 				}
 			}
 			else {
-				CM_TraceThroughLeaf( &tw, &cmod->leaf );
+				CM_TraceThroughLeaf( tw, &cmod->leaf );
 			}
 		} else {
-			CM_TraceThroughTree( &tw, 0, 0, 1, tw.start, tw.end );
+			CM_TraceThroughTree( tw, 0, 0, 1, tw->start, tw->end );
 		}
 	}
+}
+
+/*
+==================
+CM_FinishTrace
+==================
+*/
+static void CM_FinishTrace( traceWork_t *tw, const vec3_t start, const vec3_t end, trace_t *results ) {
+	int			i;
 
 	// generate endpos from the original, unmodified start/end
-	if ( tw.trace.fraction == 1 ) {
-		VectorCopy (end, tw.trace.endpos);
+	if ( tw->trace.fraction == 1 ) {
+		VectorCopy (end, tw->trace.endpos);
 	} else {
 		for ( i=0 ; i<3 ; i++ ) {
-			tw.trace.endpos[i] = start[i] + tw.trace.fraction * (end[i] - start[i]);
+			tw->trace.endpos[i] = start[i] + tw->trace.fraction * (end[i] - start[i]);
 		}
 	}
 
         // If allsolid is set (was entirely inside something solid), the plane is not valid.
         // If fraction == 1.0, we never hit anything, and thus the plane is not valid.
         // Otherwise, the normal on the plane should have unit length
-        assert(tw.trace.allsolid ||
-               tw.trace.fraction == 1.0 ||
-               VectorLengthSquared(tw.trace.plane.normal) > 0.9999);
-	*results = tw.trace;
+        assert(tw->trace.allsolid ||
+               tw->trace.fraction == 1.0 ||
+               VectorLengthSquared(tw->trace.plane.normal) > 0.9999);
+	*results = tw->trace;
+}
+
+/*
+==================
+CM_Trace
+==================
+*/
+void CM_Trace( cmTraceContext_t *ctx, trace_t *results, const vec3_t start, const vec3_t end, vec3_t mins, vec3_t maxs,
+						  clipHandle_t model, const vec3_t origin, int brushmask, int capsule, sphere_t *sphere ) {
+	traceWork_t	tw;
+	cmodel_t	*cmod;
+
+	cmod = CM_ClipHandleToModel( model );
+
+	if ( !CM_InitTraceWork( ctx, &tw, start, end, mins, maxs, origin, brushmask, capsule, sphere ) ) {
+		*results = tw.trace;
+		return;
+	}
+
+	CM_TraceWork( &tw, start, end, model, cmod );
+	CM_FinishTrace( &tw, start, end, results );
+}
+
+/*
+==================
+CM_TraceBatch
+
+Traces numTraces boxes of the same size through the same model, with
+the same results as calling CM_BoxTrace for each of them
+==================
+*/
+void CM_TraceBatch( trace_t *results, int numTraces, const vec3_t *starts, const vec3_t *ends,
+						  vec3_t mins, vec3_t maxs, clipHandle_t model, int brushmask, int capsule ) {
+	traceWork_t		tws[MAX_TRACE_BATCH];
+	traceSegment_t	segs[MAX_TRACE_BATCH];
+	traceSegment_t	*list[MAX_TRACE_BATCH];
+	cmodel_t		*cmod;
+	int				first, count, numSegs;
+	int				i, checkcount;
+
+	cmod = CM_ClipHandleToModel( model );
+
+	for ( first = 0 ; first < numTraces ; first += count ) {
+		count = numTraces - first;
+		if ( count > MAX_TRACE_BATCH ) {
+			count = MAX_TRACE_BATCH;
+		}
+
+		numSegs = 0;
+		for ( i = 0 ; i < count ; i++ ) {
+			const float	*start = starts[first+i];
+			const float	*end = ends[first+i];
+
+			if ( !CM_InitTraceWork( &cm.serialContext, &tws[i], start, end, mins, maxs,
+				vec3_origin, brushmask, capsule, NULL ) ) {
+				continue;
+			}
+
+			// position tests and inline models don't walk the tree
+			if ( model || ( start[0] == end[0] && start[1] == end[1] && start[2] == end[2] ) ) {
+				CM_TraceWork( &tws[i], start, end, model, cmod );
+				continue;
+			}
+
+			CM_SetSweepExtents( &tws[i] );
+			segs[numSegs].tw = &tws[i];
+			segs[numSegs].p1f = 0;
+			segs[numSegs].p2f = 1;
+			VectorCopy( tws[i].start, segs[numSegs].p1 );
+			VectorCopy( tws[i].end, segs[numSegs].p2 );
+			numSegs++;
+		}
+
+		if ( numSegs ) {
+			checkcount = ++cm.serialContext.checkcount;
+			for ( i = 0 ; i < numSegs ; i++ ) {
+				segs[i].tw->checkcount = checkcount;
+				segs[i].tw->batchBit = 1u << i;
+				list[i] = &segs[i];
+			}
+			CM_TraceBatchThroughTree( list, numSegs, 0 );
+		}
+
+		for ( i = 0 ; i < count ; i++ ) {
+			if ( !cm.numNodes ) {
+				results[first+i] = tws[i].trace;
+				continue;
+			}
+			CM_FinishTrace( &tws[i], starts[first+i], ends[first+i], &results[first+i] );
+		}
+	}
+}
+
+/*
+==================
+CM_SetThreadTraceContext
+
+Makes CM_BoxTrace and CM_TransformedBoxTrace on the calling thread go
+through ctx, so code that only knows the plain calls can trace from a
+worker thread.
+==================
+*/
+static QTHREADLOCAL cmTraceContext_t *cm_threadContext;
+
+void CM_SetThreadTraceContext( cmTraceContext_t *ctx ) {
+	cm_threadContext = ctx;
+}
+
+/*
+==================
+CM_BoxTraceContext
+==================
+*/
+void CM_BoxTraceContext( cmTraceContext_t *ctx, trace_t *results, const vec3_t start, const vec3_t end,
+						  vec3_t mins, vec3_t maxs,
+						  clipHandle_t model, int brushmask, int capsule ) {
+	CM_Trace( ctx, results, start, end, mins, maxs, model, vec3_origin, brushmask, capsule, NULL );
 }
 
 /*
@@ -1366,18 +2356,19 @@ CM_BoxTrace
 void CM_BoxTrace( trace_t *results, const vec3_t start, const vec3_t end,
 						  vec3_t mins, vec3_t maxs,
 						  clipHandle_t model, int brushmask, int capsule ) {
-	CM_Trace( results, start, end, mins, maxs, model, vec3_origin, brushmask, capsule, NULL );
+	CM_Trace( cm_threadContext ? cm_threadContext : &cm.serialContext, results, start, end,
+		mins, maxs, model, vec3_origin, brushmask, capsule, NULL );
 }
 
 /*
 ==================
-CM_TransformedBoxTrace
+CM_TransformedBoxTraceContext
 
 Handles offseting and rotation of the end points for moving and
 rotating entities
 ==================
 */
-void CM_TransformedBoxTrace( trace_t *results, const vec3_t start, const vec3_t end,
+void CM_TransformedBoxTraceContext( cmTraceContext_t *ctx, trace_t *results, const vec3_t start, const vec3_t end,
 						  vec3_t mins, vec3_t maxs,
 						  clipHandle_t model, int brushmask,
 						  const vec3_t origin, const vec3_t angles, int capsule ) {
@@ -1451,7 +2442,7 @@ void CM_TransformedBoxTrace( trace_t *results, const vec3_t start, const vec3_t
 	}
 
 	// sweep the box through the model
-	CM_Trace( &trace, start_l, end_l, symetricSize[0], symetricSize[1], model, origin, brushmask, capsule, &sphere );
+	CM_Trace( ctx, &trace, start_l, end_l, symetricSize[0], symetricSize[1], model, origin, brushmask, capsule, &sphere );
 
 	// if the bmodel was rotated and there was a collision
 	if ( rotated && trace.fraction != 1.0 ) {
@@ -1468,3 +2459,16 @@ void CM_TransformedBoxTrace( trace_t *results, const vec3_t start, const vec3_t
 
 	*results = trace;
 }
+
+/*
+==================
+CM_TransformedBoxTrace
+==================
+*/
+void CM_TransformedBoxTrace( trace_t *results, const vec3_t start, const vec3_t end,
+						  vec3_t mins, vec3_t maxs,
+						  clipHandle_t model, int brushmask,
+						  const vec3_t origin, const vec3_t angles, int capsule ) {
+	CM_TransformedBoxTraceContext( cm_threadContext ? cm_threadContext : &cm.serialContext,
+		results, start, end, mins, maxs, model, brushmask, origin, angles, capsule );
+}
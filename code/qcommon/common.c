@@ -795,12 +795,28 @@ The rover can be left pointing at a non-empty block
 
 The zone calls are pretty much only used for small strings and structures,
 all big things are allocated on the hunk.
+
+Small allocations are served from per size class slabs that are carved out
+of the zone in SLAB_PAGE_SIZE pages, so the common case never has to scan
+the block list.  Slab blocks keep a regular memblock_t header (with SLABID
+instead of ZONEID) and are linked into a per zone in use list, so Z_Free and
+Z_FreeTags work on them unchanged.  Slab pages are never given back to the
+zone, free slab blocks are reused by later allocations of the same class.
 ==============================================================================
 */
 
 #define	ZONEID	0x1d4a11
+#define	SLABID	0x1d4a12
 #define MINFRAGMENT	64
 
+#define	SLAB_PAGE_SIZE		8192
+#define	NUM_SLAB_CLASSES	8
+
+// block sizes of the slab classes, including the header and the trash tester
+static const int slabClassSizes[NUM_SLAB_CLASSES] = {
+	48, 64, 96, 128, 192, 256, 384, 512
+};
+
 typedef struct zonedebug_s {
 	char		*label;
 	char		*file;
@@ -818,11 +834,23 @@ typedef struct memblock_s {
 #endif
 } memblock_t;
 
+typedef struct {
+	memblock_t	*freelist;		// free blocks, linked through next
+	int			pages;			// pages carved from the zone
+	int			inuse;			// blocks currently allocated
+	unsigned int	hits;		// allocations served by this class
+	unsigned int	frees;
+} zoneslab_t;
+
 typedef struct {
 	int			size;			// total bytes malloced, including header
 	int			used;			// total bytes used
 	memblock_t	blocklist;	// start / end cap for linked list
 	memblock_t	*rover;
+	memblock_t	slablist;	// start / end cap for in use slab blocks
+	zoneslab_t	slabs[NUM_SLAB_CLASSES];
+	unsigned int	misses;		// small allocations the slabs could not serve
+	unsigned int	large;		// allocations too big for any slab class
 } memzone_t;
 
 // main zone for all "dynamic" memory allocation
@@ -831,7 +859,11 @@ static memzone_t	*mainzone;
 // fragment the main zone (think of cvar and cmd strings)
 static memzone_t	*smallzone;
 
+// cleared by com_zoneSlabs 0, already allocated slab blocks stay valid
+static qboolean		zoneSlabs = qtrue;
+
 static void Z_CheckHeap( void );
+static void Z_SlabFree( memzone_t *zone, memblock_t *block );
 
 /*
 ========================
@@ -851,6 +883,14 @@ static void Z_ClearZone( memzone_t *zone, int size ) {
 	zone->rover = block;
 	zone->size = size;
 	zone->used = 0;
+
+	zone->slablist.next = zone->slablist.prev = &zone->slablist;
+	zone->slablist.tag = 1;
+	zone->slablist.id = 0;
+	zone->slablist.size = 0;
+	Com_Memset( zone->slabs, 0, sizeof( zone->slabs ) );
+	zone->misses = 0;
+	zone->large = 0;
 	
 	block->prev = block->next = &zone->blocklist;
 	block->tag = 0;			// free block
@@ -890,7 +930,7 @@ void Z_Free( void *ptr ) {
 	}
 
 	block = (memblock_t *) ( (byte *)ptr - sizeof(memblock_t));
-	if (block->id != ZONEID) {
+	if (block->id != ZONEID && block->id != SLABID) {
 		Com_Error( ERR_FATAL, "Z_Free: freed a pointer without ZONEID" );
 	}
 	if (block->tag == 0) {
@@ -913,6 +953,11 @@ void Z_Free( void *ptr ) {
 		zone = mainzone;
 	}
 
+	if (block->id == SLABID) {
+		Z_SlabFree( zone, block );
+		return;
+	}
+
 	zone->used -= block->size;
 	// set the block to something that should cause problems
 	// if it is referenced...
@@ -951,6 +996,7 @@ Z_FreeTags
 */
 void Z_FreeTags( int tag ) {
 	memzone_t	*zone;
+	memblock_t	*block, *next;
 
 	if ( tag == TAG_SMALL ) {
 		zone = smallzone;
@@ -958,6 +1004,13 @@ void Z_FreeTags( int tag ) {
 	else {
 		zone = mainzone;
 	}
+	// slab blocks are not in the block list
+	for ( block = zone->slablist.next ; block != &zone->slablist ; block = next ) {
+		next = block->next;
+		if ( block->tag == tag ) {
+			Z_Free( (void *)(block + 1) );
+		}
+	}
 	// use the rover as our pointer, because
 	// Z_Free automatically adjusts it
 	zone->rover = zone->blocklist.next;
@@ -973,56 +1026,23 @@ void Z_FreeTags( int tag ) {
 
 /*
 ================
-Z_TagMalloc
+Z_ZoneAlloc
+
+Scans the block list for the first free block of at least size bytes,
+size already includes the header and the trash tester.
+Returns NULL if the zone has no block large enough.
 ================
 */
-#ifdef ZONE_DEBUG
-void *Z_TagMallocDebug( int size, int tag, char *label, char *file, int line ) {
-	int		allocSize;
-#else
-void *Z_TagMalloc( int size, int tag ) {
-#endif
+static memblock_t *Z_ZoneAlloc( memzone_t *zone, int size, int tag ) {
 	int		extra;
 	memblock_t	*start, *rover, *new, *base;
-	memzone_t *zone;
-
-	if (!tag) {
-		Com_Error( ERR_FATAL, "Z_TagMalloc: tried to use a 0 tag" );
-	}
 
-	if ( tag == TAG_SMALL ) {
-		zone = smallzone;
-	}
-	else {
-		zone = mainzone;
-	}
-
-#ifdef ZONE_DEBUG
-	allocSize = size;
-#endif
-	//
-	// scan through the block list looking for the first free block
-	// of sufficient size
-	//
-	size += sizeof(memblock_t);	// account for size of block header
-	size += 4;					// space for memory trash tester
-	size = PAD(size, sizeof(intptr_t));		// align to 32/64 bit boundary
-	
 	base = rover = zone->rover;
 	start = base->prev;
 	
 	do {
 		if (rover == start)	{
 			// scaned all the way around the list
-#ifdef ZONE_DEBUG
-			Z_LogHeap();
-
-			Com_Error(ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes from the %s zone: %s, line: %d (%s)",
-								size, zone == smallzone ? "small" : "main", file, line, label);
-#else
-			Com_Error(ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes from the %s zone",
-								size, zone == smallzone ? "small" : "main");
-#endif
 			return NULL;
 		}
 		if (rover->tag) {
@@ -1056,6 +1076,190 @@ void *Z_TagMalloc( int size, int tag ) {
 	
 	base->id = ZONEID;
 
+	return base;
+}
+
+/*
+================
+Z_SlabClass
+
+Returns the smallest slab class that fits a block of size bytes, or -1
+================
+*/
+static int Z_SlabClass( int size ) {
+	int		i;
+
+	for ( i = 0 ; i < NUM_SLAB_CLASSES ; i++ ) {
+		if ( size <= slabClassSizes[i] ) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/*
+================
+Z_SlabGrow
+
+Carves a new page out of the zone and puts its blocks on the free list
+================
+*/
+static qboolean Z_SlabGrow( memzone_t *zone, int cls ) {
+	memblock_t	*page, *block;
+	zoneslab_t	*slab;
+	int			size, i, count;
+
+	size = PAD( SLAB_PAGE_SIZE + sizeof(memblock_t) + 4, sizeof(intptr_t) );
+	page = Z_ZoneAlloc( zone, size, TAG_SLAB );
+	if ( !page ) {
+		return qfalse;
+	}
+#ifdef ZONE_DEBUG
+	page->d.label = "slab page";
+	page->d.file = __FILE__;
+	page->d.line = __LINE__;
+	page->d.allocSize = SLAB_PAGE_SIZE;
+#endif
+	*(int *)((byte *)page + page->size - 4) = ZONEID;
+
+	slab = &zone->slabs[cls];
+	size = slabClassSizes[cls];
+	count = SLAB_PAGE_SIZE / size;
+	for ( i = count - 1 ; i >= 0 ; i-- ) {
+		block = (memblock_t *)( (byte *)(page + 1) + i * size );
+		block->size = size;
+		block->tag = 0;
+		block->id = SLABID;
+		block->prev = NULL;
+		block->next = slab->freelist;
+		slab->freelist = block;
+	}
+	slab->pages++;
+
+	return qtrue;
+}
+
+/*
+================
+Z_SlabAlloc
+
+Returns NULL if the block has to come from the zone instead
+================
+*/
+static memblock_t *Z_SlabAlloc( memzone_t *zone, int size, int tag ) {
+	memblock_t	*block;
+	zoneslab_t	*slab;
+	int			cls;
+
+	cls = Z_SlabClass( size );
+	if ( cls < 0 ) {
+		zone->large++;
+		return NULL;
+	}
+	slab = &zone->slabs[cls];
+	if ( !slab->freelist && !Z_SlabGrow( zone, cls ) ) {
+		zone->misses++;
+		return NULL;
+	}
+
+	block = slab->freelist;
+	slab->freelist = block->next;
+	block->tag = tag;
+
+	// link into the in use list so Z_FreeTags can find it
+	block->prev = &zone->slablist;
+	block->next = zone->slablist.next;
+	block->next->prev = block;
+	zone->slablist.next = block;
+
+	slab->inuse++;
+	slab->hits++;
+
+	return block;
+}
+
+/*
+================
+Z_SlabFree
+================
+*/
+static void Z_SlabFree( memzone_t *zone, memblock_t *block ) {
+	zoneslab_t	*slab;
+
+	slab = &zone->slabs[Z_SlabClass( block->size )];
+
+	block->prev->next = block->next;
+	block->next->prev = block->prev;
+
+	// set the block to something that should cause problems
+	// if it is referenced...
+	Com_Memset( block + 1, 0xaa, block->size - sizeof( *block ) );
+
+	block->tag = 0;		// mark as free
+	block->prev = NULL;
+	block->next = slab->freelist;
+	slab->freelist = block;
+
+	slab->inuse--;
+	slab->frees++;
+}
+
+/*
+================
+Z_TagMalloc
+================
+*/
+#ifdef ZONE_DEBUG
+void *Z_TagMallocDebug( int size, int tag, char *label, char *file, int line ) {
+	int		allocSize;
+#else
+void *Z_TagMalloc( int size, int tag ) {
+#endif
+	memblock_t	*base;
+	memzone_t *zone;
+
+	if (!tag) {
+		Com_Error( ERR_FATAL, "Z_TagMalloc: tried to use a 0 tag" );
+	}
+
+	if ( tag == TAG_SMALL ) {
+		zone = smallzone;
+	}
+	else {
+		zone = mainzone;
+	}
+
+#ifdef ZONE_DEBUG
+	allocSize = size;
+#endif
+	size += sizeof(memblock_t);	// account for size of block header
+	size += 4;					// space for memory trash tester
+	size = PAD(size, sizeof(intptr_t));		// align to 32/64 bit boundary
+
+	base = NULL;
+	if ( zoneSlabs ) {
+		base = Z_SlabAlloc( zone, size, tag );
+	}
+	if ( !base ) {
+		//
+		// scan through the block list looking for the first free block
+		// of sufficient size
+		//
+		base = Z_ZoneAlloc( zone, size, tag );
+	}
+	if ( !base ) {
+#ifdef ZONE_DEBUG
+		Z_LogHeap();
+
+		Com_Error(ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes from the %s zone: %s, line: %d (%s)",
+							size, zone == smallzone ? "small" : "main", file, line, label);
+#else
+		Com_Error(ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes from the %s zone",
+							size, zone == smallzone ? "small" : "main");
+#endif
+		return NULL;
+	}
+
 #ifdef ZONE_DEBUG
 	base->d.label = label;
 	base->d.file = file;
@@ -1318,18 +1522,22 @@ void Com_Meminfo_f( void ) {
 	int			zoneBytes, zoneBlocks;
 	int			smallZoneBytes;
 	int			botlibBytes, rendererBytes;
+	int			slabBytes;
 	int			unused;
 
 	zoneBytes = 0;
 	botlibBytes = 0;
 	rendererBytes = 0;
+	slabBytes = 0;
 	zoneBlocks = 0;
 	for (block = mainzone->blocklist.next ; ; block = block->next) {
 		if ( Cmd_Argc() != 1 ) {
 			Com_Printf ("block:%p    size:%7i    tag:%3i\n",
 				(void *)block, block->size, block->tag);
 		}
-		if ( block->tag ) {
+		if ( block->tag == TAG_SLAB ) {
+			slabBytes += block->size;
+		} else if ( block->tag ) {
 			zoneBytes += block->size;
 			zoneBlocks++;
 			if ( block->tag == TAG_BOTLIB ) {
@@ -1353,6 +1561,17 @@ void Com_Meminfo_f( void ) {
 		}
 	}
 
+	// slab blocks are accounted by the tag they were allocated with
+	for (block = mainzone->slablist.next ; block != &mainzone->slablist ; block = block->next) {
+		zoneBytes += block->size;
+		zoneBlocks++;
+		if ( block->tag == TAG_BOTLIB ) {
+			botlibBytes += block->size;
+		} else if ( block->tag == TAG_RENDERER ) {
+			rendererBytes += block->size;
+		}
+	}
+
 	smallZoneBytes = 0;
 	for (block = smallzone->blocklist.next ; ; block = block->next) {
 		if ( block->tag ) {
@@ -1396,6 +1615,66 @@ void Com_Meminfo_f( void ) {
 	Com_Printf( "        %8i bytes in dynamic renderer\n", rendererBytes );
 	Com_Printf( "        %8i bytes in dynamic other\n", zoneBytes - ( botlibBytes + rendererBytes ) );
 	Com_Printf( "        %8i bytes in small Zone memory\n", smallZoneBytes );
+	Com_Printf( "%8i bytes in main zone slab pages\n", slabBytes );
+}
+
+/*
+=================
+Com_ZoneStatsZone
+=================
+*/
+static void Com_ZoneStatsZone( memzone_t *zone, const char *name ) {
+	memblock_t	*block;
+	zoneslab_t	*slab;
+	unsigned int	hits;
+	int			i, count, freeBytes, freeBlocks, largest, slack;
+
+	Com_Printf( "%s zone: %i of %i bytes used\n", name, zone->used, zone->size );
+	Com_Printf( " class  pages  inuse   free       hits      frees\n" );
+
+	hits = 0;
+	slack = 0;
+	for ( i = 0 ; i < NUM_SLAB_CLASSES ; i++ ) {
+		slab = &zone->slabs[i];
+		count = slab->pages * ( SLAB_PAGE_SIZE / slabClassSizes[i] );
+		Com_Printf( "%6i %6i %6i %6i %10u %10u\n", slabClassSizes[i], slab->pages,
+			slab->inuse, count - slab->inuse, slab->hits, slab->frees );
+		hits += slab->hits;
+		slack += ( count - slab->inuse ) * slabClassSizes[i];
+	}
+
+	freeBytes = freeBlocks = largest = 0;
+	for ( block = zone->blocklist.next ; block != &zone->blocklist ; block = block->next ) {
+		if ( !block->tag ) {
+			freeBytes += block->size;
+			freeBlocks++;
+			if ( block->size > largest ) {
+				largest = block->size;
+			}
+		}
+	}
+
+	Com_Printf( "slab hit rate: %.1f%% (%u hits, %u misses, %u large)\n",
+		hits + zone->misses + zone->large ? 100.0f * hits / ( hits + zone->misses + zone->large ) : 0.0f,
+		hits, zone->misses, zone->large );
+	Com_Printf( "%i bytes free in slabs\n", slack );
+	Com_Printf( "%i bytes free in %i zone blocks, largest %i, %.1f%% fragmented\n",
+		freeBytes, freeBlocks, largest,
+		freeBytes ? 100.0f * ( freeBytes - largest ) / freeBytes : 0.0f );
+}
+
+/*
+=================
+Com_ZoneStats_f
+=================
+*/
+void Com_ZoneStats_f( void ) {
+	if ( !zoneSlabs ) {
+		Com_Printf( "zone slabs are disabled (com_zoneSlabs 0)\n" );
+	}
+	Com_ZoneStatsZone( mainzone, "main" );
+	Com_Printf( "\n" );
+	Com_ZoneStatsZone( smallzone, "small" );
 }
 
 /*
@@ -1485,6 +1764,8 @@ void Com_InitZoneMemory( void ) {
 	}
 	Z_ClearZone( mainzone, s_zoneTotal );
 
+	cv = Cvar_Get( "com_zoneSlabs", "1", CVAR_LATCH );
+	zoneSlabs = cv->integer ? qtrue : qfalse;
 }
 
 /*
@@ -1571,8 +1852,9 @@ Com_InitHunkZoneMemory
 =================
 */
 void Com_InitHunkMemory( void ) {
-	cvar_t	*cv;
+	cvar_t	*cv, *hugePages, *lockHunk;
 	int nMinAlloc;
+	int hugeBytes;
 	char *pMsg = NULL;
 
 	// make sure the file system has allocated and "not" freed any temp blocks
@@ -1604,15 +1886,30 @@ void Com_InitHunkMemory( void ) {
 		s_hunkTotal = cv->integer * 1024 * 1024;
 	}
 
-	s_hunkData = calloc( s_hunkTotal + 31, 1 );
-	if ( !s_hunkData ) {
-		Com_Error( ERR_FATAL, "Hunk data failed to allocate %i megs", s_hunkTotal / (1024*1024) );
+	// map data, AAS and VM data segments all live on the hunk, so backing
+	// it with huge pages and faulting it in now avoids TLB and page fault
+	// stalls the first time they are touched in game
+	hugePages = Cvar_Get( "com_hugePages", "0", CVAR_LATCH );
+	Cvar_SetDescription( hugePages, "Back the hunk with huge pages, 1 = transparent, 2 = MAP_HUGETLB" );
+	lockHunk = Cvar_Get( "com_lockHunk", "0", CVAR_LATCH );
+	Cvar_SetDescription( lockHunk, "Pre-fault and mlock the hunk memory segment" );
+
+	s_hunkData = Sys_HunkAlloc( s_hunkTotal, hugePages->integer, lockHunk->integer ? qtrue : qfalse, &hugeBytes );
+	if ( s_hunkData ) {
+		Com_Printf( "Hunk: %i of %i megs in huge pages%s\n", hugeBytes / (1024*1024),
+			s_hunkTotal / (1024*1024), lockHunk->integer ? ", locked" : "" );
+	} else {
+		s_hunkData = calloc( s_hunkTotal + 31, 1 );
+		if ( !s_hunkData ) {
+			Com_Error( ERR_FATAL, "Hunk data failed to allocate %i megs", s_hunkTotal / (1024*1024) );
+		}
+		// cacheline align
+		s_hunkData = (byte *) ( ( (intptr_t)s_hunkData + 31 ) & ~31 );
 	}
-	// cacheline align
-	s_hunkData = (byte *) ( ( (intptr_t)s_hunkData + 31 ) & ~31 );
 	Hunk_Clear();
 
 	Cmd_AddCommand( "meminfo", Com_Meminfo_f );
+	Cmd_AddCommand( "zonestats", Com_ZoneStats_f );
 #ifdef ZONE_DEBUG
 	Cmd_AddCommand( "zonelog", Z_LogHeap );
 #endif
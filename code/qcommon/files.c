@@ -204,6 +204,10 @@ typedef struct {
 	qboolean		extrapure;					// if false, the pak will be excluded from the loaded paks
 	fileInPack_t*	*hashTable;					// hash table
 	fileInPack_t*	buildBuffer;				// buffer with the filenames etc.
+	byte			*mapping;					// whole pk3 mapped on first FS_ReadFile
+	int				mappingLength;
+	int				mappingMtime;				// pk3 modification time when mapped
+	qboolean		mappingFailed;
 } pack_t;
 
 typedef struct {
@@ -236,11 +240,32 @@ static	cvar_t		*fs_gamedirvar;
 static	searchpath_t	*fs_searchpaths;
 static	cvar_t		*fs_lowPriorityDownloads;
 static	cvar_t		*fs_reorderPaks;
+static	cvar_t		*fs_mmapPaks;
 static	int			fs_readCount;			// total bytes read
 static	int			fs_loadCount;			// total files read
 static	int			fs_loadStack;			// total files in memory
 static	int			fs_packFiles = 0;		// total number of files in packs
 
+// merged hash over the files of all paks, so FS_FOpenFileRead doesn't
+// have to probe every pak in the search path
+typedef struct fileIndex_s {
+	fileInPack_t		*pakFile;
+	searchpath_t		*search;
+	int					order;		// position of search in fs_searchpaths
+	struct fileIndex_s	*next;		// next file in the hash, in search order
+} fileIndex_t;
+
+typedef struct {
+	searchpath_t		*search;
+	int					order;
+} dirIndex_t;
+
+static	fileIndex_t	**fs_fileIndexHash;		// NULL when out of date
+static	fileIndex_t	*fs_fileIndex;
+static	int			fs_fileIndexSize;		// hash table size (power of 2)
+static	dirIndex_t	*fs_dirIndex;			// directories still have to be probed
+static	int			fs_numDirIndex;
+
 static int fs_checksumFeed;
 
 typedef union qfile_gus {
@@ -260,6 +285,7 @@ typedef struct {
 	int			zipFilePos;
 	int			zipFileLen;
 	qboolean	zipFile;
+	pack_t		*zipPak;
 	char		name[MAX_ZPATH];
 } fileHandleData_t;
 
@@ -1292,6 +1318,7 @@ long FS_FOpenFileReadDir(const char *filename, searchpath_t *search, fileHandle_
 
 					Q_strncpyz(fsh[*file].name, filename, sizeof(fsh[*file].name));
 					fsh[*file].zipFile = qtrue;
+					fsh[*file].zipPak = pak;
 
 					// set the file position in the zip file (also sets the current file info)
 					unzSetOffset(fsh[*file].handleFiles.file.z, pakFile->pos);
@@ -1367,6 +1394,162 @@ long FS_FOpenFileReadDir(const char *filename, searchpath_t *search, fileHandle_
 	return -1;
 }
 
+/*
+===========
+FS_FreeFileIndex
+===========
+*/
+static void FS_FreeFileIndex( void )
+{
+	if(fs_fileIndexHash)
+		Z_Free(fs_fileIndexHash);
+	if(fs_fileIndex)
+		Z_Free(fs_fileIndex);
+	if(fs_dirIndex)
+		Z_Free(fs_dirIndex);
+
+	fs_fileIndexHash = NULL;
+	fs_fileIndex = NULL;
+	fs_dirIndex = NULL;
+	fs_fileIndexSize = 0;
+	fs_numDirIndex = 0;
+}
+
+/*
+===========
+FS_BuildFileIndex
+
+Merges the hash tables of all paks into one, has to be called
+whenever fs_searchpaths is changed or reordered
+===========
+*/
+static void FS_BuildFileIndex( void )
+{
+	searchpath_t	*search;
+	fileIndex_t		*entry, **tail;
+	fileInPack_t	*pakFile;
+	int				i, order, numFiles, numDirs;
+	long			hash;
+
+	FS_FreeFileIndex();
+
+	numFiles = numDirs = 0;
+	for(search = fs_searchpaths; search; search = search->next)
+	{
+		if(search->pack)
+			numFiles += search->pack->numfiles;
+		else
+			numDirs++;
+	}
+
+	for(fs_fileIndexSize = 64; fs_fileIndexSize < numFiles && fs_fileIndexSize < (1 << 20); fs_fileIndexSize <<= 1)
+		;
+
+	fs_fileIndexHash = Z_Malloc(fs_fileIndexSize * sizeof(*fs_fileIndexHash));
+	fs_fileIndex = Z_Malloc(numFiles * sizeof(*fs_fileIndex) + 1);
+	fs_dirIndex = Z_Malloc(numDirs * sizeof(*fs_dirIndex) + 1);
+
+	entry = fs_fileIndex;
+	for(search = fs_searchpaths, order = 0; search; search = search->next, order++)
+	{
+		if(!search->pack)
+		{
+			fs_dirIndex[fs_numDirIndex].search = search;
+			fs_dirIndex[fs_numDirIndex].order = order;
+			fs_numDirIndex++;
+			continue;
+		}
+
+		for(i = 0; i < search->pack->numfiles; i++)
+		{
+			pakFile = &search->pack->buildBuffer[i];
+			if(!pakFile->name)
+				continue;
+
+			hash = FS_HashFileName(pakFile->name, fs_fileIndexSize);
+
+			// append so every chain stays in search order
+			for(tail = &fs_fileIndexHash[hash]; *tail; tail = &(*tail)->next)
+				;
+
+			entry->pakFile = pakFile;
+			entry->search = search;
+			entry->order = order;
+			entry->next = NULL;
+			*tail = entry;
+			entry++;
+		}
+	}
+}
+
+/*
+===========
+FS_NextIndexedFile
+
+Returns the next entry for filename in the chain starting at entry
+===========
+*/
+static fileIndex_t *FS_NextIndexedFile(fileIndex_t *entry, const char *filename)
+{
+	for(; entry; entry = entry->next)
+	{
+		if(!FS_FilenameCompare(entry->pakFile->name, filename))
+			return entry;
+	}
+
+	return NULL;
+}
+
+/*
+===========
+FS_FOpenFileReadIndexed
+
+Same as walking fs_searchpaths with FS_FOpenFileReadDir, but only
+the paks actually containing the file and the directories are tried
+===========
+*/
+static long FS_FOpenFileReadIndexed(const char *filename, fileHandle_t *file, qboolean uniqueFILE)
+{
+	searchpath_t	*search;
+	fileIndex_t		*entry;
+	const char		*hashname;
+	int				dir;
+	long			len;
+
+	hashname = filename;
+	if(hashname[0] == '/' || hashname[0] == '\\')
+		hashname++;
+
+	entry = FS_NextIndexedFile(fs_fileIndexHash[FS_HashFileName(hashname, fs_fileIndexSize)], hashname);
+	dir = 0;
+
+	while(entry || dir < fs_numDirIndex)
+	{
+		if(entry && (dir >= fs_numDirIndex || entry->order < fs_dirIndex[dir].order))
+		{
+			search = entry->search;
+			entry = FS_NextIndexedFile(entry->next, hashname);
+		}
+		else
+			search = fs_dirIndex[dir++].search;
+
+		len = FS_FOpenFileReadDir(filename, search, file, uniqueFILE, qfalse);
+
+		if(file == NULL)
+		{
+			if(len > 0)
+				return len;
+		}
+		else
+		{
+			if(len >= 0 && *file)
+				return len;
+		}
+	}
+
+	return file ? -1 : 0;
+}
+
 /*
 ===========
 FS_FOpenFileRead
@@ -1385,9 +1568,9 @@ long FS_FOpenFileRead(const char *filename, fileHandle_t *file, qboolean uniqueF
 	if(!fs_searchpaths)
 		Com_Error(ERR_FATAL, "Filesystem call made without initialization");
 
-	for(search = fs_searchpaths; search; search = search->next)
+	if(fs_fileIndexHash && filename)
 	{
-		len = FS_FOpenFileReadDir(filename, search, file, uniqueFILE, qfalse);
+		len = FS_FOpenFileReadIndexed(filename, file, uniqueFILE);
 
 		if(file == NULL)
 		{
@@ -1399,7 +1582,25 @@ long FS_FOpenFileRead(const char *filename, fileHandle_t *file, qboolean uniqueF
 			if(len >= 0 && *file)
 				return len;
 		}
+	}
+	else
+	{
+		for(search = fs_searchpaths; search; search = search->next)
+		{
+			len = FS_FOpenFileReadDir(filename, search, file, uniqueFILE, qfalse);
 
+			if(file == NULL)
+			{
+				if(len > 0)
+					return len;
+			}
+			else
+			{
+				if(len >= 0 && *file)
+					return len;
+			}
+
+		}
 	}
 	
 #ifdef FS_MISSING
@@ -1797,6 +1998,221 @@ int	FS_FileIsInPAK(const char *filename, int *pChecksum ) {
 	return -1;
 }
 
+/*
+=================================================================================
+
+MAPPED PK3 READS
+
+FS_ReadFile reads whole pk3 entries straight from a mapping of the pk3
+instead of going through unzip's small buffers.  Large stored entries are
+mapped copy on write and handed out without any copy, smaller ones are
+copied once, and deflated entries are inflated in one shot from the mapped
+compressed bytes.
+
+Reading a mapping of a pk3 that was truncated on disk raises SIGBUS, so
+this is off unless fs_mmapPaks is set, and the size and modification time
+of the pk3 are checked before every read of its mapping.
+
+=================================================================================
+*/
+
+// stored entries smaller than this are cheaper to copy than to map
+#define	MAPPED_FILE_MIN_SIZE	( 64 * 1024 )
+#define	MAX_MAPPED_FILES		64
+
+typedef struct {
+	byte		*buffer;		// returned by FS_ReadFile, NULL if unused
+	void		*base;
+	int			length;
+} mappedFile_t;
+
+static mappedFile_t	fs_mappedFiles[MAX_MAPPED_FILES];
+
+#define	ZIP_SHORT(p)	( (p)[0] | ( (p)[1] << 8 ) )
+#define	ZIP_LONG(p)		( (unsigned int)ZIP_SHORT(p) | ( (unsigned int)ZIP_SHORT((p) + 2) << 16 ) )
+
+/*
+=================
+FS_ZipEntryData
+
+Finds the data of the entry whose central directory record is at pos,
+returns the offset of the data in the pk3 or -1
+=================
+*/
+static int FS_ZipEntryData( pack_t *pak, int pos, int *method, int *compressedSize )
+{
+	byte			*cd, *local;
+	unsigned int	localOfs, dataOfs, csize;
+
+	if ( pos < 0 || pak->mappingLength < 46 || pos > pak->mappingLength - 46 ) {
+		return -1;
+	}
+	cd = pak->mapping + pos;
+	if ( ZIP_LONG( cd ) != 0x02014b50 || ( ZIP_SHORT( cd + 8 ) & 1 ) ) {
+		return -1;		// no central directory record, or encrypted
+	}
+
+	csize = ZIP_LONG( cd + 20 );
+	localOfs = ZIP_LONG( cd + 42 );
+	if ( pak->mappingLength < 30 || localOfs > pak->mappingLength - 30 ) {
+		return -1;
+	}
+	local = pak->mapping + localOfs;
+	if ( ZIP_LONG( local ) != 0x04034b50 ) {
+		return -1;
+	}
+
+	dataOfs = localOfs + 30 + ZIP_SHORT( local + 26 ) + ZIP_SHORT( local + 28 );
+	if ( dataOfs > pak->mappingLength || csize > pak->mappingLength - dataOfs ) {
+		return -1;
+	}
+
+	*method = ZIP_SHORT( cd + 10 );
+	*compressedSize = csize;
+	return dataOfs;
+}
+
+/*
+=================
+FS_PakMapping
+
+Maps the pk3 on its first use, and drops the mapping for good once the
+pk3 on disk is no longer the file that was mapped
+=================
+*/
+static qboolean FS_PakMapping( pack_t *pak )
+{
+	int		size, mtime;
+
+	if ( pak->mappingFailed ) {
+		return qfalse;
+	}
+
+	if ( !Sys_FileStat( pak->pakFilename, &size, &mtime ) ) {
+		size = -1;
+	}
+
+	if ( pak->mapping ) {
+		if ( size == pak->mappingLength && mtime == pak->mappingMtime ) {
+			return qtrue;
+		}
+		Com_Printf( "WARNING: %s changed on disk, no longer reading it mapped\n", pak->pakFilename );
+		Sys_UnmapFile( pak->mapping, pak->mappingLength );
+		pak->mapping = NULL;
+		pak->mappingFailed = qtrue;
+		return qfalse;
+	}
+
+	if ( size > 0 ) {
+		pak->mapping = Sys_MapFile( pak->pakFilename, &pak->mappingLength );
+	}
+	if ( !pak->mapping ) {
+		pak->mappingFailed = qtrue;
+		return qfalse;
+	}
+	// written between the stat and the map
+	if ( pak->mappingLength != size ) {
+		Sys_UnmapFile( pak->mapping, pak->mappingLength );
+		pak->mapping = NULL;
+		pak->mappingFailed = qtrue;
+		return qfalse;
+	}
+	pak->mappingMtime = mtime;
+	return qtrue;
+}
+
+/*
+=================
+FS_ReadZipFileMapped
+
+Reads a whole pk3 entry opened with FS_FOpenFileRead through the mapping
+of its pk3. Returns a 0 terminated buffer for FS_FreeFile, or NULL if the
+entry has to be read through unzip.
+=================
+*/
+static byte *FS_ReadZipFileMapped( fileHandle_t h, long len )
+{
+	pack_t		*pak;
+	byte		*buf;
+	void		*base;
+	int			i, ofs, method, csize, mapLength;
+	z_stream	stream;
+
+	pak = fsh[h].zipPak;
+	if ( !pak || !fs_mmapPaks || !fs_mmapPaks->integer || len != fsh[h].zipFileLen ) {
+		return NULL;
+	}
+
+	if ( !FS_PakMapping( pak ) ) {
+		return NULL;
+	}
+
+	ofs = FS_ZipEntryData( pak, fsh[h].zipFilePos, &method, &csize );
+	if ( ofs < 0 ) {
+		return NULL;
+	}
+
+	if ( method == 0 ) {
+		if ( csize != len ) {
+			return NULL;
+		}
+
+		// the central directory always follows, so the byte after
+		// the entry can be mapped and overwritten by the trailing 0
+		if ( len >= MAPPED_FILE_MIN_SIZE && ofs + len < pak->mappingLength ) {
+			for ( i = 0 ; i < MAX_MAPPED_FILES ; i++ ) {
+				if ( !fs_mappedFiles[i].buffer ) {
+					break;
+				}
+			}
+			if ( i < MAX_MAPPED_FILES ) {
+				buf = Sys_MapFileRegion( pak->pakFilename, ofs, len + 1, &base, &mapLength );
+				if ( buf ) {
+					buf[len] = 0;
+					fs_mappedFiles[i].buffer = buf;
+					fs_mappedFiles[i].base = base;
+					fs_mappedFiles[i].length = mapLength;
+					fs_readCount += len;
+					return buf;
+				}
+			}
+		}
+
+		buf = Hunk_AllocateTempMemory( len + 1 );
+		Com_Memcpy( buf, pak->mapping + ofs, len );
+		buf[len] = 0;
+		fs_readCount += len;
+		return buf;
+	}
+
+	if ( method != Z_DEFLATED ) {
+		return NULL;
+	}
+
+	buf = Hunk_AllocateTempMemory( len + 1 );
+
+	Com_Memset( &stream, 0, sizeof( stream ) );
+	if ( inflateInit2( &stream, -MAX_WBITS ) != Z_OK ) {
+		Hunk_FreeTempMemory( buf );
+		return NULL;
+	}
+	stream.next_in = pak->mapping + ofs;
+	stream.avail_in = csize;
+	stream.next_out = buf;
+	stream.avail_out = len;
+
+	if ( inflate( &stream, Z_FINISH ) != Z_STREAM_END || stream.total_out != len ) {
+		inflateEnd( &stream );
+		Hunk_FreeTempMemory( buf );
+		return NULL;
+	}
+	inflateEnd( &stream );
+
+	buf[len] = 0;
+	fs_readCount += len;
+	return buf;
+}
+
 /*
 ============
 FS_ReadFileDir
@@ -1909,13 +2325,20 @@ long FS_ReadFileDir(const char *qpath, void *searchPath, qboolean unpure, void *
 	fs_loadCount++;
 	fs_loadStack++;
 
-	buf = Hunk_AllocateTempMemory(len+1);
-	*buffer = buf;
+	buf = NULL;
+	if ( fsh[h].zipFile ) {
+		buf = FS_ReadZipFileMapped( h, len );
+	}
 
-	FS_Read (buf, len, h);
+	if ( !buf ) {
+		buf = Hunk_AllocateTempMemory(len+1);
 
-	// guarantee that it will have a trailing 0 for string operations
-	buf[len] = 0;
+		FS_Read (buf, len, h);
+
+		// guarantee that it will have a trailing 0 for string operations
+		buf[len] = 0;
+	}
+	*buffer = buf;
 	FS_FCloseFile( h );
 
 	// if we are journalling and it is a config file, write it to the journal file
@@ -1941,12 +2364,91 @@ long FS_ReadFile(const char *qpath, void **buffer)
 	return FS_ReadFileDir(qpath, NULL, qfalse, buffer);
 }
 
+/*
+============
+FS_ReadHomeFile
+
+FS_ReadFile for files the engine writes itself with FS_WriteFile.
+Only the game directory under fs_homepath is searched, so neither a
+pk3 nor another install can supply them.
+============
+*/
+long FS_ReadHomeFile( const char *qpath, void **buffer )
+{
+	searchpath_t	*search;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	}
+
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+		if ( search->dir && !Q_stricmp( search->dir->path, fs_homepath->string )
+			&& !Q_stricmp( search->dir->gamedir, fs_gamedir ) ) {
+			return FS_ReadFileDir( qpath, search, qtrue, buffer );
+		}
+	}
+
+	if ( buffer ) {
+		*buffer = NULL;
+	}
+	return -1;
+}
+
+/*
+============
+FS_MapFile
+
+Maps a file that is found as a loose file in the search path read only.
+Returns NULL if the file is missing, is found in a pk3 first or can't be
+mapped, in which case it has to be read through FS_Read.
+The mapping is released with FS_UnmapFile.
+============
+*/
+void *FS_MapFile( const char *qpath, int *length )
+{
+	searchpath_t	*search;
+	char			*netpath;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	}
+
+	if ( !qpath || !qpath[0] ) {
+		Com_Error( ERR_FATAL, "FS_MapFile with empty name" );
+	}
+
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+		if ( FS_FOpenFileReadDir( qpath, search, NULL, qfalse, qfalse ) <= 0 ) {
+			continue;
+		}
+		// loose files are not allowed next to the pure paks
+		if ( !search->dir || fs_numServerPaks ) {
+			return NULL;
+		}
+		netpath = FS_BuildOSPath( search->dir->path, search->dir->gamedir, qpath );
+		return Sys_MapFile( netpath, length );
+	}
+	return NULL;
+}
+
+/*
+============
+FS_UnmapFile
+============
+*/
+void FS_UnmapFile( void *buffer, int length )
+{
+	Sys_UnmapFile( buffer, length );
+}
+
 /*
 =============
 FS_FreeFile
 =============
 */
 void FS_FreeFile( void *buffer ) {
+	int		i;
+
 	if ( !fs_searchpaths ) {
 		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
 	}
@@ -1955,7 +2457,16 @@ void FS_FreeFile( void *buffer ) {
 	}
 	fs_loadStack--;
 
-	Hunk_FreeTempMemory( buffer );
+	for ( i = 0 ; i < MAX_MAPPED_FILES ; i++ ) {
+		if ( fs_mappedFiles[i].buffer == buffer ) {
+			Sys_UnmapFile( fs_mappedFiles[i].base, fs_mappedFiles[i].length );
+			fs_mappedFiles[i].buffer = NULL;
+			break;
+		}
+	}
+	if ( i == MAX_MAPPED_FILES ) {
+		Hunk_FreeTempMemory( buffer );
+	}
 
 	// if all of our temp files are free, clear all of our space
 	if ( fs_loadStack == 0 ) {
@@ -2002,6 +2513,371 @@ ZIP FILE LOADING
 ==========================================================================
 */
 
+/*
+=================================================================================
+
+PAK INDEX CACHE
+
+Walking the central directory of every pk3 at each FS_Startup is slow with
+hundreds of map paks, so the parsed file lists and checksums are kept in
+<fs_homepath>/pakindex.dat keyed by the pk3 path, size and modification time.
+The index is mapped once per FS_Startup, a record is only validated when its
+pk3 gets loaded, and the file is rewritten at the end of FS_Startup if any pk3
+had to be parsed.
+
+=================================================================================
+*/
+
+#define	PAKINDEX_IDENT		(('X'<<24)+('D'<<16)+('I'<<8)+'P')
+#define	PAKINDEX_VERSION	1
+#define	PAKINDEX_NAME		"pakindex.dat"
+#define	PAKINDEX_HASH_SIZE	256
+
+typedef struct {
+	int		ident;
+	int		version;
+	int		numPaks;
+} pakIndexHeader_t;
+
+typedef struct {
+	int		size;			// of the whole record, multiple of 4
+	int		fileSize;		// size and modification time of the pk3
+	int		mtime;
+	int		numFiles;
+	int		pathLen;		// including the trailing 0
+	int		namesLen;
+	// followed by pakIndexFile_t files[numFiles], char path[pathLen], char names[namesLen]
+} pakIndexPak_t;
+
+typedef struct {
+	unsigned int	pos;	// file info position in zip
+	unsigned int	len;	// uncompressed file size
+	int				crc;
+	int				name;	// offset into the names
+} pakIndexFile_t;
+
+typedef struct pakIndexEntry_s {
+	pakIndexPak_t	*pak;
+	qboolean		pending;	// freshly parsed, Z_Malloced
+	qboolean		used;		// validated against its pk3 during this startup
+	qboolean		stale;		// replaced by a pending record
+	struct pakIndexEntry_s	*next;		// next in the hash chain
+	struct pakIndexEntry_s	*nextPending;
+} pakIndexEntry_t;
+
+static	cvar_t			*fs_pakIndex;
+static	qboolean		fs_pakIndexActive;		// only between FS_LoadPakIndex and FS_WritePakIndex
+static	byte			*fs_pakIndexData;		// mapped index file
+static	int				fs_pakIndexLength;
+static	pakIndexEntry_t	*fs_pakIndexEntries;
+static	pakIndexEntry_t	*fs_pakIndexHash[PAKINDEX_HASH_SIZE];
+static	pakIndexEntry_t	*fs_pakIndexPending;
+static	int				fs_pakIndexHits;
+static	int				fs_pakIndexParsed;
+
+#define	PAKINDEX_FILES(p)	((pakIndexFile_t *)((p) + 1))
+#define	PAKINDEX_PATH(p)	((char *)(PAKINDEX_FILES(p) + (p)->numFiles))
+#define	PAKINDEX_NAMES(p)	(PAKINDEX_PATH(p) + (p)->pathLen)
+
+/*
+================
+FS_HashPakPath
+================
+*/
+static long FS_HashPakPath( const char *path ) {
+	int		i;
+	long	hash;
+
+	hash = 0;
+	for ( i = 0 ; path[i] ; i++ ) {
+		hash += (long)(path[i]) * (i + 119);
+	}
+	hash = (hash ^ (hash >> 10) ^ (hash >> 20));
+	return hash & (PAKINDEX_HASH_SIZE - 1);
+}
+
+/*
+================
+FS_PakIndexRecordSize
+================
+*/
+static int FS_PakIndexRecordSize( int numFiles, int pathLen, int namesLen ) {
+	return PAD( sizeof(pakIndexPak_t) + numFiles * sizeof(pakIndexFile_t) + pathLen + namesLen, 4 );
+}
+
+/*
+================
+FS_PakIndexLink
+================
+*/
+static void FS_PakIndexLink( pakIndexEntry_t *entry ) {
+	long	hash;
+
+	hash = FS_HashPakPath( PAKINDEX_PATH( entry->pak ) );
+	entry->next = fs_pakIndexHash[hash];
+	fs_pakIndexHash[hash] = entry;
+}
+
+/*
+================
+FS_PakIndexFind
+================
+*/
+static pakIndexEntry_t *FS_PakIndexFind( const char *zipfile ) {
+	pakIndexEntry_t	*entry;
+
+	for ( entry = fs_pakIndexHash[FS_HashPakPath( zipfile )] ; entry ; entry = entry->next ) {
+		if ( !entry->stale && !strcmp( PAKINDEX_PATH( entry->pak ), zipfile ) ) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+/*
+================
+FS_LoadPakIndex
+
+Maps the index and hashes the records by path, the record contents are
+checked by FS_PakIndexLookup when the pk3 is loaded
+================
+*/
+static void FS_LoadPakIndex( void ) {
+	pakIndexHeader_t	*header;
+	pakIndexPak_t		*pak;
+	char				ospath[MAX_OSPATH];
+	int					i, ofs, remaining, numPaks;
+
+	fs_pakIndex = Cvar_Get( "fs_pakIndex", "1", CVAR_ARCHIVE | CVAR_LATCH );
+
+	Com_Memset( fs_pakIndexHash, 0, sizeof( fs_pakIndexHash ) );
+	fs_pakIndexData = NULL;
+	fs_pakIndexLength = 0;
+	fs_pakIndexEntries = NULL;
+	fs_pakIndexPending = NULL;
+	fs_pakIndexHits = 0;
+	fs_pakIndexParsed = 0;
+	fs_pakIndexActive = qfalse;
+
+	if ( !fs_pakIndex->integer || !fs_homepath->string[0] ) {
+		return;
+	}
+	fs_pakIndexActive = qtrue;
+
+	Com_sprintf( ospath, sizeof( ospath ), "%s%c%s", fs_homepath->string, PATH_SEP, PAKINDEX_NAME );
+	fs_pakIndexData = Sys_MapFile( ospath, &fs_pakIndexLength );
+	if ( !fs_pakIndexData ) {
+		return;
+	}
+
+	header = (pakIndexHeader_t *)fs_pakIndexData;
+	if ( fs_pakIndexLength < sizeof( *header ) || header->ident != PAKINDEX_IDENT
+		|| header->version != PAKINDEX_VERSION || header->numPaks <= 0 ) {
+		Com_Printf( "Ignoring invalid %s\n", PAKINDEX_NAME );
+		return;
+	}
+
+	numPaks = header->numPaks;
+	if ( numPaks > ( fs_pakIndexLength - sizeof( *header ) ) / sizeof( pakIndexPak_t ) ) {
+		Com_Printf( "Ignoring invalid %s\n", PAKINDEX_NAME );
+		return;
+	}
+	fs_pakIndexEntries = Z_Malloc( numPaks * sizeof( pakIndexEntry_t ) );
+
+	ofs = sizeof( *header );
+	for ( i = 0 ; i < numPaks ; i++ ) {
+		pak = (pakIndexPak_t *)( fs_pakIndexData + ofs );
+		remaining = fs_pakIndexLength - ofs;
+		if ( remaining < sizeof( *pak ) || pak->size > remaining
+			|| pak->numFiles < 0 || pak->numFiles > remaining / sizeof( pakIndexFile_t )
+			|| pak->pathLen <= 0 || pak->pathLen > remaining
+			|| pak->namesLen < 0 || pak->namesLen > remaining ) {
+			break;
+		}
+		if ( pak->size != FS_PakIndexRecordSize( pak->numFiles, pak->pathLen, pak->namesLen )
+			|| PAKINDEX_PATH( pak )[pak->pathLen - 1] ) {
+			break;
+		}
+		fs_pakIndexEntries[i].pak = pak;
+		FS_PakIndexLink( &fs_pakIndexEntries[i] );
+		ofs += pak->size;
+	}
+	if ( i != numPaks ) {
+		Com_Printf( "%s is truncated after %i paks\n", PAKINDEX_NAME, i );
+	}
+}
+
+/*
+================
+FS_PakIndexLookup
+
+Returns the cached record for a pk3 if it is still up to date
+================
+*/
+static pakIndexPak_t *FS_PakIndexLookup( const char *zipfile, int fileSize, int mtime, int numFiles ) {
+	pakIndexEntry_t	*entry;
+	pakIndexPak_t	*pak;
+	pakIndexFile_t	*files;
+	const char		*names;
+	int				i, namesTotal;
+
+	entry = FS_PakIndexFind( zipfile );
+	if ( !entry ) {
+		return NULL;
+	}
+	pak = entry->pak;
+	if ( pak->fileSize != fileSize || pak->mtime != mtime || pak->numFiles != numFiles ) {
+		return NULL;
+	}
+
+	// the names have to stay inside the record, and as FS_LoadZipFile
+	// copies every name into a buffer of namesLen bytes they can't add
+	// up to more than that either
+	names = PAKINDEX_NAMES( pak );
+	if ( pak->namesLen > 0 && names[pak->namesLen - 1] ) {
+		return NULL;
+	}
+	files = PAKINDEX_FILES( pak );
+	namesTotal = 0;
+	for ( i = 0 ; i < pak->numFiles ; i++ ) {
+		if ( files[i].name < 0 || files[i].name >= pak->namesLen ) {
+			return NULL;
+		}
+		namesTotal += strlen( names + files[i].name ) + 1;
+		if ( namesTotal > pak->namesLen ) {
+			return NULL;
+		}
+	}
+
+	entry->used = qtrue;
+	fs_pakIndexHits++;
+	return pak;
+}
+
+/*
+================
+FS_PakIndexAdd
+
+Queues the record of a freshly parsed pk3 for FS_WritePakIndex
+================
+*/
+static void FS_PakIndexAdd( pakIndexPak_t *pak ) {
+	pakIndexEntry_t	*entry;
+
+	entry = FS_PakIndexFind( PAKINDEX_PATH( pak ) );
+	if ( entry ) {
+		entry->stale = qtrue;
+	}
+
+	entry = Z_Malloc( sizeof( *entry ) );
+	entry->pak = pak;
+	entry->pending = qtrue;
+	entry->used = qtrue;
+	FS_PakIndexLink( entry );
+
+	entry->nextPending = fs_pakIndexPending;
+	fs_pakIndexPending = entry;
+	fs_pakIndexParsed++;
+}
+
+/*
+================
+FS_WritePakIndex
+
+Rewrites the index if any pk3 had to be parsed, keeping the records of
+paks that still exist but were not loaded this time, then releases it
+================
+*/
+static void FS_WritePakIndex( void ) {
+	pakIndexHeader_t	header;
+	pakIndexEntry_t		*entry, *next;
+	char				ospath[MAX_OSPATH], tmppath[MAX_OSPATH];
+	FILE				*f;
+	int					i, numEntries, fileSize, mtime;
+	qboolean			ok;
+
+	if ( !fs_pakIndexActive ) {
+		return;
+	}
+	fs_pakIndexActive = qfalse;
+
+	Com_sprintf( ospath, sizeof( ospath ), "%s%c%s", fs_homepath->string, PATH_SEP, PAKINDEX_NAME );
+	Com_sprintf( tmppath, sizeof( tmppath ), "%s.tmp", ospath );
+
+	numEntries = 0;
+	if ( fs_pakIndexData ) {
+		numEntries = ( (pakIndexHeader_t *)fs_pakIndexData )->numPaks;
+	}
+
+	f = NULL;
+	if ( fs_pakIndexPending ) {
+		f = Sys_FOpen( tmppath, "wb" );
+		if ( !f ) {
+			Com_Printf( "Couldn't write %s\n", tmppath );
+		}
+	}
+
+	if ( f ) {
+		header.ident = PAKINDEX_IDENT;
+		header.version = PAKINDEX_VERSION;
+		header.numPaks = 0;
+		ok = fwrite( &header, sizeof( header ), 1, f ) == 1;
+
+		for ( entry = fs_pakIndexPending ; entry ; entry = entry->nextPending ) {
+			ok &= fwrite( entry->pak, entry->pak->size, 1, f ) == 1;
+			header.numPaks++;
+		}
+		for ( i = 0 ; i < numEntries && fs_pakIndexEntries ; i++ ) {
+			entry = &fs_pakIndexEntries[i];
+			if ( !entry->pak || entry->stale ) {
+				continue;
+			}
+			// drop records of paks that have been removed
+			if ( !entry->used && !Sys_FileStat( PAKINDEX_PATH( entry->pak ), &fileSize, &mtime ) ) {
+				continue;
+			}
+			ok &= fwrite( entry->pak, entry->pak->size, 1, f ) == 1;
+			header.numPaks++;
+		}
+
+		ok &= fseek( f, 0, SEEK_SET ) == 0;
+		ok &= fwrite( &header, sizeof( header ), 1, f ) == 1;
+		ok &= fclose( f ) == 0;
+	}
+
+	// the old index has to be unmapped before it can be replaced
+	if ( fs_pakIndexData ) {
+		Sys_UnmapFile( fs_pakIndexData, fs_pakIndexLength );
+		fs_pakIndexData = NULL;
+	}
+
+	if ( f ) {
+		if ( ok ) {
+			remove( ospath );
+			ok = rename( tmppath, ospath ) == 0;
+		}
+		if ( !ok ) {
+			Com_Printf( "Couldn't write %s\n", ospath );
+			remove( tmppath );
+		}
+	}
+
+	Com_Printf( "%d pk3 directories from %s, %d parsed\n", fs_pakIndexHits, PAKINDEX_NAME, fs_pakIndexParsed );
+
+	for ( entry = fs_pakIndexPending ; entry ; entry = next ) {
+		next = entry->nextPending;
+		Z_Free( entry->pak );
+		Z_Free( entry );
+	}
+	fs_pakIndexPending = NULL;
+
+	if ( fs_pakIndexEntries ) {
+		Z_Free( fs_pakIndexEntries );
+		fs_pakIndexEntries = NULL;
+	}
+	Com_Memset( fs_pakIndexHash, 0, sizeof( fs_pakIndexHash ) );
+}
+
 /*
 =================
 FS_LoadZipFile
@@ -2023,9 +2899,13 @@ static pack_t *FS_LoadZipFile(const char *zipfile, const char *basename, const c
 	long			hash;
 	int				fs_numHeaderLongs;
 	int				*fs_headerLongs;
-	char			*namePtr;
+	char			*namePtr, *names;
 	qboolean		alreadydangerous = qfalse;
 	char			*download;
+	pakIndexPak_t	*index, *record;
+	pakIndexFile_t	*indexFiles;
+	int				fileSize, mtime;
+	qboolean		indexable;
 
 	fs_numHeaderLongs = 0;
 
@@ -2035,20 +2915,45 @@ static pack_t *FS_LoadZipFile(const char *zipfile, const char *basename, const c
 	if (err != UNZ_OK)
 		return NULL;
 
-	len = 0;
-	unzGoToFirstFile(uf);
-	for (i = 0; i < gi.number_entry; i++)
-	{
-		err = unzGetCurrentFileInfo(uf, &file_info, filename_inzip, sizeof(filename_inzip), NULL, 0, NULL, 0);
-		if (err != UNZ_OK) {
-			break;
+	index = record = NULL;
+	indexFiles = NULL;
+	indexable = fs_pakIndexActive && Sys_FileStat( zipfile, &fileSize, &mtime );
+	if ( indexable ) {
+		index = FS_PakIndexLookup( zipfile, fileSize, mtime, gi.number_entry );
+	}
+
+	if ( index ) {
+		// the directory is cached, no need to walk it
+		indexFiles = PAKINDEX_FILES( index );
+		len = index->namesLen;
+	} else {
+		len = 0;
+		unzGoToFirstFile(uf);
+		for (i = 0; i < gi.number_entry; i++)
+		{
+			err = unzGetCurrentFileInfo(uf, &file_info, filename_inzip, sizeof(filename_inzip), NULL, 0, NULL, 0);
+			if (err != UNZ_OK) {
+				break;
+			}
+			len += strlen(filename_inzip) + 1;
+			unzGoToNextFile(uf);
+		}
+
+		if ( indexable && i == gi.number_entry ) {
+			i = strlen( zipfile ) + 1;
+			record = Z_Malloc( FS_PakIndexRecordSize( gi.number_entry, i, len ) );
+			record->size = FS_PakIndexRecordSize( gi.number_entry, i, len );
+			record->fileSize = fileSize;
+			record->mtime = mtime;
+			record->numFiles = gi.number_entry;
+			record->pathLen = i;
+			record->namesLen = len;
+			Q_strncpyz( PAKINDEX_PATH( record ), zipfile, i );
 		}
-		len += strlen(filename_inzip) + 1;
-		unzGoToNextFile(uf);
 	}
 
 	buildBuffer = Z_Malloc( (gi.number_entry * sizeof( fileInPack_t )) + len );
-	namePtr = ((char *) buildBuffer) + gi.number_entry * sizeof( fileInPack_t );
+	namePtr = names = ((char *) buildBuffer) + gi.number_entry * sizeof( fileInPack_t );
 	fs_headerLongs = Z_Malloc( ( gi.number_entry + 1 ) * sizeof(int) );
 	fs_headerLongs[ fs_numHeaderLongs++ ] = LittleLong( fs_checksumFeed );
 
@@ -2091,9 +2996,15 @@ static pack_t *FS_LoadZipFile(const char *zipfile, const char *basename, const c
 
 	for (i = 0; i < gi.number_entry; i++)
 	{
-		err = unzGetCurrentFileInfo(uf, &file_info, filename_inzip, sizeof(filename_inzip), NULL, 0, NULL, 0);
-		if (err != UNZ_OK) {
-			break;
+		if (index) {
+			Q_strncpyz( filename_inzip, PAKINDEX_NAMES( index ) + indexFiles[i].name, sizeof( filename_inzip ) );
+			file_info.uncompressed_size = indexFiles[i].len;
+			file_info.crc = indexFiles[i].crc;
+		} else {
+			err = unzGetCurrentFileInfo(uf, &file_info, filename_inzip, sizeof(filename_inzip), NULL, 0, NULL, 0);
+			if (err != UNZ_OK) {
+				break;
+			}
 		}
 
 		if (pack->downloaded && (COM_CompareExtension(filename_inzip, ".qvm")
@@ -2127,11 +3038,29 @@ static pack_t *FS_LoadZipFile(const char *zipfile, const char *basename, const c
 		strcpy( buildBuffer[i].name, filename_inzip );
 		namePtr += strlen(filename_inzip) + 1;
 		// store the file position in the zip
-		buildBuffer[i].pos = unzGetOffset(uf);
+		buildBuffer[i].pos = index ? indexFiles[i].pos : unzGetOffset(uf);
 		buildBuffer[i].len = file_info.uncompressed_size;
 		buildBuffer[i].next = pack->hashTable[hash];
 		pack->hashTable[hash] = &buildBuffer[i];
-		unzGoToNextFile(uf);
+
+		if (record) {
+			PAKINDEX_FILES( record )[i].pos = buildBuffer[i].pos;
+			PAKINDEX_FILES( record )[i].len = buildBuffer[i].len;
+			PAKINDEX_FILES( record )[i].crc = file_info.crc;
+			PAKINDEX_FILES( record )[i].name = buildBuffer[i].name - names;
+		}
+		if (!index) {
+			unzGoToNextFile(uf);
+		}
+	}
+
+	if (record) {
+		if (i == gi.number_entry && namePtr - names == len) {
+			Com_Memcpy( PAKINDEX_NAMES( record ), names, len );
+			FS_PakIndexAdd( record );
+		} else {
+			Z_Free( record );
+		}
 	}
 
 	pack->checksum = Com_BlockChecksum( &fs_headerLongs[ 1 ], sizeof(*fs_headerLongs) * ( fs_numHeaderLongs - 1 ) );
@@ -2156,6 +3085,8 @@ Frees a pak structure and releases all associated resources
 
 static void FS_FreePak(pack_t *thepak)
 {
+	if (thepak->mapping)
+		Sys_UnmapFile(thepak->mapping, thepak->mappingLength);
 	unzClose(thepak->handle);
 	Z_Free(thepak->buildBuffer);
 	Z_Free(thepak);
@@ -3258,6 +4189,7 @@ void FS_Shutdown( qboolean closemfp ) {
 
 	// any FS_ calls will now be an error until reinitialized
 	fs_searchpaths = NULL;
+	FS_FreeFileIndex();
 
 	Cmd_RemoveCommand( "path" );
 	Cmd_RemoveCommand( "dir" );
@@ -3310,6 +4242,11 @@ static void FS_ReorderPurePaks( void )
 			p_previous = &s->next;
 		}
 	}
+
+	// FS_Startup builds the index once the search path is complete
+	if ( fs_reordered && fs_fileIndexHash ) {
+		FS_BuildFileIndex();
+	}
 }
 
 /*
@@ -3404,6 +4341,10 @@ void FS_ReorderPaks( void )
 	if (tail != NULL) {
 		tail->next = fs_searchpaths;
 		fs_searchpaths = head;
+
+		if (fs_fileIndexHash) {
+			FS_BuildFileIndex();
+		}
 	}
 
 	fs_mapNameChanged = qfalse;
@@ -3429,6 +4370,8 @@ static void FS_Startup( const char *gameName )
 	fs_basegame = Cvar_Get ("fs_basegame", "", CVAR_INIT );
 	fs_lowPriorityDownloads = Cvar_Get ("fs_lowPriorityDownloads", "1", CVAR_ARCHIVE|CVAR_LATCH);
 	fs_reorderPaks = Cvar_Get ("fs_reorderPaks", "1", CVAR_ARCHIVE|CVAR_LATCH);
+	// a pk3 overwritten in place while mapped can crash the server
+	fs_mmapPaks = Cvar_Get ("fs_mmapPaks", "0", CVAR_ARCHIVE|CVAR_LATCH);
 	fs_defaultHomePath = Cvar_Get ("fs_defaultHomePath", "0", CVAR_INIT|CVAR_PROTECTED );
 
 	if (fs_defaultHomePath->integer == 1) {
@@ -3477,6 +4420,8 @@ static void FS_Startup( const char *gameName )
 		Com_Error( ERR_DROP, "Invalid fs_game '%s'", fs_gamedirvar->string );
 	}
 
+	FS_LoadPakIndex();
+
 	// add search path elements in reverse priority order
 
 	if (fs_lowPriorityDownloads->integer) {
@@ -3548,6 +4493,8 @@ static void FS_Startup( const char *gameName )
 	}
 
 
+	FS_WritePakIndex();
+
 	// add our commands
 	Cmd_AddCommand ("path", FS_Path_f);
 	Cmd_AddCommand ("dir", FS_Dir_f );
@@ -3561,6 +4508,8 @@ static void FS_Startup( const char *gameName )
 
 	FS_ReorderPaks();
 
+	FS_BuildFileIndex();
+
 	// print the current search paths
 	FS_Path_f();
 
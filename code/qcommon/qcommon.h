@@ -681,12 +681,20 @@ long	FS_ReadFile(const char *qpath, void **buffer);
 // the buffer should be considered read-only, because it may be cached
 // for other uses.
 
+long	FS_ReadHomeFile( const char *qpath, void **buffer );
+// like FS_ReadFile, but only from the game directory under fs_homepath,
+// for files the engine wrote there itself with FS_WriteFile
+
 void	FS_ForceFlush( fileHandle_t f );
 // forces flush on files we're writing to.
 
 void	FS_FreeFile( void *buffer );
 // frees the memory returned by FS_ReadFile
 
+void	*FS_MapFile( const char *qpath, int *length );
+void	FS_UnmapFile( void *buffer, int length );
+// maps a loose file read only, NULL if it is in a pk3 or can't be mapped
+
 void	FS_WriteFile( const char *qpath, const void *buffer, int size );
 // writes a complete file, creating any subdirectories needed
 
@@ -915,7 +923,8 @@ typedef enum {
 	TAG_BOTLIB,
 	TAG_RENDERER,
 	TAG_SMALL,
-	TAG_STATIC
+	TAG_STATIC,
+	TAG_SLAB			// zone pages holding slab blocks
 } memtag_t;
 
 /*
@@ -1115,6 +1124,7 @@ void	Sys_Print( const char *msg );
 // Sys_Milliseconds should only be used for profiling purposes,
 // any game related timing information should come from event timestamps
 int		Sys_Milliseconds (void);
+int64_t	Sys_Microseconds (void);
 
 qboolean Sys_RandomBytes( byte *string, int len );
 
@@ -1137,6 +1147,10 @@ FILE	*Sys_FOpen( const char *ospath, const char *mode );
 qboolean Sys_Mkdir( const char *path );
 FILE	*Sys_Mkfifo( const char *ospath );
 char	*Sys_Cwd( void );
+qboolean Sys_FileStat( const char *ospath, int *size, int *mtime );
+void	*Sys_MapFile( const char *ospath, int *length );	// read only, NULL on failure
+void	*Sys_MapFileRegion( const char *ospath, int offset, int length, void **base, int *mapLength );	// copy on write
+void	Sys_UnmapFile( void *base, int length );
 void	Sys_SetDefaultInstallPath(const char *path);
 char	*Sys_DefaultInstallPath(void);
 char	*Sys_SteamPath(void);
@@ -1158,6 +1172,27 @@ void	Sys_FreeFileList( char **list );
 void	Sys_Sleep(int msec);
 
 qboolean Sys_LowPhysicalMemory( void );
+void	*Sys_HunkAlloc( int size, int hugePages, qboolean lock, int *hugeBytes );	// NULL to use calloc
+
+// worker threads must stay away from cvars and commands, and from the zone
+// unless every thread that touches it meanwhile holds the same mutex
+void	*Sys_CreateThread( void (*function)( void *data ), void *data );	// NULL on failure
+void	Sys_JoinThread( void *thread );
+int		Sys_NumProcessors( void );
+void	*Sys_CreateMutex( void );	// NULL on failure
+void	Sys_LockMutex( void *mutex );
+void	Sys_UnlockMutex( void *mutex );
+void	Sys_DestroyMutex( void *mutex );
+void	*Sys_CreateSemaphore( void );	// NULL on failure, starts at 0
+void	Sys_PostSemaphore( void *semaphore );
+void	Sys_WaitSemaphore( void *semaphore );
+void	Sys_DestroySemaphore( void *semaphore );
+
+#ifdef _MSC_VER
+#define	QTHREADLOCAL	__declspec(thread)
+#else
+#define	QTHREADLOCAL	__thread
+#endif
 
 void Sys_SetEnv(const char *name, const char *value);
 
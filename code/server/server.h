@@ -32,6 +32,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 										// GAME BOTH REFERENCE !!!
 
 #define	MAX_ENT_CLUSTERS	16
+#define	ENT_CLUSTER_WORDS	4		// span of clusters an entity can hold as a bitset
 
 #ifdef USE_VOIP
 #define VOIP_QUEUE_LENGTH 64
@@ -62,11 +63,15 @@ typedef struct skeetInfo_s {
 typedef struct svEntity_s {
 	struct worldSector_s *worldSector;
 	struct svEntity_s *nextEntityInWorldSector;
+	struct entityTreeNode_s *entityTreeNode;	// leaf in the entity tree when sv_entityTree is on
 	
 	entityState_t	baseline;		// for delta compression of initial sighting
 	int			numClusters;		// if -1, use headnode instead
 	int			clusternums[MAX_ENT_CLUSTERS];
 	int			lastCluster;		// if all the clusters don't fit in clusternums
+	int			clusterWord;		// first word of a pvs row covered by clusterBits
+	int			numClusterWords;	// 0 if the clusters span too far, use clusternums instead
+	unsigned	clusterBits[ENT_CLUSTER_WORDS];	// every cluster touched, laid out like a pvs row
 	int			areanum, areanum2;
 	int			snapshotCounter;	// used to prevent double adding from portal views
 #ifdef USE_SKEETMOD
@@ -307,9 +312,19 @@ typedef struct
 
 //=============================================================================
 
+// frame benchmark state, see SV_FrameBench_f
+typedef struct {
+	qboolean	active;
+	int			seed;				// random seed handed to the game
+	int			depth;				// timed system calls in progress
+	int64_t		botlibUsec;			// spent in botlib system calls this frame
+	int64_t		collisionUsec;		// spent in trace and contents system calls this frame
+} svBench_t;
+
 extern	serverStatic_t	svs;				// persistant server info across maps
 extern	server_t		sv;					// cleared each map
 extern	vm_t			*gvm;				// game virtual machine
+extern	svBench_t		sv_bench;			// frame benchmark in progress
 
 extern	cvar_t	*sv_fps;
 extern	cvar_t	*sv_timeout;
@@ -350,6 +365,8 @@ extern	cvar_t	*sv_autoRecordDemo;		// automatically create a server demo of ever
 extern	cvar_t	*sv_sayprefix;
 extern	cvar_t	*sv_tellprefix;
 extern	cvar_t	*sv_teamSwitch;			// allow players to switch teams (0, Default = players must wait 5 seconds to switch, 1 = no restriction)
+extern	cvar_t	*sv_entityTree;			// link entities into a dynamic bounding box tree instead of the world sectors
+extern	cvar_t	*sv_lagCompensation;	// msec of entity history traces for a client may be rewound by, 0 = off
 
 #ifdef USE_VOIP
 extern	cvar_t	*sv_voip;
@@ -410,6 +427,7 @@ void		SV_RemoveOperatorCommands (void);
 
 void		SV_MasterShutdown (void);
 int			SV_RateMsec(client_t *client);
+void		SV_FrameBench_f( void );
 
 
 //
@@ -531,6 +549,7 @@ int			BotImport_DebugPolygonCreate(int color, int numPoints, vec3_t *points);
 void		BotImport_DebugPolygonDelete(int id);
 
 void		SV_BotInitBotLib(void);
+void		SV_BotPrecompute_f( void );
 
 //============================================================
 //
@@ -556,6 +575,9 @@ clipHandle_t SV_ClipHandleForEntity( const sharedEntity_t *ent );
 
 
 void		SV_SectorList_f( void );
+void		SV_TraceStress_f( void );
+void		SV_TraceBatchBench_f( void );
+void		SV_EntityBench_f( void );
 
 
 int			SV_AreaEntities( const vec3_t mins, const vec3_t maxs, int *entityList, int maxcount );
@@ -582,10 +604,28 @@ void		SV_Trace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs,
 
 // passEntityNum is explicitly excluded from clipping checks (normally ENTITYNUM_NONE)
 
+void		SV_TraceBatch( trace_t *results, int numTraces, const vec3_t *starts, const vec3_t *ends, vec3_t mins, vec3_t maxs, int passEntityNum, int contentmask, int capsule );
+// SV_Trace for numTraces start/end pairs that share one mins/maxs
+
+void		SV_RecordEntityHistory( void );
+// called after every game frame to record entity positions for SV_TraceAtTime
+
+int			SV_ClientViewTime( int clientNum );
+// the server time clientNum was looking at when it sent its last command
+
+void		SV_TraceAtTime( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int capsule, int time );
+// SV_Trace against the non-bmodel entities as they were at the given server time
+
+void		SV_TraceForClient( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int clientNum );
+// SV_TraceAtTime at SV_ClientViewTime( clientNum )
 
 void		SV_ClipToEntity( trace_t *trace, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int entityNum, int contentmask, int capsule );
 // clip to a specific entity
 
+void		SV_EnableWorkerTraces( qboolean enable );
+// lets threads with their own CM_SetThreadTraceContext use SV_Trace, SV_ClipToEntity
+// and SV_PointContents next to the main thread, as long as nothing gets linked
+
 //
 // sv_net_chan.c
 //
@@ -38,6 +38,8 @@ int bot_maxdebugpolys;
 extern botlib_export_t	*botlib_export;
 int	bot_enable;
 
+static cvar_t	*bot_threads;
+
 
 /*
 ==================
@@ -131,18 +133,10 @@ void BotDrawDebugPolygons(void (*drawPoly)(int color, int numPoints, float *poin
 
 /*
 ==================
-BotImport_Print
+SV_BotPrint
 ==================
 */
-static __attribute__ ((format (printf, 2, 3))) void QDECL BotImport_Print(int type, char *fmt, ...)
-{
-	char str[2048];
-	va_list ap;
-
-	va_start(ap, fmt);
-	Q_vsnprintf(str, sizeof(str), fmt, ap);
-	va_end(ap);
-
+static void SV_BotPrint( int type, const char *str ) {
 	switch(type) {
 		case PRT_MESSAGE: {
 			Com_Printf("%s", str);
@@ -171,6 +165,90 @@ static __attribute__ ((format (printf, 2, 3))) void QDECL BotImport_Print(int ty
 	}
 }
 
+// botlib prints from bot job worker threads are kept here until the
+// main thread is done running the jobs, see SV_BotFlushPrints
+#define	BOT_PRINT_QUEUE		8192
+
+static QTHREADLOCAL qboolean	sv_botWorkerThread;
+static void		*sv_botPrintLock;
+static char		sv_botPrints[BOT_PRINT_QUEUE];	// type byte and string, repeated
+static int		sv_botPrintLength;
+static int		sv_botPrintsDropped;
+
+/*
+==================
+SV_BotQueuePrint
+==================
+*/
+static void SV_BotQueuePrint( int type, const char *str ) {
+	int		len;
+
+	len = strlen( str ) + 1;
+
+	Sys_LockMutex( sv_botPrintLock );
+	if ( sv_botPrintLength + 1 + len > sizeof( sv_botPrints ) ) {
+		sv_botPrintsDropped++;
+	} else {
+		sv_botPrints[sv_botPrintLength] = type;
+		Com_Memcpy( sv_botPrints + sv_botPrintLength + 1, str, len );
+		sv_botPrintLength += 1 + len;
+	}
+	Sys_UnlockMutex( sv_botPrintLock );
+}
+
+/*
+==================
+SV_BotFlushPrints
+
+Has to be called on the main thread while no job runs.
+==================
+*/
+static void SV_BotFlushPrints( void ) {
+	char	prints[BOT_PRINT_QUEUE];
+	int		length, dropped, ofs;
+
+	if ( !sv_botPrintLength && !sv_botPrintsDropped ) {
+		return;
+	}
+
+	// a PRT_EXIT print drops out of here, so empty the queue first
+	length = sv_botPrintLength;
+	dropped = sv_botPrintsDropped;
+	Com_Memcpy( prints, sv_botPrints, length );
+	sv_botPrintLength = 0;
+	sv_botPrintsDropped = 0;
+
+	if ( dropped ) {
+		Com_Printf( S_COLOR_YELLOW "Warning: %i bot job prints dropped\n", dropped );
+	}
+	for ( ofs = 0 ; ofs < length ; ofs += 2 + strlen( prints + ofs + 1 ) ) {
+		SV_BotPrint( prints[ofs], prints + ofs + 1 );
+	}
+}
+
+/*
+==================
+BotImport_Print
+==================
+*/
+static __attribute__ ((format (printf, 2, 3))) void QDECL BotImport_Print(int type, char *fmt, ...)
+{
+	char str[2048];
+	va_list ap;
+
+	va_start(ap, fmt);
+	Q_vsnprintf(str, sizeof(str), fmt, ap);
+	va_end(ap);
+
+	// Com_Printf isn't safe on the bot job workers
+	if ( sv_botWorkerThread ) {
+		SV_BotQueuePrint( type, str );
+		return;
+	}
+
+	SV_BotPrint( type, str );
+}
+
 /*
 ==================
 BotImport_Trace
@@ -439,6 +517,213 @@ void SV_BotFrame( int time ) {
 	VM_Call( gvm, BOTAI_START_FRAME, time );
 }
 
+/*
+==================
+BOT JOBS
+
+Botlib hands per bot work (batched movement and routing queries) to
+SV_BotRunJobs, which spreads it over a pool of worker threads that is
+kept from one batch to the next.  Each worker keeps its own trace
+context until the map changes, and clips against entities are
+serialized by SV_EnableWorkerTraces.  The main thread runs the first
+stripe of jobs.
+==================
+*/
+
+#define	MAX_BOT_THREADS		16
+
+typedef struct {
+	void				*thread;
+	void				*wake;		// posted when there is a stripe to run or the pool stops
+	int					first;
+	cmTraceContext_t	*ctx;		// NULL for the main thread
+} botWorker_t;
+
+static struct {
+	botWorker_t	workers[MAX_BOT_THREADS];	// [0] is the main thread
+	int			numThreads;		// started worker threads
+	void		*done;			// posted by a worker when its stripe is done
+	qboolean	quit;
+
+	void		(*job)( void *data, int index );
+	void		*data;
+	int			numJobs;
+	int			stride;
+} sv_botJobs;
+
+/*
+==================
+SV_BotRunStripe
+==================
+*/
+static void SV_BotRunStripe( botWorker_t *w ) {
+	int		i;
+
+	CM_SetThreadTraceContext( w->ctx );
+	for ( i = w->first ; i < sv_botJobs.numJobs ; i += sv_botJobs.stride ) {
+		sv_botJobs.job( sv_botJobs.data, i );
+	}
+	CM_SetThreadTraceContext( NULL );
+}
+
+/*
+==================
+SV_BotJobWorker
+==================
+*/
+static void SV_BotJobWorker( void *data ) {
+	botWorker_t	*w = data;
+
+	sv_botWorkerThread = qtrue;
+	for ( ;; ) {
+		Sys_WaitSemaphore( w->wake );
+		if ( sv_botJobs.quit ) {
+			break;
+		}
+		SV_BotRunStripe( w );
+		Sys_PostSemaphore( sv_botJobs.done );
+	}
+}
+
+/*
+==================
+SV_BotStopJobThreads
+==================
+*/
+static void SV_BotStopJobThreads( void ) {
+	botWorker_t	*w;
+	int			i;
+
+	sv_botJobs.quit = qtrue;
+	for ( i = 1 ; i <= sv_botJobs.numThreads ; i++ ) {
+		Sys_PostSemaphore( sv_botJobs.workers[i].wake );
+	}
+	for ( i = 1 ; i <= sv_botJobs.numThreads ; i++ ) {
+		w = &sv_botJobs.workers[i];
+		Sys_JoinThread( w->thread );
+		Sys_DestroySemaphore( w->wake );
+		if ( w->ctx ) {
+			CM_FreeTraceContext( w->ctx );
+		}
+		Com_Memset( w, 0, sizeof( *w ) );
+	}
+	sv_botJobs.numThreads = 0;
+	sv_botJobs.quit = qfalse;
+}
+
+/*
+==================
+SV_BotStartJobThreads
+
+Starts as many of the threads as the system lets it
+==================
+*/
+static void SV_BotStartJobThreads( int numThreads ) {
+	botWorker_t	*w;
+	int			i;
+
+	if ( !sv_botJobs.done ) {
+		sv_botJobs.done = Sys_CreateSemaphore();
+		sv_botPrintLock = Sys_CreateMutex();
+		if ( !sv_botJobs.done || !sv_botPrintLock ) {
+			Com_Error( ERR_FATAL, "SV_BotStartJobThreads: couldn't create semaphore" );
+		}
+	}
+
+	for ( i = 1 ; i <= numThreads ; i++ ) {
+		w = &sv_botJobs.workers[i];
+		w->first = i;
+		w->wake = Sys_CreateSemaphore();
+		if ( !w->wake ) {
+			break;
+		}
+		w->thread = Sys_CreateThread( SV_BotJobWorker, w );
+		if ( !w->thread ) {
+			Sys_DestroySemaphore( w->wake );
+			w->wake = NULL;
+			break;
+		}
+		sv_botJobs.numThreads++;
+	}
+}
+
+/*
+==================
+SV_BotJobThreads
+
+bot_threads is the number of threads besides the main one, 0 picks
+one per extra processor and a negative value runs everything serially.
+==================
+*/
+static int SV_BotJobThreads( void ) {
+	int		threads;
+
+	threads = bot_threads ? bot_threads->integer : -1;
+	if ( threads == 0 ) {
+		threads = Sys_NumProcessors() - 1;
+	}
+	if ( threads > MAX_BOT_THREADS - 1 ) {
+		threads = MAX_BOT_THREADS - 1;
+	}
+	return threads > 0 ? threads : 0;
+}
+
+/*
+==================
+SV_BotRunJobs
+==================
+*/
+static void SV_BotRunJobs( void (*job)( void *data, int index ), void *data, int numJobs ) {
+	botWorker_t	*w;
+	int			i, numThreads, wanted;
+
+	// the pool follows bot_threads, not the size of the batch
+	wanted = SV_BotJobThreads();
+	if ( wanted != sv_botJobs.numThreads ) {
+		SV_BotStopJobThreads();
+		SV_BotStartJobThreads( wanted );
+	}
+
+	numThreads = sv_botJobs.numThreads;
+	if ( numThreads > numJobs - 1 ) {
+		numThreads = numJobs - 1;
+	}
+	if ( numThreads <= 0 ) {
+		for ( i = 0 ; i < numJobs ; i++ ) {
+			job( data, i );
+		}
+		return;
+	}
+
+	for ( i = 1 ; i <= numThreads ; i++ ) {
+		w = &sv_botJobs.workers[i];
+		if ( w->ctx && !CM_TraceContextCurrent( w->ctx ) ) {
+			CM_FreeTraceContext( w->ctx );
+			w->ctx = NULL;
+		}
+		if ( !w->ctx ) {
+			w->ctx = CM_AllocTraceContext();
+		}
+	}
+
+	sv_botJobs.job = job;
+	sv_botJobs.data = data;
+	sv_botJobs.numJobs = numJobs;
+	sv_botJobs.stride = numThreads + 1;
+
+	SV_EnableWorkerTraces( qtrue );
+	for ( i = 1 ; i <= numThreads ; i++ ) {
+		Sys_PostSemaphore( sv_botJobs.workers[i].wake );
+	}
+	SV_BotRunStripe( &sv_botJobs.workers[0] );
+	for ( i = 1 ; i <= numThreads ; i++ ) {
+		Sys_WaitSemaphore( sv_botJobs.done );
+	}
+	SV_EnableWorkerTraces( qfalse );
+
+	SV_BotFlushPrints();
+}
+
 /*
 ===============
 SV_BotLibSetup
@@ -473,9 +758,74 @@ int SV_BotLibShutdown( void ) {
 		return -1;
 	}
 
+	SV_BotStopJobThreads();
+
 	return botlib_export->BotLibShutdown();
 }
 
+/*
+==================
+SV_BotPrecompute_f
+
+Loads the collision and AAS data of the given maps without starting a
+game and writes the bot routing caches for all their areas to
+maps/<map>.rcd, so the map pool can be warmed offline.
+==================
+*/
+void SV_BotPrecompute_f( void ) {
+	char	name[MAX_QPATH];
+	char	*mapname;
+	int		i, checksum, start, errnum, failed;
+
+	if ( Cmd_Argc() < 2 ) {
+		Com_Printf( "Usage: bot_precompute <map> [map ...]\n" );
+		return;
+	}
+
+	if ( com_sv_running->integer ) {
+		Com_Printf( "bot_precompute can't be used while a server is running.\n" );
+		return;
+	}
+
+	if ( !botlib_export ) {
+		Com_Printf( S_COLOR_RED "Error: bot_precompute without SV_BotInitBotLib\n" );
+		return;
+	}
+
+	failed = 0;
+	for ( i = 1 ; i < Cmd_Argc() ; i++ ) {
+		mapname = Cmd_Argv( i );
+		Com_sprintf( name, sizeof( name ), "maps/%s.bsp", mapname );
+		if ( FS_ReadFile( name, NULL ) <= 0 ) {
+			Com_Printf( S_COLOR_RED "Can't find map %s\n", name );
+			failed++;
+			continue;
+		}
+
+		start = Sys_Milliseconds();
+
+		Hunk_Clear();
+		CM_ClearMap();
+		CM_LoadMap( name, qfalse, &checksum );
+
+		botlib_export->BotLibVarSet( "basegame", com_basegame->string );
+		botlib_export->BotLibVarSet( "sv_mapChecksum", va( "%i", checksum ) );
+		errnum = botlib_export->BotLibPrecomputeRouting( mapname );
+
+		if ( errnum != BLERR_NOERROR ) {
+			Com_Printf( S_COLOR_RED "Couldn't precompute the routing of %s, error %d\n", mapname, errnum );
+			failed++;
+			continue;
+		}
+		Com_Printf( "%s routing precomputed in %d msec\n", mapname, Sys_Milliseconds() - start );
+	}
+
+	Hunk_Clear();
+	CM_ClearMap();
+
+	Com_Printf( "%d maps precomputed, %d failed\n", Cmd_Argc() - 1 - failed, failed );
+}
+
 /*
 ==================
 SV_BotInitCvars
@@ -513,6 +863,7 @@ void SV_BotInitCvars(void) {
 	Cvar_Get("bot_interbreedbots", "10", CVAR_CHEAT);	//number of bots used for interbreeding
 	Cvar_Get("bot_interbreedcycle", "20", CVAR_CHEAT);	//bot interbreeding cycle
 	Cvar_Get("bot_interbreedwrite", "", CVAR_CHEAT);	//write interbreeded bots to this file
+	bot_threads = Cvar_Get("bot_threads", "0", CVAR_ARCHIVE);	//extra threads for bot jobs, 0 = one per processor, -1 = none
 }
 
 /*
@@ -548,6 +899,8 @@ void SV_BotInitBotLib(void) {
 	botlib_import.FS_Write = FS_Write;
 	botlib_import.FS_FCloseFile = FS_FCloseFile;
 	botlib_import.FS_Seek = FS_Seek;
+	botlib_import.FS_MapFile = FS_MapFile;
+	botlib_import.FS_UnmapFile = FS_UnmapFile;
 
 	//debug lines
 	botlib_import.DebugLineCreate = BotImport_DebugLineCreate;
@@ -558,6 +911,13 @@ void SV_BotInitBotLib(void) {
 	botlib_import.DebugPolygonCreate = BotImport_DebugPolygonCreate;
 	botlib_import.DebugPolygonDelete = BotImport_DebugPolygonDelete;
 
+	//bot jobs
+	botlib_import.MutexCreate = Sys_CreateMutex;
+	botlib_import.MutexLock = Sys_LockMutex;
+	botlib_import.MutexUnlock = Sys_UnlockMutex;
+	botlib_import.MutexFree = Sys_DestroyMutex;
+	botlib_import.RunJobs = SV_BotRunJobs;
+
 	botlib_export = (botlib_export_t *)GetBotLibAPI( BOTLIB_API_VERSION, &botlib_import );
 	assert(botlib_export); 	// somehow we end up with a zero import.
 }
@@ -1922,6 +1922,11 @@ void SV_AddOperatorCommands( void ) {
 	Cmd_AddCommand ("dumpuser", SV_DumpUser_f);
 	Cmd_AddCommand ("map_restart", SV_MapRestart_f);
 	Cmd_AddCommand ("sectorlist", SV_SectorList_f);
+	Cmd_AddCommand ("tracestress", SV_TraceStress_f);
+	Cmd_AddCommand ("tracebatch", SV_TraceBatchBench_f);
+	Cmd_AddCommand ("entitybench", SV_EntityBench_f);
+	Cmd_AddCommand ("bot_precompute", SV_BotPrecompute_f);
+	Cmd_AddCommand ("framebench", SV_FrameBench_f);
 	Cmd_AddCommand ("map", SV_Map_f);
 	Cmd_SetCommandCompletionFunc( "map", SV_CompleteMapName );
 #ifndef PRE_RELEASE_DEMO
@@ -1972,6 +1977,10 @@ void SV_RemoveOperatorCommands( void ) {
 	Cmd_RemoveCommand ("dumpuser");
 	Cmd_RemoveCommand ("map_restart");
 	Cmd_RemoveCommand ("sectorlist");
+	Cmd_RemoveCommand ("tracestress");
+	Cmd_RemoveCommand ("tracebatch");
+	Cmd_RemoveCommand ("entitybench");
+	Cmd_RemoveCommand ("framebench");
 	Cmd_RemoveCommand ("say");
 	Cmd_RemoveCommand ("startserverdemo");
 	Cmd_RemoveCommand ("stopserverdemo");
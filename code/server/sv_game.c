@@ -303,12 +303,12 @@ static int	FloatAsInt( float f ) {
 
 /*
 ====================
-SV_GameSystemCalls
+SV_DispatchGameSystemCall
 
 The module is making a system call
 ====================
 */
-intptr_t SV_GameSystemCalls( intptr_t *args ) {
+static intptr_t SV_DispatchGameSystemCall( intptr_t *args ) {
 	switch( args[0] ) {
 	case G_PRINT:
 		Com_Printf( "%s", (const char*)VMA(1) );
@@ -391,6 +391,12 @@ intptr_t SV_GameSystemCalls( intptr_t *args ) {
 	case G_TRACECAPSULE:
 		SV_Trace( VMA(1), VMA(2), VMA(3), VMA(4), VMA(5), args[6], args[7], /*int capsule*/ qtrue );
 		return 0;
+	case G_TRACE_BATCH:
+		SV_TraceBatch( VMA(1), args[2], VMA(3), VMA(4), VMA(5), VMA(6), args[7], args[8], args[9] );
+		return 0;
+	case G_TRACE_FOR_CLIENT:
+		SV_TraceForClient( VMA(1), VMA(2), VMA(3), VMA(4), VMA(5), args[6], args[7], args[8] );
+		return 0;
 	case G_POINT_CONTENTS:
 		return SV_PointContents( VMA(1), args[2] );
 	case G_SET_BRUSH_MODEL:
@@ -543,6 +549,9 @@ intptr_t SV_GameSystemCalls( intptr_t *args ) {
 
 	case BOTLIB_AAS_AREA_TRAVEL_TIME_TO_GOAL_AREA:
 		return botlib_export->aas.AAS_AreaTravelTimeToGoalArea( args[1], VMA(2), args[3], args[4] );
+	case BOTLIB_AAS_AREA_TRAVEL_TIME_BATCH:
+		botlib_export->aas.AAS_AreaTravelTimeToGoalAreaBatch( VMA(1), args[2], VMA(3), VMA(4), VMA(5), args[6] );
+		return 0;
 	case BOTLIB_AAS_ENABLE_ROUTING_AREA:
 		return botlib_export->aas.AAS_EnableRoutingArea( args[1], args[2] );
 	case BOTLIB_AAS_PREDICT_ROUTE:
@@ -784,6 +793,9 @@ intptr_t SV_GameSystemCalls( intptr_t *args ) {
 	case BOTLIB_AI_MOVE_TO_GOAL:
 		botlib_export->ai.BotMoveToGoal( VMA(1), args[2], VMA(3), args[4] );
 		return 0;
+	case BOTLIB_AI_MOVE_TO_GOAL_BATCH:
+		botlib_export->ai.BotMoveToGoalBatch( VMA(1), args[2], VMA(3), VMA(4), VMA(5) );
+		return 0;
 	case BOTLIB_AI_MOVE_IN_DIRECTION:
 		return botlib_export->ai.BotMoveInDirection( args[1], VMA(2), VMF(3), args[4] );
 	case BOTLIB_AI_RESET_AVOID_REACH:
@@ -809,6 +821,9 @@ intptr_t SV_GameSystemCalls( intptr_t *args ) {
 
 	case BOTLIB_AI_CHOOSE_BEST_FIGHT_WEAPON:
 		return botlib_export->ai.BotChooseBestFightWeapon( args[1], VMA(2) );
+	case BOTLIB_AI_CHOOSE_BEST_FIGHT_WEAPON_BATCH:
+		botlib_export->ai.BotChooseBestFightWeaponBatch( VMA(1), args[2], VMA(3), VMA(4), args[5] );
+		return 0;
 	case BOTLIB_AI_GET_WEAPON_INFO:
 		botlib_export->ai.BotGetWeaponInfo( args[1], args[2], VMA(3) );
 		return 0;
@@ -895,6 +910,73 @@ intptr_t SV_GameSystemCalls( intptr_t *args ) {
 	return 0;
 }
 
+/*
+====================
+SV_BenchTimer
+
+Returns the frame benchmark counter the time of a system call is added
+to, or NULL if the call is counted as game time
+====================
+*/
+static int64_t *SV_BenchTimer( intptr_t call ) {
+	switch( call ) {
+	case G_TRACE:
+	case G_TRACECAPSULE:
+	case G_TRACE_BATCH:
+	case G_TRACE_FOR_CLIENT:
+	case G_POINT_CONTENTS:
+	case G_ENTITY_CONTACT:
+	case G_ENTITY_CONTACTCAPSULE:
+	case G_ENTITIES_IN_BOX:
+	case G_IN_PVS:
+	case G_IN_PVS_IGNORE_PORTALS:
+		return &sv_bench.collisionUsec;
+
+	// these run the client code of the game for the bot
+	case BOTLIB_USER_COMMAND:
+	case BOTLIB_EA_SAY:
+	case BOTLIB_EA_SAY_TEAM:
+	case BOTLIB_EA_COMMAND:
+		return NULL;
+	}
+
+	if ( call >= BOTLIB_SETUP && call <= BOTLIB_AI_CHOOSE_BEST_FIGHT_WEAPON_BATCH ) {
+		return &sv_bench.botlibUsec;
+	}
+	return NULL;
+}
+
+/*
+====================
+SV_GameSystemCalls
+
+While a frame benchmark runs, the time of the outermost botlib and
+collision calls is added up.  Anything they call back into the game
+is counted with them.
+====================
+*/
+intptr_t SV_GameSystemCalls( intptr_t *args ) {
+	int64_t		*timer, start;
+	intptr_t	ret;
+
+	if ( !sv_bench.active || sv_bench.depth ) {
+		return SV_DispatchGameSystemCall( args );
+	}
+
+	timer = SV_BenchTimer( args[0] );
+	if ( !timer ) {
+		return SV_DispatchGameSystemCall( args );
+	}
+
+	sv_bench.depth++;
+	start = Sys_Microseconds();
+	ret = SV_DispatchGameSystemCall( args );
+	*timer += Sys_Microseconds() - start;
+	sv_bench.depth--;
+
+	return ret;
+}
+
 /*
 ===============
 SV_ShutdownGameProgs
@@ -932,9 +1014,10 @@ static void SV_InitGameVM( qboolean restart ) {
 		svs.clients[i].gentity = NULL;
 	}
 	
-	// use the current msec count for a random seed
+	// use the current msec count for a random seed, unless a
+	// frame benchmark needs the same game every time
 	// init for this gamestate
-	VM_Call (gvm, GAME_INIT, sv.time, Com_Milliseconds(), restart);
+	VM_Call (gvm, GAME_INIT, sv.time, sv_bench.active ? sv_bench.seed : Com_Milliseconds(), restart);
 }
 
 
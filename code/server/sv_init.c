@@ -586,6 +586,9 @@ void SV_SpawnServer( char *server, qboolean killBots ) {
 	qboolean	isBot;
 	char		systemInfo[16384];
 	const char	*p;
+	int			startTime, fsTime, cmTime, gameTime, settleTime, baselineTime;
+
+	startTime = Sys_Milliseconds();
 
 	// shut down the existing game if it is running
 	SV_ShutdownGameProgs();
@@ -657,8 +660,10 @@ void SV_SpawnServer( char *server, qboolean killBots ) {
 	// get a new checksum feed and restart the file system
 	sv.checksumFeed = ( ((unsigned int)rand() << 16) ^ (unsigned int)rand() ) ^ Com_Milliseconds();
 	FS_SetMapName(server);
+	fsTime = Sys_Milliseconds();
 	FS_Restart( sv.checksumFeed );
 
+	cmTime = Sys_Milliseconds();
 	CM_LoadMap( va("maps/%s.bsp", server), qfalse, &checksum );
 
 	// set serverinfo visible name
@@ -673,6 +678,8 @@ void SV_SpawnServer( char *server, qboolean killBots ) {
 	Cvar_Set( "sv_serverid", va("%i", sv.serverId ) );
 
 	// clear physics interaction links
+	// Update latched value
+	Cvar_Get ("sv_entityTree", "0", CVAR_ARCHIVE | CVAR_LATCH);
 	SV_ClearWorld ();
 	
 	// media configstring setting should be done during
@@ -680,13 +687,15 @@ void SV_SpawnServer( char *server, qboolean killBots ) {
 	// to load during actual gameplay
 	sv.state = SS_LOADING;
 
-	// load and spawn all other entities
+	// load and spawn all other entities, the bots load their aas here
+	gameTime = Sys_Milliseconds();
 	SV_InitGameProgs();
 
 	// don't allow a map_restart if game is modified
 	sv_gametype->modified = qfalse;
 
 	// run a few frames to allow everything to settle
+	settleTime = Sys_Milliseconds();
 	for (i = 0;i < 3; i++)
 	{
 		VM_Call (gvm, GAME_RUN_FRAME, sv.time);
@@ -696,6 +705,7 @@ void SV_SpawnServer( char *server, qboolean killBots ) {
 	}
 
 	// create a baseline for more efficient communications
+	baselineTime = Sys_Milliseconds();
 	SV_CreateBaseline ();
 	
 	// stop server-side demo (if any)
@@ -850,6 +860,9 @@ void SV_SpawnServer( char *server, qboolean killBots ) {
 	}
 #endif
 
+	Com_Printf( "Server loaded in %i msec (shutdown %i, fs %i, cm %i, game %i, settle %i, rest %i)\n",
+		Sys_Milliseconds() - startTime, fsTime - startTime, cmTime - fsTime, gameTime - cmTime,
+		settleTime - gameTime, baselineTime - settleTime, Sys_Milliseconds() - baselineTime );
 	Com_Printf ("-----------------------------------\n");
 }
 
@@ -929,6 +942,8 @@ void SV_Init (void)
 	sv_sayprefix = Cvar_Get ("sv_sayprefix", "console: ", CVAR_ARCHIVE );
 	sv_tellprefix = Cvar_Get ("sv_tellprefix", "console_tell: ", CVAR_ARCHIVE );
 	sv_teamSwitch = Cvar_Get("sv_teamSwitch", "0", CVAR_ARCHIVE );
+	sv_entityTree = Cvar_Get("sv_entityTree", "0", CVAR_ARCHIVE | CVAR_LATCH );
+	sv_lagCompensation = Cvar_Get("sv_lagCompensation", "0", CVAR_ARCHIVE );
 	sv_extraPaks = Cvar_Get ("sv_extraPaks", "", CVAR_ARCHIVE | CVAR_LATCH);
 	sv_extraPure = Cvar_Get ("sv_extraPure", "0", CVAR_ARCHIVE | CVAR_LATCH);
 
@@ -1007,6 +1022,9 @@ void SV_Shutdown( char *finalmsg ) {
 
 	Com_Printf( "----- Server Shutdown (%s) -----\n", finalmsg );
 
+	// an error may have cut a frame benchmark short
+	sv_bench.active = qfalse;
+
 	NET_LeaveMulticast6();
 
 	// stop server-side demos (if any)
@@ -25,6 +25,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 serverStatic_t	svs;					// persistant server info
 server_t		sv;						// local server
 vm_t			*gvm = NULL;			// game virtual machine
+svBench_t		sv_bench;				// frame benchmark in progress
 
 cvar_t	*sv_fps = NULL;					// time rate for running non-clients
 cvar_t	*sv_timeout;					// seconds without any message
@@ -64,6 +65,8 @@ cvar_t	*sv_autoRecordDemo;				// automatically create a server demo of every pla
 cvar_t	*sv_tellprefix;
 cvar_t	*sv_sayprefix;
 cvar_t	*sv_teamSwitch;					// allow players to switch teams (0, Default = players must wait 5 seconds to switch, 1 = no restriction)
+cvar_t	*sv_entityTree;					// link entities into a dynamic bounding box tree instead of the world sectors
+cvar_t	*sv_lagCompensation;			// msec of entity history traces for a client may be rewound by, 0 = off
 
 #ifdef USE_VOIP
 cvar_t	*sv_voip;
@@ -1196,6 +1199,9 @@ void SV_Frame( int msec ) {
 
 		// let everything in the world think and move
 		VM_Call (gvm, GAME_RUN_FRAME, sv.time);
+
+		// remember where it all went for lag compensated traces
+		SV_RecordEntityHistory();
 	}
 
 	if ( com_speeds->integer ) {
@@ -1221,6 +1227,190 @@ void SV_Frame( int msec ) {
 
 }
 
+#define	MAX_BENCH_FRAMES	100000
+
+typedef enum {
+	BENCH_GAME,
+	BENCH_BOTLIB,
+	BENCH_COLLISION,
+	BENCH_SNAPSHOT,
+	BENCH_FRAME,
+	NUM_BENCH_TIMES
+} benchTime_t;
+
+static const char *sv_benchTimeNames[NUM_BENCH_TIMES] = {
+	"game", "botlib", "collision", "snapshot", "frame"
+};
+
+/*
+==================
+SV_CompareBenchTimes
+==================
+*/
+static int SV_CompareBenchTimes( const void *a, const void *b ) {
+	return *(const int *)a - *(const int *)b;
+}
+
+/*
+==================
+SV_BenchStateHash
+
+Hash of the entity states the game ended up with, so two runs can be
+checked for having simulated the same thing
+==================
+*/
+static unsigned SV_BenchStateHash( void ) {
+	sharedEntity_t	*ent;
+	const byte		*p;
+	unsigned		hash;
+	int				i, j;
+
+	hash = 2166136261u;
+	for ( i = 0 ; i < sv.num_entities ; i++ ) {
+		ent = SV_GentityNum( i );
+		if ( !ent->r.linked ) {
+			continue;
+		}
+		p = (const byte *)&ent->s;
+		for ( j = 0 ; j < (int)sizeof( ent->s ) ; j++ ) {
+			hash = ( hash ^ p[j] ) * 16777619u;
+		}
+	}
+	return hash;
+}
+
+/*
+==================
+SV_FrameBench_f
+
+Loads a map, adds bots with the addbot command of the game, which
+allocates them with SV_BotAllocateClient, and runs a fixed number of
+server frames back to back without waiting for real time.  The game
+and the C library are seeded with a fixed seed.  Prints how the frame
+time splits into game, botlib, collision and snapshot building, and
+optionally writes the timings of every frame to a file.
+==================
+*/
+void SV_FrameBench_f( void ) {
+	char			mapname[MAX_QPATH], logname[MAX_QPATH];
+	cvar_t			*bot;
+	fileHandle_t	f;
+	int				*times[NUM_BENCH_TIMES], *sorted;
+	int64_t			start, snapshotStart, end, total;
+	int				numBots, numFrames, frameMsec;
+	int				i, j, n;
+
+	if ( Cmd_Argc() < 4 ) {
+		Com_Printf( "Usage: framebench <map> <bots> <frames> [seed] [logfile]\n" );
+		return;
+	}
+
+	Q_strncpyz( mapname, Cmd_Argv( 1 ), sizeof( mapname ) );
+	numBots = Com_Clamp( 0, MAX_CLIENTS, atoi( Cmd_Argv( 2 ) ) );
+	numFrames = Com_Clamp( 1, MAX_BENCH_FRAMES, atoi( Cmd_Argv( 3 ) ) );
+	Q_strncpyz( logname, Cmd_Argc() > 5 ? Cmd_Argv( 5 ) : "", sizeof( logname ) );
+
+	// botname and skill handed to addbot
+	bot = Cvar_Get( "sv_benchBot", "boa 3", 0 );
+
+	Com_Memset( &sv_bench, 0, sizeof( sv_bench ) );
+	sv_bench.active = qtrue;
+	sv_bench.seed = Cmd_Argc() > 4 ? atoi( Cmd_Argv( 4 ) ) : 0;
+	srand( sv_bench.seed );
+
+	Cmd_ExecuteString( va( "map %s", mapname ) );
+	if ( !com_sv_running->integer || !gvm ) {
+		Com_Printf( "framebench: couldn't load %s\n", mapname );
+		sv_bench.active = qfalse;
+		return;
+	}
+
+	for ( i = 0 ; i < numBots ; i++ ) {
+		Cmd_ExecuteString( va( "addbot %s", bot->string ) );
+	}
+	for ( i = 0, n = 0 ; i < sv_maxclients->integer ; i++ ) {
+		if ( svs.clients[i].state >= CS_CONNECTED && svs.clients[i].netchan.remoteAddress.type == NA_BOT ) {
+			n++;
+		}
+	}
+	if ( n < numBots ) {
+		Com_Printf( S_COLOR_YELLOW "framebench: only %i of %i bots were added\n", n, numBots );
+	}
+	numBots = n;
+
+	if ( sv_fps->integer < 1 ) {
+		Cvar_Set( "sv_fps", "10" );
+	}
+	frameMsec = 1000 / sv_fps->integer;
+
+	for ( i = 0 ; i < NUM_BENCH_TIMES ; i++ ) {
+		times[i] = Z_Malloc( numFrames * sizeof( int ) );
+	}
+
+	// same steps as SV_Frame for a dedicated server, one game frame at a time
+	for ( i = 0 ; i < numFrames ; i++ ) {
+		sv_bench.botlibUsec = 0;
+		sv_bench.collisionUsec = 0;
+
+		start = Sys_Microseconds();
+
+		SV_BotFrame( sv.time );
+
+		svs.time += frameMsec;
+		sv.time += frameMsec;
+		VM_Call( gvm, GAME_RUN_FRAME, sv.time );
+		SV_RecordEntityHistory();
+
+		snapshotStart = Sys_Microseconds();
+		SV_SendClientMessages();
+		end = Sys_Microseconds();
+
+		times[BENCH_BOTLIB][i] = sv_bench.botlibUsec;
+		times[BENCH_COLLISION][i] = sv_bench.collisionUsec;
+		times[BENCH_GAME][i] = snapshotStart - start - sv_bench.botlibUsec - sv_bench.collisionUsec;
+		times[BENCH_SNAPSHOT][i] = end - snapshotStart;
+		times[BENCH_FRAME][i] = end - start;
+	}
+
+	sv_bench.active = qfalse;
+
+	Com_Printf( "%i frames of %i msec with %i bots on %s, seed %i\n",
+		numFrames, frameMsec, numBots, mapname, sv_bench.seed );
+	Com_Printf( "usec          mean      p50      p99      max\n" );
+	sorted = Z_Malloc( numFrames * sizeof( int ) );
+	for ( i = 0 ; i < NUM_BENCH_TIMES ; i++ ) {
+		Com_Memcpy( sorted, times[i], numFrames * sizeof( int ) );
+		qsort( sorted, numFrames, sizeof( int ), SV_CompareBenchTimes );
+		for ( j = 0, total = 0 ; j < numFrames ; j++ ) {
+			total += sorted[j];
+		}
+		Com_Printf( "%-10s %7i  %7i  %7i  %7i\n", sv_benchTimeNames[i], (int)( total / numFrames ),
+			sorted[numFrames / 2], sorted[numFrames * 99 / 100], sorted[numFrames - 1] );
+	}
+	Z_Free( sorted );
+	Com_Printf( "state hash %08x\n", SV_BenchStateHash() );
+
+	if ( logname[0] ) {
+		f = FS_FOpenFileWrite( logname );
+		if ( f ) {
+			FS_Printf( f, "frame,%s,%s,%s,%s,%s\n", sv_benchTimeNames[0], sv_benchTimeNames[1],
+				sv_benchTimeNames[2], sv_benchTimeNames[3], sv_benchTimeNames[4] );
+			for ( i = 0 ; i < numFrames ; i++ ) {
+				FS_Printf( f, "%i,%i,%i,%i,%i,%i\n", i, times[BENCH_GAME][i], times[BENCH_BOTLIB][i],
+					times[BENCH_COLLISION][i], times[BENCH_SNAPSHOT][i], times[BENCH_FRAME][i] );
+			}
+			FS_FCloseFile( f );
+			Com_Printf( "wrote %s\n", logname );
+		} else {
+			Com_Printf( S_COLOR_RED "framebench: couldn't write %s\n", logname );
+		}
+	}
+
+	for ( i = 0 ; i < NUM_BENCH_TIMES ; i++ ) {
+		Z_Free( times[i] );
+	}
+}
+
 /*
 ====================
 SV_RateMsec
@@ -303,6 +303,65 @@ static void SV_AddEntToSnapshot( svEntity_t *svEnt, sharedEntity_t *gEnt, snapsh
 	eNums->numSnapshotEntities++;
 }
 
+/*
+===============
+SV_ClusterBitsVisible
+
+Tests the packed cluster bits of an entity against a pvs or phs row.
+===============
+*/
+static qboolean SV_ClusterBitsVisible( const svEntity_t *svEnt, const byte *bitvector ) {
+	const unsigned	*row;
+	int				i;
+
+	row = (const unsigned *)bitvector + svEnt->clusterWord;
+	for ( i = 0 ; i < svEnt->numClusterWords ; i++ ) {
+		if ( svEnt->clusterBits[i] & row[i] ) {
+			return qtrue;
+		}
+	}
+	return qfalse;
+}
+
+/*
+===============
+SV_ClusterListVisible
+
+Tests the clusters of an entity one by one, for entities that spread
+over too many clusters to pack.
+===============
+*/
+static qboolean SV_ClusterListVisible( const svEntity_t *svEnt, const byte *bitvector ) {
+	int		i, l;
+
+	// check individual leafs
+	if ( !svEnt->numClusters ) {
+		return qfalse;
+	}
+	l = 0;
+	for ( i=0 ; i < svEnt->numClusters ; i++ ) {
+		l = svEnt->clusternums[i];
+		if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
+			return qtrue;
+		}
+	}
+
+	// if we haven't found it to be visible,
+	// check overflow clusters that coudln't be stored
+	if ( svEnt->lastCluster ) {
+		for ( ; l <= svEnt->lastCluster ; l++ ) {
+			if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
+				break;
+			}
+		}
+		if ( l == svEnt->lastCluster ) {
+			return qfalse;	// not visible
+		}
+		return qtrue;
+	}
+	return qfalse;
+}
+
 /*
 ===============
 SV_AddEntitiesVisibleFromPoint
@@ -310,13 +369,12 @@ SV_AddEntitiesVisibleFromPoint
 */
 static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *frame, 
 									snapshotEntityNumbers_t *eNums, qboolean portal ) {
-	int		e, i;
+	int		e;
 	sharedEntity_t *ent;
 	svEntity_t	*svEnt;
-	int		l;
 	int		clientarea, clientcluster;
 	int		leafnum;
-	byte	*clientpvs;
+	byte	*clientpvs, *clientphs;
 	byte	*bitvector;
 
 	// during an error shutdown message we may need to transmit
@@ -334,6 +392,7 @@ static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *fra
 	frame->areabytes = CM_WriteAreaBits( frame->areabits, clientarea );
 
 	clientpvs = CM_ClusterPVS (clientcluster);
+	clientphs = CM_ClusterPHS (clientcluster);
 
 	for ( e = 0 ; e < sv.num_entities ; e++ ) {
 		ent = SV_GentityNum(e);
@@ -396,35 +455,18 @@ static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *fra
 			}
 		}
 
-		bitvector = clientpvs;
-
-		// check individual leafs
-		if ( !svEnt->numClusters ) {
-			continue;
-		}
-		l = 0;
-		for ( i=0 ; i < svEnt->numClusters ; i++ ) {
-			l = svEnt->clusternums[i];
-			if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
-				break;
-			}
+		if ( ent->r.svFlags & SVF_PHS ) {
+			bitvector = clientphs;
+		} else {
+			bitvector = clientpvs;
 		}
 
-		// if we haven't found it to be visible,
-		// check overflow clusters that coudln't be stored
-		if ( i == svEnt->numClusters ) {
-			if ( svEnt->lastCluster ) {
-				for ( ; l <= svEnt->lastCluster ; l++ ) {
-					if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
-						break;
-					}
-				}
-				if ( l == svEnt->lastCluster ) {
-					continue;	// not visible
-				}
-			} else {
+		if ( svEnt->numClusterWords ) {
+			if ( !SV_ClusterBitsVisible( svEnt, bitvector ) ) {
 				continue;
 			}
+		} else if ( !SV_ClusterListVisible( svEnt, bitvector ) ) {
+			continue;
 		}
 
 		// add it
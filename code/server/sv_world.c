@@ -75,6 +75,542 @@ worldSector_t	sv_worldSectors[AREA_NODES];
 int			sv_numworldSectors;
 
 
+/*
+===============================================================================
+
+ENTITY TREE
+
+With sv_entityTree set, entities are linked into a dynamic bounding box
+tree instead of the world sectors.  Every linked entity is a leaf with
+its absmin / absmax grown by a margin, so an entity that moves a little
+stays in its leaf, and the tree is kept balanced with rotations as
+leafs come and go.  Unlike the sectors it doesn't depend on the world
+size, and big entities don't end up in a long list at the top node.
+
+===============================================================================
+*/
+
+#define	ENTITY_TREE_NODES	( 2 * MAX_GENTITIES )
+#define	ENTITY_TREE_MARGIN	8
+#define	ENTITY_TREE_STACK	128
+
+typedef struct entityTreeNode_s {
+	vec3_t		mins, maxs;
+	struct entityTreeNode_s	*parent;		// next free node when not in use
+	struct entityTreeNode_s	*children[2];	// NULL for leafs
+	svEntity_t	*ent;						// leafs only
+	int			height;						// leafs are 0
+} entityTreeNode_t;
+
+static entityTreeNode_t	sv_entityTreeNodes[ENTITY_TREE_NODES];
+static entityTreeNode_t	*sv_entityTreeRoot;
+static entityTreeNode_t	*sv_entityTreeFree;
+static qboolean			sv_useEntityTree;
+
+/*
+===============
+SV_EntityTreeClear
+===============
+*/
+static void SV_EntityTreeClear( void ) {
+	int		i;
+
+	Com_Memset( sv_entityTreeNodes, 0, sizeof( sv_entityTreeNodes ) );
+	for ( i = 0 ; i < ENTITY_TREE_NODES - 1 ; i++ ) {
+		sv_entityTreeNodes[i].parent = &sv_entityTreeNodes[i+1];
+	}
+	sv_entityTreeFree = sv_entityTreeNodes;
+	sv_entityTreeRoot = NULL;
+}
+
+/*
+===============
+SV_EntityTreeAllocNode
+===============
+*/
+static entityTreeNode_t *SV_EntityTreeAllocNode( void ) {
+	entityTreeNode_t	*node;
+
+	// every entity takes at most two nodes, so this can't run out
+	node = sv_entityTreeFree;
+	sv_entityTreeFree = node->parent;
+
+	Com_Memset( node, 0, sizeof( *node ) );
+	return node;
+}
+
+/*
+===============
+SV_EntityTreeFreeNode
+===============
+*/
+static void SV_EntityTreeFreeNode( entityTreeNode_t *node ) {
+	node->parent = sv_entityTreeFree;
+	sv_entityTreeFree = node;
+}
+
+/*
+===============
+SV_BoxCost
+
+Surface area of a box, what it costs to have it in the tree
+===============
+*/
+static float SV_BoxCost( const vec3_t mins, const vec3_t maxs ) {
+	vec3_t	size;
+
+	VectorSubtract( maxs, mins, size );
+	return 2 * ( size[0] * size[1] + size[1] * size[2] + size[2] * size[0] );
+}
+
+/*
+===============
+SV_CombineBoxes
+===============
+*/
+static void SV_CombineBoxes( const vec3_t mins1, const vec3_t maxs1, const vec3_t mins2, const vec3_t maxs2, vec3_t mins, vec3_t maxs ) {
+	int		i;
+
+	for ( i = 0 ; i < 3 ; i++ ) {
+		mins[i] = mins1[i] < mins2[i] ? mins1[i] : mins2[i];
+		maxs[i] = maxs1[i] > maxs2[i] ? maxs1[i] : maxs2[i];
+	}
+}
+
+/*
+===============
+SV_EntityTreeRefit
+
+Recomputes the bounds and height of an inner node from its children
+===============
+*/
+static void SV_EntityTreeRefit( entityTreeNode_t *node ) {
+	entityTreeNode_t	*a, *b;
+
+	a = node->children[0];
+	b = node->children[1];
+	SV_CombineBoxes( a->mins, a->maxs, b->mins, b->maxs, node->mins, node->maxs );
+	node->height = 1 + ( a->height > b->height ? a->height : b->height );
+}
+
+/*
+===============
+SV_EntityTreeBalance
+
+If one child of node is more than one level taller than the other,
+rotates the taller child up into node's place.  Returns the node
+that ends up at the top of the subtree.
+===============
+*/
+static entityTreeNode_t *SV_EntityTreeBalance( entityTreeNode_t *a ) {
+	entityTreeNode_t	*up, *other, *f, *g;
+	int					side, balance;
+
+	if ( !a->children[0] || a->height < 2 ) {
+		return a;
+	}
+
+	balance = a->children[1]->height - a->children[0]->height;
+	if ( balance > 1 ) {
+		side = 1;
+	} else if ( balance < -1 ) {
+		side = 0;
+	} else {
+		return a;
+	}
+
+	// the taller child of a takes a's place, a becomes its first child,
+	// and the shorter of its children goes over to a
+	up = a->children[side];
+	other = a->children[!side];
+	f = up->children[0];
+	g = up->children[1];
+
+	up->children[0] = a;
+	up->parent = a->parent;
+	a->parent = up;
+
+	if ( up->parent ) {
+		if ( up->parent->children[0] == a ) {
+			up->parent->children[0] = up;
+		} else {
+			up->parent->children[1] = up;
+		}
+	} else {
+		sv_entityTreeRoot = up;
+	}
+
+	if ( f->height < g->height ) {
+		up->children[1] = g;
+		a->children[side] = f;
+		f->parent = a;
+	} else {
+		up->children[1] = f;
+		a->children[side] = g;
+		g->parent = a;
+	}
+	a->children[!side] = other;
+
+	SV_EntityTreeRefit( a );
+	SV_EntityTreeRefit( up );
+
+	return up;
+}
+
+/*
+===============
+SV_EntityTreeFixUpwards
+
+Refits and rebalances every node from node up to the root
+===============
+*/
+static void SV_EntityTreeFixUpwards( entityTreeNode_t *node ) {
+	while ( node ) {
+		node = SV_EntityTreeBalance( node );
+		SV_EntityTreeRefit( node );
+		node = node->parent;
+	}
+}
+
+/*
+===============
+SV_EntityTreeInsertLeaf
+
+Puts the leaf next to the node that grows the tree's total box
+surface the least
+===============
+*/
+static void SV_EntityTreeInsertLeaf( entityTreeNode_t *leaf ) {
+	entityTreeNode_t	*sibling, *oldParent, *newParent, *child;
+	vec3_t				mins, maxs;
+	float				cost, inheritCost, childCost[2];
+	int					i;
+
+	if ( !sv_entityTreeRoot ) {
+		sv_entityTreeRoot = leaf;
+		leaf->parent = NULL;
+		return;
+	}
+
+	sibling = sv_entityTreeRoot;
+	while ( sibling->children[0] ) {
+		SV_CombineBoxes( sibling->mins, sibling->maxs, leaf->mins, leaf->maxs, mins, maxs );
+
+		// cost of making a new parent for this node and the leaf
+		cost = 2 * SV_BoxCost( mins, maxs );
+
+		// minimum cost of pushing the leaf further down the tree
+		inheritCost = 2 * ( SV_BoxCost( mins, maxs ) - SV_BoxCost( sibling->mins, sibling->maxs ) );
+
+		for ( i = 0 ; i < 2 ; i++ ) {
+			child = sibling->children[i];
+			SV_CombineBoxes( child->mins, child->maxs, leaf->mins, leaf->maxs, mins, maxs );
+			childCost[i] = SV_BoxCost( mins, maxs ) + inheritCost;
+			if ( child->children[0] ) {
+				childCost[i] -= SV_BoxCost( child->mins, child->maxs );
+			}
+		}
+
+		if ( cost < childCost[0] && cost < childCost[1] ) {
+			break;
+		}
+		sibling = sibling->children[ childCost[1] < childCost[0] ];
+	}
+
+	oldParent = sibling->parent;
+	newParent = SV_EntityTreeAllocNode();
+	newParent->parent = oldParent;
+	newParent->children[0] = sibling;
+	newParent->children[1] = leaf;
+	sibling->parent = newParent;
+	leaf->parent = newParent;
+
+	if ( oldParent ) {
+		if ( oldParent->children[0] == sibling ) {
+			oldParent->children[0] = newParent;
+		} else {
+			oldParent->children[1] = newParent;
+		}
+	} else {
+		sv_entityTreeRoot = newParent;
+	}
+
+	SV_EntityTreeFixUpwards( newParent );
+}
+
+/*
+===============
+SV_EntityTreeRemoveLeaf
+
+Takes the leaf out and puts its sibling in the place of their parent
+===============
+*/
+static void SV_EntityTreeRemoveLeaf( entityTreeNode_t *leaf ) {
+	entityTreeNode_t	*parent, *grandParent, *sibling;
+
+	if ( leaf == sv_entityTreeRoot ) {
+		sv_entityTreeRoot = NULL;
+		return;
+	}
+
+	parent = leaf->parent;
+	grandParent = parent->parent;
+	sibling = parent->children[ parent->children[0] == leaf ];
+
+	sibling->parent = grandParent;
+	if ( grandParent ) {
+		if ( grandParent->children[0] == parent ) {
+			grandParent->children[0] = sibling;
+		} else {
+			grandParent->children[1] = sibling;
+		}
+	} else {
+		sv_entityTreeRoot = sibling;
+	}
+	SV_EntityTreeFreeNode( parent );
+
+	SV_EntityTreeFixUpwards( grandParent );
+}
+
+/*
+===============
+SV_EntityTreeLink
+
+Links the entity with the given bounds, leaving the tree alone
+if they still fit in the grown bounds of its leaf
+===============
+*/
+static void SV_EntityTreeLink( svEntity_t *ent, const vec3_t absmin, const vec3_t absmax ) {
+	entityTreeNode_t	*leaf;
+	int					i;
+
+	leaf = ent->entityTreeNode;
+	if ( leaf ) {
+		if ( leaf->mins[0] <= absmin[0] && leaf->mins[1] <= absmin[1] && leaf->mins[2] <= absmin[2]
+			&& leaf->maxs[0] >= absmax[0] && leaf->maxs[1] >= absmax[1] && leaf->maxs[2] >= absmax[2] ) {
+			return;
+		}
+		SV_EntityTreeRemoveLeaf( leaf );
+	} else {
+		leaf = SV_EntityTreeAllocNode();
+		leaf->ent = ent;
+		ent->entityTreeNode = leaf;
+	}
+
+	for ( i = 0 ; i < 3 ; i++ ) {
+		leaf->mins[i] = absmin[i] - ENTITY_TREE_MARGIN;
+		leaf->maxs[i] = absmax[i] + ENTITY_TREE_MARGIN;
+	}
+	SV_EntityTreeInsertLeaf( leaf );
+}
+
+/*
+===============
+SV_EntityTreeUnlink
+===============
+*/
+static void SV_EntityTreeUnlink( svEntity_t *ent ) {
+	entityTreeNode_t	*leaf;
+
+	leaf = ent->entityTreeNode;
+	if ( !leaf ) {
+		return;
+	}
+	ent->entityTreeNode = NULL;
+
+	SV_EntityTreeRemoveLeaf( leaf );
+	SV_EntityTreeFreeNode( leaf );
+}
+
+/*
+===============================================================================
+
+ENTITY HISTORY
+
+With sv_lagCompensation set, the position and size of every linked
+non-bmodel entity is recorded after each game frame.  SV_TraceAtTime
+clips against the recorded entities where they were at an earlier
+server time instead of where they are now, so a shot can be checked
+against what the shooting client actually saw.  Nothing is relinked:
+the rewound positions only ever live on the stack of the trace.
+
+===============================================================================
+*/
+
+#define	ENTITY_HISTORY_FRAMES	32		// must be a power of two
+
+typedef struct {
+	int			time;
+	vec3_t		origin;
+	vec3_t		mins, maxs;
+} entityHistoryRecord_t;
+
+typedef struct {
+	int			numRecords;		// 0 when not recorded last frame
+	int			head;			// newest record
+	entityHistoryRecord_t	records[ENTITY_HISTORY_FRAMES];
+} entityHistory_t;
+
+static entityHistory_t	sv_entityHistory[MAX_GENTITIES];
+static int				sv_historyEntities[MAX_GENTITIES];
+static int				sv_numHistoryEntities;
+
+/*
+===============
+SV_ClearEntityHistory
+===============
+*/
+static void SV_ClearEntityHistory( void ) {
+	Com_Memset( sv_entityHistory, 0, sizeof( sv_entityHistory ) );
+	sv_numHistoryEntities = 0;
+}
+
+/*
+===============
+SV_RecordEntityHistory
+
+Called after every game frame.  An entity that isn't linked at the end
+of a frame loses its history, so a reused slot never rewinds into the
+previous owner.
+===============
+*/
+void SV_RecordEntityHistory( void ) {
+	int				i;
+	sharedEntity_t	*gEnt;
+	entityHistory_t	*hist;
+	entityHistoryRecord_t	*rec;
+
+	if ( !sv_lagCompensation->integer ) {
+		if ( sv_numHistoryEntities ) {
+			SV_ClearEntityHistory();
+		}
+		return;
+	}
+
+	sv_numHistoryEntities = 0;
+	for ( i = 0 ; i < sv.num_entities ; i++ ) {
+		gEnt = SV_GentityNum( i );
+		hist = &sv_entityHistory[i];
+
+		if ( !gEnt->r.linked || gEnt->r.bmodel || !gEnt->r.contents ) {
+			hist->numRecords = 0;
+			continue;
+		}
+
+		hist->head = ( hist->head + 1 ) & ( ENTITY_HISTORY_FRAMES - 1 );
+		if ( hist->numRecords < ENTITY_HISTORY_FRAMES ) {
+			hist->numRecords++;
+		}
+
+		rec = &hist->records[hist->head];
+		rec->time = sv.time;
+		VectorCopy( gEnt->r.currentOrigin, rec->origin );
+		VectorCopy( gEnt->r.mins, rec->mins );
+		VectorCopy( gEnt->r.maxs, rec->maxs );
+
+		sv_historyEntities[sv_numHistoryEntities++] = i;
+	}
+}
+
+/*
+===============
+SV_EntityHistoryAt
+
+Returns qfalse if the entity isn't being recorded.  Otherwise fills in
+where it was at the given time, interpolating between the two frames
+around it.  Times past the newest record give the live position and
+times before the oldest one give the oldest.
+===============
+*/
+static qboolean SV_EntityHistoryAt( int entityNum, int time, vec3_t origin, vec3_t mins, vec3_t maxs ) {
+	entityHistory_t	*hist;
+	entityHistoryRecord_t	*older, *newer;
+	sharedEntity_t	*gEnt;
+	int				i;
+	float			frac;
+
+	hist = &sv_entityHistory[entityNum];
+	if ( !hist->numRecords ) {
+		return qfalse;
+	}
+
+	newer = &hist->records[hist->head];
+	if ( time >= newer->time ) {
+		gEnt = SV_GentityNum( entityNum );
+		VectorCopy( gEnt->r.currentOrigin, origin );
+		VectorCopy( gEnt->r.mins, mins );
+		VectorCopy( gEnt->r.maxs, maxs );
+		return qtrue;
+	}
+
+	older = newer;
+	for ( i = 1 ; i < hist->numRecords ; i++ ) {
+		older = &hist->records[( hist->head - i ) & ( ENTITY_HISTORY_FRAMES - 1 )];
+		if ( older->time <= time ) {
+			break;
+		}
+		newer = older;
+	}
+
+	if ( older == newer || older->time > time ) {
+		VectorCopy( older->origin, origin );
+		VectorCopy( older->mins, mins );
+		VectorCopy( older->maxs, maxs );
+		return qtrue;
+	}
+
+	frac = (float)( time - older->time ) / ( newer->time - older->time );
+	for ( i = 0 ; i < 3 ; i++ ) {
+		origin[i] = older->origin[i] + frac * ( newer->origin[i] - older->origin[i] );
+	}
+	// the size can't be blended, so take the frame that was showing
+	if ( frac < 0.5f ) {
+		VectorCopy( older->mins, mins );
+		VectorCopy( older->maxs, maxs );
+	} else {
+		VectorCopy( newer->mins, mins );
+		VectorCopy( newer->maxs, maxs );
+	}
+	return qtrue;
+}
+
+/*
+===============
+SV_ClientViewTime
+
+The server time the client was looking at when it sent its last
+command, clamped to sv_lagCompensation msec back.  The command time
+is what the client had interpolated to; a client whose command time
+is out of range is rewound by its ping instead.
+===============
+*/
+int SV_ClientViewTime( int clientNum ) {
+	client_t	*cl;
+	int			time, oldest;
+
+	if ( !sv_lagCompensation->integer || clientNum < 0 || clientNum >= sv_maxclients->integer ) {
+		return sv.time;
+	}
+
+	cl = &svs.clients[clientNum];
+	if ( cl->state != CS_ACTIVE ) {
+		return sv.time;
+	}
+
+	oldest = sv.time - sv_lagCompensation->integer;
+	time = cl->lastUsercmd.serverTime;
+	if ( time > sv.time || time < oldest ) {
+		time = sv.time - cl->ping;
+	}
+
+	if ( time < oldest ) {
+		time = oldest;
+	} else if ( time > sv.time ) {
+		time = sv.time;
+	}
+	return time;
+}
+
 /*
 ===============
 SV_SectorList_f
@@ -85,6 +621,18 @@ void SV_SectorList_f( void ) {
 	worldSector_t	*sec;
 	svEntity_t		*ent;
 
+	if ( sv_useEntityTree ) {
+		c = 0;
+		for ( i = 0 ; i < MAX_GENTITIES ; i++ ) {
+			if ( sv.svEntities[i].entityTreeNode ) {
+				c++;
+			}
+		}
+		Com_Printf( "entity tree: %i entities, height %i\n", c,
+			sv_entityTreeRoot ? sv_entityTreeRoot->height : 0 );
+		return;
+	}
+
 	for ( i = 0 ; i < AREA_NODES ; i++ ) {
 		sec = &sv_worldSectors[i];
 
@@ -96,6 +644,246 @@ void SV_SectorList_f( void ) {
 	}
 }
 
+#define	MAX_STRESS_THREADS	16
+
+typedef struct {
+	vec3_t			start, end;
+	vec3_t			mins, maxs;
+	vec3_t			angles;
+	clipHandle_t	model;
+	int				brushmask;
+	int				capsule;
+	trace_t			serial;			// result of the main thread trace
+} stressTrace_t;
+
+typedef struct {
+	cmTraceContext_t	*ctx;
+	stressTrace_t		*traces;
+	int					numTraces;
+	int					first;		// each worker starts somewhere else
+	int					mismatches;
+} stressWorker_t;
+
+/*
+===============
+SV_StressTrace
+===============
+*/
+static void SV_StressTrace( cmTraceContext_t *ctx, stressTrace_t *t, trace_t *tr ) {
+	if ( ctx ) {
+		CM_TransformedBoxTraceContext( ctx, tr, t->start, t->end, t->mins, t->maxs,
+			t->model, t->brushmask, vec3_origin, t->angles, t->capsule );
+	} else {
+		CM_TransformedBoxTrace( tr, t->start, t->end, t->mins, t->maxs,
+			t->model, t->brushmask, vec3_origin, t->angles, t->capsule );
+	}
+}
+
+/*
+===============
+SV_TracesDiffer
+===============
+*/
+static qboolean SV_TracesDiffer( const trace_t *a, const trace_t *b ) {
+	return a->fraction != b->fraction
+		|| a->allsolid != b->allsolid
+		|| a->startsolid != b->startsolid
+		|| a->contents != b->contents
+		|| a->surfaceFlags != b->surfaceFlags
+		|| !VectorCompare( a->endpos, b->endpos )
+		|| !VectorCompare( a->plane.normal, b->plane.normal );
+}
+
+/*
+===============
+SV_TraceStressWorker
+===============
+*/
+static void SV_TraceStressWorker( void *data ) {
+	stressWorker_t	*w = data;
+	stressTrace_t	*t;
+	trace_t			tr;
+	int				i;
+
+	for ( i = 0 ; i < w->numTraces ; i++ ) {
+		t = &w->traces[ ( w->first + i ) % w->numTraces ];
+		SV_StressTrace( w->ctx, t, &tr );
+
+		if ( SV_TracesDiffer( &tr, &t->serial ) ) {
+			w->mismatches++;
+		}
+	}
+}
+
+/*
+===============
+SV_TraceStress_f
+
+Runs a set of random traces on the main thread, then runs the same
+set from several threads at once with their own trace contexts and
+counts the results that differ.
+===============
+*/
+void SV_TraceStress_f( void ) {
+	stressWorker_t	workers[MAX_STRESS_THREADS];
+	void			*threads[MAX_STRESS_THREADS];
+	stressTrace_t	*traces, *t;
+	vec3_t			mins, maxs;
+	int				numTraces, numThreads, numModels;
+	int				i, j, start, serialMsec, threadMsec, mismatches;
+
+	if ( !com_sv_running->integer ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+
+	numTraces = Cmd_Argc() > 1 ? atoi( Cmd_Argv( 1 ) ) : 10000;
+	numTraces = Com_Clamp( 1, 100000, numTraces );
+	numThreads = Cmd_Argc() > 2 ? atoi( Cmd_Argv( 2 ) ) : Sys_NumProcessors();
+	numThreads = Com_Clamp( 1, MAX_STRESS_THREADS, numThreads );
+
+	CM_ModelBounds( 0, mins, maxs );
+	numModels = CM_NumInlineModels();
+
+	traces = Hunk_AllocateTempMemory( numTraces * sizeof( *traces ) );
+	Com_Memset( traces, 0, numTraces * sizeof( *traces ) );
+
+	for ( i = 0, t = traces ; i < numTraces ; i++, t++ ) {
+		for ( j = 0 ; j < 3 ; j++ ) {
+			t->start[j] = mins[j] + random() * ( maxs[j] - mins[j] );
+			t->end[j] = ( i & 7 ) ? t->start[j] + crandom() * 512 : t->start[j];
+		}
+		if ( i & 1 ) {
+			VectorSet( t->mins, -15, -15, -24 );
+			VectorSet( t->maxs, 15, 15, 32 );
+		}
+		t->model = ( i & 3 ) || numModels < 2 ? 0 : 1 + rand() % ( numModels - 1 );
+		if ( t->model ) {
+			t->angles[YAW] = random() * 360;
+		}
+		t->brushmask = ( i & 2 ) ? CONTENTS_SOLID : -1;
+		t->capsule = ( i % 5 ) == 0;
+	}
+
+	start = Sys_Milliseconds();
+	for ( i = 0 ; i < numTraces ; i++ ) {
+		SV_StressTrace( NULL, &traces[i], &traces[i].serial );
+	}
+	serialMsec = Sys_Milliseconds() - start;
+
+	for ( i = 0 ; i < numThreads ; i++ ) {
+		workers[i].ctx = CM_AllocTraceContext();
+		workers[i].traces = traces;
+		workers[i].numTraces = numTraces;
+		workers[i].first = i * numTraces / numThreads;
+		workers[i].mismatches = 0;
+	}
+
+	start = Sys_Milliseconds();
+	for ( i = 0 ; i < numThreads ; i++ ) {
+		threads[i] = Sys_CreateThread( SV_TraceStressWorker, &workers[i] );
+		if ( !threads[i] ) {
+			SV_TraceStressWorker( &workers[i] );
+		}
+	}
+	for ( i = 0 ; i < numThreads ; i++ ) {
+		if ( threads[i] ) {
+			Sys_JoinThread( threads[i] );
+		}
+	}
+	threadMsec = Sys_Milliseconds() - start;
+
+	mismatches = 0;
+	for ( i = 0 ; i < numThreads ; i++ ) {
+		mismatches += workers[i].mismatches;
+		CM_FreeTraceContext( workers[i].ctx );
+	}
+
+	Hunk_FreeTempMemory( traces );
+
+	Com_Printf( "%i traces: %i msec serial, %i msec for %i each on %i threads, %i mismatches\n",
+		numTraces, serialMsec, threadMsec, numTraces, numThreads, mismatches );
+}
+
+#define	BATCH_BENCH_RAYS	32
+
+/*
+===============
+SV_TraceBatchBench_f
+
+Fires bundles of rays spread around a random direction, like a shotgun
+blast, through the world one at a time and then as CM_TraceBatch
+bundles, and compares the timings and the results.
+===============
+*/
+void SV_TraceBatchBench_f( void ) {
+	vec3_t		*starts, *ends;
+	trace_t		*serial, *batch;
+	vec3_t		mins, maxs, dir;
+	float		spread;
+	int			numBundles, numRays;
+	int			i, j, k, start, serialMsec, batchMsec, mismatches;
+
+	if ( !com_sv_running->integer ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+
+	numBundles = Cmd_Argc() > 1 ? atoi( Cmd_Argv( 1 ) ) : 1000;
+	numBundles = Com_Clamp( 1, 10000, numBundles );
+	spread = Cmd_Argc() > 2 ? atof( Cmd_Argv( 2 ) ) : 0.1f;
+	numRays = numBundles * BATCH_BENCH_RAYS;
+
+	CM_ModelBounds( 0, mins, maxs );
+
+	starts = Hunk_AllocateTempMemory( numRays * sizeof( *starts ) );
+	ends = Hunk_AllocateTempMemory( numRays * sizeof( *ends ) );
+	serial = Hunk_AllocateTempMemory( numRays * sizeof( *serial ) );
+	batch = Hunk_AllocateTempMemory( numRays * sizeof( *batch ) );
+
+	for ( i = 0 ; i < numRays ; i += BATCH_BENCH_RAYS ) {
+		for ( j = 0 ; j < 3 ; j++ ) {
+			starts[i][j] = mins[j] + random() * ( maxs[j] - mins[j] );
+			dir[j] = crandom();
+		}
+		VectorNormalize( dir );
+		for ( k = i ; k < i + BATCH_BENCH_RAYS ; k++ ) {
+			VectorCopy( starts[i], starts[k] );
+			for ( j = 0 ; j < 3 ; j++ ) {
+				ends[k][j] = starts[k][j] + ( dir[j] + crandom() * spread ) * 8192;
+			}
+		}
+	}
+
+	start = Sys_Milliseconds();
+	for ( i = 0 ; i < numRays ; i++ ) {
+		CM_BoxTrace( &serial[i], starts[i], ends[i], vec3_origin, vec3_origin, 0, MASK_SHOT, qfalse );
+	}
+	serialMsec = Sys_Milliseconds() - start;
+
+	start = Sys_Milliseconds();
+	for ( i = 0 ; i < numRays ; i += BATCH_BENCH_RAYS ) {
+		CM_TraceBatch( &batch[i], BATCH_BENCH_RAYS, (const vec3_t *)&starts[i], (const vec3_t *)&ends[i],
+			vec3_origin, vec3_origin, 0, MASK_SHOT, qfalse );
+	}
+	batchMsec = Sys_Milliseconds() - start;
+
+	mismatches = 0;
+	for ( i = 0 ; i < numRays ; i++ ) {
+		if ( SV_TracesDiffer( &serial[i], &batch[i] ) ) {
+			mismatches++;
+		}
+	}
+
+	Hunk_FreeTempMemory( batch );
+	Hunk_FreeTempMemory( serial );
+	Hunk_FreeTempMemory( ends );
+	Hunk_FreeTempMemory( starts );
+
+	Com_Printf( "%i rays in bundles of %i: %i msec serial, %i msec batched, %i mismatches\n",
+		numRays, BATCH_BENCH_RAYS, serialMsec, batchMsec, mismatches );
+}
+
 /*
 ===============
 SV_CreateworldSector
@@ -151,6 +939,11 @@ void SV_ClearWorld( void ) {
 	Com_Memset( sv_worldSectors, 0, sizeof(sv_worldSectors) );
 	sv_numworldSectors = 0;
 
+	SV_EntityTreeClear();
+	sv_useEntityTree = sv_entityTree->integer ? qtrue : qfalse;
+
+	SV_ClearEntityHistory();
+
 	// get world map bounds
 	h = CM_InlineModel( 0 );
 	CM_ModelBounds( h, mins, maxs );
@@ -173,6 +966,11 @@ void SV_UnlinkEntity( sharedEntity_t *gEnt ) {
 
 	gEnt->r.linked = qfalse;
 
+	if ( sv_useEntityTree ) {
+		SV_EntityTreeUnlink( ent );
+		return;
+	}
+
 	ws = ent->worldSector;
 	if ( !ws ) {
 		return;		// not linked in anywhere
@@ -195,13 +993,65 @@ void SV_UnlinkEntity( sharedEntity_t *gEnt ) {
 }
 
 
+#define MAX_TOTAL_ENT_LEAFS		128
+
+/*
+===============
+SV_SetEntityClusterBits
+
+Packs the clusters of all the leafs an entity touches into a few words
+laid out like a pvs row, so that snapshots can test them with a word
+wise and.  Entities whose clusters spread over too many words, or that
+touched more leafs than were returned, keep numClusterWords at 0 and
+are tested through clusternums.
+===============
+*/
+static void SV_SetEntityClusterBits( svEntity_t *ent, const int *leafs, int numLeafs ) {
+	int		i, cluster;
+	int		firstWord, lastWord;
+	byte	*bits;
+
+	ent->numClusterWords = 0;
+	if ( numLeafs >= MAX_TOTAL_ENT_LEAFS ) {
+		return;
+	}
+
+	firstWord = lastWord = -1;
+	for ( i = 0 ; i < numLeafs ; i++ ) {
+		cluster = CM_LeafCluster( leafs[i] );
+		if ( cluster == -1 ) {
+			continue;
+		}
+		if ( firstWord == -1 || ( cluster >> 5 ) < firstWord ) {
+			firstWord = cluster >> 5;
+		}
+		if ( ( cluster >> 5 ) > lastWord ) {
+			lastWord = cluster >> 5;
+		}
+	}
+	if ( firstWord == -1 || lastWord - firstWord >= ENT_CLUSTER_WORDS ) {
+		return;
+	}
+
+	Com_Memset( ent->clusterBits, 0, sizeof( ent->clusterBits ) );
+	bits = (byte *)ent->clusterBits;
+	for ( i = 0 ; i < numLeafs ; i++ ) {
+		cluster = CM_LeafCluster( leafs[i] );
+		if ( cluster != -1 ) {
+			cluster -= firstWord << 5;
+			bits[cluster >> 3] |= 1 << ( cluster & 7 );
+		}
+	}
+	ent->clusterWord = firstWord;
+	ent->numClusterWords = lastWord - firstWord + 1;
+}
+
 /*
 ===============
 SV_LinkEntity
 
 ===============
 */
-#define MAX_TOTAL_ENT_LEAFS		128
 void SV_LinkEntity( sharedEntity_t *gEnt ) {
 	worldSector_t	*node;
 	int			leafs[MAX_TOTAL_ENT_LEAFS];
@@ -215,6 +1065,7 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 
 	ent = SV_SvEntityForGentity( gEnt );
 
+	// the entity tree keeps the entity in place if it hasn't moved far
 	if ( ent->worldSector ) {
 		SV_UnlinkEntity( gEnt );	// unlink from old position
 	}
@@ -281,6 +1132,7 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 	// link to PVS leafs
 	ent->numClusters = 0;
 	ent->lastCluster = 0;
+	ent->numClusterWords = 0;
 	ent->areanum = -1;
 	ent->areanum2 = -1;
 
@@ -291,6 +1143,9 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 	// if none of the leafs were inside the map, the
 	// entity is outside the world and can be considered unlinked
 	if ( !num_leafs ) {
+		if ( ent->entityTreeNode ) {
+			SV_UnlinkEntity( gEnt );
+		}
 		return;
 	}
 
@@ -330,8 +1185,16 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 		ent->lastCluster = CM_LeafCluster( lastLeaf );
 	}
 
+	SV_SetEntityClusterBits( ent, leafs, num_leafs );
+
 	gEnt->r.linkcount++;
 
+	if ( sv_useEntityTree ) {
+		SV_EntityTreeLink( ent, gEnt->r.absmin, gEnt->r.absmax );
+		gEnt->r.linked = qtrue;
+		return;
+	}
+
 	// find the first world sector node that the ent's box crosses
 	node = sv_worldSectors;
 	while (1)
@@ -385,7 +1248,83 @@ static void SV_AreaEntities_r( worldSector_t *node, areaParms_t *ap ) {
 	for ( check = node->entities  ; check ; check = next ) {
 		next = check->nextEntityInWorldSector;
 
-		gcheck = SV_GEntityForSvEntity( check );
+		gcheck = SV_GEntityForSvEntity( check );
+
+		if ( gcheck->r.absmin[0] > ap->maxs[0]
+		|| gcheck->r.absmin[1] > ap->maxs[1]
+		|| gcheck->r.absmin[2] > ap->maxs[2]
+		|| gcheck->r.absmax[0] < ap->mins[0]
+		|| gcheck->r.absmax[1] < ap->mins[1]
+		|| gcheck->r.absmax[2] < ap->mins[2]) {
+			continue;
+		}
+
+		if ( ap->count == ap->maxcount ) {
+			Com_Printf ("SV_AreaEntities: MAXCOUNT\n");
+			return;
+		}
+
+		ap->list[ap->count] = check - sv.svEntities;
+		ap->count++;
+	}
+	
+	if (node->axis == -1) {
+		return;		// terminal node
+	}
+
+	// recurse down both sides
+	if ( ap->maxs[node->axis] > node->dist ) {
+		SV_AreaEntities_r ( node->children[0], ap );
+	}
+	if ( ap->mins[node->axis] < node->dist ) {
+		SV_AreaEntities_r ( node->children[1], ap );
+	}
+}
+
+/*
+====================
+SV_AreaEntitiesTree
+
+====================
+*/
+static void SV_AreaEntitiesTree( areaParms_t *ap ) {
+	entityTreeNode_t	*stack[ENTITY_TREE_STACK];
+	entityTreeNode_t	*node;
+	sharedEntity_t		*gcheck;
+	int					depth;
+
+	if ( !sv_entityTreeRoot ) {
+		return;
+	}
+
+	depth = 0;
+	stack[depth++] = sv_entityTreeRoot;
+
+	while ( depth ) {
+		node = stack[--depth];
+
+		if ( node->mins[0] > ap->maxs[0]
+		|| node->mins[1] > ap->maxs[1]
+		|| node->mins[2] > ap->maxs[2]
+		|| node->maxs[0] < ap->mins[0]
+		|| node->maxs[1] < ap->mins[1]
+		|| node->maxs[2] < ap->mins[2]) {
+			continue;
+		}
+
+		if ( node->children[0] ) {
+			// a balanced tree over MAX_GENTITIES leafs never gets near this deep
+			if ( depth + 2 > ENTITY_TREE_STACK ) {
+				Com_Printf( "SV_AreaEntities: entity tree too deep\n" );
+				return;
+			}
+			stack[depth++] = node->children[1];
+			stack[depth++] = node->children[0];
+			continue;
+		}
+
+		// the leaf bounds are grown, check the real ones
+		gcheck = SV_GEntityForSvEntity( node->ent );
 
 		if ( gcheck->r.absmin[0] > ap->maxs[0]
 		|| gcheck->r.absmin[1] > ap->maxs[1]
@@ -401,21 +1340,9 @@ static void SV_AreaEntities_r( worldSector_t *node, areaParms_t *ap ) {
 			return;
 		}
 
-		ap->list[ap->count] = check - sv.svEntities;
+		ap->list[ap->count] = node->ent - sv.svEntities;
 		ap->count++;
 	}
-	
-	if (node->axis == -1) {
-		return;		// terminal node
-	}
-
-	// recurse down both sides
-	if ( ap->maxs[node->axis] > node->dist ) {
-		SV_AreaEntities_r ( node->children[0], ap );
-	}
-	if ( ap->mins[node->axis] < node->dist ) {
-		SV_AreaEntities_r ( node->children[1], ap );
-	}
 }
 
 /*
@@ -432,7 +1359,11 @@ int SV_AreaEntities( const vec3_t mins, const vec3_t maxs, int *entityList, int
 	ap.count = 0;
 	ap.maxcount = maxcount;
 
-	SV_AreaEntities_r( sv_worldSectors, &ap );
+	if ( sv_useEntityTree ) {
+		SV_AreaEntitiesTree( &ap );
+	} else {
+		SV_AreaEntities_r( sv_worldSectors, &ap );
+	}
 
 	return ap.count;
 }
@@ -450,10 +1381,57 @@ typedef struct {
 	vec3_t		end;
 	trace_t		trace;
 	int			passEntityNum;
+	int			passOwnerNum;
 	int			contentmask;
 	int			capsule;
+	int			rewindTime;	// 0 = clip against the current positions
 } moveclip_t;
 
+// CM_TempBoxModel is shared, so while worker threads trace (bot jobs)
+// every clip against an entity holds this from the clip handle to the
+// end of the trace.  The world part of a trace stays in parallel.
+static void		*sv_tempBoxLock;
+static qboolean	sv_workerTraces;
+
+/*
+====================
+SV_EnableWorkerTraces
+
+Has to be called on the main thread with no other thread tracing.
+====================
+*/
+void SV_EnableWorkerTraces( qboolean enable ) {
+	if ( enable && !sv_tempBoxLock ) {
+		sv_tempBoxLock = Sys_CreateMutex();
+		if ( !sv_tempBoxLock ) {
+			Com_Error( ERR_FATAL, "SV_EnableWorkerTraces: couldn't create mutex" );
+		}
+	}
+	sv_workerTraces = enable;
+}
+
+/*
+====================
+SV_LockTempBox
+====================
+*/
+static ID_INLINE void SV_LockTempBox( void ) {
+	if ( sv_workerTraces ) {
+		Sys_LockMutex( sv_tempBoxLock );
+	}
+}
+
+/*
+====================
+SV_UnlockTempBox
+====================
+*/
+static ID_INLINE void SV_UnlockTempBox( void ) {
+	if ( sv_workerTraces ) {
+		Sys_UnlockMutex( sv_tempBoxLock );
+	}
+}
+
 
 /*
 ====================
@@ -478,6 +1456,7 @@ void SV_ClipToEntity( trace_t *trace, const vec3_t start, const vec3_t mins, con
 	}
 
 	// might intersect, so do an exact clip
+	SV_LockTempBox();
 	clipHandle = SV_ClipHandleForEntity (touch);
 
 	origin = touch->r.currentOrigin;
@@ -490,6 +1469,7 @@ void SV_ClipToEntity( trace_t *trace, const vec3_t start, const vec3_t mins, con
 	CM_TransformedBoxTrace ( trace, (float *)start, (float *)end,
 		(float *)mins, (float *)maxs, clipHandle,  contentmask,
 		origin, angles, capsule);
+	SV_UnlockTempBox();
 
 	if ( trace->fraction < 1 ) {
 		trace->entityNum = touch->s.number;
@@ -497,6 +1477,115 @@ void SV_ClipToEntity( trace_t *trace, const vec3_t start, const vec3_t mins, con
 }
 
 
+/*
+====================
+SV_ClipIgnoresEntity
+====================
+*/
+static qboolean SV_ClipIgnoresEntity( const moveclip_t *clip, int entityNum, const sharedEntity_t *touch ) {
+	// see if we should ignore this entity
+	if ( clip->passEntityNum != ENTITYNUM_NONE ) {
+		if ( entityNum == clip->passEntityNum ) {
+			return qtrue;	// don't clip against the pass entity
+		}
+		if ( touch->r.ownerNum == clip->passEntityNum ) {
+			return qtrue;	// don't clip against own missiles
+		}
+		if ( touch->r.ownerNum == clip->passOwnerNum ) {
+			return qtrue;	// don't clip against other missiles from our owner
+		}
+	}
+
+	// if it doesn't have any brushes of a type we
+	// are looking for, ignore it
+	if ( ! ( clip->contentmask & touch->r.contents ) ) {
+		return qtrue;
+	}
+
+	return qfalse;
+}
+
+
+/*
+====================
+SV_ClipMoveToEntity
+
+Does the exact clip against one entity placed at origin / angles.
+====================
+*/
+static void SV_ClipMoveToEntity( moveclip_t *clip, const sharedEntity_t *touch, clipHandle_t clipHandle, const vec3_t origin, const vec3_t angles ) {
+	trace_t		trace;
+
+	CM_TransformedBoxTrace ( &trace, (float *)clip->start, (float *)clip->end,
+		(float *)clip->mins, (float *)clip->maxs, clipHandle,  clip->contentmask,
+		origin, angles, clip->capsule);
+
+	if ( trace.allsolid ) {
+		clip->trace.allsolid = qtrue;
+		trace.entityNum = touch->s.number;
+	} else if ( trace.startsolid ) {
+		clip->trace.startsolid = qtrue;
+		trace.entityNum = touch->s.number;
+	}
+
+	if ( trace.fraction < clip->trace.fraction ) {
+		qboolean	oldStart;
+
+		// make sure we keep a startsolid from a previous trace
+		oldStart = clip->trace.startsolid;
+
+		trace.entityNum = touch->s.number;
+		clip->trace = trace;
+		clip->trace.startsolid |= oldStart;
+	}
+}
+
+
+/*
+====================
+SV_ClipMoveToRewoundEntities
+
+Clips against the recorded entities where they were at clip->rewindTime.
+====================
+*/
+static void SV_ClipMoveToRewoundEntities( moveclip_t *clip ) {
+	int			i, num;
+	sharedEntity_t *touch;
+	clipHandle_t	clipHandle;
+	vec3_t		origin, mins, maxs;
+
+	for ( i = 0 ; i < sv_numHistoryEntities ; i++ ) {
+		if ( clip->trace.allsolid ) {
+			return;
+		}
+		num = sv_historyEntities[i];
+		touch = SV_GentityNum( num );
+
+		if ( !touch->r.linked || SV_ClipIgnoresEntity( clip, num, touch ) ) {
+			continue;
+		}
+		if ( !SV_EntityHistoryAt( num, clip->rewindTime, origin, mins, maxs ) ) {
+			continue;
+		}
+
+		// same test SV_AreaEntities does, with the rewound bounds
+		if ( origin[0] + mins[0] - 1 > clip->boxmaxs[0]
+			|| origin[1] + mins[1] - 1 > clip->boxmaxs[1]
+			|| origin[2] + mins[2] - 1 > clip->boxmaxs[2]
+			|| origin[0] + maxs[0] + 1 < clip->boxmins[0]
+			|| origin[1] + maxs[1] + 1 < clip->boxmins[1]
+			|| origin[2] + maxs[2] + 1 < clip->boxmins[2] ) {
+			continue;
+		}
+
+		SV_LockTempBox();
+		clipHandle = CM_TempBoxModel( mins, maxs, touch->r.svFlags & SVF_CAPSULE );
+		SV_ClipMoveToEntity( clip, touch, clipHandle, origin, vec3_origin );
+		SV_UnlockTempBox();
+	}
+}
+
+
 /*
 ====================
 SV_ClipMoveToEntities
@@ -507,20 +1596,18 @@ static void SV_ClipMoveToEntities( moveclip_t *clip ) {
 	int			i, num;
 	int			touchlist[MAX_GENTITIES];
 	sharedEntity_t *touch;
-	int			passOwnerNum;
-	trace_t		trace;
 	clipHandle_t	clipHandle;
 	float		*origin, *angles;
 
 	num = SV_AreaEntities( clip->boxmins, clip->boxmaxs, touchlist, MAX_GENTITIES);
 
 	if ( clip->passEntityNum != ENTITYNUM_NONE ) {
-		passOwnerNum = ( SV_GentityNum( clip->passEntityNum ) )->r.ownerNum;
-		if ( passOwnerNum == ENTITYNUM_NONE ) {
-			passOwnerNum = -1;
+		clip->passOwnerNum = ( SV_GentityNum( clip->passEntityNum ) )->r.ownerNum;
+		if ( clip->passOwnerNum == ENTITYNUM_NONE ) {
+			clip->passOwnerNum = -1;
 		}
 	} else {
-		passOwnerNum = -1;
+		clip->passOwnerNum = -1;
 	}
 
 	for ( i=0 ; i<num ; i++ ) {
@@ -529,26 +1616,17 @@ static void SV_ClipMoveToEntities( moveclip_t *clip ) {
 		}
 		touch = SV_GentityNum( touchlist[i] );
 
-		// see if we should ignore this entity
-		if ( clip->passEntityNum != ENTITYNUM_NONE ) {
-			if ( touchlist[i] == clip->passEntityNum ) {
-				continue;	// don't clip against the pass entity
-			}
-			if ( touch->r.ownerNum == clip->passEntityNum ) {
-				continue;	// don't clip against own missiles
-			}
-			if ( touch->r.ownerNum == passOwnerNum ) {
-				continue;	// don't clip against other missiles from our owner
-			}
+		if ( SV_ClipIgnoresEntity( clip, touchlist[i], touch ) ) {
+			continue;
 		}
 
-		// if it doesn't have any brushes of a type we
-		// are looking for, ignore it
-		if ( ! ( clip->contentmask & touch->r.contents ) ) {
+		// recorded entities are clipped at their old position below
+		if ( clip->rewindTime && sv_entityHistory[touchlist[i]].numRecords ) {
 			continue;
 		}
 
 		// might intersect, so do an exact clip
+		SV_LockTempBox();
 		clipHandle = SV_ClipHandleForEntity (touch);
 
 		origin = touch->r.currentOrigin;
@@ -559,61 +1637,36 @@ static void SV_ClipMoveToEntities( moveclip_t *clip ) {
 			angles = vec3_origin;	// boxes don't rotate
 		}
 
-		CM_TransformedBoxTrace ( &trace, (float *)clip->start, (float *)clip->end,
-			(float *)clip->mins, (float *)clip->maxs, clipHandle,  clip->contentmask,
-			origin, angles, clip->capsule);
-
-		if ( trace.allsolid ) {
-			clip->trace.allsolid = qtrue;
-			trace.entityNum = touch->s.number;
-		} else if ( trace.startsolid ) {
-			clip->trace.startsolid = qtrue;
-			trace.entityNum = touch->s.number;
-		}
-
-		if ( trace.fraction < clip->trace.fraction ) {
-			qboolean	oldStart;
-
-			// make sure we keep a startsolid from a previous trace
-			oldStart = clip->trace.startsolid;
+		SV_ClipMoveToEntity( clip, touch, clipHandle, origin, angles );
+		SV_UnlockTempBox();
+	}
 
-			trace.entityNum = touch->s.number;
-			clip->trace = trace;
-			clip->trace.startsolid |= oldStart;
-		}
+	if ( clip->rewindTime ) {
+		SV_ClipMoveToRewoundEntities( clip );
 	}
 }
 
 
 /*
 ==================
-SV_Trace
+SV_ClipTraceToEntities
 
-Moves the given mins/maxs volume through the world from start to end.
-passEntityNum and entities owned by passEntityNum are explicitly not checked.
+Finishes a trace that has already been clipped to the world by
+clipping it against the solid entities along the move.
 ==================
 */
-void SV_Trace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int capsule ) {
+static void SV_ClipTraceToEntities( trace_t *results, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int capsule, int rewindTime ) {
 	moveclip_t	clip;
 	int			i;
 
-	if ( !mins ) {
-		mins = vec3_origin;
-	}
-	if ( !maxs ) {
-		maxs = vec3_origin;
+	results->entityNum = results->fraction != 1.0 ? ENTITYNUM_WORLD : ENTITYNUM_NONE;
+	if ( results->fraction == 0 ) {
+		return;		// blocked immediately by the world
 	}
 
 	Com_Memset ( &clip, 0, sizeof ( moveclip_t ) );
 
-	// clip to world
-	CM_BoxTrace( &clip.trace, start, end, mins, maxs, 0, contentmask, capsule );
-	clip.trace.entityNum = clip.trace.fraction != 1.0 ? ENTITYNUM_WORLD : ENTITYNUM_NONE;
-	if ( clip.trace.fraction == 0 ) {
-		*results = clip.trace;
-		return;		// blocked immediately by the world
-	}
-
+	clip.trace = *results;
 	clip.contentmask = contentmask;
 	clip.start = start;
 //	VectorCopy( clip.trace.endpos, clip.end );
@@ -622,6 +1675,7 @@ void SV_Trace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, c
 	clip.maxs = maxs;
 	clip.passEntityNum = passEntityNum;
 	clip.capsule = capsule;
+	clip.rewindTime = rewindTime;
 
 	// create the bounding box of the entire move
 	// we can limit it to the part of the move not
@@ -644,6 +1698,99 @@ void SV_Trace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, c
 }
 
 
+/*
+==================
+SV_Trace
+
+Moves the given mins/maxs volume through the world from start to end.
+passEntityNum and entities owned by passEntityNum are explicitly not checked.
+==================
+*/
+void SV_Trace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int capsule ) {
+	if ( !mins ) {
+		mins = vec3_origin;
+	}
+	if ( !maxs ) {
+		maxs = vec3_origin;
+	}
+
+	// clip to world
+	CM_BoxTrace( results, start, end, mins, maxs, 0, contentmask, capsule );
+
+	SV_ClipTraceToEntities( results, start, mins, maxs, end, passEntityNum, contentmask, capsule, 0 );
+}
+
+
+/*
+==================
+SV_TraceAtTime
+
+SV_Trace with the recorded entities moved back to where they were at
+the given server time.  Everything else is clipped where it is now.
+==================
+*/
+void SV_TraceAtTime( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int capsule, int time ) {
+	if ( !mins ) {
+		mins = vec3_origin;
+	}
+	if ( !maxs ) {
+		maxs = vec3_origin;
+	}
+	if ( time >= sv.time || !sv_numHistoryEntities ) {
+		time = 0;
+	}
+
+	// clip to world
+	CM_BoxTrace( results, start, end, mins, maxs, 0, contentmask, capsule );
+
+	SV_ClipTraceToEntities( results, start, mins, maxs, end, passEntityNum, contentmask, capsule, time );
+}
+
+
+/*
+==================
+SV_TraceForClient
+
+SV_TraceAtTime rewound to what clientNum was looking at, which is
+how a shot fired by that client should be checked.
+==================
+*/
+void SV_TraceForClient( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int clientNum ) {
+	SV_TraceAtTime( results, start, mins, maxs, end, passEntityNum, contentmask, qfalse, SV_ClientViewTime( clientNum ) );
+}
+
+
+/*
+==================
+SV_TraceBatch
+
+Same as SV_Trace for each of numTraces start/end pairs sharing one
+volume, but the world part is done with CM_TraceBatch so that rays
+which run through the same part of the bsp share the descent.
+==================
+*/
+void SV_TraceBatch( trace_t *results, int numTraces, const vec3_t *starts, const vec3_t *ends, vec3_t mins, vec3_t maxs, int passEntityNum, int contentmask, int capsule ) {
+	int			i;
+
+	if ( numTraces <= 0 ) {
+		return;
+	}
+	if ( !mins ) {
+		mins = vec3_origin;
+	}
+	if ( !maxs ) {
+		maxs = vec3_origin;
+	}
+
+	// clip to world
+	CM_TraceBatch( results, numTraces, starts, ends, mins, maxs, 0, contentmask, capsule );
+
+	for ( i = 0 ; i < numTraces ; i++ ) {
+		SV_ClipTraceToEntities( &results[i], starts[i], mins, maxs, ends[i], passEntityNum, contentmask, capsule, 0 );
+	}
+}
+
+
 
 /*
 =============
@@ -670,6 +1817,7 @@ int SV_PointContents( const vec3_t p, int passEntityNum ) {
 		}
 		hit = SV_GentityNum( touch[i] );
 		// might intersect, so do an exact clip
+		SV_LockTempBox();
 		clipHandle = SV_ClipHandleForEntity( hit );
 		angles = hit->r.currentAngles;
 		if ( !hit->r.bmodel ) {
@@ -677,6 +1825,7 @@ int SV_PointContents( const vec3_t p, int passEntityNum ) {
 		}
 
 		c2 = CM_TransformedPointContents (p, clipHandle, hit->r.currentOrigin, angles);
+		SV_UnlockTempBox();
 
 		contents |= c2;
 	}
@@ -685,3 +1834,210 @@ int SV_PointContents( const vec3_t p, int passEntityNum ) {
 }
 
 
+
+/*
+===============================================================================
+
+ENTITY LINKING BENCHMARK
+
+===============================================================================
+*/
+
+#define	BENCH_SEED		0x5eed
+
+typedef struct {
+	sharedEntity_t	*gentities;
+	int				gentitySize;
+	int				num_entities;
+	svEntity_t		*svEntities;
+	worldSector_t	*worldSectors;
+	int				numworldSectors;
+	entityTreeNode_t	*treeNodes;
+	entityTreeNode_t	*treeRoot;
+	entityTreeNode_t	*treeFree;
+	qboolean		useEntityTree;
+	entityHistory_t	*entityHistory;
+	int				*historyEntities;
+	int				numHistoryEntities;
+} worldBackup_t;
+
+/*
+===============
+SV_BackupWorld
+
+Keeps everything the benchmark relinks, so the real entities
+can be put back the way they were
+===============
+*/
+static void SV_BackupWorld( worldBackup_t *b ) {
+	b->gentities = sv.gentities;
+	b->gentitySize = sv.gentitySize;
+	b->num_entities = sv.num_entities;
+	b->svEntities = Hunk_AllocateTempMemory( sizeof( sv.svEntities ) );
+	Com_Memcpy( b->svEntities, sv.svEntities, sizeof( sv.svEntities ) );
+	b->worldSectors = Hunk_AllocateTempMemory( sizeof( sv_worldSectors ) );
+	Com_Memcpy( b->worldSectors, sv_worldSectors, sizeof( sv_worldSectors ) );
+	b->numworldSectors = sv_numworldSectors;
+	b->treeNodes = Hunk_AllocateTempMemory( sizeof( sv_entityTreeNodes ) );
+	Com_Memcpy( b->treeNodes, sv_entityTreeNodes, sizeof( sv_entityTreeNodes ) );
+	b->treeRoot = sv_entityTreeRoot;
+	b->treeFree = sv_entityTreeFree;
+	b->useEntityTree = sv_useEntityTree;
+	b->entityHistory = Hunk_AllocateTempMemory( sizeof( sv_entityHistory ) );
+	Com_Memcpy( b->entityHistory, sv_entityHistory, sizeof( sv_entityHistory ) );
+	b->historyEntities = Hunk_AllocateTempMemory( sizeof( sv_historyEntities ) );
+	Com_Memcpy( b->historyEntities, sv_historyEntities, sizeof( sv_historyEntities ) );
+	b->numHistoryEntities = sv_numHistoryEntities;
+}
+
+/*
+===============
+SV_RestoreWorld
+===============
+*/
+static void SV_RestoreWorld( worldBackup_t *b ) {
+	sv.gentities = b->gentities;
+	sv.gentitySize = b->gentitySize;
+	sv.num_entities = b->num_entities;
+	sv_entityTreeRoot = b->treeRoot;
+	sv_entityTreeFree = b->treeFree;
+	sv_useEntityTree = b->useEntityTree;
+	sv_numworldSectors = b->numworldSectors;
+	sv_numHistoryEntities = b->numHistoryEntities;
+
+	Com_Memcpy( sv_historyEntities, b->historyEntities, sizeof( sv_historyEntities ) );
+	Hunk_FreeTempMemory( b->historyEntities );
+	Com_Memcpy( sv_entityHistory, b->entityHistory, sizeof( sv_entityHistory ) );
+	Hunk_FreeTempMemory( b->entityHistory );
+	Com_Memcpy( sv_entityTreeNodes, b->treeNodes, sizeof( sv_entityTreeNodes ) );
+	Hunk_FreeTempMemory( b->treeNodes );
+	Com_Memcpy( sv_worldSectors, b->worldSectors, sizeof( sv_worldSectors ) );
+	Hunk_FreeTempMemory( b->worldSectors );
+	Com_Memcpy( sv.svEntities, b->svEntities, sizeof( sv.svEntities ) );
+	Hunk_FreeTempMemory( b->svEntities );
+}
+
+/*
+===============
+SV_EntityBenchRun
+
+Links a crowd of boxes, then every frame moves them all a bit,
+relinks them and fires traces from some of them through the others
+===============
+*/
+static void SV_EntityBenchRun( sharedEntity_t *ents, int numEnts, int numFrames, int numTraces,
+		qboolean useTree, int *linkMsec, int *traceMsec, unsigned *hash ) {
+	static vec3_t	playerMins = { -15, -15, -24 };
+	static vec3_t	playerMaxs = { 15, 15, 32 };
+	sharedEntity_t	*ent;
+	vec3_t			worldMins, worldMaxs, end;
+	trace_t			tr;
+	int				seed;
+	int				i, j, frame, start;
+
+	CM_ModelBounds( 0, worldMins, worldMaxs );
+
+	Com_Memset( sv.svEntities, 0, sizeof( sv.svEntities ) );
+	Com_Memset( ents, 0, numEnts * sizeof( *ents ) );
+	SV_ClearWorld();
+	sv_useEntityTree = useTree;
+
+	seed = BENCH_SEED;
+	for ( i = 0 ; i < numEnts ; i++ ) {
+		ent = &ents[i];
+		ent->s.number = i;
+		ent->r.contents = CONTENTS_BODY;
+		ent->r.ownerNum = ENTITYNUM_NONE;
+		if ( i % 10 == 0 ) {
+			// every so often something big, like a mover or a trigger
+			VectorSet( ent->r.mins, -128, -128, -64 );
+			VectorSet( ent->r.maxs, 128, 128, 64 );
+		} else {
+			VectorCopy( playerMins, ent->r.mins );
+			VectorCopy( playerMaxs, ent->r.maxs );
+		}
+		for ( j = 0 ; j < 3 ; j++ ) {
+			ent->r.currentOrigin[j] = worldMins[j] + Q_random( &seed ) * ( worldMaxs[j] - worldMins[j] );
+		}
+	}
+
+	*linkMsec = 0;
+	*traceMsec = 0;
+	*hash = 0;
+
+	for ( frame = 0 ; frame < numFrames ; frame++ ) {
+		start = Sys_Milliseconds();
+		for ( i = 0 ; i < numEnts ; i++ ) {
+			ent = &ents[i];
+			for ( j = 0 ; j < 3 ; j++ ) {
+				ent->r.currentOrigin[j] += Q_crandom( &seed ) * 16;
+				if ( ent->r.currentOrigin[j] < worldMins[j] ) {
+					ent->r.currentOrigin[j] = worldMins[j];
+				} else if ( ent->r.currentOrigin[j] > worldMaxs[j] ) {
+					ent->r.currentOrigin[j] = worldMaxs[j];
+				}
+			}
+			SV_LinkEntity( ent );
+		}
+		*linkMsec += Sys_Milliseconds() - start;
+
+		start = Sys_Milliseconds();
+		for ( i = 0 ; i < numTraces ; i++ ) {
+			ent = &ents[ ( Q_rand( &seed ) & 0x7fffffff ) % numEnts ];
+			for ( j = 0 ; j < 3 ; j++ ) {
+				end[j] = ent->r.currentOrigin[j] + Q_crandom( &seed ) * 1024;
+			}
+			SV_Trace( &tr, ent->r.currentOrigin, playerMins, playerMaxs, end,
+				ent->s.number, MASK_PLAYERSOLID, qfalse );
+			*hash = *hash * 31 + tr.entityNum;
+		}
+		*traceMsec += Sys_Milliseconds() - start;
+	}
+}
+
+/*
+===============
+SV_EntityBench_f
+
+Compares the world sectors with the entity tree on the loaded map,
+using boxes of its own in place of the game entities
+===============
+*/
+void SV_EntityBench_f( void ) {
+	worldBackup_t	backup;
+	sharedEntity_t	*ents;
+	int				numEnts, numFrames, numTraces;
+	int				sectorLink, sectorTrace, treeLink, treeTrace;
+	unsigned		sectorHash, treeHash;
+
+	if ( !com_sv_running->integer ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+
+	numEnts = Cmd_Argc() > 1 ? atoi( Cmd_Argv( 1 ) ) : 500;
+	numEnts = Com_Clamp( 1, MAX_GENTITIES - 2, numEnts );
+	numFrames = Cmd_Argc() > 2 ? atoi( Cmd_Argv( 2 ) ) : 100;
+	numFrames = Com_Clamp( 1, 10000, numFrames );
+	numTraces = Cmd_Argc() > 3 ? atoi( Cmd_Argv( 3 ) ) : 200;
+	numTraces = Com_Clamp( 0, 10000, numTraces );
+
+	SV_BackupWorld( &backup );
+
+	ents = Z_Malloc( numEnts * sizeof( *ents ) );
+	sv.gentities = ents;
+	sv.gentitySize = sizeof( *ents );
+	sv.num_entities = numEnts;
+
+	SV_EntityBenchRun( ents, numEnts, numFrames, numTraces, qfalse, &sectorLink, &sectorTrace, &sectorHash );
+	SV_EntityBenchRun( ents, numEnts, numFrames, numTraces, qtrue, &treeLink, &treeTrace, &treeHash );
+
+	Z_Free( ents );
+
+	SV_RestoreWorld( &backup );
+
+	Com_Printf( "%i entities, %i frames, %i traces a frame\n", numEnts, numFrames, numTraces );
+	Com_Printf( "sectors: %i msec linking, %i msec tracing\n", sectorLink, sectorTrace );
+	Com_Printf( "tree:    %i msec linking, %i msec tracing\n", treeLink, treeTrace );
+	Com_Printf( "results %s\n", sectorHash == treeHash ? "match" : "differ" );
+}
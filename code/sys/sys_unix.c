@@ -38,6 +38,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include <fcntl.h>
 #include <fenv.h>
 #include <sys/wait.h>
+#include <pthread.h>
 
 qboolean stdinIsATTY;
 
@@ -152,6 +153,32 @@ int Sys_Milliseconds (void)
 	return curtime;
 }
 
+/*
+================
+Sys_Microseconds
+
+For profiling code that is too fast to be timed in milliseconds, only
+the difference between two calls means anything. Uses the monotonic
+clock where there is one, so setting the system time doesn't skew it
+================
+*/
+int64_t Sys_Microseconds (void)
+{
+#ifdef CLOCK_MONOTONIC
+	struct timespec tp;
+
+	clock_gettime(CLOCK_MONOTONIC, &tp);
+
+	return (int64_t)tp.tv_sec*1000000 + tp.tv_nsec/1000;
+#else
+	struct timeval tp;
+
+	gettimeofday(&tp, NULL);
+
+	return (int64_t)tp.tv_sec*1000000 + tp.tv_usec;
+#endif
+}
+
 /*
 ==================
 Sys_RandomBytes
@@ -206,6 +233,114 @@ qboolean Sys_LowPhysicalMemory( void )
 	return qfalse;
 }
 
+#define HUGE_PAGE_SIZE	( 2 * 1024 * 1024 )
+
+#ifdef __linux__
+/*
+==================
+Sys_AnonHugeBytes
+
+Returns how much of the mapping containing base is backed by
+transparent huge pages, according to /proc/self/smaps
+==================
+*/
+static int Sys_AnonHugeBytes( void *base )
+{
+	FILE		*f;
+	char		line[256];
+	unsigned long	start, end, kb;
+	qboolean	found = qfalse;
+	int			bytes = 0;
+
+	f = fopen( "/proc/self/smaps", "r" );
+	if ( !f )
+		return 0;
+
+	while ( fgets( line, sizeof( line ), f ) ) {
+		if ( sscanf( line, "%lx-%lx ", &start, &end ) == 2 ) {
+			found = ( (unsigned long)base >= start && (unsigned long)base < end ) ? qtrue : qfalse;
+		} else if ( found && sscanf( line, "AnonHugePages: %lu kB", &kb ) == 1 ) {
+			bytes = kb * 1024;
+			break;
+		}
+	}
+
+	fclose( f );
+	return bytes;
+}
+#endif
+
+/*
+==================
+Sys_HunkAlloc
+
+Allocates zeroed memory for the hunk, aligned to a huge page.
+hugePages 1 asks for transparent huge pages, 2 for MAP_HUGETLB pages
+with transparent ones as fallback. lock pins the memory with mlock.
+The memory is pre-faulted so first touches mid game don't stall.
+Returns NULL if the caller should fall back to a plain allocation.
+==================
+*/
+void *Sys_HunkAlloc( int size, int hugePages, qboolean lock, int *hugeBytes )
+{
+#ifdef __linux__
+	size_t		len, i;
+	byte		*map, *base;
+	qboolean	hugetlb = qfalse;
+
+	*hugeBytes = 0;
+	if ( !hugePages && !lock )
+		return NULL;
+
+	len = PAD( (size_t)size, HUGE_PAGE_SIZE );
+	base = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+	if ( hugePages > 1 ) {
+		base = mmap( NULL, len, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 );
+		if ( base == MAP_FAILED )
+			Com_Printf( "MAP_HUGETLB failed (%s), trying transparent huge pages\n", strerror( errno ) );
+		else
+			hugetlb = qtrue;
+	}
+#endif
+
+	if ( base == MAP_FAILED ) {
+		// over allocate so the start can be aligned to a huge page
+		map = mmap( NULL, len + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+		if ( map == MAP_FAILED ) {
+			Com_Printf( "WARNING: mmap of the hunk failed: %s\n", strerror( errno ) );
+			return NULL;
+		}
+
+		base = (byte *)PAD( (intptr_t)map, HUGE_PAGE_SIZE );
+		if ( base > map )
+			munmap( map, base - map );
+		if ( base + len < map + len + HUGE_PAGE_SIZE )
+			munmap( base + len, map + HUGE_PAGE_SIZE - base );
+
+#ifdef MADV_HUGEPAGE
+		if ( hugePages && madvise( base, len, MADV_HUGEPAGE ) )
+			Com_Printf( "WARNING: madvise(MADV_HUGEPAGE) failed: %s\n", strerror( errno ) );
+#endif
+	}
+
+	if ( lock && mlock( base, len ) )
+		Com_Printf( "WARNING: mlock of the hunk failed: %s\n", strerror( errno ) );
+
+	for ( i = 0; i < len; i += 4096 )
+		base[i] = 0;
+
+	*hugeBytes = hugetlb ? len : Sys_AnonHugeBytes( base );
+	return base;
+#else
+	*hugeBytes = 0;
+	return NULL;
+#endif
+}
+
 /*
 ==================
 Sys_Basename
@@ -286,6 +421,302 @@ FILE *Sys_Mkfifo( const char *ospath )
 	return fifo;
 }
 
+/*
+==================
+Sys_FileStat
+==================
+*/
+qboolean Sys_FileStat( const char *ospath, int *size, int *mtime )
+{
+	struct stat st;
+
+	if( stat( ospath, &st ) != 0 || !S_ISREG( st.st_mode ) )
+		return qfalse;
+
+	*size = (int)st.st_size;
+	*mtime = (int)st.st_mtime;
+	return qtrue;
+}
+
+/*
+==================
+Sys_MapFile
+
+Maps a whole file read only, returns NULL if it can't be mapped
+==================
+*/
+void *Sys_MapFile( const char *ospath, int *length )
+{
+	struct stat st;
+	void *base;
+	int fd;
+
+	fd = open( ospath, O_RDONLY );
+	if( fd < 0 )
+		return NULL;
+
+	if( fstat( fd, &st ) != 0 || st.st_size <= 0 || st.st_size > 0x7fffffff )
+	{
+		close( fd );
+		return NULL;
+	}
+
+	base = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	close( fd );
+
+	if( base == MAP_FAILED )
+		return NULL;
+
+	*length = (int)st.st_size;
+	return base;
+}
+
+/*
+==================
+Sys_MapFileRegion
+
+Maps length bytes at offset copy on write, so the memory can be modified
+without touching the file. Returns a pointer to offset, base and mapLength
+are what has to be passed to Sys_UnmapFile.
+==================
+*/
+void *Sys_MapFileRegion( const char *ospath, int offset, int length, void **base, int *mapLength )
+{
+	long page = sysconf( _SC_PAGESIZE );
+	int start, fd;
+	void *map;
+
+	if( page <= 0 || offset < 0 || length <= 0 )
+		return NULL;
+
+	fd = open( ospath, O_RDONLY );
+	if( fd < 0 )
+		return NULL;
+
+	start = offset - ( offset % page );
+	map = mmap( NULL, length + offset - start, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, start );
+	close( fd );
+
+	if( map == MAP_FAILED )
+		return NULL;
+
+	*base = map;
+	*mapLength = length + offset - start;
+	return (byte *)map + offset - start;
+}
+
+/*
+==================
+Sys_UnmapFile
+==================
+*/
+void Sys_UnmapFile( void *base, int length )
+{
+	munmap( base, length );
+}
+
+typedef struct {
+	pthread_t	thread;
+	void		(*function)( void *data );
+	void		*data;
+} sysThread_t;
+
+/*
+==================
+Sys_ThreadMain
+==================
+*/
+static void *Sys_ThreadMain( void *arg )
+{
+	sysThread_t *t = arg;
+
+	t->function( t->data );
+	return NULL;
+}
+
+/*
+==================
+Sys_CreateThread
+==================
+*/
+void *Sys_CreateThread( void (*function)( void *data ), void *data )
+{
+	sysThread_t *t;
+
+	t = malloc( sizeof( *t ) );
+	if( !t )
+		return NULL;
+
+	t->function = function;
+	t->data = data;
+
+	if( pthread_create( &t->thread, NULL, Sys_ThreadMain, t ) )
+	{
+		free( t );
+		return NULL;
+	}
+
+	return t;
+}
+
+/*
+==================
+Sys_JoinThread
+==================
+*/
+void Sys_JoinThread( void *thread )
+{
+	sysThread_t *t = thread;
+
+	pthread_join( t->thread, NULL );
+	free( t );
+}
+
+/*
+==================
+Sys_NumProcessors
+==================
+*/
+int Sys_NumProcessors( void )
+{
+	long n = sysconf( _SC_NPROCESSORS_ONLN );
+
+	return n > 0 ? (int)n : 1;
+}
+
+/*
+==================
+Sys_CreateMutex
+==================
+*/
+void *Sys_CreateMutex( void )
+{
+	pthread_mutex_t *m;
+
+	m = malloc( sizeof( *m ) );
+	if( !m )
+		return NULL;
+
+	if( pthread_mutex_init( m, NULL ) )
+	{
+		free( m );
+		return NULL;
+	}
+
+	return m;
+}
+
+/*
+==================
+Sys_LockMutex
+==================
+*/
+void Sys_LockMutex( void *mutex )
+{
+	pthread_mutex_lock( mutex );
+}
+
+/*
+==================
+Sys_UnlockMutex
+==================
+*/
+void Sys_UnlockMutex( void *mutex )
+{
+	pthread_mutex_unlock( mutex );
+}
+
+/*
+==================
+Sys_DestroyMutex
+==================
+*/
+void Sys_DestroyMutex( void *mutex )
+{
+	pthread_mutex_destroy( mutex );
+	free( mutex );
+}
+
+typedef struct {
+	pthread_mutex_t	mutex;
+	pthread_cond_t	cond;
+	int				count;
+} sysSemaphore_t;
+
+/*
+==================
+Sys_CreateSemaphore
+==================
+*/
+void *Sys_CreateSemaphore( void )
+{
+	sysSemaphore_t *s;
+
+	s = malloc( sizeof( *s ) );
+	if( !s )
+		return NULL;
+
+	if( pthread_mutex_init( &s->mutex, NULL ) )
+	{
+		free( s );
+		return NULL;
+	}
+	if( pthread_cond_init( &s->cond, NULL ) )
+	{
+		pthread_mutex_destroy( &s->mutex );
+		free( s );
+		return NULL;
+	}
+	s->count = 0;
+
+	return s;
+}
+
+/*
+==================
+Sys_PostSemaphore
+==================
+*/
+void Sys_PostSemaphore( void *semaphore )
+{
+	sysSemaphore_t *s = semaphore;
+
+	pthread_mutex_lock( &s->mutex );
+	s->count++;
+	pthread_cond_signal( &s->cond );
+	pthread_mutex_unlock( &s->mutex );
+}
+
+/*
+==================
+Sys_WaitSemaphore
+==================
+*/
+void Sys_WaitSemaphore( void *semaphore )
+{
+	sysSemaphore_t *s = semaphore;
+
+	pthread_mutex_lock( &s->mutex );
+	while( !s->count )
+		pthread_cond_wait( &s->cond, &s->mutex );
+	s->count--;
+	pthread_mutex_unlock( &s->mutex );
+}
+
+/*
+==================
+Sys_DestroySemaphore
+==================
+*/
+void Sys_DestroySemaphore( void *semaphore )
+{
+	sysSemaphore_t *s = semaphore;
+
+	pthread_cond_destroy( &s->cond );
+	pthread_mutex_destroy( &s->mutex );
+	free( s );
+}
+
 /*
 ==================
 Sys_Cwd
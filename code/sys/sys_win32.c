@@ -33,6 +33,8 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include <stdio.h>
 #include <direct.h>
 #include <io.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 #include <conio.h>
 #include <wincrypt.h>
 #include <shlobj.h>
@@ -242,6 +244,25 @@ int Sys_Milliseconds (void)
 	return sys_curtime;
 }
 
+/*
+================
+Sys_Microseconds
+================
+*/
+int64_t Sys_Microseconds (void)
+{
+	static LARGE_INTEGER	frequency, base;
+	LARGE_INTEGER			count;
+
+	if (!frequency.QuadPart) {
+		QueryPerformanceFrequency(&frequency);
+		QueryPerformanceCounter(&base);
+	}
+	QueryPerformanceCounter(&count);
+
+	return (count.QuadPart - base.QuadPart) * 1000000 / frequency.QuadPart;
+}
+
 /*
 ================
 Sys_RandomBytes
@@ -300,6 +321,19 @@ qboolean Sys_LowPhysicalMemory( void )
 	return (stat.dwTotalPhys <= MEM_THRESHOLD) ? qtrue : qfalse;
 }
 
+/*
+==================
+Sys_HunkAlloc
+
+Large page support is not implemented, use a plain allocation
+==================
+*/
+void *Sys_HunkAlloc( int size, int hugePages, qboolean lock, int *hugeBytes )
+{
+	*hugeBytes = 0;
+	return NULL;
+}
+
 /*
 ==============
 Sys_Basename
@@ -395,6 +429,273 @@ FILE *Sys_Mkfifo( const char *ospath )
 	return NULL;
 }
 
+/*
+==============
+Sys_FileStat
+==============
+*/
+qboolean Sys_FileStat( const char *ospath, int *size, int *mtime )
+{
+	struct _stat st;
+
+	if( _stat( ospath, &st ) != 0 || !( st.st_mode & _S_IFREG ) )
+		return qfalse;
+
+	*size = (int)st.st_size;
+	*mtime = (int)st.st_mtime;
+	return qtrue;
+}
+
+/*
+==============
+Sys_MapFile
+
+Maps a whole file read only, returns NULL if it can't be mapped
+==============
+*/
+void *Sys_MapFile( const char *ospath, int *length )
+{
+	HANDLE file, mapping;
+	DWORD size;
+	void *base;
+
+	file = CreateFile( ospath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if( file == INVALID_HANDLE_VALUE )
+		return NULL;
+
+	size = GetFileSize( file, NULL );
+	if( size == INVALID_FILE_SIZE || size == 0 || size > 0x7fffffff )
+	{
+		CloseHandle( file );
+		return NULL;
+	}
+
+	mapping = CreateFileMapping( file, NULL, PAGE_READONLY, 0, 0, NULL );
+	CloseHandle( file );
+	if( !mapping )
+		return NULL;
+
+	base = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+	CloseHandle( mapping );
+	if( !base )
+		return NULL;
+
+	*length = (int)size;
+	return base;
+}
+
+/*
+==============
+Sys_MapFileRegion
+
+Maps length bytes at offset copy on write, so the memory can be modified
+without touching the file. Returns a pointer to offset, base and mapLength
+are what has to be passed to Sys_UnmapFile.
+==============
+*/
+void *Sys_MapFileRegion( const char *ospath, int offset, int length, void **base, int *mapLength )
+{
+	SYSTEM_INFO info;
+	HANDLE file, mapping;
+	void *map;
+	int start;
+
+	if( offset < 0 || length <= 0 )
+		return NULL;
+
+	file = CreateFile( ospath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if( file == INVALID_HANDLE_VALUE )
+		return NULL;
+
+	mapping = CreateFileMapping( file, NULL, PAGE_WRITECOPY, 0, 0, NULL );
+	CloseHandle( file );
+	if( !mapping )
+		return NULL;
+
+	// views have to start at the allocation granularity
+	GetSystemInfo( &info );
+	start = offset - ( offset % info.dwAllocationGranularity );
+
+	map = MapViewOfFile( mapping, FILE_MAP_COPY, 0, start, length + offset - start );
+	CloseHandle( mapping );
+	if( !map )
+		return NULL;
+
+	*base = map;
+	*mapLength = length + offset - start;
+	return (byte *)map + offset - start;
+}
+
+/*
+==============
+Sys_UnmapFile
+==============
+*/
+void Sys_UnmapFile( void *base, int length )
+{
+	UnmapViewOfFile( base );
+}
+
+typedef struct {
+	HANDLE		thread;
+	void		(*function)( void *data );
+	void		*data;
+} sysThread_t;
+
+/*
+==============
+Sys_ThreadMain
+==============
+*/
+static DWORD WINAPI Sys_ThreadMain( LPVOID arg )
+{
+	sysThread_t *t = arg;
+
+	t->function( t->data );
+	return 0;
+}
+
+/*
+==============
+Sys_CreateThread
+==============
+*/
+void *Sys_CreateThread( void (*function)( void *data ), void *data )
+{
+	sysThread_t *t;
+
+	t = malloc( sizeof( *t ) );
+	if( !t )
+		return NULL;
+
+	t->function = function;
+	t->data = data;
+	t->thread = CreateThread( NULL, 0, Sys_ThreadMain, t, 0, NULL );
+
+	if( !t->thread )
+	{
+		free( t );
+		return NULL;
+	}
+
+	return t;
+}
+
+/*
+==============
+Sys_JoinThread
+==============
+*/
+void Sys_JoinThread( void *thread )
+{
+	sysThread_t *t = thread;
+
+	WaitForSingleObject( t->thread, INFINITE );
+	CloseHandle( t->thread );
+	free( t );
+}
+
+/*
+==============
+Sys_NumProcessors
+==============
+*/
+int Sys_NumProcessors( void )
+{
+	SYSTEM_INFO info;
+
+	GetSystemInfo( &info );
+	return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+}
+
+/*
+==============
+Sys_CreateMutex
+==============
+*/
+void *Sys_CreateMutex( void )
+{
+	CRITICAL_SECTION *cs;
+
+	cs = malloc( sizeof( *cs ) );
+	if( !cs )
+		return NULL;
+
+	InitializeCriticalSection( cs );
+	return cs;
+}
+
+/*
+==============
+Sys_LockMutex
+==============
+*/
+void Sys_LockMutex( void *mutex )
+{
+	EnterCriticalSection( mutex );
+}
+
+/*
+==============
+Sys_UnlockMutex
+==============
+*/
+void Sys_UnlockMutex( void *mutex )
+{
+	LeaveCriticalSection( mutex );
+}
+
+/*
+==============
+Sys_DestroyMutex
+==============
+*/
+void Sys_DestroyMutex( void *mutex )
+{
+	DeleteCriticalSection( mutex );
+	free( mutex );
+}
+
+/*
+==============
+Sys_CreateSemaphore
+==============
+*/
+void *Sys_CreateSemaphore( void )
+{
+	return CreateSemaphore( NULL, 0, LONG_MAX, NULL );
+}
+
+/*
+==============
+Sys_PostSemaphore
+==============
+*/
+void Sys_PostSemaphore( void *semaphore )
+{
+	ReleaseSemaphore( semaphore, 1, NULL );
+}
+
+/*
+==============
+Sys_WaitSemaphore
+==============
+*/
+void Sys_WaitSemaphore( void *semaphore )
+{
+	WaitForSingleObject( semaphore, INFINITE );
+}
+
+/*
+==============
+Sys_DestroySemaphore
+==============
+*/
+void Sys_DestroySemaphore( void *semaphore )
+{
+	CloseHandle( semaphore );
+}
+
 /*
 ==============
 Sys_Cwd